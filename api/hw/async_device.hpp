@@ -18,6 +18,7 @@
 #pragma once
 #include <kernel/events.hpp>
 #include <hw/usernet.hpp>
+#include <net/packet_burst.hpp>
 #include <deque>
 
 namespace hw
@@ -36,16 +37,22 @@ public:
   {
     this->event_id = Events::get().subscribe(
       [this] {
+        // everything queued goes up as one burst
+        net::Packet_burst burst;
         while(! queue.empty()) {
-          this->driver_receive(std::move(queue.front()));
+          burst.push_back(std::move(queue.front()));
           queue.pop_front();
         }
+        if (not burst.empty())
+          this->m_nic.receive_burst(burst.release());
         this->m_nic.signal_tqa();
       });
   }
 
   void receive(net::Packet_ptr pckt) {
-    queue.push_back(std::move(pckt));
+    // a transmitted chain arrives as separate frames
+    while (pckt != nullptr)
+      queue.push_back(net::Packet_burst::pop_front(pckt));
     Events::get().trigger_event(event_id);
   }
 
@@ -58,9 +65,6 @@ public:
   }
 
 private:
-  inline void driver_receive(net::Packet_ptr packet) {
-    this->m_nic.receive(std::move(packet));
-  }
   Driver& m_nic;
   int event_id = 0;
   std::deque<net::Packet_ptr> queue;
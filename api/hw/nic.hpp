@@ -21,10 +21,13 @@
 #include "mac_addr.hpp"
 #include <net/inet_common.hpp>
 #include "device.hpp"
+#include <smp>
 
 #define NIC_SENDQ_LIMIT_DEFAULT  4096
 #define NIC_BUFFER_LIMIT_DEFAULT 4096
 
+namespace net { class Capture; }
+
 namespace hw {
 
   /**
@@ -74,6 +77,13 @@ namespace hw {
     virtual void set_arp_upstream(upstream handler) = 0;
     virtual void set_vlan_upstream(upstream handler) = 0;
 
+    /**
+     * Set a receive path taking a burst of unicast IPv4 packets as one
+     * packet chain. Drivers without burst receive ignore it.
+     */
+    virtual void set_ip4_burst_upstream(upstream)
+    {}
+
     /** Number of bytes in a frame needed by the link layer **/
     virtual size_t frame_offset_link() const noexcept = 0;
 
@@ -83,6 +93,34 @@ namespace hw {
      */
     virtual net::Packet_ptr create_packet(int layer_begin) = 0;
 
+    /** Offload features a driver can perform on behalf of the stack */
+    enum Offload : uint32_t {
+      TX_CSUM = 1 << 0, // complete partial L4 checksums on transmit
+      RX_CSUM = 1 << 1, // mark valid L4 checksums on receive
+      TSO4    = 1 << 2, // segment TCP/IPv4 super-segments on transmit
+      TSO6    = 1 << 3, // segment TCP/IPv6 super-segments on transmit
+      TX_SG   = 1 << 4  // transmit external payload (Packet::ext_data)
+    };
+
+    /** The offload features negotiated by the driver **/
+    virtual uint32_t offload_features() const noexcept
+    { return 0; }
+
+    bool has_offload(uint32_t features) const noexcept
+    { return (offload_features() & features) == features; }
+
+    /** Largest link payload of a segmentation offload super-segment **/
+    virtual uint32_t gso_max_size() const noexcept
+    { return MTU(); }
+
+    /**
+     * Create a packet with room for a segmentation offload super-segment,
+     * i.e. gso_max_size() bytes of link payload
+     * @param layer_begin : offset in octets from the link-layer header
+     */
+    virtual net::Packet_ptr create_gso_packet(int layer_begin)
+    { return create_packet(layer_begin); }
+
     /** Subscribe to event for when there is more room in the tx queue */
     virtual void on_transmit_queue_available(net::transmit_avail_delg del)
     { tqa_events_.push_back(del); }
@@ -104,8 +142,33 @@ namespace hw {
 
     virtual ~Nic() {}
 
-    /** Check for completed rx and pass rx packets up the stack */
-    virtual void poll() = 0;
+    /**
+     *  Check for completed rx and pass rx packets up the stack,
+     *  returns true if there was any work to do
+     */
+    virtual bool poll() = 0;
+
+    /**
+     *  Whether the queues serviced by @cpu are busy polled, with their
+     *  interrupts off. Drivers turn them off or on in their next poll().
+     *  See kernel/busy_poll.hpp
+     */
+    void set_busy_poll(int cpu, bool on) noexcept
+    { busy_poll_.at(cpu) = on; }
+
+    bool busy_poll(int cpu) const noexcept
+    { return busy_poll_.at(cpu); }
+
+    /**
+     *  Copy the packets passing this NIC into @cap, or stop capturing
+     *  with nullptr. The capture must outlive its use here.
+     *  See net/capture.hpp
+     */
+    virtual void set_capture(net::Capture* cap)
+    { capture_ = cap; }
+
+    net::Capture* capture() const noexcept
+    { return capture_; }
 
     /** Overridable MTU detection function per-network **/
     static uint16_t MTU_detection_override(int idx, uint16_t default_MTU);
@@ -124,6 +187,18 @@ namespace hw {
 
     virtual void add_vlan([[maybe_unused]] const int id){}
 
+    /**
+     *  Set a receive path for packets arriving on a queue serviced by @cpu,
+     *  for NICs with one queue per CPU. Without one, such packets are handed
+     *  to the link layer on the CPU that owns the NIC.
+     */
+    void set_cpu_upstream(int cpu, upstream handler)
+    { cpu_upstream_.at(cpu) = handler; }
+
+    /** Number of receive / transmit queue pairs in use */
+    virtual int queue_pairs() const noexcept
+    { return 1; }
+
   protected:
     /**
      *  Constructor
@@ -138,6 +213,9 @@ namespace hw {
 
     std::vector<net::transmit_avail_delg> tqa_events_;
 
+    upstream& cpu_upstream(int cpu)
+    { return cpu_upstream_.at(cpu); }
+
     void transmit_queue_available_event(size_t packets)
     {
       // early on its possible someone tries to transmit without subscribers
@@ -159,6 +237,19 @@ namespace hw {
       }
     }
 
+    /** Capture a received packet chain, when capturing */
+    void capture_rx(const net::Packet* chain) const noexcept
+    {
+      if (UNLIKELY(capture_ != nullptr))
+        do_capture(chain, false);
+    }
+
+    void capture_tx(const net::Packet* chain) const noexcept
+    {
+      if (UNLIKELY(capture_ != nullptr))
+        do_capture(chain, true);
+    }
+
     bool buffers_still_available(uint32_t size) const noexcept {
       return this->buffer_limit() == 0 || size < this->buffer_limit();
     }
@@ -168,8 +259,12 @@ namespace hw {
 
   private:
     int N;
+    net::Capture* capture_ = nullptr;
+    SMP::Array<upstream> cpu_upstream_;
+    SMP::Array<bool> busy_poll_ {};
     uint32_t m_buffer_limit = buffer_limit_default;
     uint32_t m_sendq_limit = sendq_limit_default;
+    void do_capture(const net::Packet* chain, bool outbound) const noexcept;
     friend class Devices;
   };
 
@@ -0,0 +1,125 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#ifndef HW_TX_BATCH_HPP
+#define HW_TX_BATCH_HPP
+
+#include <statman>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+namespace hw {
+
+  /**
+   * @brief      Doorbell and interrupt policy for a NIC transmit ring.
+   *             Descriptors are written as packets are sent, and the
+   *             doorbell is rung once at the end of the burst, or as soon
+   *             as a quarter of the ring or MAX_BYTES is pending, so the
+   *             device starts on large bursts early. Sent packets are
+   *             reclaimed on the next transmit, and a completion interrupt
+   *             is only wanted when the ring is filling up.
+   */
+  class Tx_batch {
+  public:
+    static constexpr uint32_t MAX_BYTES = 64 * 1024;
+
+    Tx_batch() = default;
+
+    explicit Tx_batch(uint32_t ring_size) noexcept
+      : max_packets_{std::max<uint32_t>(ring_size / 4, 1)}
+    {}
+
+    /** Count a packet written to the ring, true when the doorbell is due now */
+    bool add(uint32_t bytes) noexcept
+    {
+      packets_++;
+      bytes_ += bytes;
+      return packets_ >= max_packets_ or bytes_ >= MAX_BYTES;
+    }
+
+    /** Whether there are packets the device has not been told about */
+    bool pending() const noexcept
+    { return packets_ > 0; }
+
+    /** The doorbell was rung */
+    void rung() noexcept
+    { packets_ = 0; bytes_ = 0; }
+
+    /**
+     * @brief      Whether to take an interrupt when packets are sent:
+     *             only when packets are waiting for room in the ring, or
+     *             the ring is three quarters full, so the stack gets to
+     *             know when it can send more.
+     */
+    static bool want_interrupt(uint32_t in_flight, uint32_t ring_size,
+                               bool waiting) noexcept
+    { return waiting or in_flight >= ring_size - ring_size / 4; }
+
+  private:
+    uint32_t max_packets_ = 64;
+    uint32_t packets_ = 0;
+    uint32_t bytes_   = 0;
+  };
+
+  /**
+   * @brief      Doorbells rung and transmit interrupts taken by a NIC, in
+   *             total and per packet sent, as these are the VM exits of
+   *             the transmit path. Safe to update from several CPUs.
+   */
+  class Tx_stats {
+  public:
+    explicit Tx_stats(const std::string& device)
+      : kicks_{Statman::get().create(Stat::UINT64, device + ".tx_kicks").get_uint64()},
+        irqs_{Statman::get().create(Stat::UINT64, device + ".tx_irqs").get_uint64()},
+        kicks_per_packet_{Statman::get().create(Stat::FLOAT, device + ".tx_kicks_per_packet").get_float()},
+        irqs_per_packet_{Statman::get().create(Stat::FLOAT, device + ".tx_irqs_per_packet").get_float()}
+    {}
+
+    void packets(uint32_t n) noexcept
+    { __sync_fetch_and_add(&packets_, n); }
+
+    void kick() noexcept
+    {
+      const auto kicks = __sync_add_and_fetch(&kicks_, 1);
+      if (packets_) kicks_per_packet_ = (float) kicks / packets_;
+    }
+
+    void irq() noexcept
+    {
+      const auto irqs = __sync_add_and_fetch(&irqs_, 1);
+      if (packets_) irqs_per_packet_ = (float) irqs / packets_;
+    }
+
+    uint64_t kicks() const noexcept
+    { return kicks_; }
+
+    uint64_t irqs() const noexcept
+    { return irqs_; }
+
+  private:
+    uint64_t& kicks_;
+    uint64_t& irqs_;
+    float&    kicks_per_packet_;
+    float&    irqs_per_packet_;
+    uint64_t  packets_ = 0;
+  };
+
+} //< namespace hw
+
+#endif
@@ -62,6 +62,8 @@ public:
   void receive(void*, net::BufferStore* = nullptr);
   void receive(net::Packet_ptr);
   void receive(const void* data, int len);
+  /** a burst of packets coming in from network, as a packet chain **/
+  void receive_burst(net::Packet_ptr chain);
 
   /** Space available in the transmit queue, in packets */
   size_t transmit_queue_available() override;
@@ -70,7 +72,7 @@ public:
   void deactivate() override {}
   void move_to_this_cpu() override {}
   void flush() override {}
-  void poll() override {}
+  bool poll() override { return false; }
 
   struct driver_hdr {
     uint32_t len;
@@ -0,0 +1,97 @@
+// -*-C++-*-
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+
+#pragma once
+#ifndef KERNEL_BUSY_POLL_HPP
+#define KERNEL_BUSY_POLL_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <smp>
+
+namespace hw { class Nic; }
+
+/**
+ * Busy polling of NICs, trading a CPU for receive latency.
+ * A CPU with NICs to poll checks their rings in its event loop instead of
+ * halting, with their interrupts turned off. When it has found no work
+ * for a while it backs off, first by spinning longer between polls and
+ * then by re-arming the interrupts and halting until the next one.
+**/
+class alignas(SMP_ALIGN) Busy_poll {
+public:
+  using duration_t = std::chrono::nanoseconds;
+
+  static constexpr duration_t DEFAULT_IDLE_TIMEOUT = std::chrono::microseconds(200);
+  /** Longest spin between two polls that found nothing */
+  static constexpr int MAX_SPINS = 64;
+
+  /** Get per-cpu instance */
+  static Busy_poll& get();
+
+  /** Poll @nic on this CPU, from now on. Must be called on the polling CPU. */
+  void add(hw::Nic& nic);
+  /** Stop polling @nic, giving it back its interrupts */
+  void remove(hw::Nic& nic);
+
+  /** Whether this CPU has any NICs to poll */
+  bool active() const noexcept
+  { return not nics_.empty(); }
+
+  /** Time without work before the CPU halts */
+  void set_idle_timeout(duration_t timeout) noexcept
+  { idle_timeout_ = timeout.count(); }
+
+  /** Poll each NIC once, returns true if any of them had work */
+  bool poll();
+
+  /**
+   * Wait for something to do, in place of os::halt() in an event loop.
+   * Polls the NICs once and returns, unless they have been idle for longer
+   * than the idle timeout, in which case the CPU halts.
+   */
+  void wait();
+
+  /** Polls made, and the share of them that found work */
+  uint64_t polls() const noexcept
+  { return stat_polls_ ? *stat_polls_ : 0; }
+
+  float efficiency() const noexcept
+  { return stat_efficiency_ ? *stat_efficiency_ : 0.0f; }
+
+  /** Times the CPU halted for lack of work */
+  uint64_t halts() const noexcept
+  { return stat_halts_ ? *stat_halts_ : 0; }
+
+private:
+  void halt();
+
+  std::vector<hw::Nic*> nics_;
+  int      cpu_ = 0;
+  int64_t  idle_timeout_ = DEFAULT_IDLE_TIMEOUT.count();
+  // when the NICs last had work, 0 when they had it on the last poll
+  uint64_t idle_since_ = 0;
+  int      spins_ = 1;
+
+  uint64_t* stat_polls_ = nullptr;
+  uint64_t* stat_busy_  = nullptr;
+  float*    stat_efficiency_ = nullptr;
+  uint64_t* stat_halts_ = nullptr;
+};
+
+#endif //< KERNEL_BUSY_POLL_HPP
@@ -42,6 +42,9 @@ public:
   static id_t periodic(duration_t when, duration_t period, handler_t);
   // un-schedule timer, and free it
   static void stop(id_t);
+  /// reschedule a waiting timer to trigger @when from now, keeping its id
+  /// returns false if the timer is not waiting (eg. stopped or being handled)
+  static bool restart(id_t, duration_t when);
 
   /// returns the number of current, active timers
   static size_t active();
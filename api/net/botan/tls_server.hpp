@@ -19,6 +19,7 @@
 #ifndef NET_TLS_SERVER_STREAM_HPP
 #define NET_TLS_SERVER_STREAM_HPP
 
+#include <algorithm>
 #include <botan/credentials_manager.h>
 #include <botan/rng.h>
 #include <botan/tls_server.h>
@@ -207,6 +208,18 @@ protected:
     if (m_on_connect) m_on_connect(*this);
   }
 
+  /** The protocols to choose from with ALPN, in order of preference */
+  void set_app_protocols(std::vector<std::string> protocols)
+  { m_app_protocols = std::move(protocols); }
+
+  std::string tls_server_choose_app_protocol(const std::vector<std::string>& client_protos) override
+  {
+    for (const auto& proto : m_app_protocols)
+      if (std::find(client_protos.begin(), client_protos.end(), proto) != client_protos.end())
+        return proto;
+    return "";
+  }
+
 private:
   Stream::ReadCallback    m_on_read = nullptr;
   Stream::WriteCallback   m_on_write = nullptr;
@@ -214,6 +227,7 @@ private:
   Stream::CloseCallback   m_on_close = nullptr;
   bool m_busy = false;
   bool m_deferred_close = false;
+  std::vector<std::string> m_app_protocols;
 
   Botan::Credentials_Manager&   m_creds;
   Botan::TLS::Strict_Policy     m_policy;
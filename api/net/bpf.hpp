@@ -0,0 +1,142 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#ifndef NET_BPF_HPP
+#define NET_BPF_HPP
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace net {
+
+  struct Bpf_error : public std::runtime_error {
+    using runtime_error::runtime_error;
+  };
+
+  /**
+   * @brief      Classic BPF packet filter.
+   *             Programs use the instruction format of the Linux socket
+   *             filter, so the output of `tcpdump -dd <expression>` can be
+   *             used as is. A program is validated when it is loaded:
+   *             jumps only go forward and stay within the program, scratch
+   *             memory is in range, and the last instruction returns, so
+   *             running it always terminates without checks for those.
+   */
+  class Bpf {
+  public:
+    struct Insn {
+      uint16_t code;
+      uint8_t  jt;
+      uint8_t  jf;
+      uint32_t k;
+    };
+    using Program = std::vector<Insn>;
+
+    /** Scratch memory words */
+    static constexpr uint32_t MEMWORDS = 16;
+    /** Longest program accepted */
+    static constexpr size_t MAX_INSNS = 4096;
+
+    // instruction classes
+    static constexpr uint16_t LD   = 0x00;
+    static constexpr uint16_t LDX  = 0x01;
+    static constexpr uint16_t ST   = 0x02;
+    static constexpr uint16_t STX  = 0x03;
+    static constexpr uint16_t ALU  = 0x04;
+    static constexpr uint16_t JMP  = 0x05;
+    static constexpr uint16_t RET  = 0x06;
+    static constexpr uint16_t MISC = 0x07;
+    // load sizes
+    static constexpr uint16_t W = 0x00;
+    static constexpr uint16_t H = 0x08;
+    static constexpr uint16_t B = 0x10;
+    // load modes
+    static constexpr uint16_t IMM = 0x00;
+    static constexpr uint16_t ABS = 0x20;
+    static constexpr uint16_t IND = 0x40;
+    static constexpr uint16_t MEM = 0x60;
+    static constexpr uint16_t LEN = 0x80;
+    static constexpr uint16_t MSH = 0xa0;
+    // alu operations
+    static constexpr uint16_t ADD = 0x00;
+    static constexpr uint16_t SUB = 0x10;
+    static constexpr uint16_t MUL = 0x20;
+    static constexpr uint16_t DIV = 0x30;
+    static constexpr uint16_t OR  = 0x40;
+    static constexpr uint16_t AND = 0x50;
+    static constexpr uint16_t LSH = 0x60;
+    static constexpr uint16_t RSH = 0x70;
+    static constexpr uint16_t NEG = 0x80;
+    static constexpr uint16_t MOD = 0x90;
+    static constexpr uint16_t XOR = 0xa0;
+    // jumps
+    static constexpr uint16_t JA   = 0x00;
+    static constexpr uint16_t JEQ  = 0x10;
+    static constexpr uint16_t JGT  = 0x20;
+    static constexpr uint16_t JGE  = 0x30;
+    static constexpr uint16_t JSET = 0x40;
+    // operand sources
+    static constexpr uint16_t K = 0x00;
+    static constexpr uint16_t X = 0x08;
+    static constexpr uint16_t A = 0x10; //< return A
+    // misc operations
+    static constexpr uint16_t TAX = 0x00;
+    static constexpr uint16_t TXA = 0x80;
+
+    static constexpr Insn stmt(uint16_t code, uint32_t k) noexcept
+    { return {code, 0, 0, k}; }
+
+    static constexpr Insn jump(uint16_t code, uint32_t k, uint8_t jt, uint8_t jf) noexcept
+    { return {code, jt, jf, k}; }
+
+    /** A filter accepting every packet in full */
+    Bpf() = default;
+
+    /** @throws Bpf_error if the program is not valid */
+    explicit Bpf(Program program);
+
+    /** The reason @program is not valid, or nullptr */
+    static const char* validate(const Program& program) noexcept;
+
+    /**
+     * @brief      Run the filter over a packet
+     *
+     * @param      data     The packet, from the link layer header
+     * @param      buflen   Bytes available at @data
+     * @param      wirelen  Length of the packet on the wire
+     *
+     * @return     The number of bytes to keep, 0 to drop the packet.
+     *             Loads beyond @buflen drop the packet.
+     */
+    uint32_t run(const uint8_t* data, uint32_t buflen, uint32_t wirelen) const noexcept;
+
+    /** Whether the filter accepts everything */
+    bool empty() const noexcept
+    { return prog_.empty(); }
+
+    const Program& program() const noexcept
+    { return prog_; }
+
+  private:
+    Program prog_;
+  };
+
+} //< namespace net
+
+#endif
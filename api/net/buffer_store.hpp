@@ -20,6 +20,8 @@
 #define NET_BUFFER_STORE_HPP
 
 #include <common>
+#include <array>
+#include <atomic>
 #include <stdexcept>
 #include <vector>
 #include <smp>
@@ -32,10 +34,21 @@ namespace net
    * @note : The buffer store is intended to be used by Packet, which is
    * a semi-intelligent buffer wrapper, used throughout the IP-stack.
    *
+   * Buffers are handed out from a small per-CPU cache (magazine), which
+   * is refilled from and drained to a shared depot in bulk. Only the
+   * bulk operations take the depot lock, so packet alloc/free on
+   * different cores don't contend with each other.
+   *
    * There shouldn't be any need for raw buffers in services.
    **/
   class BufferStore {
   public:
+    // buffers cached per CPU before draining to the depot
+    static constexpr int MAGAZINE_SIZE = 32;
+    // maximum number of pools, at most half of the pool lookup slots
+    static constexpr int POOL_SLOTS = 256;
+    static constexpr int MAX_POOLS  = POOL_SLOTS / 2;
+
     BufferStore(uint32_t num, uint32_t bufsize);
     ~BufferStore();
 
@@ -50,17 +63,24 @@ namespace net
     uint32_t poolsize() const noexcept
     { return poolsize_; }
 
-    /** Check if an address belongs to this buffer store */
+    /** Check if an address belongs to this buffer store, in O(1) */
     bool is_valid(uint8_t* addr) const noexcept
     {
-      for (const auto* pool : pools_)
-          if ((addr - pool) % bufsize_ == 0
-            && addr >= pool && addr < pool + poolsize_) return true;
-      return false;
+      // pools are aligned to pool_span_, so the span base identifies the pool
+      const auto base = (uintptr_t) addr & ~(uintptr_t) (pool_span_ - 1);
+      const auto off  = (uintptr_t) addr - base;
+      if (off >= poolsize_ || off % bufsize_ != 0) return false;
+      return find_pool(base);
     }
 
-    size_t available() const noexcept {
-      return this->available_.size();
+    /** Buffers not in use, including those cached on each CPU.
+        With SMP enabled this is a snapshot, and may be slightly off. **/
+    size_t available() const noexcept
+    {
+      size_t total = this->available_.size();
+      for (const auto& mag : this->cache_)
+          total += mag.count;
+      return total;
     }
 
     size_t total_buffers() const noexcept {
@@ -75,15 +95,42 @@ namespace net
     void move_to_this_cpu() noexcept;
 
   private:
+    struct alignas(SMP_ALIGN) Magazine {
+      int      count = 0;
+      uint8_t* bufs[MAGAZINE_SIZE];
+    };
+
     uint32_t pool_buffers() const noexcept { return poolsize_ / bufsize_; }
     void create_new_pool();
     bool growth_enabled() const;
+    // move buffers between this CPUs magazine and the depot
+    void refill(Magazine&);
+    void drain(Magazine&);
+
+    static uint32_t pool_slot(uintptr_t base, uint32_t shift) noexcept
+    { return (base >> shift) & (POOL_SLOTS - 1); }
+
+    bool find_pool(uintptr_t base) const noexcept
+    {
+      for (uint32_t i = 0; i < POOL_SLOTS; i++)
+      {
+        const auto& slot = pool_table_[(pool_slot(base, pool_shift_) + i) & (POOL_SLOTS-1)];
+        const auto  val  = slot.load(std::memory_order_acquire);
+        if (val == base) return true;
+        if (val == 0)    return false;
+      }
+      return false;
+    }
 
     uint32_t              poolsize_;
     uint32_t              bufsize_;
+    uint32_t              pool_span_;
+    uint32_t              pool_shift_;
     int                   index = -1;
     std::vector<uint8_t*> available_;
     std::vector<uint8_t*> pools_;
+    std::array<std::atomic<uintptr_t>, POOL_SLOTS> pool_table_ {};
+    SMP::Array<Magazine>  cache_;
 #ifdef INCLUDEOS_SMP_ENABLE
     // has strict alignment reqs, so put at end
     spinlock_t           plock = 0;
@@ -98,10 +145,9 @@ namespace net
   {
     auto* buff = (uint8_t*) addr;
     if (LIKELY(this->is_valid(buff))) {
-#ifdef INCLUDEOS_SMP_ENABLE
-      scoped_spinlock spinlock(this->plock);
-#endif
-      this->available_.push_back(buff);
+      auto& mag = PER_CPU(this->cache_);
+      if (UNLIKELY(mag.count == MAGAZINE_SIZE)) this->drain(mag);
+      mag.bufs[mag.count++] = buff;
       return;
     }
     throw std::runtime_error("Buffer did not belong");
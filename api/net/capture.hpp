@@ -0,0 +1,147 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#ifndef NET_CAPTURE_HPP
+#define NET_CAPTURE_HPP
+
+#include <net/bpf.hpp>
+#include <net/packet.hpp>
+#include <fs/fd_compatible.hpp>
+#include <pmr>
+#include <atomic>
+#include <memory>
+#include <string>
+
+namespace net {
+
+  class Stream;
+
+  /**
+   * @brief      Packet capture at the boundary between a NIC and its link
+   *             layer, see hw::Nic::set_capture. Packets accepted by the
+   *             filter are copied, up to the snap length, into a ring of
+   *             fixed size slots, which CPUs can write to at the same time
+   *             without locking. When the ring is full new packets are
+   *             dropped, and counted. The ring is read out as pcapng,
+   *             directly, as a stream (eg. a TCP connection), or through
+   *             a file descriptor when mounted in the VFS:
+   *
+   *               static net::Capture cap {"eth0", {}, net::Bpf{prog}};
+   *               nic.set_capture(&cap);
+   *               cap.mount("/dev/capture/eth0");
+   */
+  class Capture : public FD_compatible {
+  public:
+    /** As in the pcapng epb_flags option */
+    enum class Direction : uint8_t {
+      IN  = 1,
+      OUT = 2
+    };
+
+    struct Config {
+      /** Slots in the ring, rounded up to a power of two */
+      uint32_t slots   = 1024;
+      /** Most bytes kept from a packet */
+      uint32_t snaplen = 256;
+    };
+
+    /** pcapng block types and link type */
+    static constexpr uint32_t BLOCK_SHB = 0x0A0D0D0A;
+    static constexpr uint32_t BLOCK_IDB = 0x00000001;
+    static constexpr uint32_t BLOCK_EPB = 0x00000006;
+    static constexpr uint16_t LINKTYPE_ETHERNET = 1;
+
+    Capture(std::string ifname, Config config, Bpf filter = {});
+    ~Capture();
+
+    /**
+     * @brief      Record a chain of packets passing the NIC.
+     *             Safe to call from several CPUs at once.
+     */
+    void capture(const Packet* chain, Direction dir) noexcept;
+
+    /**
+     * @brief      Take captured packets out of the ring, appending them to
+     *             @out as pcapng blocks. The first read starts the pcapng
+     *             section. Only one reader at a time.
+     *
+     * @return     The number of packets read
+     */
+    size_t read(os::mem::buffer& out, size_t max_packets = SIZE_MAX);
+
+    /** Write what has been captured to @stream, in one write */
+    size_t write_to(Stream& stream);
+
+    /** Make the capture readable from a file descriptor opened at @path */
+    void mount(const std::string& path);
+
+    /** Whether there is anything to read */
+    bool pending() const noexcept
+    { return slot(tail_).seq.load(std::memory_order_acquire) == tail_ + 1; }
+
+    /** Packets recorded, dropped with the ring full, and rejected by the filter */
+    uint64_t captured() const noexcept
+    { return captured_.load(std::memory_order_relaxed); }
+
+    uint64_t dropped() const noexcept
+    { return dropped_.load(std::memory_order_relaxed); }
+
+    uint64_t filtered() const noexcept
+    { return filtered_.load(std::memory_order_relaxed); }
+
+    uint32_t snaplen() const noexcept
+    { return snaplen_; }
+
+    const std::string& ifname() const noexcept
+    { return ifname_; }
+
+  private:
+    struct Slot {
+      // the ring position this slot is ready for, +1 once written
+      std::atomic<uint64_t> seq;
+      uint64_t timestamp;
+      uint32_t wirelen;
+      uint32_t caplen;
+      Direction dir;
+      uint8_t  data[0];
+    };
+
+    Slot& slot(uint64_t pos) const noexcept
+    { return *reinterpret_cast<Slot*>(ring_.get() + (pos & mask_) * stride_); }
+
+    void record(const Packet&, Direction) noexcept;
+    void write_header(os::mem::buffer& out) const;
+
+    const std::string ifname_;
+    const Bpf        filter_;
+    const uint32_t   snaplen_;
+    uint32_t         stride_;
+    uint64_t         mask_;
+    std::unique_ptr<uint8_t[]> ring_;
+
+    alignas(64) std::atomic<uint64_t> head_ {0};
+    alignas(64) uint64_t tail_ = 0;
+    bool     header_written_ = false;
+    std::atomic<uint64_t> captured_ {0};
+    std::atomic<uint64_t> dropped_  {0};
+    std::atomic<uint64_t> filtered_ {0};
+  };
+
+} //< namespace net
+
+#endif
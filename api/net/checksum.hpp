@@ -27,6 +27,13 @@ namespace net {
   // Compute internet checksum with partial @sum provided
   uint16_t checksum(uint32_t sum, const void* data, size_t len) noexcept;
 
+  // Fold a 32-bit partial sum into 16 bits, without inverting it
+  inline uint16_t checksum_fold(uint32_t sum) noexcept {
+    while (sum >> 16)
+      sum = (sum & 0xffff) + (sum >> 16);
+    return sum;
+  }
+
   // Compute the internet checksum for the buffer / buffer part provided
   inline uint16_t checksum(const void* data, size_t len) noexcept {
     return checksum(0, data, len);
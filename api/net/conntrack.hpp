@@ -22,11 +22,14 @@
 #include <net/socket.hpp>
 #include <net/ip4/packet_ip4.hpp>
 #include <net/ip6/packet_ip6.hpp>
+#include <array>
 #include <vector>
 #include <unordered_map>
 #include <rtc>
 #include <chrono>
 #include <util/timer.hpp>
+#include <util/timer_wheel.hpp>
+#include <util/slab_pool.hpp>
 
 namespace net {
 
@@ -101,6 +104,13 @@ public:
     State             state;
     uint8_t           flags{0x0};
     uint8_t           other{0x0}; // whoever can make whatever here
+    int32_t           id{-1}; // in the entry pool
+    /** Filter verdicts for the connection, see Filter_rules */
+    struct Cached_verdict {
+      uint32_t tag{0};
+      uint8_t  verdict{0};
+    };
+    mutable std::array<Cached_verdict, 4> verdicts{};
     Entry_handler     on_close;
 
     Entry(Quadruple quad, Protocol p)
@@ -241,9 +251,28 @@ public:
 
   /**
    * @brief      Remove all expired entries, both confirmed and unconfirmed.
+   *             Walks every entry, so timeouts changed directly on an entry
+   *             are seen. The flush timer only visits the entries that are due.
    */
   void remove_expired();
 
+  /**
+   * @brief      Reclaim up to @budget expired entries. The entries that are
+   *             due are collected when the previous round is done, in time
+   *             proportional to their number. Called by the flush timer.
+   *
+   * @param[in]  budget  The maximum number of entries to remove
+   *
+   * @return     The number of entries removed
+   */
+  size_t reap(size_t budget);
+
+  /**
+   * @brief      Number of expired entries waiting to be reclaimed.
+   */
+  size_t pending_reaps() const noexcept
+  { return reap_queue.size(); }
+
   /**
    * @brief      Number of entries currently tracked.
    *
@@ -258,7 +287,10 @@ public:
    * @param[in]  count  The count
    */
   void reserve(size_t count)
-  { entries.reserve(count); }
+  {
+    entries.reserve(count);
+    pool.reserve((count + 1) / 2);
+  }
 
   /**
    * @brief      A very simple and unreliable way for tracking quintuples.
@@ -307,6 +339,9 @@ public:
   /** How often the flush timer should fire */
   std::chrono::seconds flush_interval {10};
 
+  /** Maximum number of expired entries reclaimed per event loop iteration */
+  size_t reap_budget {1024};
+
   /** Custom TCP handler can (and should) be added here */
   Packet_tracker  tcp_in;
   Packet_tracker6 tcp6_in;
@@ -315,12 +350,23 @@ public:
   void serialize_to(std::vector<char>&) const;
 
 private:
-  using Entry_table = std::unordered_map<Quintuple, std::shared_ptr<Entry>, Quintuple_hasher>;
-  Entry_table entries;
-  Timer       flush_timer;
+  using Entry_table = std::unordered_map<Quintuple, Entry*, Quintuple_hasher>;
+  // timeouts are in RTC seconds, one tick each
+  using Expiry_wheel = Timer_wheel<0, 3>;
+  Entry_table       entries;
+  Slab_pool<Entry>  pool;
+  Expiry_wheel      expiry;
+  std::vector<int32_t> reap_queue;
+  Timer             flush_timer;
+
+  Entry* create_entry(const Quadruple& quad, const Protocol proto);
 
   inline void update_timeout(Entry& ent, const Timeout_settings& timeouts);
 
+  inline void schedule(Entry& ent);
+
+  void erase(Entry& ent);
+
   void on_timeout();
 
 };
@@ -356,6 +402,15 @@ inline Quadruple Conntrack::get_quadruple_icmp(const IP_packet& pkt)
 inline void Conntrack::update_timeout(Entry& ent, const Timeout_settings& timeouts)
 {
   ent.timeout = RTC::now() + timeouts.get(ent.proto).count();
+  schedule(ent);
+}
+
+inline void Conntrack::schedule(Entry& ent)
+{
+  if (UNLIKELY(expiry.empty()))
+    expiry.advance(RTC::now());
+  // a later timeout only updates the deadline, the entry is moved when reached
+  expiry.update(ent.id, ent.timeout);
 }
 
 }
@@ -52,10 +52,22 @@ namespace net {
     /** Bottom upstream input, "Bottom up". Handle raw ethernet buffer. */
     void receive(Packet_ptr);
 
+    /**
+     * Bottom upstream input of a burst of frames (a packet chain).
+     * Unicast IPv4 goes up as one burst when there is a burst upstream
+     * and the IPv4 upstream has not been replaced since it was set,
+     * the rest is handled one by one as in receive().
+     */
+    void receive_burst(Packet_ptr chain);
+
 
     /** Protocol handler getters */
     upstream_ip& ip4_upstream()
-    { return ip4_upstream_; }
+    {
+      // may be replaced through the reference
+      ip4_burst_paired_ = false;
+      return ip4_upstream_;
+    }
 
     upstream_ip& ip6_upstream()
     { return ip6_upstream_; }
@@ -66,7 +78,20 @@ namespace net {
 
     /** Delegate upstream IPv4 upstream. */
     void set_ip4_upstream(upstream_ip del)
-    { ip4_upstream_ = del; }
+    {
+      ip4_upstream_ = del;
+      ip4_burst_paired_ = false;
+    }
+
+    /**
+     * Delegate upstream IPv4 burst upstream. It must deliver where the
+     * current IPv4 upstream does, and is used until that is replaced.
+     */
+    void set_ip4_burst_upstream(upstream del)
+    {
+      ip4_burst_upstream_ = del;
+      ip4_burst_paired_ = true;
+    }
 
     /** Delegate upstream IPv6 upstream. */
     void set_ip6_upstream(upstream_ip del)
@@ -126,6 +151,9 @@ namespace net {
 
     /** Upstream OUTPUT connections */
     upstream_ip ip4_upstream_ = nullptr;
+    upstream ip4_burst_upstream_ = nullptr;
+    // whether ip4_upstream_ is the one the burst upstream goes around
+    bool ip4_burst_paired_ = false;
     upstream_ip ip6_upstream_ = nullptr;
     upstream arp_upstream_ = nullptr;
     upstream vlan_upstream_ = nullptr;
@@ -0,0 +1,438 @@
+// -*-C++-*-
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#ifndef NET_FLOW_TABLE_HPP
+#define NET_FLOW_TABLE_HPP
+
+#include <net/socket.hpp>
+#include <branch_prediction>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <utility>
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+namespace net {
+
+/**
+ * @brief      Hash for flows (pairs of sockets).
+ *             Unlike std::hash<Socket> which XORs the words together,
+ *             every word is mixed in, so flows sharing the local socket
+ *             and differing only in the remote port spread over the table.
+ */
+struct Flow_hash {
+  size_t operator()(const Socket& s) const noexcept
+  {
+    uint64_t h = mix(0, s.address().v6().i64[0]);
+    h = mix(h, s.address().v6().i64[1]);
+    return finish(mix(h, s.port()));
+  }
+
+  size_t operator()(const std::pair<Socket, Socket>& f) const noexcept
+  { return hash(f.first, f.second); }
+
+  size_t operator()(const Quadruple& q) const noexcept
+  { return hash(q.src, q.dst); }
+
+private:
+  static uint64_t mix(uint64_t h, uint64_t w) noexcept
+  {
+    h = (h ^ w) * 0x9E3779B97F4A7C15ull;
+    return h ^ (h >> 32);
+  }
+
+  static uint64_t finish(uint64_t h) noexcept
+  {
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ull;
+    return h ^ (h >> 32);
+  }
+
+  static size_t hash(const Socket& a, const Socket& b) noexcept
+  {
+    uint64_t h = mix(0, a.address().v6().i64[0]);
+    h = mix(h, a.address().v6().i64[1]);
+    h = mix(h, b.address().v6().i64[0]);
+    h = mix(h, b.address().v6().i64[1]);
+    return finish(mix(h, (uint64_t(a.port()) << 16) | b.port()));
+  }
+};
+
+/**
+ * @brief      Open addressing hash table for flow lookup.
+ * @details    Slots are grouped 16 at a time, each group having an array
+ *             of one byte tags (7 bits of the hash, or empty/deleted).
+ *             A lookup hashes to a group and compares all 16 tags at once
+ *             (SSE2 when available), only touching the slots whose tag
+ *             matches, and probes further groups until one has an empty
+ *             tag. The tags of four groups share a cache line, and the
+ *             entries are stored inline, so there is no pointer chasing
+ *             as with the node based std::unordered_map.
+ *
+ *             Iterators and references are invalidated by insertion.
+ *             Erase only invalidates the erased entry.
+ */
+template <typename Key, typename T,
+          typename Hash = Flow_hash, typename Equal = std::equal_to<Key>>
+class Flow_table {
+public:
+  using key_type    = Key;
+  using mapped_type = T;
+  using value_type  = std::pair<const Key, T>;
+
+  static constexpr size_t GROUP = 16;
+
+private:
+  static constexpr int8_t EMPTY   = -128; // 0b10000000
+  static constexpr int8_t DELETED = -2;   // 0b11111110
+
+  struct alignas(GROUP) Group {
+    int8_t tag[GROUP];
+  };
+
+  union Slot {
+    Slot() {}
+    ~Slot() {}
+    value_type value;
+  };
+
+  template <bool Const>
+  class Iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = Flow_table::value_type;
+    using difference_type   = std::ptrdiff_t;
+    using reference = std::conditional_t<Const, const value_type&, value_type&>;
+    using pointer   = std::conditional_t<Const, const value_type*, value_type*>;
+
+    Iterator() = default;
+
+    // iterator converts to const_iterator
+    template <bool C = Const, typename = std::enable_if_t<C>>
+    Iterator(const Iterator<false>& other) noexcept
+      : table_{other.table_}, idx_{other.idx_} {}
+
+    reference operator*() const noexcept
+    { return table_->slots_[idx_].value; }
+
+    pointer operator->() const noexcept
+    { return &table_->slots_[idx_].value; }
+
+    Iterator& operator++() noexcept
+    {
+      idx_ = table_->next_full(idx_ + 1);
+      return *this;
+    }
+
+    Iterator operator++(int) noexcept
+    { auto copy = *this; ++(*this); return copy; }
+
+    bool operator==(const Iterator& other) const noexcept
+    { return idx_ == other.idx_; }
+
+    bool operator!=(const Iterator& other) const noexcept
+    { return idx_ != other.idx_; }
+
+  private:
+    friend class Flow_table;
+    template <bool> friend class Iterator;
+    using table_ptr = std::conditional_t<Const, const Flow_table*, Flow_table*>;
+    table_ptr table_ = nullptr;
+    size_t    idx_   = 0;
+
+    Iterator(table_ptr table, size_t idx) noexcept
+      : table_{table}, idx_{idx} {}
+  };
+
+public:
+  using iterator       = Iterator<false>;
+  using const_iterator = Iterator<true>;
+
+  Flow_table() = default;
+
+  explicit Flow_table(size_t capacity)
+  { reserve(capacity); }
+
+  Flow_table(const Flow_table&) = delete;
+  Flow_table& operator=(const Flow_table&) = delete;
+
+  ~Flow_table()
+  { clear(); }
+
+  size_t size() const noexcept
+  { return size_; }
+
+  bool empty() const noexcept
+  { return size_ == 0; }
+
+  /** Number of slots */
+  size_t capacity() const noexcept
+  { return capacity_; }
+
+  iterator begin() noexcept
+  { return {this, next_full(0)}; }
+
+  iterator end() noexcept
+  { return {this, capacity_}; }
+
+  const_iterator begin() const noexcept
+  { return {this, next_full(0)}; }
+
+  const_iterator end() const noexcept
+  { return {this, capacity_}; }
+
+  const_iterator cbegin() const noexcept
+  { return begin(); }
+
+  const_iterator cend() const noexcept
+  { return end(); }
+
+  iterator find(const Key& key) noexcept
+  { return {this, find_index(key, Hash{}(key))}; }
+
+  const_iterator find(const Key& key) const noexcept
+  { return {this, find_index(key, Hash{}(key))}; }
+
+  size_t count(const Key& key) const noexcept
+  { return find(key) != end(); }
+
+  /**
+   * @brief      Inserts a value constructed from @args, unless the key
+   *             already exists (like std::unordered_map::try_emplace)
+   *
+   * @return     The iterator to the entry, and whether it was inserted
+   */
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(const Key& key, Args&&... args)
+  {
+    const size_t hash = Hash{}(key);
+    const size_t found = find_index(key, hash);
+    if (found != capacity_)
+      return {{this, found}, false};
+
+    if (UNLIKELY(growth_left_ == 0))
+      rehash_for(size_ + 1);
+
+    const size_t idx = find_free(hash);
+    if (tags_at(idx) == EMPTY)
+      growth_left_--;
+    set_tag(idx, h2(hash));
+    new (&slots_[idx].value) value_type(std::piecewise_construct,
+      std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+    size_++;
+    return {{this, idx}, true};
+  }
+
+  /** Erase the entry with @key, returns the number of entries erased */
+  size_t erase(const Key& key)
+  {
+    const size_t idx = find_index(key, Hash{}(key));
+    if (idx == capacity_) return 0;
+    erase_index(idx);
+    return 1;
+  }
+
+  /** Erase the entry at @it, returns the iterator to the next entry */
+  iterator erase(iterator it)
+  {
+    erase_index(it.idx_);
+    return {this, next_full(it.idx_ + 1)};
+  }
+
+  void clear() noexcept
+  {
+    for (size_t i = 0; i < capacity_; i++)
+      if (is_full(tags_at(i))) slots_[i].value.~value_type();
+    for (size_t g = 0; g < groups(); g++)
+      std::memset(groups_[g].tag, EMPTY, GROUP);
+    size_ = 0;
+    growth_left_ = max_load(capacity_);
+  }
+
+  /** Makes room for at least @n entries without rehashing */
+  void reserve(size_t n)
+  {
+    if (n > size_ + growth_left_)
+      rehash_for(n);
+  }
+
+private:
+  std::unique_ptr<Group[]> groups_;
+  std::unique_ptr<Slot[]>  slots_;
+  size_t capacity_    = 0;
+  size_t size_        = 0;
+  size_t growth_left_ = 0;
+
+  size_t groups() const noexcept
+  { return capacity_ / GROUP; }
+
+  // the top bits select the group, the low 7 bits are the tag
+  static size_t h1(size_t hash) noexcept
+  { return hash >> 7; }
+
+  static int8_t h2(size_t hash) noexcept
+  { return hash & 0x7F; }
+
+  static bool is_full(int8_t tag) noexcept
+  { return tag >= 0; }
+
+  // keep at most 7/8 of the slots used
+  static size_t max_load(size_t capacity) noexcept
+  { return capacity - capacity / 8; }
+
+  int8_t tags_at(size_t idx) const noexcept
+  { return groups_[idx / GROUP].tag[idx % GROUP]; }
+
+  void set_tag(size_t idx, int8_t tag) noexcept
+  { groups_[idx / GROUP].tag[idx % GROUP] = tag; }
+
+  /** Bitmask of the slots in group @g with tag @tag */
+  uint32_t match(size_t g, int8_t tag) const noexcept
+  {
+#if defined(__SSE2__)
+    const auto tags = _mm_load_si128(reinterpret_cast<const __m128i*>(groups_[g].tag));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8(tag)));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < GROUP; i++)
+      mask |= uint32_t(groups_[g].tag[i] == tag) << i;
+    return mask;
+#endif
+  }
+
+  /** Bitmask of the empty or deleted slots in group @g */
+  uint32_t match_free(size_t g) const noexcept
+  {
+#if defined(__SSE2__)
+    const auto tags = _mm_load_si128(reinterpret_cast<const __m128i*>(groups_[g].tag));
+    return _mm_movemask_epi8(tags);
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < GROUP; i++)
+      mask |= uint32_t(groups_[g].tag[i] < 0) << i;
+    return mask;
+#endif
+  }
+
+  /**
+   * Probe the groups in triangular order (1, 2, 3.. groups apart),
+   * which visits every group when the group count is a power of two.
+   */
+  size_t find_index(const Key& key, size_t hash) const noexcept
+  {
+    if (UNLIKELY(capacity_ == 0)) return capacity_;
+    const size_t gmask = groups() - 1;
+    const int8_t tag = h2(hash);
+    size_t g = h1(hash) & gmask;
+    for (size_t step = 1; step <= groups(); step++)
+    {
+      for (uint32_t m = match(g, tag); m != 0; m &= m - 1)
+      {
+        const size_t idx = g * GROUP + __builtin_ctz(m);
+        if (LIKELY(Equal{}(slots_[idx].value.first, key)))
+          return idx;
+      }
+      // an empty slot ends the probe sequence
+      if (LIKELY(match(g, EMPTY) != 0))
+        return capacity_;
+      g = (g + step) & gmask;
+    }
+    return capacity_;
+  }
+
+  /** The first empty or deleted slot in the probe sequence of @hash */
+  size_t find_free(size_t hash) const noexcept
+  {
+    const size_t gmask = groups() - 1;
+    size_t g = h1(hash) & gmask;
+    for (size_t step = 1; ; step++)
+    {
+      const uint32_t m = match_free(g);
+      if (m != 0)
+        return g * GROUP + __builtin_ctz(m);
+      g = (g + step) & gmask;
+    }
+  }
+
+  size_t next_full(size_t idx) const noexcept
+  {
+    while (idx < capacity_ and not is_full(tags_at(idx)))
+      idx++;
+    return idx;
+  }
+
+  void erase_index(size_t idx)
+  {
+    slots_[idx].value.~value_type();
+    size_--;
+    // a group with an empty slot ends every probe sequence reaching it,
+    // so the slot can be made empty instead of leaving a tombstone
+    if (match(idx / GROUP, EMPTY) != 0) {
+      set_tag(idx, EMPTY);
+      growth_left_++;
+    }
+    else {
+      set_tag(idx, DELETED);
+    }
+  }
+
+  /** Rehash into a table with room for @n entries, dropping tombstones */
+  void rehash_for(size_t n)
+  {
+    size_t capacity = std::max(capacity_, GROUP);
+    while (max_load(capacity) < n)
+      capacity *= 2;
+    // rehash in place when the table is mostly tombstones, otherwise grow
+    if (capacity == capacity_ and n > max_load(capacity) / 2)
+      capacity *= 2;
+    rehash(capacity);
+  }
+
+  void rehash(size_t capacity)
+  {
+    auto old_groups = std::move(groups_);
+    auto old_slots  = std::move(slots_);
+    const size_t old_capacity = capacity_;
+
+    groups_.reset(new Group[capacity / GROUP]);
+    slots_.reset(new Slot[capacity]);
+    capacity_ = capacity;
+    for (size_t g = 0; g < groups(); g++)
+      std::memset(groups_[g].tag, EMPTY, GROUP);
+
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+      if (not is_full(old_groups[i / GROUP].tag[i % GROUP])) continue;
+      auto& value = old_slots[i].value;
+      const size_t hash = Hash{}(value.first);
+      const size_t idx  = find_free(hash);
+      set_tag(idx, h2(hash));
+      new (&slots_[idx].value) value_type(std::move(value));
+      value.~value_type();
+    }
+    growth_left_ = max_load(capacity_) - size_;
+  }
+};
+
+} // < namespace net
+
+#endif // < NET_FLOW_TABLE_HPP
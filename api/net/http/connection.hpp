@@ -24,6 +24,7 @@
 #include "response.hpp"
 
 #include <net/tcp/stream.hpp>
+#include <sstream>
 
 namespace http {
 
@@ -89,6 +90,14 @@ namespace http {
 
     void end();
 
+    /**
+     * @brief      Write the status line and header of a response,
+     *             as HTTP/1.1 unless the protocol has its own framing
+     *
+     * @param[in]  res   The response
+     */
+    virtual void write_header(const Response& res);
+
     /* Delete copy constructor */
     Connection(const Connection&)             = delete;
 
@@ -148,6 +157,13 @@ namespace http {
     return copy;
   }
 
+  inline void Connection::write_header(const Response& res)
+  {
+    std::ostringstream header;
+    header << res.status_line() << "\r\n" << res.header();
+    stream_->write(header.str());
+  }
+
   inline void Connection::end()
   {
     if(released())
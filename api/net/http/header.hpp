@@ -21,6 +21,8 @@
 #include <algorithm>
 #include <cctype>
 #include <cstring>
+#include <forward_list>
+#include <memory>
 #include <ostream>
 #include <type_traits>
 
@@ -39,12 +41,27 @@ namespace http {
 /// but the amount can be specified by using the
 /// appropriate constructor
 ///
+/// Fields are views, either into the buffer a request
+/// was parsed from, which the header keeps alive, or into
+/// copies of the fields added by value
+///
 class Header {
 private:
+  ///
+  /// A field, with its name interned when it is one
+  /// of the fields in header_fields.hpp
+  ///
+  struct Field_entry {
+    util::sview   name;
+    util::sview   value;
+    header::Field id;
+    bool          owned;
+  };
+
   ///
   /// Internal class type aliases
   ///
-  using Const_iterator = Header_set::const_iterator;
+  using Const_iterator = std::vector<Field_entry>::const_iterator;
 public:
   ///
   /// Default constructor that limits the amount
@@ -67,9 +84,9 @@ public:
   ~Header() noexcept = default;
 
   ///
-  /// Default copy constructor
+  /// Copy constructor, copying the fields added by value
   ///
-  Header(const Header&) = default;
+  Header(const Header&);
 
   ///
   /// Default move constructor
@@ -77,9 +94,9 @@ public:
   Header(Header&&) noexcept = default;
 
   ///
-  /// Default assignment operator
+  /// Assignment operator, copying the fields added by value
   ///
-  Header& operator = (const Header&) = default;
+  Header& operator = (const Header&);
 
   ///
   /// Default move assignemt operator
@@ -182,11 +199,57 @@ public:
   ///
   bool set_content_length(const size_t len);
 
+  ///
+  /// Call {func} with the name and value of
+  /// each field, in the order they were added
+  ///
+  template <typename Func>
+  void for_each(Func&& func) const {
+    for (const auto& field : fields_) func(field.name, field.value);
+  }
+
 private:
   ///
   /// Class data members
   ///
-  Header_set fields_;
+  std::vector<Field_entry> fields_;
+  std::size_t limit_;
+  ///
+  /// Copies of the fields added by value, a list so
+  /// the views into them stay valid as it grows
+  ///
+  std::forward_list<std::string> owned_;
+  ///
+  /// The buffer the parsed fields are views into
+  ///
+  std::shared_ptr<const void> source_;
+
+  ///
+  /// Add a field without copying it, the views must
+  /// point into the source set with {set_source}
+  ///
+  /// @return true if the field was added, false
+  /// otherwise
+  ///
+  bool add_parsed(util::sview field, util::sview value);
+
+  ///
+  /// Keep the buffer holding the parsed fields alive
+  ///
+  void set_source(std::shared_ptr<const void> source) noexcept
+  { source_ = std::move(source); }
+
+  ///
+  /// Make an owned copy of the field with the given name and value
+  ///
+  Field_entry own(util::csview field, util::csview value, header::Field id);
+
+  ///
+  /// Free the copy held by a field added by value
+  ///
+  void disown(const Field_entry& entry) noexcept;
+
+  friend class Request_parser;
 
   ///
   /// Find the location of a field within the set
@@ -212,9 +275,9 @@ private:
 template<typename Char, typename Char_traits>
 std::basic_ostream<Char, Char_traits>& operator<<(std::basic_ostream<Char, Char_traits>& output_device, const Header& header) {
   if (not header.is_empty()) {
-    for (const auto field : header.fields_) {
-      output_device << field.first  << ": "
-                    << field.second << "\r\n";
+    for (const auto& field : header.fields_) {
+      output_device << field.name  << ": "
+                    << field.value << "\r\n";
     }
     //-----------------------------------
     output_device << "\r\n";
@@ -18,11 +18,18 @@
 #ifndef HTTP_HEADER_FIELDS_HPP
 #define HTTP_HEADER_FIELDS_HPP
 
+#include "../../util/detail/string_view"
+
 namespace http {
 namespace header {
 //------------------------------------------------
 using Field = const char*;
 //------------------------------------------------
+// The field below with the name @name, compared
+// without case, or nullptr when it is not one of them
+//------------------------------------------------
+Field intern(util::csview name) noexcept;
+//------------------------------------------------
 // Request Fields
 //------------------------------------------------
 extern Field Accept;
@@ -76,6 +83,7 @@ extern Field Content_Range;
 extern Field Content_Type;
 extern Field Expires;
 extern Field Last_Modified;
+extern Field Transfer_Encoding;
 //------------------------------------------------
 //------------------------------------------------
 } //< namespace header
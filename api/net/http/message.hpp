@@ -120,7 +120,7 @@ public:
   ///
   /// @return The object that invoked this method
   ///
-  Message& add_chunk(const Message_body& chunk);
+  Message& add_chunk(util::csview chunk);
 
   ///
   /// Check if this message has an entity
@@ -0,0 +1,116 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HTTP_REQUEST_PARSER_HPP
+#define HTTP_REQUEST_PARSER_HPP
+
+#include "request.hpp"
+
+#include <pmr>
+
+namespace http {
+
+///
+/// Incremental HTTP/1.1 request parser
+///
+/// Data is fed to it as it is received, and complete requests
+/// are taken out of it, several per read when they are pipelined.
+/// The request line and header fields are parsed in place: the
+/// fields of a request are views into the buffer they arrived in,
+/// which the request keeps alive. Only a request head split over
+/// several reads is copied, to join it. Bodies, delimited by
+/// Content-Length or chunked, are copied into the request.
+///
+class Request_parser {
+public:
+  using buffer_t = os::mem::buf_ptr;
+
+  struct Limits {
+    /// Longest request line and header fields
+    std::size_t max_head   = 8192;
+    /// Most header fields kept, the rest are ignored
+    std::size_t max_fields = 25;
+    /// Largest body
+    std::size_t max_body   = 16 << 20;
+  };
+
+  Request_parser() noexcept;
+
+  explicit Request_parser(Limits limits) noexcept
+    : limits_{limits}
+  {}
+
+  ///
+  /// Add data received on the connection
+  ///
+  void feed(buffer_t buf);
+
+  ///
+  /// Take out the next complete request
+  ///
+  /// @return The request, or nullptr when more data is needed
+  ///
+  /// @throws Request_error on a malformed request, after
+  /// which the parser needs to be reset
+  ///
+  Request_ptr next();
+
+  ///
+  /// Whether part of a request has been received
+  ///
+  bool partial() const noexcept
+  { return state_ != State::HEAD or available() > 0; }
+
+  ///
+  /// Drop everything received so far
+  ///
+  void reset() noexcept;
+
+private:
+  enum class State : uint8_t {
+    HEAD, BODY, CHUNK_SIZE, CHUNK_DATA, CHUNK_END, TRAILER, ERROR
+  };
+
+  Limits      limits_;
+  State       state_ = State::HEAD;
+  buffer_t    buf_;
+  /// Start of the unparsed data in the buffer
+  std::size_t pos_ = 0;
+  /// Unparsed bytes searched for the end of the head
+  std::size_t scanned_ = 0;
+  /// Bytes left of the body or chunk being read
+  std::size_t remaining_ = 0;
+  /// The request whose body is being read
+  Request_ptr req_;
+
+  std::size_t available() const noexcept
+  { return buf_ ? buf_->size() - pos_ : 0; }
+
+  util::sview unparsed() const noexcept
+  { return {reinterpret_cast<const char*>(buf_->data()) + pos_, available()}; }
+
+  Request_ptr parse_head(util::sview head);
+  void read_framing(Request& req);
+  bool read_body();
+  bool read_line(util::sview& line, std::size_t max);
+
+  [[noreturn]] void fail(const char* reason);
+}; //< class Request_parser
+
+} //< namespace http
+
+#endif //< HTTP_REQUEST_PARSER_HPP
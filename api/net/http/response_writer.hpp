@@ -46,6 +46,12 @@ namespace http {
   public:
     Response_writer(Response_ptr res, Connection&);
 
+    /**
+     * @brief      A writer owning the connection it writes on,
+     *             eg. one stream of a HTTP/2 connection
+     */
+    Response_writer(Response_ptr res, std::unique_ptr<Connection> conn);
+
     auto& header()
     { return response_->header(); }
 
@@ -111,6 +117,7 @@ namespace http {
     Response_ptr  response_;
     Connection&   connection_;
     bool          header_sent_{false};
+    std::unique_ptr<Connection> owned_;
 
     /**
      * @brief      Preprocessing of a write
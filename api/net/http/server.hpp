@@ -25,6 +25,9 @@
 #include "response_writer.hpp"
 
 #include <net/tcp/tcp.hpp>
+#include <util/slab_pool.hpp>
+#include <util/timer.hpp>
+#include <util/timer_wheel.hpp>
 #include <timers>
 #include <vector>
 #include <statman>
@@ -47,10 +50,13 @@ namespace http {
 
     static constexpr size_t     DEFAULT_BUFSIZE = 2048;
     static const idle_duration  DEFAULT_IDLE_TIMEOUT; // server.cpp, 60s
+    static constexpr size_t     DEFAULT_CONNECTIONS = 256;
 
   private:
-    using Connection_set  = std::vector<std::unique_ptr<Server_connection>>;
-    using Index_set       = std::vector<size_t>;
+    // connections are addressed by their id in the pool
+    using Connection_pool = Slab_pool<Server_connection>;
+    // idle deadlines are in RTC seconds, one tick each
+    using Idle_wheel      = Timer_wheel<0, 3>;
 
   public:
     /**
@@ -83,7 +89,16 @@ namespace http {
      * @return     Number of connected clients
      */
     size_t connected_clients() const noexcept
-    { return connections_.size() - free_idx_.size(); }
+    { return connections_.size(); }
+
+    /**
+     * @brief      Make room for @n connections up front, so accepting
+     *             them does not allocate
+     *
+     * @param[in]  n     The number of connections
+     */
+    void reserve_connections(size_t n)
+    { connections_.reserve(n); }
 
     /**
      * @brief      Creates a response with some predefined values
@@ -133,10 +148,10 @@ namespace http {
     friend class Server_connection;
 
     Request_handler on_request_;
-    Connection_set  connections_;
-    Index_set       free_idx_;
+    Connection_pool connections_;
+    Idle_wheel      idle_;
+    Timer           idle_timer_;
     bool            keep_alive_;
-    Timers::id_t    timer_id_;
 
     const idle_duration idle_timeout_;
 
@@ -153,11 +168,18 @@ namespace http {
     void close(Server_connection&);
 
     /**
-     * @brief      Timeout (close) all clients that been idle for more than limit.
+     * @brief      Restart the idle timeout of a connection with activity.
+     *             A later deadline only updates its entry in the wheel.
      *
-     * @param[in]  <unnamed>  A timer id (unused)
+     * @param      <unnamed>  The server connection
      */
-    void timeout_clients(int32_t);
+    void update_idle(Server_connection&);
+
+    /**
+     * @brief      Timeout (close) the clients that have been idle for
+     *             more than the limit, the cost is in proportion to them.
+     */
+    void timeout_clients();
 
     /**
      * @brief      Receive a incoming HTTP request
@@ -168,6 +190,14 @@ namespace http {
      */
     void receive(Request_ptr, status_t code, Server_connection&);
 
+    /**
+     * @brief      Receive a HTTP/2 request, on a stream of its own
+     *
+     * @param[in]  <unnamed>  The HTTP request
+     * @param[in]  <unnamed>  The stream to respond on, owned by the Response_writer
+     */
+    void receive_h2(Request_ptr, std::unique_ptr<Connection>);
+
   }; // < class Server
 
   /**
@@ -21,6 +21,9 @@
 
 // http
 #include "connection.hpp"
+#include "request_parser.hpp"
+
+#include <net/http2/connection.hpp>
 
 #include <rtc>
 
@@ -45,19 +48,22 @@ namespace http {
 
   private:
     Server&           server_;
-    Request_ptr       req_;
+    Request_parser    parser_;
+    std::unique_ptr<http2::Connection> h2_;
     size_t            idx_;
     RTC::timestamp_t  idle_since_;
 
     void recv_request(buffer_t);
 
-    void end_request(status_t code = http::OK);
+    void end_request(Request_ptr req, status_t code = http::OK);
+
+    void recv_h2(Request_ptr req, std::unique_ptr<http2::Exchange> exchange);
 
     void close() override;
 
-    void update_idle()
-    { idle_since_ = RTC::now(); }
+    void update_idle();
 
+    friend class Server;
   }; // < class Server_connection
 
 
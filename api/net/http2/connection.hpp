@@ -0,0 +1,310 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#ifndef HTTP2_CONNECTION_HPP
+#define HTTP2_CONNECTION_HPP
+
+#include "frame.hpp"
+#include "hpack.hpp"
+
+#include <net/http/connection.hpp>
+#include <net/stream.hpp>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+namespace http2 {
+
+  /** The peer broke the protocol, the connection is closed with GOAWAY */
+  class Connection_error : public std::runtime_error {
+    using base = std::runtime_error;
+  public:
+    Connection_error(Error code, const char* what)
+      : base{what}, code_{code}
+    {}
+
+    Error code() const noexcept
+    { return code_; }
+
+  private:
+    Error code_;
+  };
+
+  class Connection;
+
+  /**
+   * @brief      One stream of a HTTP/2 connection, seen as a net::Stream
+   *             for writing the response. Writes are sent as DATA frames,
+   *             as the flow control windows and the priorities allow, and
+   *             close ends the stream. The request has already been read.
+   */
+  class Stream : public net::Stream {
+  public:
+    Stream(Connection& conn, uint32_t id) noexcept
+      : conn_{&conn}, id_{id}
+    {}
+
+    ~Stream();
+
+    uint32_t id() const noexcept
+    { return id_; }
+
+    /** Send the response status line and header as a HEADERS frame */
+    void write_header(const http::Response& res);
+
+    void on_connect(ConnectCallback) override {}
+    void on_read(size_t, ReadCallback) override {}
+    void on_data(DataCallback) override {}
+    size_t next_size() override
+    { return 0; }
+    buffer_t read_next() override
+    { return nullptr; }
+
+    void on_close(CloseCallback cb) override
+    { on_close_ = std::move(cb); }
+
+    void on_write(WriteCallback cb) override
+    { on_write_ = std::move(cb); }
+
+    void write(const void* buf, size_t n) override;
+
+    void write(buffer_t buf) override
+    { write(buf->data(), buf->size()); }
+
+    void write(const std::string& str) override
+    { write(str.data(), str.size()); }
+
+    void close() override;
+
+    void reset_callbacks() override
+    {
+      on_close_.reset();
+      on_write_.reset();
+    }
+
+    net::Socket local() const override;
+    net::Socket remote() const override;
+    std::string to_string() const override;
+
+    bool is_connected() const noexcept override
+    { return conn_ != nullptr and not reset_; }
+
+    bool is_writable() const noexcept override
+    { return is_connected() and not closing_; }
+
+    bool is_readable() const noexcept override
+    { return false; }
+
+    bool is_closing() const noexcept override
+    { return closing_; }
+
+    bool is_closed() const noexcept override
+    { return not is_connected(); }
+
+    int get_cpuid() const noexcept override;
+
+    net::Stream* transport() noexcept override;
+
+  private:
+    Connection*   conn_;
+    uint32_t      id_;
+    bool          closing_ = false;
+    bool          reset_   = false;
+    CloseCallback on_close_;
+    WriteCallback on_write_;
+
+    friend class Connection;
+  };
+
+  /**
+   * @brief      A request and the response to it on one stream, so
+   *             http::Response_writer can write the response as frames.
+   *             Ending it ends the stream, the connection is kept.
+   */
+  class Exchange : public http::Connection {
+  public:
+    explicit Exchange(std::unique_ptr<http2::Stream> stream)
+      : http::Connection(std::move(stream), false)
+    {}
+
+    void write_header(const http::Response& res) override
+    { static_cast<http2::Stream&>(*stream_).write_header(res); }
+  };
+
+  /**
+   * @brief      The server side of a HTTP/2 connection (RFC 7540) over a
+   *             net::Stream, eg. TLS after ALPN chose "h2", or TCP when
+   *             the client starts with the preface (h2c prior knowledge).
+   *
+   *             Frames are parsed as they are received, and the frames
+   *             sent in reply are batched into one write per read. Each
+   *             request is handed over with an Exchange to respond on.
+   *             Responses are interleaved by weight, a stream getting to
+   *             send only when the streams it depends on can not.
+   */
+  class Connection {
+  public:
+    using Request_handler = delegate<void(http::Request_ptr, std::unique_ptr<Exchange>)>;
+
+    struct Limits {
+      /** Concurrent streams allowed the client */
+      uint32_t max_streams     = 100;
+      /** Receive window of each stream */
+      uint32_t stream_window   = DEFAULT_WINDOW;
+      /** Receive window of the connection */
+      uint32_t connection_window = 1 << 20;
+      /** Largest decoded header block */
+      uint32_t max_header_list = 16384;
+      /** Most header fields kept in a request */
+      uint32_t max_fields      = 25;
+      /** Largest request body */
+      size_t   max_body        = 1 << 20;
+      /** Request body data held for all the streams, the window is
+          opened as it arrives, so past this streams are refused */
+      size_t   max_buffered    = 4 << 20;
+    };
+
+    Connection(net::Stream& transport, Request_handler on_request);
+
+    Connection(net::Stream& transport, Request_handler on_request, Limits limits);
+
+    ~Connection();
+
+    /**
+     * @brief      Process data received on the transport, starting
+     *             with the client connection preface
+     */
+    void receive(const uint8_t* data, size_t len);
+
+    /** Send GOAWAY, closing the transport on errors */
+    void goaway(Error code);
+
+    /** Number of open (or half closed) streams */
+    size_t active_streams() const noexcept;
+
+    /** Whether the connection has ended, or the peer is going away */
+    bool closing() const noexcept
+    { return goaway_sent_ or goaway_received_; }
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+  private:
+    struct Stream_state {
+      Stream_state(uint32_t id, int64_t send, int64_t recv) noexcept
+        : id{id}, send_window{send}, recv_window{recv}
+      {}
+
+      uint32_t          id;
+      int64_t           send_window;
+      int64_t           recv_window;
+      uint32_t          recv_unacked = 0;
+      // body data held until the request is handed over
+      size_t            held = 0;
+      bool              remote_closed = false;
+      bool              local_closed  = false;
+      bool              headers_sent  = false;
+      // END_STREAM goes after the pending data
+      bool              end_pending   = false;
+      std::string       pending;
+      size_t            pending_off   = 0;
+      http::Request_ptr request;
+      Stream*           view = nullptr;
+      // priority
+      uint32_t          parent = 0;
+      uint16_t          weight = 16;
+      uint64_t          vtime  = 0;
+
+      size_t pending_bytes() const noexcept
+      { return pending.size() - pending_off; }
+    };
+
+    net::Stream&     transport_;
+    Request_handler  on_request_;
+    Limits           limits_;
+    Hpack_decoder    decoder_;
+    Hpack_encoder    encoder_;
+    std::unordered_map<uint32_t, Stream_state> streams_;
+
+    // receiving
+    size_t           preface_ = 0;
+    bool             settings_seen_ = false;
+    std::string      in_;
+    uint32_t         last_stream_ = 0;
+    uint32_t         headers_stream_ = 0;
+    bool             headers_end_stream_ = false;
+    std::string      header_block_;
+    int64_t          recv_window_;
+    uint32_t         recv_unacked_ = 0;
+    size_t           held_ = 0;
+
+    // sending
+    std::string      out_;
+    bool             receiving_ = false;
+    int64_t          send_window_ = DEFAULT_WINDOW;
+    uint32_t         peer_window_ = DEFAULT_WINDOW;
+    uint32_t         peer_frame_size_ = MIN_FRAME_SIZE;
+    uint64_t         vtime_ = 0;
+    bool             goaway_sent_ = false;
+    bool             goaway_received_ = false;
+    bool             close_pending_ = false;
+    bool             closed_ = false;
+
+    size_t process(const uint8_t* data, size_t len);
+    void   frame(const Frame_header& hdr, const uint8_t* payload);
+    void   on_data(const Frame_header&, const uint8_t*);
+    void   on_headers(const Frame_header&, const uint8_t*);
+    void   on_continuation(const Frame_header&, const uint8_t*);
+    void   on_priority(const Frame_header&, const uint8_t*);
+    void   on_rst_stream(const Frame_header&, const uint8_t*);
+    void   on_settings(const Frame_header&, const uint8_t*);
+    void   on_ping(const Frame_header&, const uint8_t*);
+    void   on_goaway(const Frame_header&, const uint8_t*);
+    void   on_window_update(const Frame_header&, const uint8_t*);
+
+    void   end_headers();
+    http::Request_ptr make_request();
+    void   dispatch(Stream_state&);
+    void   set_priority(uint32_t id, uint32_t parent, uint16_t weight, bool exclusive);
+    bool   depends_on(uint32_t id, uint32_t ancestor) const;
+    bool   ready(const Stream_state&) const noexcept;
+    bool   blocked(const Stream_state&) const;
+
+    Stream_state* find(uint32_t id) noexcept;
+    void   reset(Stream_state&, Error code);
+    void   reset(uint32_t id, Error code);
+    void   terminate(Stream_state&);
+    void   maybe_erase(Stream_state&);
+
+    void   send_frame(Frame_type type, uint8_t flags, uint32_t stream,
+                      const void* payload, size_t len);
+    void   send_settings();
+    void   send_window_update(uint32_t stream, uint32_t increment);
+    void   send_headers(Stream_state&, const http::Response&);
+    void   send_data(Stream_state&, const void* data, size_t len);
+    void   end_stream(Stream_state&);
+    void   detach(Stream_state&);
+    void   schedule();
+    void   flush();
+
+    friend class Stream;
+  };
+
+} //< namespace http2
+
+#endif //< HTTP2_CONNECTION_HPP
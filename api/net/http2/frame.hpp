@@ -0,0 +1,118 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#ifndef HTTP2_FRAME_HPP
+#define HTTP2_FRAME_HPP
+
+#include <cstdint>
+#include "../../util/detail/string_view"
+
+namespace http2 {
+
+  /** Sent by a client first on every connection (RFC 7540 3.5) */
+  static constexpr util::csview PREFACE {"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n", 24};
+
+  enum class Frame_type : uint8_t {
+    DATA          = 0x0,
+    HEADERS       = 0x1,
+    PRIORITY      = 0x2,
+    RST_STREAM    = 0x3,
+    SETTINGS      = 0x4,
+    PUSH_PROMISE  = 0x5,
+    PING          = 0x6,
+    GOAWAY        = 0x7,
+    WINDOW_UPDATE = 0x8,
+    CONTINUATION  = 0x9
+  };
+
+  namespace flag {
+    static constexpr uint8_t END_STREAM  = 0x1;
+    static constexpr uint8_t ACK         = 0x1;
+    static constexpr uint8_t END_HEADERS = 0x4;
+    static constexpr uint8_t PADDED      = 0x8;
+    static constexpr uint8_t PRIORITY    = 0x20;
+  }
+
+  enum class Error : uint32_t {
+    NO_ERROR            = 0x0,
+    PROTOCOL_ERROR      = 0x1,
+    INTERNAL_ERROR      = 0x2,
+    FLOW_CONTROL_ERROR  = 0x3,
+    SETTINGS_TIMEOUT    = 0x4,
+    STREAM_CLOSED       = 0x5,
+    FRAME_SIZE_ERROR    = 0x6,
+    REFUSED_STREAM      = 0x7,
+    CANCEL              = 0x8,
+    COMPRESSION_ERROR   = 0x9,
+    CONNECT_ERROR       = 0xa,
+    ENHANCE_YOUR_CALM   = 0xb,
+    INADEQUATE_SECURITY = 0xc,
+    HTTP_1_1_REQUIRED   = 0xd
+  };
+
+  enum Setting : uint16_t {
+    HEADER_TABLE_SIZE      = 0x1,
+    ENABLE_PUSH            = 0x2,
+    MAX_CONCURRENT_STREAMS = 0x3,
+    INITIAL_WINDOW_SIZE    = 0x4,
+    MAX_FRAME_SIZE         = 0x5,
+    MAX_HEADER_LIST_SIZE   = 0x6
+  };
+
+  static constexpr uint32_t DEFAULT_WINDOW     = 65535;
+  static constexpr uint32_t MAX_WINDOW         = 0x7fffffff;
+  static constexpr uint32_t MIN_FRAME_SIZE     = 16384;
+  static constexpr uint32_t MAX_FRAME_SIZE_LIMIT = 0xffffff;
+
+  /** The 9 byte header in front of every frame */
+  struct Frame_header {
+    static constexpr size_t SIZE = 9;
+
+    uint32_t   length;
+    Frame_type type;
+    uint8_t    flags;
+    uint32_t   stream;
+
+    static Frame_header read(const uint8_t* p) noexcept
+    {
+      return {
+        uint32_t(p[0]) << 16 | uint32_t(p[1]) << 8 | p[2],
+        Frame_type(p[3]),
+        p[4],
+        (uint32_t(p[5]) << 24 | uint32_t(p[6]) << 16 | uint32_t(p[7]) << 8 | p[8]) & MAX_WINDOW
+      };
+    }
+
+    void write(uint8_t* p) const noexcept
+    {
+      p[0] = length >> 16; p[1] = length >> 8; p[2] = length;
+      p[3] = uint8_t(type);
+      p[4] = flags;
+      p[5] = stream >> 24; p[6] = stream >> 16; p[7] = stream >> 8; p[8] = stream;
+    }
+
+    bool has(uint8_t f) const noexcept
+    { return flags & f; }
+  };
+
+  inline uint32_t read_u32(const uint8_t* p) noexcept
+  { return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3]; }
+
+} //< namespace http2
+
+#endif //< HTTP2_FRAME_HPP
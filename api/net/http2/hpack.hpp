@@ -0,0 +1,184 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#ifndef HTTP2_HPACK_HPP
+#define HTTP2_HPACK_HPP
+
+#include <cstdint>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <delegate>
+
+#include "../../util/detail/string_view"
+
+namespace http2 {
+
+  /** A header block could not be decoded, a connection error (COMPRESSION_ERROR) */
+  class Hpack_error : public std::runtime_error {
+    using base = std::runtime_error;
+  public:
+    using base::base;
+  };
+
+  /**
+   * @brief      Header compression for HTTP/2 (RFC 7541)
+   */
+  namespace hpack {
+
+    static constexpr size_t DEFAULT_TABLE_SIZE = 4096;
+    /** Entries in the static table, the dynamic table starts after them */
+    static constexpr size_t STATIC_ENTRIES = 61;
+
+    /** Append an integer with a @prefix bits prefix, @first holds the bits above it */
+    void encode_int(std::string& out, int prefix, uint8_t first, uint32_t value);
+
+    /** Decode an integer with a @prefix bits prefix, advancing @p */
+    uint32_t decode_int(const uint8_t*& p, const uint8_t* end, int prefix);
+
+    /** Size of @str when Huffman coded */
+    size_t huffman_size(util::csview str) noexcept;
+
+    /** Append the Huffman code of @str */
+    void huffman_encode(util::csview str, std::string& out);
+
+    /** Append the decoded Huffman string of @len bytes */
+    void huffman_decode(const uint8_t* data, size_t len, std::string& out);
+
+    /**
+     * @brief      The dynamic table, newest entry first
+     */
+    class Table {
+    public:
+      struct Entry {
+        std::string name;
+        std::string value;
+      };
+      // the size of an entry is counted with this overhead
+      static constexpr size_t ENTRY_OVERHEAD = 32;
+
+      explicit Table(size_t max_size = DEFAULT_TABLE_SIZE) noexcept
+        : max_size_{max_size}
+      {}
+
+      /** Insert at the front, evicting old entries to make room */
+      void add(util::csview name, util::csview value);
+
+      /** Change the maximum size, evicting what no longer fits */
+      void resize(size_t max_size);
+
+      /** Entry @i, 0 is the newest */
+      const Entry& operator[](size_t i) const noexcept
+      { return entries_[i]; }
+
+      size_t count() const noexcept
+      { return entries_.size(); }
+
+      size_t size() const noexcept
+      { return size_; }
+
+      size_t max_size() const noexcept
+      { return max_size_; }
+
+    private:
+      std::deque<Entry> entries_;
+      size_t size_ = 0;
+      size_t max_size_;
+
+      void evict(size_t room);
+    };
+
+  } //< namespace hpack
+
+  /**
+   * @brief      Decodes header blocks received from the peer
+   */
+  class Hpack_decoder {
+  public:
+    using Field_handler = delegate<void(util::csview name, util::csview value)>;
+
+    /**
+     * @param[in]  max_table  The table size we announced in SETTINGS_HEADER_TABLE_SIZE
+     * @param[in]  max_list   The limit on the decoded size of a header block
+     */
+    explicit Hpack_decoder(size_t max_table = hpack::DEFAULT_TABLE_SIZE,
+                           size_t max_list = 16384) noexcept
+      : table_{max_table}, max_table_{max_table}, max_list_{max_list}
+    {}
+
+    /**
+     * @brief      Decode a complete header block (HEADERS with CONTINUATION),
+     *             calling @on_field for each field in order.
+     *
+     * @throws     Hpack_error when the block is malformed or too large
+     */
+    void decode(const uint8_t* data, size_t len, Field_handler on_field);
+
+    const hpack::Table& table() const noexcept
+    { return table_; }
+
+  private:
+    hpack::Table table_;
+    size_t       max_table_;
+    size_t       max_list_;
+    std::string  name_;
+    std::string  value_;
+
+    void read_string(const uint8_t*& p, const uint8_t* end, std::string& out);
+    std::pair<util::sview, util::sview> entry(uint32_t index) const;
+  };
+
+  /**
+   * @brief      Encodes header blocks to send to the peer. Names are
+   *             lowercased, and strings are Huffman coded when shorter.
+   */
+  class Hpack_encoder {
+  public:
+    explicit Hpack_encoder(size_t max_table = hpack::DEFAULT_TABLE_SIZE) noexcept
+      : table_{max_table}
+    {}
+
+    /**
+     * @brief      The peer's SETTINGS_HEADER_TABLE_SIZE. The table is kept
+     *             to at most the default size, and the change is signalled
+     *             at the start of the next block.
+     */
+    void set_max_table_size(size_t size);
+
+    /** Start a header block */
+    void begin(std::string& out);
+
+    /** Append a field. Sensitive fields are never indexed. */
+    void encode(std::string& out, util::csview name, util::csview value);
+
+    const hpack::Table& table() const noexcept
+    { return table_; }
+
+  private:
+    hpack::Table table_;
+    bool         size_update_ = false;
+    size_t       min_size_ = 0;
+    std::string  lower_;
+
+    void write_string(std::string& out, util::csview str);
+  };
+
+} //< namespace http2
+
+#endif //< HTTP2_HPACK_HPP
@@ -241,6 +241,36 @@ namespace net {
       return ip_packet;
     }
 
+    /**
+     * Provision an IP packet with room for a segmentation
+     * offload super-segment, see hw::Nic::gso_max_size
+     */
+    IP4::IP_packet_ptr create_gso_ip_packet(Protocol proto) {
+      auto raw = nic_.create_gso_packet(nic_.frame_offset_link());
+      auto ip_packet = static_unique_ptr_cast<IP4::IP_packet>(std::move(raw));
+
+      ip_packet->init(proto);
+
+      return ip_packet;
+    }
+
+    IP6::IP_packet_ptr create_gso_ip6_packet(Protocol proto) {
+      auto raw = nic_.create_gso_packet(nic_.frame_offset_link());
+      auto ip_packet = static_unique_ptr_cast<IP6::IP_packet>(std::move(raw));
+
+      ip_packet->init(proto);
+
+      return ip_packet;
+    }
+
+    /** Whether the Nic performs all of the given offload features */
+    bool nic_offload(uint32_t features) const noexcept
+    { return nic_.has_offload(features); }
+
+    /** Largest IP packet the Nic takes for segmentation offload */
+    uint32_t nic_gso_max_size() const noexcept
+    { return nic_.gso_max_size(); }
+
     IP_packet_factory ip_packet_factory()
     { return IP_packet_factory{this, &Inet::create_ip_packet}; }
 
@@ -105,6 +105,12 @@ namespace net {
     /** Upstream: Input from link layer */
     void receive(Packet_ptr, const bool link_bcast);
 
+    /**
+     * Upstream: A burst of unicast packets from the link layer, as a chain.
+     * TCP and UDP go on as bursts when their burst handlers are set.
+     */
+    void receive_burst(Packet_ptr chain);
+
 
     //
     // Delegate setters
@@ -122,6 +128,14 @@ namespace net {
     void set_tcp_handler(upstream s)
     { tcp_handler_ = s; }
 
+    /** Set UDP protocol handler for bursts of packets (upstream) */
+    void set_udp_burst_handler(upstream s)
+    { udp_burst_handler_ = s; }
+
+    /** Set TCP protocol handler for bursts of packets (upstream) */
+    void set_tcp_burst_handler(upstream s)
+    { tcp_burst_handler_ = s; }
+
     /** Set packet dropped handler */
     void set_drop_handler(drop_handler s)
     { drop_handler_ = s; }
@@ -494,6 +508,8 @@ namespace net {
     upstream icmp_handler_ = nullptr;
     upstream udp_handler_  = nullptr;
     upstream tcp_handler_  = nullptr;
+    upstream udp_burst_handler_ = nullptr;
+    upstream tcp_burst_handler_ = nullptr;
 
     /** Packet forwarding  */
     Forward_delg forward_packet_;
@@ -514,6 +530,15 @@ namespace net {
     /** Drop a packet, calling drop handler if set */
     IP_packet_ptr drop(IP_packet_ptr ptr, Direction direction, Drop_reason reason);
 
+    /**
+     * Validation, prerouting, forwarding, reassembly and the input chain.
+     * Returns the packet if it is to be passed on to a protocol handler.
+     */
+    IP_packet_ptr ingress(Packet_ptr pckt);
+
+    /** Pass a packet to its protocol handler */
+    void dispatch(IP_packet_ptr packet);
+
   }; //< class IP4
 
 } //< namespace net
@@ -96,11 +96,11 @@ namespace net {
     const ip4::Addr& ip_dst() const noexcept
     { return ip_header().daddr; }
 
-    /** Get IP data length. */
+    /** Get IP data length, including any external payload. */
     uint16_t ip_data_length() const noexcept
     {
       //Expects(size() and static_cast<size_t>(size()) >= sizeof(ip4::Header));
-      return size() - ip_header_length();
+      return size() + ext_length() - ip_header_length();
     }
 
     /** Adjust packet size to match IP header's tot_len in case of padding */
@@ -172,6 +172,10 @@ namespace net {
       ip_header().frag_off_flags |= htons(offs) >> 3;
     }
 
+    /** Clear the fragment offset and MF flag, keeping DF (eg. after reassembly) */
+    void clear_ip_fragment() noexcept
+    { ip_header().frag_off_flags &= htons(0x4000); }
+
     /** Set total length header field */
     void set_ip_ttl(uint8_t ttl) noexcept
     { ip_header().ttl = ttl; }
@@ -238,12 +242,13 @@ namespace net {
       increment_data_end(sizeof(ip4::Header));
     }
 
+    // the data in the buffer
     Span ip_data() {
-      return {ip_data_ptr(), ip_data_length()};
+      return {ip_data_ptr(), size() - ip_header_length()};
     }
 
     Cspan ip_data() const {
-      return {ip_data_ptr(), ip_data_length()};
+      return {ip_data_ptr(), size() - ip_header_length()};
     }
 
     bool validate_length() const noexcept {
@@ -270,7 +275,7 @@ namespace net {
      *  Inferred from packet size
      */
     void set_segment_length() noexcept
-    { ip_header().tot_len = htons(size()); }
+    { ip_header().tot_len = htons(size() + ext_length()); }
 
     const ip4::Header& ip_header() const noexcept
     { return *reinterpret_cast<const ip4::Header*>(layer_begin()); }
@@ -0,0 +1,161 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#ifndef NET_IP4_REASSEMBLY_HPP
+#define NET_IP4_REASSEMBLY_HPP
+
+#include <net/ip4/packet_ip4.hpp>
+#include <net/flow_table.hpp>
+#include <deque>
+#include <vector>
+
+namespace net {
+namespace ip4 {
+
+  /**
+   * @brief      IPv4 fragment reassembly.
+   *             Datagrams are found by (src, dst, id, protocol) in a hash
+   *             table with a fixed number of entries. The fragments of a
+   *             datagram are kept, unmodified, as a packet chain sorted by
+   *             offset, and the missing parts are tracked with a hole list
+   *             (RFC 815). The data is copied once, when the last hole is
+   *             filled: into the buffer of the first fragment when there is
+   *             room, otherwise into a buffer of the exact datagram size.
+   *
+   *             The buffers held by all datagrams are limited, and the
+   *             oldest datagrams are evicted to make room for new ones.
+   *             Overlapping fragments drop the whole datagram.
+   */
+  class Reassembly {
+  public:
+    using Packet_ptr  = std::unique_ptr<PacketIP4>;
+    using timestamp_t = uint64_t; //< seconds
+
+    /** Largest IP data length of a datagram */
+    static constexpr uint32_t MAX_DATAGRAM = 65535 - 20;
+    /** Smallest fragment, other than the last one */
+    static constexpr uint32_t MIN_FRAGMENT = 400;
+
+    struct Config {
+      /** Datagrams being reassembled at the same time */
+      uint32_t max_datagrams = 64;
+      /** Packet buffer bytes held by all datagrams */
+      uint32_t max_bytes     = 1024 * 1024;
+      /** Seconds before an incomplete datagram is dropped */
+      uint32_t timeout       = 15;
+    };
+
+    struct Stats {
+      uint64_t reassembled = 0;
+      uint64_t timed_out   = 0;
+      uint64_t evicted     = 0;
+      uint64_t overlapped  = 0;
+      uint64_t dropped     = 0;  //< invalid or unwanted fragments
+    };
+
+    Reassembly() : Reassembly(Config{}) {}
+    explicit Reassembly(Config config);
+
+    /**
+     * @brief      Add a fragment received at @now
+     *
+     * @return     The reassembled datagram, when @frag completes it
+     */
+    Packet_ptr process(Packet_ptr frag, timestamp_t now);
+
+    /** Drop the datagrams that have waited for longer than the timeout */
+    void expire(timestamp_t now);
+
+    /** Number of incomplete datagrams */
+    size_t size() const noexcept
+    { return table_.size(); }
+
+    /** Packet buffer bytes held */
+    size_t bytes() const noexcept
+    { return bytes_; }
+
+    const Stats& stats() const noexcept
+    { return stats_; }
+
+  private:
+    struct Key {
+      uint32_t src;
+      uint32_t dst;
+      uint16_t id;
+      uint8_t  proto;
+
+      bool operator==(const Key& other) const noexcept
+      { return src == other.src and dst == other.dst
+           and id == other.id and proto == other.proto; }
+    };
+
+    struct Key_hash {
+      size_t operator()(const Key& k) const noexcept
+      {
+        uint64_t h = ((uint64_t) k.src << 32 | k.dst) * 0x9E3779B97F4A7C15ull;
+        h ^= ((uint64_t) k.id << 8 | k.proto) + (h >> 29);
+        h *= 0xBF58476D1CE4E5B9ull;
+        return h ^ (h >> 32);
+      }
+    };
+
+    // a range of missing data bytes, inclusive
+    struct Hole {
+      uint32_t first;
+      uint32_t last;
+    };
+    static constexpr uint32_t OPEN_END = 0xffffffff;
+
+    struct Datagram {
+      Packet_ptr  frags;  //< sorted by offset
+      std::vector<Hole> holes {{0, OPEN_END}};
+      uint32_t    end   = 0;  //< one past the last data byte received
+      uint32_t    bytes = 0;  //< buffer bytes held
+      bool        last_seen = false;
+      uint32_t    serial;
+      timestamp_t created;
+    };
+
+    // creation order, for expiry and eviction, with entries left behind
+    // by completed datagrams skipped over
+    struct Age {
+      Key      key;
+      uint32_t serial;
+    };
+
+    Config config_;
+    Flow_table<Key, Datagram, Key_hash> table_;
+    std::deque<Age> ages_;
+    uint32_t serial_ = 0;
+    size_t   bytes_  = 0;
+    Stats    stats_;
+
+    enum class Fill { ADDED, DUPLICATE, OVERLAP };
+    static Fill fill_holes(Datagram&, uint32_t first, uint32_t last, bool more);
+    static void insert(Datagram&, Packet_ptr frag);
+    static Packet_ptr assemble(Datagram&);
+
+    bool evict_oldest(const Key* keep);
+    void drop(const Key&);
+    void compact_ages();
+  };
+
+} // < namespace ip4
+} // < namespace net
+
+#endif
@@ -101,7 +101,7 @@ namespace net
     uint16_t ip_data_length() const noexcept
     {
       Expects(size() and static_cast<size_t>(size()) >= sizeof(ip6::Header));
-      return size() - sizeof(ip6::Header);
+      return size() + ext_length() - sizeof(ip6::Header);
     }
 
     /** Get total data capacity of IP packet in bytes  */
@@ -177,12 +177,13 @@ namespace net
 
     void calculate_payload_offset();
 
+    // the data in the buffer
     Span ip_data() {
-      return {ip_data_ptr(), ip_data_length()};
+      return {ip_data_ptr(), size() - (int) sizeof(ip6::Header)};
     }
 
     Cspan ip_data() const {
-      return {ip_data_ptr(), ip_data_length()};
+      return {ip_data_ptr(), size() - (int) sizeof(ip6::Header)};
     }
 
     const uint8_t* ext_hdr_start() const
@@ -192,7 +193,7 @@ namespace net
      *  Set IP6 payload length
      */
     void set_segment_length() noexcept
-    { ip6_header().payload_length = htons(size() - sizeof(ip6::Header)); }
+    { ip6_header().payload_length = htons(size() + ext_length() - sizeof(ip6::Header)); }
 
   protected:
 
@@ -62,6 +62,9 @@ public:
   void set_vlan_upstream(upstream handler) override
   { link_.set_vlan_upstream(handler); }
 
+  void set_ip4_burst_upstream(upstream handler) override
+  { link_.set_ip4_burst_upstream(handler); }
+
   /** Number of bytes in a frame needed by the linklayer **/
   size_t frame_offset_link() const noexcept override
   { return Protocol::header_size(); }
@@ -79,17 +82,47 @@ public:
   uint64_t get_packets_dropped() override
   { return link_.get_packets_dropped(); }
 
+  /** Transmitted packets are captured between the link and the driver */
+  void set_capture(net::Capture* cap) override
+  {
+    if (cap != nullptr and hw::Nic::capture() == nullptr) {
+      phys_down_ = link_.physical_downstream();
+      link_.set_physical_downstream({this, &Link_layer::transmit_captured});
+    }
+    else if (cap == nullptr and hw::Nic::capture() != nullptr) {
+      link_.set_physical_downstream(phys_down_);
+      phys_down_.reset();
+    }
+    hw::Nic::set_capture(cap);
+  }
 
 protected:
   /** Called by the underlying physical driver inheriting the Link_layer */
   void receive(net::Packet_ptr pkt)
   {
     set_last_packet(pkt.get());
+    hw::Nic::capture_rx(pkt.get());
     link_.receive(std::move(pkt));
   }
 
+  /** Called by drivers receiving a burst of packets, as a packet chain */
+  void receive_burst(net::Packet_ptr chain)
+  {
+    set_last_packet(chain.get());
+    hw::Nic::capture_rx(chain.get());
+    link_.receive_burst(std::move(chain));
+  }
+
 private:
   Protocol link_;
+  // the driver's downstream, while transmitting through the capture
+  net::downstream phys_down_;
+
+  void transmit_captured(net::Packet_ptr pkt)
+  {
+    hw::Nic::capture_tx(pkt.get());
+    phys_down_(std::move(pkt));
+  }
 };
 
 template <class Protocol>
@@ -0,0 +1,209 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#ifndef NET_LPM_HPP
+#define NET_LPM_HPP
+
+#include <net/ip4/addr.hpp>
+#include <net/ip6/addr.hpp>
+#include <common>
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace net {
+
+  /**
+   * @brief      Longest prefix match over IPv4 routes (DIR-24-8).
+   *             The first 24 bits of an address index a table of 2^24
+   *             entries, which holds either a route or a group of 256
+   *             entries for the last 8 bits, so a lookup is at most two
+   *             memory accesses. Small tables, where the 64 MB table is
+   *             not worth it, are searched longest prefix first instead.
+   */
+  class Lpm4 {
+  public:
+    static constexpr int NONE = -1;
+    /** Tables up to this size are searched, not compiled */
+    static constexpr size_t SMALL_TABLE = 64;
+
+    /** A prefix with a negative length never matches */
+    struct Prefix {
+      ip4::Addr net;
+      int       len;
+    };
+
+    static int prefix_length(ip4::Addr netmask) noexcept
+    { return __builtin_popcount(netmask.whole); }
+
+    /**
+     * @brief      Rebuild from a list of prefixes. A lookup returns the
+     *             index of the longest matching prefix, the first one
+     *             when there are equal prefixes.
+     */
+    void build(const std::vector<Prefix>& prefixes);
+
+    /** Index of the longest prefix matching @dst, or NONE */
+    int lookup(ip4::Addr dst) const noexcept
+    {
+      const uint32_t addr = ntohl(dst.whole);
+      if (LIKELY(not tbl24_.empty()))
+      {
+        uint32_t entry = tbl24_[addr >> 8];
+        if (UNLIKELY(entry & TBL8))
+          entry = tbl8_[((entry & ~TBL8) << 8) | (addr & 0xff)];
+        return (int) entry - 1;
+      }
+      for (const auto& pfx : small_)
+        if ((addr & pfx.mask) == pfx.net) return pfx.index;
+      return NONE;
+    }
+
+    /** Whether the DIR-24-8 table is in use */
+    bool compiled() const noexcept
+    { return not tbl24_.empty(); }
+
+    /** Number of 256 entry groups for prefixes longer than 24 bits */
+    size_t tbl8_groups() const noexcept
+    { return tbl8_.size() / 256; }
+
+  private:
+    // entries are the route index + 1, 0 for no route, or a tbl8 group
+    static constexpr uint32_t TBL8 = 0x80000000;
+    std::vector<uint32_t> tbl24_;
+    std::vector<uint32_t> tbl8_;
+
+    struct Small {
+      uint32_t net;
+      uint32_t mask;
+      int      index;
+    };
+    std::vector<Small> small_;
+  };
+
+  /**
+   * @brief      Longest prefix match over IPv6 routes, as a multibit trie
+   *             with a stride of 8 bits. Prefixes are expanded to the
+   *             stride, so a lookup is at most one memory access per byte.
+   */
+  class Lpm6 {
+  public:
+    static constexpr int NONE = -1;
+
+    /** A prefix with a negative length never matches */
+    struct Prefix {
+      ip6::Addr net;
+      int       len;
+    };
+
+    static int prefix_length(uint8_t netmask) noexcept
+    { return std::min<int>(netmask, 128); }
+
+    /** Rebuild from a list of prefixes, see Lpm4::build */
+    void build(const std::vector<Prefix>& prefixes);
+
+    /** Index of the longest prefix matching @dst, or NONE */
+    int lookup(const ip6::Addr& dst) const noexcept
+    {
+      int best = default_;
+      int node = nodes_.empty() ? NONE : 0;
+      for (int depth = 0; depth < 16 and node != NONE; depth++)
+      {
+        const auto& slot = nodes_[node][dst.i8[depth]];
+        if (slot.route != NONE) best = slot.route;
+        node = slot.child;
+      }
+      return best;
+    }
+
+    size_t nodes() const noexcept
+    { return nodes_.size(); }
+
+  private:
+    struct Slot {
+      int32_t route = NONE;
+      int32_t child = NONE;
+    };
+    using Node = std::array<Slot, 256>;
+    std::vector<Node> nodes_;
+    int default_ = NONE;
+  };
+
+  /**
+   * @brief      Direct mapped cache of route lookups per destination,
+   *             invalidated as a whole when the routes change.
+   */
+  template <typename Addr, int BITS = 10>
+  class Route_cache {
+  public:
+    /** The cached route index for @dst, looked up with @lookup on a miss */
+    template <typename Lookup>
+    int get(const Addr& dst, Lookup&& lookup)
+    {
+      auto& line = lines_[hash(dst) & (SIZE-1)];
+      if (LIKELY(line.gen == gen_ and line.dst == dst)) {
+        hits_++;
+        return line.route;
+      }
+      misses_++;
+      line.dst   = dst;
+      line.route = lookup(dst);
+      line.gen   = gen_;
+      return line.route;
+    }
+
+    void invalidate() noexcept
+    {
+      if (UNLIKELY(++gen_ == 0)) {
+        lines_.fill({});
+        gen_ = 1;
+      }
+    }
+
+    uint64_t hits() const noexcept
+    { return hits_; }
+
+    uint64_t misses() const noexcept
+    { return misses_; }
+
+  private:
+    static constexpr size_t SIZE = 1 << BITS;
+    struct Line {
+      Addr     dst{};
+      int32_t  route = -1;
+      uint32_t gen = 0;
+    };
+    std::array<Line, SIZE> lines_{};
+    uint32_t gen_ = 1;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+
+    static uint32_t hash(const ip4::Addr& addr) noexcept
+    { return (addr.whole * 0x9E3779B1u) >> (32 - BITS); }
+
+    static uint32_t hash(const ip6::Addr& addr) noexcept
+    {
+      const uint64_t h = (addr.i64[0] ^ (addr.i64[1] * 0x9E3779B97F4A7C15ull))
+                       * 0x9E3779B97F4A7C15ull;
+      return h >> (64 - BITS);
+    }
+  };
+
+} //< namespace net
+
+#endif
@@ -21,6 +21,9 @@
 
 #include <delegate>
 #include <list>
+#include <optional>
+#include <unordered_map>
+#include <vector>
 #include "conntrack.hpp"
 
 namespace net {
@@ -64,6 +67,212 @@ struct Filter_verdict
   { return std::move(packet); }
 };
 
+/**
+ * @brief      A rule matching on the 5-tuple of a packet.
+ *             Unset fields match anything. Ports are only known for
+ *             TCP and UDP, and are 0 for every other packet.
+ *
+ * @tparam     Addr  IP address type
+ */
+template <typename Addr>
+struct Filter_rule
+{
+  struct Port_range {
+    uint16_t first = 0;
+    uint16_t last  = 0xffff;
+  };
+
+  Addr                    src{};
+  int                     src_len = 0;
+  Addr                    dst{};
+  int                     dst_len = 0;
+  std::optional<Protocol> proto;
+  Port_range              sport;
+  Port_range              dport;
+  Filter_verdict_type     verdict = Filter_verdict_type::DROP;
+};
+
+/**
+ * @brief      An ordered list of filter rules, compiled for classification
+ *             by tuple space search. The rules are grouped by the prefix
+ *             lengths they match with (port ranges are split into
+ *             prefixes), and each group is a hash table, so a packet costs
+ *             one lookup per group instead of one call per rule.
+ *             The first matching rule decides. Verdicts are cached in the
+ *             conntrack entry of the packet, per direction.
+ *
+ * @tparam     Addr  IP address type
+ */
+template <typename Addr>
+class Filter_rules
+{
+public:
+  using Rule = Filter_rule<Addr>;
+
+  /** The 5-tuple of a packet */
+  struct Key {
+    Addr     src{};
+    Addr     dst{};
+    uint16_t sport = 0;
+    uint16_t dport = 0;
+    uint8_t  proto = 0;
+
+    bool operator==(const Key& other) const noexcept
+    {
+      return sport == other.sport and dport == other.dport
+        and proto == other.proto and src == other.src and dst == other.dst;
+    }
+  };
+
+  /** Verdict when no rule matches */
+  Filter_verdict_type policy = Filter_verdict_type::ACCEPT;
+
+  /** Append a rule, the rules are compiled before the next packet */
+  void push_back(Rule rule)
+  {
+    rules_.push_back(std::move(rule));
+    dirty_ = true;
+  }
+
+  /** Replace all rules and compile them */
+  void assign(std::vector<Rule> rules)
+  {
+    rules_ = std::move(rules);
+    compile();
+  }
+
+  void clear()
+  { assign({}); }
+
+  const std::vector<Rule>& rules() const noexcept
+  { return rules_; }
+
+  bool empty() const noexcept
+  { return rules_.empty(); }
+
+  size_t size() const noexcept
+  { return rules_.size(); }
+
+  /** Number of hash tables a packet may be looked up in */
+  size_t tuples() const noexcept
+  { return tuples_.size(); }
+
+  /** Build the classifier from the rules */
+  void compile();
+
+  /** The verdict for a 5-tuple, the rules must be compiled */
+  Filter_verdict_type classify(const Key& key) const noexcept;
+
+  /**
+   * @brief      The verdict for a packet, from the conntrack entry when
+   *             the connection has already been classified.
+   */
+  template <typename IP_packet>
+  Filter_verdict_type operator()(const IP_packet& pkt, Conntrack::Entry_ptr ct)
+  {
+    if (UNLIKELY(dirty_)) compile();
+    const Key key = key_of(pkt);
+    // fragments are not cached, later ones have no ports to match with
+    if (ct == nullptr or not has_ports(pkt))
+      return classify(key);
+
+    const uint32_t tag = (tag_ << 1) | is_reply(key, *ct);
+    auto& cached = ct->verdicts[(tag * 0x9E3779B1u) >> 30];
+    if (LIKELY(cached.tag == tag))
+      return static_cast<Filter_verdict_type>(cached.verdict);
+
+    const auto verdict = classify(key);
+    cached.tag     = tag;
+    cached.verdict = static_cast<uint8_t>(verdict);
+    return verdict;
+  }
+
+  template <typename IP_packet>
+  static Key key_of(const IP_packet& pkt) noexcept
+  {
+    Key key{pkt.ip_src(), pkt.ip_dst(), 0, 0,
+            static_cast<uint8_t>(pkt.ip_protocol())};
+    const auto proto = pkt.ip_protocol();
+    if (carries_ports(proto) and first_fragment(pkt)
+        and pkt.ip_data().size() >= 4)
+    {
+      const auto* ports = reinterpret_cast<const uint16_t*>(pkt.ip_data().data());
+      key.sport = ntohs(ports[0]);
+      key.dport = ntohs(ports[1]);
+    }
+    return key;
+  }
+
+private:
+  struct Key_hasher {
+    size_t operator()(const Key& key) const noexcept;
+  };
+  // the prefix lengths of a group of rules
+  struct Tuple {
+    int src_len;
+    int dst_len;
+    int sport_len;
+    int dport_len;
+    bool proto;
+
+    bool operator==(const Tuple& other) const noexcept
+    {
+      return src_len == other.src_len and dst_len == other.dst_len
+        and sport_len == other.sport_len and dport_len == other.dport_len
+        and proto == other.proto;
+    }
+  };
+  struct Group {
+    Tuple tuple;
+    // the first rule in the group, no match in it can be better
+    int   first;
+    std::unordered_map<Key, int, Key_hasher> table;
+  };
+
+  std::vector<Rule>  rules_;
+  std::vector<Group> tuples_;
+  // identifies the compiled rules in the conntrack entries, 0 is never used
+  uint32_t tag_ = 0;
+  bool dirty_ = true;
+
+  static Key mask(const Key& key, const Tuple& tuple) noexcept;
+
+  static bool first_fragment(const PacketIP4& pkt) noexcept
+  { return pkt.ip_frag_offs() == 0; }
+
+  static bool first_fragment(const PacketIP6&) noexcept
+  { return true; }
+
+  static bool fragment(const PacketIP4& pkt) noexcept
+  {
+    return pkt.ip_frag_offs() != 0
+        or (static_cast<uint8_t>(pkt.ip_flags()) & static_cast<uint8_t>(ip4::Flags::MF));
+  }
+
+  static bool fragment(const PacketIP6&) noexcept
+  { return false; }
+
+  static bool carries_ports(Protocol proto) noexcept
+  { return proto == Protocol::TCP or proto == Protocol::UDP; }
+
+  /** Whether the key of a packet has all of its 5-tuple */
+  template <typename IP_packet>
+  static bool has_ports(const IP_packet& pkt) noexcept
+  {
+    if (fragment(pkt)) return false;
+    return not carries_ports(pkt.ip_protocol()) or pkt.ip_data().size() >= 4;
+  }
+
+  static bool is_reply(const Key& key, const Conntrack::Entry& ct) noexcept
+  {
+    const bool ports = key.proto == static_cast<uint8_t>(Protocol::TCP)
+                    or key.proto == static_cast<uint8_t>(Protocol::UDP);
+    return not (ct.first.src.address() == net::Addr{key.src}
+            and ct.first.dst.address() == net::Addr{key.dst}
+            and (not ports or ct.first.src.port() == key.sport));
+  }
+};
+
 class Inet;
 
 template <typename IPV>
@@ -80,6 +289,8 @@ struct Filter_chain
 {
   using IP_packet_ptr = typename IPV::IP_packet_ptr;
 
+  /** Rules matched before the filters, dropping or letting through */
+  Filter_rules<typename IPV::addr> rules;
   std::list<Packetfilter<IPV>> chain;
   const char* name;
 
@@ -88,6 +299,10 @@ struct Filter_chain
    */
   Filter_verdict<IPV> operator()(IP_packet_ptr pckt, Inet& stack, Conntrack::Entry_ptr ct)
   {
+    if (not rules.empty() and rules(*pckt, ct) == Filter_verdict_type::DROP) {
+      debug("Packet dropped in %s chain by rule\n", name);
+      return {};
+    }
     Filter_verdict<IPV> verdict{std::move(pckt), Filter_verdict_type::ACCEPT};
     int i = 0;
     for (auto& filter : chain) {
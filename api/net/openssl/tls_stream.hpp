@@ -3,6 +3,7 @@
 #include <openssl/pem.h>
 #include <openssl/ssl.h>
 #include <net/stream_buffer.hpp>
+#include <deque>
 
 //#define VERBOSE_OPENSSL 0
 #ifdef VERBOSE_OPENSSL
@@ -17,13 +18,19 @@ namespace openssl
   {
     using Stream_ptr = net::Stream_ptr;
 
+    /** Plaintext read per buffer, one whole record */
+    static constexpr size_t READ_BUFFER_SIZE = 16384;
+
     TLS_stream(SSL_CTX* ctx, Stream_ptr, bool outgoing = false);
-    TLS_stream(Stream_ptr, SSL* ctx, BIO*, BIO*);
+    /** Take over an SSL session, which gets the stream BIO */
+    TLS_stream(Stream_ptr, SSL* ssl);
     virtual ~TLS_stream();
 
     void write(buffer_t buffer) override;
     void write(const std::string&) override;
     void write(const void* buf, size_t n) override;
+    /** Encrypts all buffers, and writes the records in one transport write */
+    void writev(const buffer_t* bufs, size_t count) override;
     void close() override;
 
     net::Socket local() const override {
@@ -65,9 +72,10 @@ namespace openssl
 
   private:
     void handle_data();
-    int  decrypt(const void *data,int size);
+    void attach_bio();
+    int  encrypt(const void* data, size_t len);
     int  send_decrypted();
-    bool tls_read(buffer_t);
+    bool tls_read();
     int  tls_perform_stream_write();
     int  tls_perform_handshake();
     bool handshake_completed() const noexcept;
@@ -79,10 +87,25 @@ namespace openssl
       STATUS_FAIL
     };
     status_t status(int n) const noexcept;
+    /*
+      OpenSSL reads and writes records through a BIO on the stream itself.
+      Received buffers are read from where they are, and the records
+      produced by one SSL call are gathered into one transport write.
+    */
+    static BIO_METHOD* bio_method();
+    static int  bio_read(BIO*, char* out, int len);
+    static int  bio_write(BIO*, const char* in, int len);
+    static long bio_ctrl(BIO*, int cmd, long num, void* ptr);
+
     Stream_ptr m_transport = nullptr;
     SSL*  m_ssl    = nullptr;
-    BIO*  m_bio_rd = nullptr;
-    BIO*  m_bio_wr = nullptr;
+    // received buffers not yet read by OpenSSL, and the offset in the first
+    std::deque<buffer_t> m_readq;
+    size_t   m_read_ofs = 0;
+    // a read buffer which got no data, used again next time
+    buffer_t m_read_buf = nullptr;
+    // records waiting to be written to the transport
+    buffer_t m_write_buf = nullptr;
     bool  m_busy = false;
     bool  m_deferred_close = false;
   };
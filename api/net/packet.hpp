@@ -23,6 +23,8 @@
 #include <gsl/gsl_assert>
 #include <delegate>
 #include <cassert>
+#include <cstring>
+#include <memory>
 
 namespace net
 {
@@ -131,6 +133,103 @@ namespace net
       data_end_ += i;
     }
 
+    /** Checksum state of the L4 payload, for NICs with checksum offload */
+    enum class Checksum : uint8_t {
+      NONE,     // checksum is set (TX) or unverified (RX)
+      PARTIAL,  // TX: device completes the checksum at csum_start + csum_offset
+      VERIFIED  // RX: device has verified the checksum
+    };
+
+    Checksum checksum_state() const noexcept
+    { return this->csum_state_; }
+
+    bool checksum_verified() const noexcept
+    { return this->csum_state_ != Checksum::NONE; }
+
+    void set_checksum_verified() noexcept
+    { this->csum_state_ = Checksum::VERIFIED; }
+
+    /**
+     *  Leave the L4 checksum to the device. The checksum field must
+     *  already contain the (non-inverted) pseudo-header sum.
+     *
+     *  @param start  : Where checksumming starts, e.g. the TCP header
+     *  @param offset : Offset from start where the checksum is placed
+     */
+    void set_checksum_partial(Byte_ptr start, uint16_t offset) noexcept
+    {
+      Expects(start >= buf() and start + offset < buffer_end());
+      this->csum_state_  = Checksum::PARTIAL;
+      this->csum_start_  = start;
+      this->csum_offset_ = offset;
+    }
+
+    Byte_ptr csum_start() const noexcept
+    { return this->csum_start_; }
+
+    uint16_t csum_offset() const noexcept
+    { return this->csum_offset_; }
+
+    /** Segmentation offload type, see Nic offload features */
+    enum class GSO : uint8_t { NONE, TCPV4, TCPV6 };
+
+    /**
+     *  Mark as a super-segment to be split by the device
+     *  into segments of @segment_size bytes of payload
+     */
+    void set_gso(GSO type, uint16_t segment_size) noexcept
+    {
+      this->gso_type_ = type;
+      this->gso_size_ = segment_size;
+    }
+
+    GSO gso_type() const noexcept
+    { return this->gso_type_; }
+
+    uint16_t gso_size() const noexcept
+    { return this->gso_size_; }
+
+    /**
+     *  Payload following the data in the buffer, referenced from memory
+     *  outside of it (scatter-gather transmit, see Nic::TX_SG).
+     *  The owner keeps the memory alive until the packet is released.
+     */
+    void set_ext_payload(std::shared_ptr<const void> owner,
+                         const Byte* data, uint32_t len) noexcept
+    {
+      Expects(data != nullptr or len == 0);
+      this->ext_owner_ = std::move(owner);
+      this->ext_data_  = data;
+      this->ext_len_   = len;
+    }
+
+    bool has_ext_payload() const noexcept
+    { return this->ext_len_ != 0; }
+
+    const Byte* ext_data() const noexcept
+    { return this->ext_data_; }
+
+    uint32_t ext_length() const noexcept
+    { return this->ext_len_; }
+
+    /**
+     *  Copy the external payload into the buffer,
+     *  for paths that can only handle a single buffer.
+     *
+     *  @return false if it doesn't fit
+     */
+    bool linearize() noexcept
+    {
+      if (not has_ext_payload())
+        return true;
+      if (data_end_ + ext_len_ > buffer_end_)
+        return false;
+      std::memcpy(data_end_, ext_data_, ext_len_);
+      data_end_ += ext_len_;
+      set_ext_payload(nullptr, nullptr, 0);
+      return true;
+    }
+
     /* Add a packet to this packet chain */
     inline void chain(Packet_ptr p) noexcept;
 
@@ -186,6 +285,16 @@ namespace net
     Packet_ptr chain_ = nullptr;
     Packet*    last_  = nullptr;
 
+    Byte_ptr   csum_start_  = nullptr;
+    uint16_t   csum_offset_ = 0;
+    uint16_t   gso_size_    = 0;
+    Checksum   csum_state_  = Checksum::NONE;
+    GSO        gso_type_    = GSO::NONE;
+
+    std::shared_ptr<const void> ext_owner_ = nullptr;
+    const Byte* ext_data_ = nullptr;
+    uint32_t    ext_len_  = 0;
+
     BufferStore*          bufstore_;
     Byte buf_[0];
   }; //< class Packet
@@ -0,0 +1,77 @@
+// -*-C++-*-
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#ifndef NET_PACKET_BURST_HPP
+#define NET_PACKET_BURST_HPP
+
+#include <net/packet.hpp>
+
+namespace net {
+
+/**
+ * @brief      A burst of received packets, handed from one layer of the
+ *             receive path to the next as a single packet chain, so each
+ *             layer runs over the whole burst before passing it on.
+ */
+class Packet_burst {
+public:
+  /** Append a packet (not a chain) in constant time */
+  void push_back(Packet_ptr pkt)
+  {
+    Expects(pkt != nullptr and pkt->tail() == nullptr);
+    auto* p = pkt.get();
+    if (head_ == nullptr)
+      head_ = std::move(pkt);
+    else
+      last_->chain(std::move(pkt));
+    last_ = p;
+    count_++;
+  }
+
+  bool empty() const noexcept
+  { return head_ == nullptr; }
+
+  int size() const noexcept
+  { return count_; }
+
+  /** Hand over the chain, leaving the burst empty */
+  Packet_ptr release() noexcept
+  {
+    last_  = nullptr;
+    count_ = 0;
+    return std::move(head_);
+  }
+
+  /** Take the first packet off a chain */
+  static Packet_ptr pop_front(Packet_ptr& chain) noexcept
+  {
+    auto tail = chain->detach_tail();
+    std::swap(tail, chain);
+    return tail;
+  }
+
+private:
+  Packet_ptr head_  = nullptr;
+  Packet*    last_  = nullptr;
+  int        count_ = 0;
+};
+
+} // < namespace net
+
+#endif // < NET_PACKET_BURST_HPP
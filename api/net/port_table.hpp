@@ -0,0 +1,71 @@
+// -*-C++-*-
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#ifndef NET_PORT_TABLE_HPP
+#define NET_PORT_TABLE_HPP
+
+#include <array>
+#include <cstdint>
+#include <memory>
+
+namespace net {
+
+/**
+ * @brief      A value per port, indexed directly by the port number.
+ *             The 65536 ports are split into pages of 256 ports which
+ *             are allocated on first use, so a lookup is two array
+ *             accesses while only the used ranges take memory.
+ */
+template <typename T>
+class Port_table {
+public:
+  static constexpr int PAGE_BITS = 8;
+  static constexpr int PAGE_SIZE = 1 << PAGE_BITS;
+  static constexpr int PAGES     = 65536 / PAGE_SIZE;
+
+  /** Returns the value for @port, or nullptr if its page is not in use */
+  T* find(const uint16_t port) noexcept
+  {
+    auto& page = pages_[port >> PAGE_BITS];
+    return (page != nullptr) ? &(*page)[port & (PAGE_SIZE-1)] : nullptr;
+  }
+
+  const T* find(const uint16_t port) const noexcept
+  {
+    const auto& page = pages_[port >> PAGE_BITS];
+    return (page != nullptr) ? &(*page)[port & (PAGE_SIZE-1)] : nullptr;
+  }
+
+  /** Returns the value for @port, allocating its page if needed */
+  T& operator[](const uint16_t port)
+  {
+    auto& page = pages_[port >> PAGE_BITS];
+    if (page == nullptr)
+      page = std::make_unique<Page>();
+    return (*page)[port & (PAGE_SIZE-1)];
+  }
+
+private:
+  using Page = std::array<T, PAGE_SIZE>;
+  std::array<std::unique_ptr<Page>, PAGES> pages_;
+};
+
+} // < namespace net
+
+#endif // < NET_PORT_TABLE_HPP
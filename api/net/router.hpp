@@ -20,6 +20,7 @@
 
 #include <net/inet.hpp>
 #include <net/netfilter.hpp>
+#include <net/lpm.hpp>
 
 //#define ROUTER_DEBUG 1
 #ifdef ROUTER_DEBUG
@@ -109,6 +110,7 @@ namespace net {
     using Packet_ptr    = typename IPV::IP_packet_ptr;
     using Interfaces    = std::vector<std::unique_ptr<Stack>>;
     using Routing_table = std::vector<Route<IPV>>;
+    using Lpm           = std::conditional_t<std::is_same_v<Addr, ip4::Addr>, Lpm4, Lpm6>;
 
     /**
      * Forward an IP packet according to local policy / routing table.
@@ -143,7 +145,7 @@ namespace net {
 
     /** Check if there exists a route for a given IP **/
     bool route_check(typename IPV::addr dest){
-      return get_first_interface(dest) != nullptr;
+      return get_most_specific_route(dest) != nullptr;
     }
 
 
@@ -164,13 +166,15 @@ namespace net {
 
     /**
      * Get cheapest route for a certain IP
-     * @todo : Optimize!
+     * (the first one, when several have the same cost)
      **/
     Route<IPV>* get_cheapest_route(typename IPV::addr dest) {
-      Routing_table all = get_all_routes(dest);
-      std::sort(all.begin(), all.end());
-      if (not all.empty()) return &all.front();
-      return nullptr;
+      Route<IPV>* cheapest = nullptr;
+      for (auto& route : routing_table_) {
+        if (route.match(dest) and (not cheapest or route < *cheapest))
+          cheapest = &route;
+      }
+      return cheapest;
     };
 
 
@@ -178,22 +182,13 @@ namespace net {
     /**
      * Get most specific route for a certain IP
      * (e.g. the route with the largest netmask)
-     * @todo : Optimize!
+     * Looked up in the compiled table, through the route cache.
      **/
     Route<IPV>* get_most_specific_route(typename IPV::addr dest)
     {
-      Route<IPV>* match = nullptr;
-      for (auto& route : routing_table_)
-        {
-          if (route.match(dest)) {
-            if (match) {
-              match = route.netmask() > match->netmask() ? &route : match;
-            } else {
-              match = &route;
-            }
-          }
-        }
-      return match;
+      const int idx = route_cache_.get(dest,
+        [this] (const Addr& addr) { return lpm_.lookup(addr); });
+      return (idx >= 0) ? &routing_table_[idx] : nullptr;
     }
 
 
@@ -204,12 +199,22 @@ namespace net {
       INFO("Router", "Router created with %lu routes", tbl.size());
       for(auto& route : routing_table_)
         INFO2("%s", route.to_string().c_str());
+      rebuild();
     }
 
     void set_routing_table(Routing_table tbl) {
       routing_table_ = tbl;
+      rebuild();
     };
 
+    /** Route lookups answered by the route cache */
+    uint64_t route_cache_hits() const noexcept
+    { return route_cache_.hits(); }
+
+    /** Route lookups that went to the compiled table */
+    uint64_t route_cache_misses() const noexcept
+    { return route_cache_.misses(); }
+
     /** Whether to send ICMP Time Exceeded when TTL is zero */
     bool send_time_exceeded = true;
 
@@ -218,6 +223,24 @@ namespace net {
 
   private:
     Routing_table routing_table_;
+    Lpm lpm_;
+    Route_cache<Addr> route_cache_;
+
+    /** Compile the routing table, after it has changed */
+    void rebuild()
+    {
+      std::vector<typename Lpm::Prefix> prefixes;
+      prefixes.reserve(routing_table_.size());
+      for (auto& route : routing_table_)
+      {
+        // a route with host bits set in its net never matches
+        const int len = route.match(route.net())
+          ? Lpm::prefix_length(route.netmask()) : -1;
+        prefixes.push_back({route.net(), len});
+      }
+      lpm_.build(prefixes);
+      route_cache_.invalidate();
+    }
 
   }; // < class Router
 
@@ -123,6 +123,18 @@ namespace net {
      */
     virtual void write(const std::string& str) = 0;
 
+    /**
+     * @brief      Async write of several shared buffers as one (gather write).
+     *             Streams which can queue them together before sending override
+     *             this, by default they are written one at a time.
+     *
+     * @param[in]  bufs   The buffers
+     * @param[in]  count  The number of buffers
+     */
+    virtual void writev(const buffer_t* bufs, size_t count) {
+      for (size_t i = 0; i < count; i++) write(bufs[i]);
+    }
+
     /**
      * @brief      Closes the stream.
      */
@@ -41,6 +41,8 @@ namespace net {
     // use of SACK
     static constexpr bool     default_sack {true};
     static constexpr size_t   default_sack_entries{32};
+    // coalescing of segments received in a burst
+    static constexpr bool     default_gro {true};
     // maximum size of a TCP segment - later set based on MTU or peer
     static constexpr uint16_t default_mss     {536};
     static constexpr uint16_t default_mss_v6  {1220};
@@ -98,28 +100,44 @@ namespace net {
     }
 
     template <typename View4>
-    uint16_t calculate_checksum4(const View4& packet)
+    uint32_t pseudo_header_sum4(const View4& packet)
     {
       constexpr uint8_t Proto_TCP = 6; // avoid including inet_common
       uint16_t length = packet.tcp_length();
       const auto ip_src = packet.ip4_src();
       const auto ip_dst = packet.ip4_dst();
       // Compute sum of pseudo-header
-      uint32_t sum =
-            (ip_src.whole >> 16)
+      return (ip_src.whole >> 16)
           + (ip_src.whole & 0xffff)
           + (ip_dst.whole >> 16)
           + (ip_dst.whole & 0xffff)
           + (Proto_TCP << 8)
           + htons(length);
+    }
 
+    template <typename View>
+    uint16_t checksum_segment(const View& packet, uint32_t sum)
+    {
       // Compute sum of header and data
       const char* buffer = (char*) &packet.tcp_header();
-      return net::checksum(sum, buffer, length);
+      const auto ext_len = packet.ext_data_length();
+      if (ext_len == 0)
+        return net::checksum(sum, buffer, packet.tcp_length());
+
+      // the part in the buffer is the header, a multiple of 4 bytes,
+      // so its folded sum is continued over the attached data
+      const uint16_t head = ~net::checksum(sum, buffer, packet.tcp_length() - ext_len);
+      return net::checksum(head, packet.ext_data(), ext_len);
+    }
+
+    template <typename View4>
+    uint16_t calculate_checksum4(const View4& packet)
+    {
+      return checksum_segment(packet, pseudo_header_sum4(packet));
     }
 
     template <typename View6>
-    uint16_t calculate_checksum6(const View6& packet)
+    uint32_t pseudo_header_sum6(const View6& packet)
     {
       constexpr uint8_t Proto_TCP = 6; // avoid including inet_common
       uint16_t length = packet.tcp_length();
@@ -139,11 +157,13 @@ namespace net {
         sum += (part & 0xffff);
       }
 
-      sum += (Proto_TCP << 8) + htons(length);
+      return sum + (Proto_TCP << 8) + htons(length);
+    }
 
-      // Compute sum of header and data
-      const char* buffer = (char*) &packet.tcp_header();
-      return net::checksum(sum, buffer, length);
+    template <typename View6>
+    uint16_t calculate_checksum6(const View6& packet)
+    {
+      return checksum_segment(packet, pseudo_header_sum6(packet));
     }
 
   } // < namespace tcp
@@ -0,0 +1,253 @@
+// -*-C++-*-
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#ifndef NET_TCP_CONGESTION_HPP
+#define NET_TCP_CONGESTION_HPP
+
+#include "common.hpp"
+#include <algorithm>
+#include <array>
+#include <memory>
+
+namespace net {
+namespace tcp {
+
+/**
+ * @brief      Congestion control algorithm for a Connection.
+ *             The connection handles loss detection, fast retransmit and
+ *             fast recovery [RFC 6582], and asks the algorithm how the
+ *             congestion window should change.
+ */
+class Congestion_control {
+public:
+  enum class Algorithm : uint8_t {
+    RENO,   // New Reno [RFC 5681]
+    CUBIC,  // [RFC 8312]
+    BBR     // Bottleneck Bandwidth and RTT
+  };
+
+  /** The congestion state of a connection */
+  struct Window {
+    uint32_t cwnd;      // congestion window
+    uint32_t ssthresh;  // slow start threshold
+    uint32_t snd_wnd;   // peers advertised window
+    uint16_t smss;      // sender maximum segment size
+  };
+
+  /** An ACK acknowledging new data */
+  struct Ack {
+    uint32_t bytes_acked;
+    uint32_t flight_size; // after the ACK
+    seq_t    ack;         // SEG.ACK
+    seq_t    snd_nxt;     // SND.NXT
+    int64_t  now;         // timestamp in microseconds
+  };
+
+  /**
+   * @brief      Creates a congestion control algorithm
+   *
+   * @param[in]  algo  The algorithm
+   *
+   * @return     The congestion control
+   */
+  static std::unique_ptr<Congestion_control> create(Algorithm algo);
+
+  virtual Algorithm algorithm() const noexcept = 0;
+
+  virtual const char* name() const noexcept = 0;
+
+  /** Set the initial window (3 segments, threshold at the peers window) */
+  virtual void init(Window& w)
+  {
+    w.cwnd     = 3 * w.smss;
+    w.ssthresh = w.snd_wnd;
+  }
+
+  /** New data was acknowledged outside of fast recovery */
+  virtual void on_ack(Window& w, const Ack& ack) = 0;
+
+  /** Loss was detected, reduce ssthresh given the flight size */
+  virtual void on_loss(Window& w, uint32_t flight_size) = 0;
+
+  /** Fast recovery has ended with a full ACK */
+  virtual void on_recovery_exit(Window& w)
+  { w.cwnd = w.ssthresh; }
+
+  /** The retransmission timer expired */
+  virtual void on_rto(Window& w)
+  { w.cwnd = 3 * w.smss; }
+
+  virtual ~Congestion_control() = default;
+
+protected:
+  /** Slow start [RFC 5681] p. 6 */
+  static void slow_start(Window& w, uint32_t bytes_acked) noexcept
+  { w.cwnd += std::min(bytes_acked, (uint32_t) w.smss); }
+
+  /**
+   * Counts round trips by waiting for the ACK of SND.NXT
+   * as it was at the start of the round.
+   */
+  struct Rounds {
+    seq_t    end   = 0;
+    int64_t  start = 0;
+    uint32_t count = 0;
+    uint32_t rtt   = 0; // duration of the last round (us)
+
+    /** Returns true when the ACK ends the current round */
+    bool update(const Ack& ack) noexcept
+    {
+      if (count > 0 and static_cast<int32_t>(ack.ack - end) < 0)
+        return false;
+      rtt   = (count > 0) ? static_cast<uint32_t>(ack.now - start) : 0;
+      end   = ack.snd_nxt;
+      start = ack.now;
+      count++;
+      return true;
+    }
+  };
+};
+
+/** New Reno [RFC 5681] [RFC 6582] */
+class Reno : public Congestion_control {
+public:
+  Algorithm algorithm() const noexcept override
+  { return Algorithm::RENO; }
+
+  const char* name() const noexcept override
+  { return "reno"; }
+
+  void on_ack(Window& w, const Ack& ack) override;
+
+  void on_loss(Window& w, uint32_t flight_size) override;
+};
+
+/** CUBIC for Fast Long-Distance Networks [RFC 8312] */
+class Cubic : public Congestion_control {
+public:
+  static constexpr float C    = 0.4f;
+  static constexpr float beta = 0.7f;
+
+  Algorithm algorithm() const noexcept override
+  { return Algorithm::CUBIC; }
+
+  const char* name() const noexcept override
+  { return "cubic"; }
+
+  void on_ack(Window& w, const Ack& ack) override;
+
+  void on_loss(Window& w, uint32_t flight_size) override;
+
+  void on_rto(Window& w) override;
+
+  /** The window size (segments) just before the last reduction */
+  float w_max() const noexcept
+  { return w_max_; }
+
+private:
+  float   w_max_       = 0;
+  float   w_last_max_  = 0;
+  float   w_est_       = 0;
+  float   k_           = 0;
+  float   origin_      = 0;
+  float   cwnd_acc_    = 0;
+  int64_t epoch_start_ = -1;
+  Rounds  rounds_;
+  uint32_t min_rtt_    = 0;
+
+  float w_cubic(float t) const noexcept
+  { return C * (t - k_) * (t - k_) * (t - k_) + origin_; }
+};
+
+/**
+ * BBR congestion control, tracking the bottleneck bandwidth and
+ * minimum round trip time to keep the congestion window at a
+ * multiple of the bandwidth-delay product, instead of backing
+ * off on every loss.
+ */
+class Bbr : public Congestion_control {
+public:
+  enum class Mode : uint8_t {
+    STARTUP,
+    DRAIN,
+    PROBE_BW,
+    PROBE_RTT
+  };
+
+  static constexpr float    high_gain        = 2.885f; // 2/ln(2)
+  static constexpr float    cwnd_gain        = 2.0f;
+  static constexpr int      bw_window_rounds = 10;
+  static constexpr int64_t  min_rtt_window   = 10000000; // us
+  static constexpr int64_t  probe_rtt_time   = 200000;   // us
+  static constexpr uint32_t min_cwnd_segs    = 4;
+
+  Algorithm algorithm() const noexcept override
+  { return Algorithm::BBR; }
+
+  const char* name() const noexcept override
+  { return "bbr"; }
+
+  void on_ack(Window& w, const Ack& ack) override;
+
+  void on_loss(Window& w, uint32_t flight_size) override;
+
+  void on_recovery_exit(Window& w) override;
+
+  void on_rto(Window& w) override;
+
+  Mode mode() const noexcept
+  { return mode_; }
+
+  /** Bottleneck bandwidth estimate in bytes per second */
+  uint64_t btl_bw() const noexcept;
+
+  /** Minimum round trip time estimate in microseconds, 0 until measured */
+  uint32_t min_rtt() const noexcept
+  { return min_rtt_; }
+
+  /** Bandwidth-delay product in bytes, or 0 without estimates */
+  uint32_t bdp() const noexcept
+  { return static_cast<uint32_t>(btl_bw() * min_rtt_ / 1000000); }
+
+private:
+  Mode     mode_          = Mode::STARTUP;
+  Rounds   rounds_;
+  uint64_t delivered_     = 0;
+  uint64_t round_delivered_ = 0;
+  // max delivery rate per round, over the last rounds
+  std::array<uint64_t, bw_window_rounds> bw_samples_ {};
+  uint32_t min_rtt_       = 0;
+  int64_t  min_rtt_stamp_ = 0;
+  uint64_t full_bw_       = 0;
+  uint8_t  full_bw_count_ = 0;
+  bool     filled_pipe_   = false;
+  uint8_t  cycle_index_   = 0;
+  int64_t  cycle_stamp_   = 0;
+  int64_t  probe_rtt_done_ = 0;
+  uint32_t prior_cwnd_    = 0;
+
+  void update_model(const Ack& ack);
+  void update_mode(Window& w, const Ack& ack);
+  float gain() const noexcept;
+};
+
+} // < namespace tcp
+} // < namespace net
+
+#endif // < NET_TCP_CONGESTION_HPP
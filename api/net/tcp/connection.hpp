@@ -20,6 +20,8 @@
 #define NET_TCP_CONNECTION_HPP
 
 #include "common.hpp"
+#include "congestion.hpp"
+#include "packet_slice.hpp"
 #include "packet_view.hpp"
 #include "read_request.hpp"
 #include "rttm.hpp"
@@ -110,6 +112,23 @@ public:
    */
   inline Connection&            on_data(DataCallback callback);
 
+  using ZerocopyCallback       = Zerocopy_rx::ReadCallback;
+  /**
+   * @brief      Event when incoming data is received by the connection,
+   *             without copying it into a receive buffer.
+   *             The callback is called for every in order segment, with slices
+   *             of the packets the data arrived in. The packets go back to the
+   *             NIC when the application drops the slices, and until then the
+   *             held bytes are taken from the receive window.
+   *             Replaces on_read and on_data.
+   *
+   * @param[in]  max_held  The most payload bytes held in packets at once
+   * @param[in]  callback  The callback
+   *
+   * @return     This connection
+   */
+  inline Connection&            on_read_zerocopy(size_t max_held, ZerocopyCallback callback);
+
   /**
    * @brief      Read the next fully acked chunk of received data if any.
    *
@@ -190,6 +209,17 @@ public:
    */
   void write(buffer_t buffer);
 
+  /**
+   * @brief      Async write of several shared buffers.
+   *             All of them are queued before any segment is sent,
+   *             so small buffers (e.g. a header) share a segment with
+   *             what follows. Empty buffers are skipped.
+   *
+   * @param[in]  bufs   The buffers
+   * @param[in]  count  The number of buffers
+   */
+  void writev(const buffer_t* bufs, size_t count);
+
   /**
    * @brief      Async write of a data with a length.
    *             Copies data into an internal (shared) buffer.
@@ -449,6 +479,23 @@ public:
   auto bytes_sacked() const noexcept
   { return bytes_sacked_; }
 
+  /**
+   * @brief      Sets the congestion control algorithm.
+   *             Resets the congestion window, so it should be set
+   *             before data transmission begins.
+   *
+   * @param[in]  algo  The congestion control algorithm
+   */
+  void set_congestion_control(Congestion_control::Algorithm algo);
+
+  /**
+   * @brief      The congestion control algorithm in use
+   *
+   * @return     The congestion control algorithm
+   */
+  Congestion_control::Algorithm congestion_algorithm() const noexcept
+  { return cc_->algorithm(); }
+
 
   /**
    * @brief      Interface for one of the many states a Connection can have.
@@ -661,6 +708,8 @@ private:
   /** The given read request */
   std::unique_ptr<Read_request> read_request;
   os::mem::Pmr_pool::Resource_ptr bufalloc{nullptr};
+  /** Receive state when reading without copying (on_read_zerocopy) */
+  std::unique_ptr<Zerocopy_rx> zc_rx_;
 
   /** Queue for write requests to process */
   Write_queue writeq;
@@ -699,6 +748,7 @@ private:
   size_t bytes_sacked_ = 0;
 
   /** Congestion control */
+  std::unique_ptr<Congestion_control> cc_;
   // is fast recovery state
   bool fast_recovery_ = false;
   // First partial ack seen
@@ -747,6 +797,11 @@ private:
    */
   void _on_data(DataCallback cb);
 
+  /**
+   * @brief      Set the zero-copy read handler
+   */
+  void _on_read_zerocopy(size_t max_held, ZerocopyCallback cb);
+
 
   // Retrieve the associated shared_ptr for a connection, if it exists
   // Throws out_of_range if it doesn't
@@ -919,9 +974,21 @@ private:
    *
    * @param[in]  in  TCP Packet containing payload
    */
-  void recv_data(const Packet_view& in);
+  void recv_data(Packet_view& in);
+
+  void recv_out_of_order(Packet_view& in);
+
+  /**
+   * @brief      Deliver in order data as packet slices, together with
+   *             the out of order segments it connects to.
+   *
+   * @param      in      TCP Packet containing payload, taken by the slices
+   * @param[in]  length  The number of new bytes in the payload
+   */
+  void recv_zerocopy(Packet_view& in, size_t length);
 
-  void recv_out_of_order(const Packet_view& in);
+  /** Reopen the receive window when held packets are released */
+  void zerocopy_released();
 
   /**
    * @brief      Acknowledge incoming data. This is done by:
@@ -1007,6 +1074,30 @@ private:
   size_t fill_packet(Packet_view& packet, const uint8_t* data, size_t n)
   { return packet.fill(data, std::min(n, (size_t)SMSS())); }
 
+  /*
+    Reference n bytes of the write buffer from offset in the packet,
+    keeping the buffer alive until the NIC is done with it.
+  */
+  size_t attach_packet(Packet_view& packet, const WriteBuffer& buf, size_t offset, size_t n)
+  { return packet.attach(buf, buf->data() + offset, n); }
+
+  /*
+    If the next segment should reference the write queue instead of copying (scatter-gather).
+    Only for buffers with at least a full segment left, smaller chunks are merged by copying.
+  */
+  bool use_sg() const noexcept;
+
+  /*
+    The most data to attach to one packet, a whole number of segments with TSO.
+  */
+  size_t sg_max_data(const Packet_view& packet, bool tso) const noexcept;
+
+  /*
+    The data of a full segment, SMSS less the options on the packet (as when copying).
+  */
+  uint16_t segment_data(const Packet_view& packet) const noexcept
+  { return SMSS() - packet.tcp_options_length(); }
+
   /*
     Transmit the packet and hooks up retransmission.
   */
@@ -1014,8 +1105,15 @@ private:
 
   /*
     Creates a new outgoing packet with the current TCB values and options.
+    With gso, the packet has room for a segmentation offload super-segment.
   */
-  Packet_view_ptr create_outgoing_packet();
+  Packet_view_ptr create_outgoing_packet(bool gso = false);
+
+  /*
+    Whether the next packet offered should be a TSO super-segment,
+    i.e. the NIC can segment it and there is more than one segment to send.
+  */
+  bool use_tso() const noexcept;
 
   Packet_view_ptr outgoing_packet()
   { return create_outgoing_packet(); }
@@ -1033,8 +1131,22 @@ private:
 
   /// --- Congestion Control [RFC 5681] --- ///
 
-  void setup_congestion_control()
-  { reno_init(); }
+  void setup_congestion_control();
+
+  /**
+   * @brief      Lets the congestion control algorithm update
+   *             cwnd and ssthresh
+   *
+   * @param      hook  Called with the algorithm and the window
+   */
+  template <typename Func>
+  void cc_update(Func&& hook)
+  {
+    Congestion_control::Window w{cb.cwnd, cb.ssthresh, cb.SND.WND, SMSS()};
+    hook(*cc_, w);
+    cb.cwnd     = w.cwnd;
+    cb.ssthresh = w.ssthresh;
+  }
 
   /**
    * @brief      Sender Maximum Segment Size
@@ -1057,21 +1169,6 @@ private:
 
   // Reno specifics //
 
-  void reno_init()
-  {
-    reno_init_cwnd(3);
-    reno_init_sshtresh();
-  }
-
-  void reno_init_cwnd(const size_t segments)
-  { cb.cwnd = segments*SMSS(); }
-
-  void reno_init_sshtresh()
-  { cb.ssthresh = cb.SND.WND; }
-
-  void reno_increase_cwnd(const uint16_t n)
-  { cb.cwnd += std::min(n, SMSS()); }
-
   void reno_deflate_cwnd(const uint16_t n)
   { cb.cwnd -= (n >= SMSS()) ? n-SMSS() : n; }
 
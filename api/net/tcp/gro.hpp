@@ -0,0 +1,95 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2018 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+#ifndef NET_TCP_GRO_HPP
+#define NET_TCP_GRO_HPP
+
+#include "common.hpp"
+#include <net/packet.hpp>
+#include <delegate>
+#include <array>
+
+namespace net {
+namespace tcp {
+
+/**
+ * @brief      Generic receive offload, in software. Coalesces the in order
+ *             segments of a flow within a receive burst, so they are handled
+ *             as one segment: one pass through the connection state, one
+ *             insert into the read buffer and one ACK decision.
+ *             The packets of a run are chained to its first packet.
+ *             Only plain ACK segments with the same headers apart from the
+ *             sequence number are coalesced, so timestamps and window are
+ *             those of every segment. A segment with PSH, or shorter than
+ *             the first one, ends the run, and PSH is set on the run.
+ */
+class Gro {
+public:
+  /** Delivers the first packet of a run, with the payload and number of segments after it */
+  using Deliver = delegate<void(net::Packet_ptr, uint16_t length, uint8_t segments)>;
+
+  /** Runs held at once, the oldest is delivered to make room for a new one */
+  static constexpr int MAX_RUNS = 8;
+  /** Maximum payload of a run, first segment included. The IP length of
+      the first packet is 16 bits, with the IP and TCP headers. */
+  static constexpr size_t MAX_LENGTH = 0xffff - 2 * 60;
+
+  explicit Gro(Deliver deliver)
+    : deliver_{std::move(deliver)}
+  {}
+
+  /** Receive an IPv4 TCP packet, which is either delivered or held */
+  void receive(net::Packet_ptr pkt);
+
+  /** Deliver every held run, at the end of a burst */
+  void flush();
+
+  /** Number of runs being held */
+  int held() const noexcept
+  { return count_; }
+
+  /** Number of segments coalesced into an earlier one */
+  uint64_t coalesced() const noexcept
+  { return coalesced_; }
+
+private:
+  struct Run {
+    net::Packet_ptr head;
+    net::Packet*    last = nullptr;
+    seq_t           next = 0;     // the sequence number continuing the run
+    uint16_t        mss = 0;      // payload of the first segment
+    uint16_t        length = 0;   // payload after the first segment
+    uint8_t         segments = 0; // segments after the first
+  };
+
+  Deliver deliver_;
+  // oldest first
+  std::array<Run, MAX_RUNS> runs_;
+  int      count_ = 0;
+  uint64_t coalesced_ = 0;
+
+  Run* find(const net::Packet& pkt) noexcept;
+
+  void deliver(Run& run);
+};
+
+} // < namespace tcp
+} // < namespace net
+
+#endif // < NET_TCP_GRO_HPP
@@ -20,6 +20,7 @@
 #define NET_TCP_LISTENER_HPP
 
 #include <deque>
+#include <optional>
 
 #include "common.hpp"
 #include "connection.hpp"
@@ -70,6 +71,18 @@ public:
   port_t port() const noexcept
   { return local_.port(); }
 
+  /**
+   * @brief Sets the congestion control algorithm for connections
+   *        accepted by this listener, instead of the TCP default.
+   *
+   * @param algo The congestion control algorithm
+   */
+  Listener& set_congestion_control(Congestion_control::Algorithm algo)
+  {
+    congestion_ = algo;
+    return *this;
+  }
+
   auto syn_queue_size() const
   { return syn_queue_.size(); }
 
@@ -98,6 +111,7 @@ private:
   ConnectCallback on_connect_;
   CloseCallback   _on_close_;
   const bool      ipv6_only_;
+  std::optional<Congestion_control::Algorithm> congestion_;
 
   bool default_on_accept(Socket);
 
@@ -40,6 +40,9 @@ public:
   uint16_t compute_tcp_checksum() const noexcept override
   { return calculate_checksum6(*this); }
 
+  uint32_t pseudo_header_sum() const noexcept override
+  { return pseudo_header_sum6(*this); }
+
   Protocol ipv() const noexcept override
   { return Protocol::IPv6; }
 
@@ -51,10 +54,10 @@ public:
 
 private:
   PacketIP6& packet() noexcept
-  { return static_cast<PacketIP6&>(*this->pkt); }
+  { return static_cast<PacketIP6&>(this->packet_ref()); }
 
   const PacketIP6& packet() const noexcept
-  { return static_cast<PacketIP6&>(*this->pkt); }
+  { return static_cast<PacketIP6&>(this->packet_ref()); }
 
   void set_ip_src(const net::Addr& addr) noexcept override
   { packet().set_ip_src(addr.v6()); }
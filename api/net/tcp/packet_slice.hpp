@@ -0,0 +1,156 @@
+// -*-C++-*-
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#ifndef NET_TCP_PACKET_SLICE_HPP
+#define NET_TCP_PACKET_SLICE_HPP
+
+#include <net/packet.hpp>
+#include <delegate>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace net {
+namespace tcp {
+
+/**
+ * @brief      A view of received data inside the packet it arrived in.
+ *             Slices share ownership of the packet, which goes back to
+ *             its buffer store when the last slice of it is destroyed.
+ */
+class Packet_slice {
+public:
+  using Packet_sptr = std::shared_ptr<net::Packet>;
+
+  Packet_slice() = default;
+
+  Packet_slice(Packet_sptr pkt, const uint8_t* data, size_t len) noexcept
+    : pkt_{std::move(pkt)}, data_{data}, len_{len}
+  {}
+
+  const uint8_t* data() const noexcept
+  { return data_; }
+
+  size_t size() const noexcept
+  { return len_; }
+
+  bool empty() const noexcept
+  { return len_ == 0; }
+
+  /** A slice of this slice, sharing the packet */
+  Packet_slice slice(size_t offset, size_t len) const noexcept
+  {
+    offset = std::min(offset, len_);
+    return {pkt_, data_ + offset, std::min(len, len_ - offset)};
+  }
+
+  /** Drop @n bytes from the front */
+  void consume(size_t n) noexcept
+  {
+    n = std::min(n, len_);
+    data_ += n;
+    len_  -= n;
+  }
+
+  /** The packet, kept alive by this slice */
+  const Packet_sptr& packet() const noexcept
+  { return pkt_; }
+
+private:
+  Packet_sptr    pkt_;
+  const uint8_t* data_ = nullptr;
+  size_t         len_  = 0;
+};
+
+/** In order received data, as a list of packet slices (like an iovec) */
+using Packet_chain = std::vector<Packet_slice>;
+
+/** Total number of bytes in a chain */
+inline size_t chain_size(const Packet_chain& chain) noexcept
+{
+  size_t bytes = 0;
+  for (const auto& s : chain) bytes += s.size();
+  return bytes;
+}
+
+/**
+ * @brief      Receive state of a connection in zero-copy mode.
+ *             Keeps track of the payload bytes held in packets, both by
+ *             the application and in the out of order queue, so the
+ *             receive window can account for them.
+ */
+struct Zerocopy_rx {
+  using ReadCallback = delegate<void(Packet_chain)>;
+
+  /** Shared with the packet deleters, which may outlive the connection */
+  struct Account {
+    size_t held = 0;
+    delegate<void()> on_release;
+  };
+
+  // sequence number order, with wrap around
+  struct Seq_less {
+    bool operator()(const uint32_t a, const uint32_t b) const noexcept
+    { return static_cast<int32_t>(a - b) < 0; }
+  };
+
+  explicit Zerocopy_rx(size_t max, ReadCallback cb)
+    : callback{std::move(cb)}, max_held{max},
+      account{std::make_shared<Account>()}
+  {}
+
+  // the packets still held can no longer reach the owner
+  ~Zerocopy_rx()
+  { account->on_release.reset(); }
+
+  /**
+   * @brief      Take ownership of a packet, making a slice of its payload.
+   *             The packet is counted as held until all slices of it are gone.
+   */
+  Packet_slice capture(net::Packet_ptr pkt, const uint8_t* data, size_t len)
+  {
+    account->held += len;
+    Packet_slice::Packet_sptr sptr{pkt.release(),
+      [acc = account, len] (net::Packet* p) {
+        acc->held -= len;
+        delete p;
+        if (acc->on_release) acc->on_release();
+      }};
+    // the segment is processed further after its payload is captured
+    processing = sptr;
+    return {std::move(sptr), data, len};
+  }
+
+  size_t held() const noexcept
+  { return account->held; }
+
+  ReadCallback callback;
+  size_t       max_held;
+  std::shared_ptr<Account> account;
+  /** Segments received out of order, waiting for the gap to fill */
+  std::map<uint32_t, Packet_slice, Seq_less> out_of_order;
+  /** The packet of the segment being processed */
+  Packet_slice::Packet_sptr processing;
+};
+
+} // < namespace tcp
+} // < namespace net
+
+#endif // < NET_TCP_PACKET_SLICE_HPP
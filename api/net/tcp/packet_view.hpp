@@ -138,6 +138,29 @@ public:
     set_tcp_checksum(compute_tcp_checksum());
   }
 
+  virtual uint32_t pseudo_header_sum() const noexcept = 0;
+
+  /**
+   * @brief      Leave the checksum to the NIC (checksum offload),
+   *             by storing the pseudo-header sum in the checksum field
+   *             and marking where the NIC should complete it.
+   */
+  void set_tcp_checksum_partial() noexcept
+  {
+    tcp_header().checksum = net::checksum_fold(pseudo_header_sum());
+    pkt->set_checksum_partial((uint8_t*) header, offsetof(Header, checksum));
+  }
+
+  /**
+   * @brief      Mark the packet as a TSO super-segment, to be split
+   *             by the NIC into segments of mss bytes of data.
+   */
+  void set_segmentation_offload(uint16_t mss) noexcept
+  {
+    pkt->set_gso((ipv() == Protocol::IPv6)
+      ? net::Packet::GSO::TCPV6 : net::Packet::GSO::TCPV4, mss);
+  }
+
   // Options //
 
   uint8_t* tcp_options()
@@ -192,14 +215,67 @@ public:
   { return (uint8_t*)header + tcp_header_length(); }
 
   // Length of data in packet when header has been accounted for
+  // (and the data of the segments coalesced with it)
   uint16_t tcp_data_length() const noexcept
-  { return ip_data_length() - tcp_header_length(); }
+  { return ip_data_length() - tcp_header_length() + coalesced_len; }
 
   bool has_tcp_data() const noexcept
   { return tcp_data_length() > 0; }
 
   inline size_t fill(const uint8_t* buffer, size_t length);
 
+  /**
+   * @brief      Reference the data instead of copying it into the packet,
+   *             for NICs with scatter-gather. The data is kept alive by
+   *             the owner until the packet is released.
+   *
+   * @return     The number of bytes attached
+   */
+  size_t attach(std::shared_ptr<const void> owner, const uint8_t* data, size_t length)
+  {
+    Expects(not has_tcp_data() && "Data is either copied or attached");
+    pkt->set_ext_payload(std::move(owner), data, length);
+    return length;
+  }
+
+  /** Data attached outside of the packet buffer, see attach() */
+  const uint8_t* ext_data() const noexcept
+  { return packet_ref().ext_data(); }
+
+  uint32_t ext_data_length() const noexcept
+  { return packet_ref().ext_length(); }
+
+  /**
+   * @brief      Mark the segments chained to this one as coalesced with it
+   *             (see tcp::Gro). They follow it in sequence, with the same
+   *             header, and their payload is part of this segment.
+   *
+   * @param[in]  length    The payload of the chained segments
+   * @param[in]  segments  The number of chained segments
+   */
+  void set_coalesced(uint16_t length, uint8_t segments) noexcept
+  {
+    coalesced_len  = length;
+    coalesced_segs = segments;
+  }
+
+  /** Number of segments coalesced with this one */
+  int coalesced_segments() const noexcept
+  { return coalesced_segs; }
+
+  /**
+   * @brief      Call @func(data, length) on the payload of this segment,
+   *             then on the payload of every segment coalesced with it.
+   */
+  template <typename Func>
+  void for_each_payload(Func func) const
+  {
+    func(tcp_data(), (size_t) ip_data_length() - tcp_header_length());
+    const int hdrs = tcp_data() - packet_ref().layer_begin();
+    for (auto* p = packet_ref().tail(); p != nullptr; p = p->tail())
+      func(p->layer_begin() + hdrs, (size_t) p->size() - hdrs);
+  }
+
   bool validate_length() const noexcept {
     return ip_data_length() >= tcp_header_length();
   }
@@ -225,6 +301,18 @@ public:
     return std::move(pkt);
   }
 
+  /**
+   * @brief      Take the packet, but keep the view readable.
+   *             The caller has to keep the packet alive for as long
+   *             as the view is used.
+   */
+  Ptr_type detach()
+  {
+    Expects(pkt != nullptr && "Packet ptr is already null");
+    detached = &*pkt;
+    return std::move(pkt);
+  }
+
   const Ptr_type& packet_ptr() const noexcept
   { return pkt; }
 
@@ -235,8 +323,11 @@ public:
 
 
 protected:
-  Ptr_type   pkt;
-  Header*    header = nullptr;
+  Ptr_type     pkt;
+  Header*      header = nullptr;
+  net::Packet* detached = nullptr;
+  uint16_t     coalesced_len = 0;
+  uint8_t      coalesced_segs = 0;
 
   Packet_v(Ptr_type ptr)
     : pkt{std::move(ptr)}
@@ -247,6 +338,10 @@ protected:
   Header& tcp_header() noexcept
   { return *header; }
 
+  // the packet, also after being detached
+  net::Packet& packet_ref() const noexcept
+  { return (pkt != nullptr) ? *pkt : *detached; }
+
   void set_header(uint8_t* hdr)
   { Expects(hdr != nullptr); header = reinterpret_cast<Header*>(hdr); }
 
@@ -129,6 +129,16 @@ namespace net::tcp
     void write(const std::string& str) override
     { write(str.data(), str.size()); }
 
+    /**
+     * @brief      Async write of several shared buffers,
+     *             queued together before anything is sent.
+     *
+     * @param[in]  bufs   The buffers
+     * @param[in]  count  The number of buffers
+     */
+    void writev(const buffer_t* bufs, size_t count) override
+    { m_tcp->writev(bufs, count); }
+
     /**
      * @brief      Closes the stream.
      */
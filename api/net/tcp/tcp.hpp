@@ -21,13 +21,17 @@
 
 #include "common.hpp"
 #include "connection.hpp"
+#include "gro.hpp"
 #include "headers.hpp"
 #include "listener.hpp"
 #include "packet_view.hpp"
 #include "packet.hpp" // remove me, temp for NaCl
 
-#include <map>  // connections, listeners
+#include <map>  // listeners
 #include <deque>  // writeq
+#include <vector>
+#include <net/flow_table.hpp> // connections
+#include <net/port_table.hpp> // listener lookup
 #include <net/socket.hpp>
 #include <net/ip4/ip4.hpp>
 #include <util/bitops.hpp>
@@ -59,7 +63,9 @@ namespace net {
 
   private:
     using Listeners       = std::map<Socket, std::shared_ptr<tcp::Listener>>;
-    using Connections     = std::unordered_map<tcp::Connection::Tuple, tcp::Connection_ptr>;
+    using Connections     = Flow_table<tcp::Connection::Tuple, tcp::Connection_ptr>;
+    // the listeners bound to each port, in the order they were added
+    using Listener_index  = Port_table<std::vector<Listeners::iterator>>;
 
   public:
     /////// TCP Stuff - Relevant to the protocol /////
@@ -183,6 +189,23 @@ namespace net {
      */
     void receive4(net::Packet_ptr);
 
+    /**
+     * @brief      Receive a burst of packets from the network layer (IP),
+     *             as a packet chain
+     *
+     * @param[in]  chain  The first packet of the chain
+     */
+    void receive4_burst(net::Packet_ptr chain);
+
+    /**
+     * @brief      Receive a segment from GRO, with the segments coalesced with it
+     *
+     * @param[in]  ptr       The first packet of the segment
+     * @param[in]  length    The payload of the coalesced segments
+     * @param[in]  segments  The number of coalesced segments
+     */
+    void receive4_coalesced(net::Packet_ptr ptr, uint16_t length, uint8_t segments);
+
     /**
      * @brief      Receive a Packet from the network layer (IP6)
      *
@@ -339,6 +362,44 @@ namespace net {
     bool uses_SACK() const noexcept
     { return sack_; }
 
+    /**
+     * @brief      Sets if segments received in a burst are coalesced
+     *             before being handled (see tcp::Gro).
+     *
+     * @param[in]  active  Whether GRO is in use.
+     */
+    void set_GRO(bool active) noexcept
+    { gro_active_ = active; }
+
+    /**
+     * @brief      Whether the TCP instance is coalescing received segments.
+     *
+     * @return     Whether GRO is in use.
+     */
+    bool uses_GRO() const noexcept
+    { return gro_active_; }
+
+    /** Number of received segments coalesced into an earlier one */
+    uint64_t gro_coalesced() const noexcept
+    { return gro_.coalesced(); }
+
+    /**
+     * @brief      Sets the default congestion control algorithm
+     *             for new connections.
+     *
+     * @param[in]  algo  The congestion control algorithm
+     */
+    void set_congestion_control(tcp::Congestion_control::Algorithm algo) noexcept
+    { congestion_ = algo; }
+
+    /**
+     * @brief      The default congestion control algorithm for new connections.
+     *
+     * @return     The congestion control algorithm
+     */
+    tcp::Congestion_control::Algorithm congestion_control() const noexcept
+    { return congestion_; }
+
     /**
      * @brief      Sets the dack. [RFC 1122] (p.96)
      *
@@ -537,6 +598,7 @@ namespace net {
   private:
     IPStack&      inet_;
     Listeners     listeners_;
+    Listener_index listener_ports_;
     Connections   connections_;
 
     size_t total_bufsize_;
@@ -565,10 +627,15 @@ namespace net {
     bool                      timestamps_;
     /** Selective ACK  [RFC 2018] */
     bool                      sack_;
+    /** Congestion control algorithm for new connections */
+    tcp::Congestion_control::Algorithm congestion_;
     /** Delayed ACK timeout - how long should we wait with sending an ACK */
     std::chrono::milliseconds dack_timeout_;
     /** Maximum SYN queue backlog */
     uint16_t                  max_syn_backlog_;
+    /** Coalescing of received segments */
+    bool                      gro_active_;
+    tcp::Gro                  gro_;
 
     /** Stats */
     uint64_t* bytes_rx_ = nullptr;
@@ -595,16 +662,57 @@ namespace net {
     /**
      * @brief      Creates an outgoing TCP packet.
      *
+     * @param[in]  gso   Whether to make room for a TSO super-segment
+     *
      * @return     A tcp packet ptr
      */
-    tcp::Packet_view_ptr create_outgoing_packet();
+    tcp::Packet_view_ptr create_outgoing_packet(bool gso = false);
 
     /**
      * @brief      Creates an outgoing TCP6 packet.
      *
+     * @param[in]  gso   Whether to make room for a TSO super-segment
+     *
      * @return     A tcp packet ptr
      */
-    tcp::Packet_view_ptr create_outgoing_packet6();
+    tcp::Packet_view_ptr create_outgoing_packet6(bool gso = false);
+
+    /**
+     * @brief      Whether the NIC completes checksums for outgoing segments.
+     *             Never used when the stack is forwarding, since the packet
+     *             may leave through a NIC without checksum offload.
+     *
+     * @return     True if checksum offload is in use
+     */
+    bool csum_offload() const;
+
+    /**
+     * @brief      Whether the NIC splits outgoing super-segments (TSO)
+     *
+     * @param[in]  ipv   The IP version of the connection
+     *
+     * @return     True if segmentation offload is in use
+     */
+    bool tso_offload(const Protocol ipv) const;
+
+    /**
+     * @brief      Largest IP packet handed to the NIC as a super-segment
+     *
+     * @return     The size in bytes, the MTU without TSO
+     */
+    uint32_t gso_max_size() const;
+
+    /**
+     * @brief      Whether outgoing segments can reference the data in the
+     *             write queue instead of copying it (scatter-gather).
+     *             Never used when forwarding, or for local destinations,
+     *             as received packets are read from a single buffer.
+     *
+     * @param[in]  remote  The destination of the segments
+     *
+     * @return     True if scatter-gather transmit is in use
+     */
+    bool sg_offload(const Socket& remote) const;
 
     /**
      * @brief      Sends a TCP reset based on the values of the incoming packet.
@@ -703,6 +811,24 @@ namespace net {
      */
     Listeners::const_iterator cfind_listener(const Socket& socket) const;
 
+    /**
+     * @brief      Adds a listener bound to socket, and indexes it by port.
+     *
+     * @param[in]  socket    The socket the listener is bound to
+     * @param[in]  listener  The listener
+     *
+     * @return     A listener iterator, and whether it was inserted
+     */
+    std::pair<Listeners::iterator, bool>
+    add_listener(const Socket& socket, std::shared_ptr<tcp::Listener> listener);
+
+    /**
+     * @brief      Removes the listener bound to socket.
+     *
+     * @param[in]  socket  The socket the listener is bound to
+     */
+    void erase_listener(const Socket& socket);
+
     /**
      * @brief      Adds a connection.
      *
@@ -95,6 +95,7 @@ namespace net {
 
     /** Input from network layer */
     void receive4(net::Packet_ptr);
+    void receive4_burst(net::Packet_ptr chain);
     void receive6(net::Packet_ptr);
     void receive(udp::Packet_view_ptr, const bool is_bcast);
 
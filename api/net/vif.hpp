@@ -70,6 +70,18 @@ public:
   net::Packet_ptr create_packet(int layer_begin) override
   { return link_.create_packet(layer_begin); }
 
+  uint32_t offload_features() const noexcept override
+  { return link_.offload_features(); }
+
+  uint32_t gso_max_size() const noexcept override
+  { return link_.gso_max_size(); }
+
+  net::Packet_ptr create_gso_packet(int layer_begin) override
+  { return link_.create_gso_packet(layer_begin); }
+
+  int queue_pairs() const noexcept override
+  { return link_.queue_pairs(); }
+
   void on_transmit_queue_available(net::transmit_avail_delg del) override
   { link_.on_transmit_queue_available(del); }
 
@@ -85,8 +97,8 @@ public:
   void flush() override
   { link_.flush(); }
 
-  void poll() override
-  { link_.poll(); }
+  bool poll() override
+  { return link_.poll(); }
 
 private:
   hw::Nic& link_;
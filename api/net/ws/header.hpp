@@ -22,9 +22,54 @@
 #include <cstdint>
 #include <cstring>
 #include <cassert>
+#if defined(__AVX2__)
+  #include <immintrin.h>
+#elif defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
 
 namespace net {
 
+  /**
+   * @brief      XOR @len bytes with the repeating 4 byte masking @key,
+   *             as it is in memory. The key is rotated by @offset bytes,
+   *             so a payload can be masked a part at a time, where offset
+   *             is the number of payload bytes before this part.
+   *             Works on 32/16 byte vectors with AVX2/SSE2, and 8 byte
+   *             words otherwise.
+   */
+  inline void ws_mask(char* data, size_t len, uint32_t key, size_t offset = 0) noexcept
+  {
+    if (offset & 3) {
+      const int rot = (offset & 3) * 8;
+      key = (key >> rot) | (key << (32 - rot));
+    }
+#if defined(__AVX2__)
+    const __m256i key256 = _mm256_set1_epi32(key);
+    for (; len >= 32; data += 32, len -= 32) {
+      const __m256i v = _mm256_loadu_si256((const __m256i*) data);
+      _mm256_storeu_si256((__m256i*) data, _mm256_xor_si256(v, key256));
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i key128 = _mm_set1_epi32(key);
+    for (; len >= 16; data += 16, len -= 16) {
+      const __m128i v = _mm_loadu_si128((const __m128i*) data);
+      _mm_storeu_si128((__m128i*) data, _mm_xor_si128(v, key128));
+    }
+#endif
+    const uint64_t key64 = key | (uint64_t) key << 32;
+    for (; len >= 8; data += 8, len -= 8) {
+      uint64_t word;
+      memcpy(&word, data, sizeof(word));
+      word ^= key64;
+      memcpy(data, &word, sizeof(word));
+    }
+    for (size_t i = 0; i < len; i++) {
+      data[i] ^= (char) (key >> ((i & 3) * 8));
+    }
+  }
+
   enum class op_code : uint8_t {
     CONTINUE  = 0,
     TEXT      = 1,
@@ -56,10 +101,15 @@ namespace net {
       bits &= 0x80ff;
       bits |= (pbits & 0x7f) << 8;
 
-      if (is_ext())
-          *(uint16_t*) vla = __builtin_bswap16(len);
-      else if (is_ext2())
-          *(uint64_t*) vla = __builtin_bswap64(len);
+      // the header can be anywhere in a buffer
+      if (is_ext()) {
+          const uint16_t ext = __builtin_bswap16(len);
+          memcpy(vla, &ext, sizeof(ext));
+      }
+      else if (is_ext2()) {
+          const uint64_t ext = __builtin_bswap64(len);
+          memcpy(vla, &ext, sizeof(ext));
+      }
       assert(data_length() == len);
     }
 
@@ -105,10 +155,16 @@ namespace net {
       return len;
     }
     size_t data_length() const noexcept {
-      if (is_ext2())
-          return __builtin_bswap64(*(uint64_t*) vla) & 0xffffffff;
-      if (is_ext())
-          return __builtin_bswap16(*(uint16_t*) vla);
+      if (is_ext2()) {
+          uint64_t ext;
+          memcpy(&ext, vla, sizeof(ext));
+          return __builtin_bswap64(ext) & 0xffffffff;
+      }
+      if (is_ext()) {
+          uint16_t ext;
+          memcpy(&ext, vla, sizeof(ext));
+          return __builtin_bswap16(ext);
+      }
       return payload();
     }
 
@@ -130,13 +186,15 @@ namespace net {
     char* data() noexcept {
       return &vla[data_offset()];
     }
+    uint32_t mask_key() const noexcept {
+      uint32_t key = 0;
+      if (is_masked())
+          memcpy(&key, &vla[data_offset() - 4], sizeof(key));
+      return key;
+    }
     void masking_algorithm(char* ptr)
     {
-      const char* mask = keymask();
-      for (size_t i = 0; i < data_length(); i++)
-      {
-        ptr[i] = ptr[i] xor mask[i & 3];
-      }
+      ws_mask(ptr, data_length(), mask_key());
     }
 
     char vla[0];
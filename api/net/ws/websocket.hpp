@@ -23,6 +23,7 @@
 
 #include <net/http/server.hpp>
 #include <net/http/basic_client.hpp>
+#include <array>
 #include <memory>
 #include <stdexcept>
 #include <vector>
@@ -36,89 +37,98 @@ struct WS_error : public std::runtime_error {
 
 class WebSocket {
 public:
+  /**
+   * @brief      A received message. The payload is kept where it was
+   *             received, as a chain of slices of the stream buffers,
+   *             with the fragments of a fragmented message in order.
+   *             It is only copied when asked for as contiguous data.
+   */
   class Message {
   public:
     using Data     = std::vector<uint8_t>;
-    using Data_it  = Data::iterator;
-    using Data_cit = Data::const_iterator;
+    using Data_it  = uint8_t*;
+    using Data_cit = const uint8_t*;
 
-    auto extract_vector() noexcept {
-      return std::move(data_);
-    }
-    auto extract_shared_vector() {
-      return std::make_shared<std::vector<uint8_t>> (std::move(data_));
-    }
+    /** A part of the payload, in place in the buffer it arrived in */
+    struct Slice {
+      Stream::buffer_t buf;
+      uint8_t*         data;
+      size_t           len;
+    };
+    using Chain = std::vector<Slice>;
 
-    std::string to_string() const
-    { return std::string(data(), size()); }
+    explicit Message(op_code code) noexcept
+      : opcode_{code} {}
 
-    size_t size() const noexcept
-    { return data_.size(); }
+    op_code opcode() const noexcept
+    { return opcode_; }
 
-    Data_it begin() noexcept
-    { return data_.begin(); }
+    /** The payload in order, without copying it */
+    const Chain& chain() const noexcept
+    { return chain_; }
 
-    Data_it end() noexcept
-    { return data_.end(); }
+    size_t size() const noexcept
+    { return size_; }
 
-    Data_cit cbegin() const noexcept
-    { return data_.begin(); }
+    bool is_complete() const noexcept
+    { return complete_; }
 
-    Data_cit cend() const noexcept
-    { return data_.end(); }
+    /** Add @len bytes of (unmasked) payload at @data inside @buf */
+    void append(Stream::buffer_t buf, uint8_t* data, size_t len)
+    {
+      if (len == 0) return;
+      // continues the last slice, e.g. a frame split in two reads
+      if (not chain_.empty() and chain_.back().buf == buf
+          and chain_.back().data + chain_.back().len == data)
+        chain_.back().len += len;
+      else
+        chain_.push_back({std::move(buf), data, len});
+      size_ += len;
+    }
 
-    const char* data() const noexcept
-    { return (const char*) data_.data(); }
+    /** The final fragment has been received */
+    void finish() noexcept
+    { complete_ = true; }
 
-    char* data() noexcept
-    { return (char*) data_.data(); }
+    /** The payload as a buffer of its own, copied unless it already is one */
+    Stream::buffer_t extract_buffer();
 
-    Message(const uint8_t* data, size_t len)
-    {
-      const auto* wsh = (ws_header*) data;
-      // setup initial header
-      const size_t hdr_bytes = std::min((size_t) wsh->header_length(), len);
-      std::memcpy(header_.data(), data, hdr_bytes);
-      this->header_length = hdr_bytes;
-      // move forward in buffer
-      data += hdr_bytes; len -= hdr_bytes;
-      // if the header became complete, reserve data
-      if (this->header_complete()) {
-        data_.reserve(header().data_length());
-      }
-      // append any remaining data
-      this->append(data, len);
-    }
+    Data extract_vector()
+    { return Data(cbegin(), cend()); }
 
-    size_t append(const uint8_t* data, size_t len);
+    auto extract_shared_vector()
+    { return std::make_shared<Data>(cbegin(), cend()); }
 
-    bool is_complete() const noexcept
-    { return header_complete() && data_.size() == header().data_length(); }
+    std::string to_string() const
+    { return std::string(data(), size()); }
 
-    const ws_header& header() const noexcept
-    { return *(ws_header*) header_.data(); }
+    Data_it begin() noexcept
+    { return (Data_it) data(); }
 
-    op_code opcode() const noexcept
-    { return header().opcode(); }
+    Data_it end() noexcept
+    { return begin() + size(); }
 
-    void unmask() noexcept
-    {
-      if (header().is_masked())
-          writable_header().masking_algorithm(this->data());
-    }
+    Data_cit cbegin() const noexcept
+    { return (Data_cit) data(); }
 
-  private:
-    Data data_;
-    std::array<uint8_t, 15> header_;
-    uint8_t header_length = 0;
+    Data_cit cend() const noexcept
+    { return cbegin() + size(); }
 
-    inline bool header_complete() const noexcept {
-      return header_length >= 2 && header_length >= header().header_length();
-    }
+    /** Contiguous payload, made so by copying a multi-slice chain once */
+    const char* data() const
+    { return (const char*) flatten(); }
 
-    ws_header& writable_header()
-    { return *(ws_header*) header_.data(); }
+    char* data()
+    { return (char*) flatten(); }
 
+  private:
+    // flattening keeps the payload the same, only where it is
+    mutable Chain chain_;
+    size_t  size_ = 0;
+    op_code opcode_;
+    bool    complete_ = false;
+
+    uint8_t* flatten() const;
   }; // < class Message
 
   using Message_ptr     = std::unique_ptr<Message>;
@@ -280,9 +290,27 @@ public:
   }
 
 private:
+  /** Receive state of the frame being parsed */
+  struct Frame {
+    // a header split between reads is gathered here
+    std::array<uint8_t, 14> header;
+    uint8_t  header_len = 0;
+    bool     in_payload = false;
+    op_code  code = op_code::CONTINUE;
+    bool     fin  = false;
+    uint32_t key  = 0;
+    size_t   remaining = 0;
+    // payload bytes unmasked so far, for the key offset
+    size_t   unmasked  = 0;
+  };
+
   net::Stream_ptr stream;
   Timer ping_timer{{this, &WebSocket::pong_timeout}};
+  Frame       frame;
+  // the data message being received, possibly over several fragments
   Message_ptr message;
+  // a control frame, which may arrive between fragments
+  Message_ptr control;
   uint32_t max_msg_size;
   bool     clientside;
   bool     m_busy = false;
@@ -296,8 +324,15 @@ private:
   bool write_opcode(op_code code, const char*, size_t);
   void failure(const std::string&);
   void close_callback_once();
-  size_t create_message(const uint8_t*, size_t len);
+  size_t read_header(const uint8_t*, size_t len);
+  bool begin_frame(const ws_header&);
+  void end_frame();
   void finalize_message();
+  void finalize_control();
+
+  // closed by us, the user or a CLOSE frame, so nothing more to read
+  bool is_done() const noexcept
+  { return stream == nullptr or not stream->is_writable(); }
 
   bool default_on_ping(const char*, size_t)
   { return true; }
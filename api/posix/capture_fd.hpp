@@ -0,0 +1,64 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2018 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#ifndef INCLUDE_CAPTURE_FD_HPP
+#define INCLUDE_CAPTURE_FD_HPP
+
+#include <net/capture.hpp>
+#include "fd.hpp"
+#include <poll.h>
+#include <cstring>
+
+/**
+ * @brief      Read-only file descriptor streaming a packet capture as
+ *             pcapng. A read returns 0 when nothing new has been captured.
+ */
+class Capture_fd : public FD {
+public:
+  Capture_fd(int fd, net::Capture& cap)
+    : FD{fd}, cap_{cap} {}
+
+  ssize_t read(void* output, size_t bytes) override
+  {
+    if (offset_ == buffer_.size()) {
+      buffer_.clear();
+      offset_ = 0;
+      cap_.read(buffer_);
+    }
+    const size_t n = std::min(bytes, buffer_.size() - offset_);
+    std::memcpy(output, buffer_.data() + offset_, n);
+    offset_ += n;
+    return n;
+  }
+
+  short poll_events(short events) override
+  {
+    const bool readable = offset_ != buffer_.size() or cap_.pending();
+    return readable ? events & (POLLIN | POLLRDNORM) : 0;
+  }
+
+  int close() override
+  { return 0; }
+
+private:
+  net::Capture& cap_;
+  os::mem::buffer buffer_;
+  size_t offset_ = 0;
+}; // < class Capture_fd
+
+#endif
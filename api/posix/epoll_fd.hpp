@@ -0,0 +1,76 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#ifndef INCLUDE_EPOLL_FD_HPP
+#define INCLUDE_EPOLL_FD_HPP
+
+#include "fd.hpp"
+#include <sys/epoll.h>
+#include <map>
+
+/**
+ * @brief      An epoll instance, holding a set of fds of interest.
+ *             Readiness is taken from FD::poll_events when waiting,
+ *             as the fds do not signal changes. Level-triggered by
+ *             default, EPOLLET reports a readiness event once until
+ *             the fd has been not ready again, and EPOLLONESHOT
+ *             disables the fd after one event until it is modified.
+ */
+class Epoll_FD : public FD {
+public:
+  explicit Epoll_FD(const int id)
+    : FD(id)
+  {}
+
+  int close() override;
+
+  /** Readable when any fd of interest is ready, for nested epoll */
+  short poll_events(short events) override;
+
+  /**
+   * @brief      Add, modify or remove an fd of interest (epoll_ctl)
+   *
+   * @return     0 on success, or a negative error code
+   */
+  int ctl(int op, int fd, struct epoll_event* event);
+
+  /**
+   * @brief      Collect up to @max ready events without blocking.
+   *             Fds that have been closed are removed from the set.
+   *
+   * @return     The number of events written to @events
+   */
+  int ready(struct epoll_event* events, int max);
+
+  size_t size() const noexcept
+  { return interest_.size(); }
+
+private:
+  struct Interest {
+    struct epoll_event event;
+    uint32_t reported = 0; // readiness last reported (EPOLLET)
+    bool     disabled = false; // after an event (EPOLLONESHOT)
+  };
+  std::map<int, Interest> interest_;
+  // where the next wait continues, so no fd is starved by maxevents
+  int cursor_ = 0;
+
+  uint32_t check(int fd, Interest& in, bool consume);
+};
+
+#endif
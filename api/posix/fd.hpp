@@ -22,6 +22,7 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <cstdarg>
 #include <errno.h>
 
@@ -77,6 +78,15 @@ public:
   // linux specific
   virtual long getdents(struct dirent*, unsigned int) { return -1; }
 
+  /** POLLING **/
+  /**
+   * Returns which of the POLL* @events are ready without blocking,
+   * together with POLLERR and POLLHUP which are always reported.
+   * By default the fd is always ready, as regular files are.
+   */
+  virtual short poll_events(short events)
+  { return events & (POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM); }
+
   id_t get_id() const noexcept { return id_; }
 
   virtual bool is_file() { return false; }
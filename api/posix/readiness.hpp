@@ -0,0 +1,66 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#ifndef INCLUDE_READINESS_HPP
+#define INCLUDE_READINESS_HPP
+
+#include <kernel/timers.hpp>
+#include <os.hpp>
+#include <chrono>
+
+namespace posix {
+
+/**
+ * @brief      Run the event loop until @ready returns a non-zero count,
+ *             or the timeout expires.
+ *
+ * @param[in]  timeout_ms  Timeout in milliseconds, 0 to not block
+ *                         and negative to wait forever
+ * @param[in]  ready       Returns the number of ready fds (or an error < 0)
+ *
+ * @return     The last result of @ready
+ */
+template <typename Ready>
+inline long block_until_ready(const int timeout_ms, Ready&& ready)
+{
+  long count = ready();
+  if (count != 0 or timeout_ms == 0)
+    return count;
+
+  bool expired = false;
+  Timers::id_t timer = Timers::UNUSED_ID;
+  if (timeout_ms > 0) {
+    timer = Timers::oneshot(std::chrono::milliseconds(timeout_ms),
+      [&expired] (Timers::id_t) { expired = true; });
+  }
+
+  // every event handled can change readiness, so check after each round
+  while (not expired)
+  {
+    os::block();
+    if ((count = ready()) != 0) break;
+  }
+
+  if (timer != Timers::UNUSED_ID and not expired)
+    Timers::stop(timer);
+  return count;
+}
+
+} // < namespace posix
+
+#endif
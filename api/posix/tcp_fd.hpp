@@ -49,6 +49,9 @@ public:
   ssize_t recvfrom(void*, size_t, int fl, struct sockaddr*, socklen_t *) override;
 
   int     shutdown(int) override;
+  int     getsockopt(int, int, void *__restrict__, socklen_t *__restrict__) override;
+
+  short   poll_events(short events) override;
 
   bool is_listener() const noexcept {
     return ld != nullptr;
@@ -79,6 +82,7 @@ struct TCP_FD_Conn
   ssize_t recv(void*, size_t, int fl);
   int     close();
   int     shutdown(int);
+  short   poll_events(short events);
 
   std::string to_string() const { return conn->to_string(); }
 
@@ -86,6 +90,8 @@ struct TCP_FD_Conn
   net::tcp::buffer_t buffer;
   size_t buf_offset;
   bool recv_disc = false;
+  // pending error, taken by getsockopt(SO_ERROR)
+  int so_error = 0;
 };
 
 struct TCP_FD_Listen
@@ -55,6 +55,8 @@ public:
 
   int     shutdown(int) override { return 0; }
 
+  short   poll_events(short events) override;
+
   int     getsockopt(int, int, void *__restrict__, socklen_t *__restrict__) override;
   int     setsockopt(int, int, const void *, socklen_t) override;
 
@@ -0,0 +1,144 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#ifndef UTIL_SLAB_POOL_HPP
+#define UTIL_SLAB_POOL_HPP
+
+#include <common>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Object pool allocating in slabs of CHUNK objects
+ * @details Objects are addressed by a dense integer id, and keep their
+ * address for as long as they live, as slabs are never moved or freed
+ * before the pool. Freed ids are reused before the pool grows, so
+ * create and destroy do not allocate once the pool has warmed up.
+ */
+template <typename T, int CHUNK = 256>
+class Slab_pool {
+public:
+  using id_t = int32_t;
+  static_assert(CHUNK > 0 and (CHUNK & (CHUNK-1)) == 0, "CHUNK must be a power of two");
+
+  Slab_pool() = default;
+  Slab_pool(const Slab_pool&) = delete;
+  Slab_pool& operator=(const Slab_pool&) = delete;
+
+  ~Slab_pool()
+  { clear(); }
+
+  /** Construct an object, returns its id */
+  template <typename... Args>
+  id_t create(Args&&... args)
+  {
+    if (UNLIKELY(free_.empty()))
+      grow();
+    const id_t id = free_.back();
+    new (&slot(id)) T(std::forward<Args>(args)...);
+    free_.pop_back();
+    live_[id] = true;
+    count_++;
+    return id;
+  }
+
+  /** Destroy the object with @id, making the id free for reuse */
+  void destroy(id_t id)
+  {
+    Expects(alive(id));
+    // mark it free first, the destructor may look the pool up
+    live_[id] = false;
+    count_--;
+    get(id).~T();
+    free_.push_back(id);
+  }
+
+  bool alive(id_t id) const noexcept
+  { return id >= 0 and (size_t) id < live_.size() and live_[id]; }
+
+  T& get(id_t id) noexcept
+  { return *std::launder(reinterpret_cast<T*>(&slot(id))); }
+
+  const T& get(id_t id) const noexcept
+  { return *std::launder(reinterpret_cast<const T*>(&slot(id))); }
+
+  T& operator[](id_t id) noexcept
+  { return get(id); }
+
+  const T& operator[](id_t id) const noexcept
+  { return get(id); }
+
+  /** Call @func on every live object. It may destroy the object it is given. */
+  template <typename Func>
+  void for_each(Func func)
+  {
+    for (id_t id = 0; (size_t) id < live_.size(); id++)
+      if (live_[id]) func(get(id));
+  }
+
+  /** Make room for @n objects without growing later */
+  void reserve(size_t n)
+  {
+    if (n > capacity())
+      grow((n - capacity() + CHUNK - 1) / CHUNK);
+  }
+
+  /** Destroy all objects, keeping the slabs */
+  void clear()
+  {
+    for (id_t id = 0; (size_t) id < live_.size(); id++)
+      if (live_[id]) destroy(id);
+  }
+
+  /** Number of live objects */
+  size_t size() const noexcept
+  { return count_; }
+
+  bool empty() const noexcept
+  { return count_ == 0; }
+
+  size_t capacity() const noexcept
+  { return slabs_.size() * CHUNK; }
+
+private:
+  using Slot = std::aligned_storage_t<sizeof(T), alignof(T)>;
+  std::vector<std::unique_ptr<Slot[]>> slabs_;
+  std::vector<id_t> free_;
+  std::vector<bool> live_;
+  size_t count_ = 0;
+
+  Slot& slot(id_t id) const noexcept
+  { return slabs_[id / CHUNK][id & (CHUNK-1)]; }
+
+  void grow(size_t slabs = 1)
+  {
+    const id_t base = capacity();
+    for (size_t i = 0; i < slabs; i++)
+      slabs_.emplace_back(new Slot[CHUNK]);
+    live_.resize(capacity(), false);
+    // below the ids already free, lowest on top, so slabs fill in order
+    free_.insert(free_.begin(), capacity() - base, 0);
+    for (size_t i = 0; i < capacity() - base; i++)
+      free_[i] = capacity() - 1 - i;
+  }
+};
+
+#endif
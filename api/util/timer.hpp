@@ -77,8 +77,8 @@ public:
 
   /**
    * @brief Restart the timer
-   * @details First stops the timer (if running)
-   * and then starts the timer with a new refreshed duration.
+   * @details Reschedules the timer (if running) with a new refreshed
+   * duration, otherwise starts the timer.
    *
    * @param  duration until timing out
    * @param  on_timeout (optional) on timeout handler
@@ -152,6 +152,12 @@ inline void Timer::stop() {
 }
 
 inline void Timer::restart(duration_t when, handler_t on_timeout) {
+  if(is_running() and Timers::restart(id_, when))
+  {
+    if(on_timeout)
+      set_on_timeout(on_timeout);
+    return;
+  }
   stop();
   start(when, on_timeout);
 }
@@ -0,0 +1,339 @@
+// -*-C++-*-
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#ifndef UTIL_TIMER_WHEEL_HPP
+#define UTIL_TIMER_WHEEL_HPP
+
+#include <branch_prediction>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Hierarchical hashed timing wheel
+ * @details Schedules integer ids at absolute deadlines (in nanoseconds).
+ * Insert, erase and reschedule are O(1) and do not allocate once the
+ * id space has been grown. Deadlines are bucketed into ticks of
+ * 2^TICK_SHIFT nanoseconds over LEVELS wheels of 256 slots each, and
+ * timers in the upper wheels are cascaded down as time advances.
+ *
+ * Deadlines are exact: an id expires at the first call to expire()
+ * where now >= deadline, regardless of the tick size.
+ *
+ * Moving a deadline later is lazy: the id stays in its slot and is
+ * re-hashed when that slot is reached, so a restarted timer which
+ * never expires (e.g. TCP retransmission) is never unlinked.
+ */
+template <int TICK_SHIFT = 20, int LEVELS = 4>
+class Timer_wheel {
+public:
+  using id_t   = int32_t;
+  using time_t = int64_t;
+
+  static constexpr int     SLOT_BITS = 8;
+  static constexpr int     SLOTS     = 1 << SLOT_BITS;
+  static constexpr id_t    NONE      = -1;
+  static constexpr time_t  NEVER     = INT64_MAX;
+  /** The longest distance that can be hashed, further deadlines are re-hashed */
+  static constexpr int64_t MAX_TICKS = (int64_t(1) << (SLOT_BITS * LEVELS)) - 1;
+
+  explicit Timer_wheel(time_t now = 0)
+    : current_{tick_of(now)}
+  {
+    for (auto& wheel : slots_) wheel.fill(NONE);
+    for (auto& bits : occupied_) bits.fill(0);
+  }
+
+  /** Schedule @id to expire at @when. The id must not be scheduled. */
+  void insert(id_t id, time_t when)
+  {
+    if (UNLIKELY((size_t) id >= nodes_.size()))
+      nodes_.resize(id + 1);
+    auto& node = nodes_[id];
+    assert(node.slot < 0 && "Id is already scheduled");
+    node.time = when;
+    link(id, node);
+    count_++;
+  }
+
+  /** Moves an empty wheel forward to @now, so inserts hash from there */
+  void advance(time_t now) noexcept
+  {
+    if (count_ == 0) current_ = std::max(current_, tick_of(now));
+  }
+
+  /** Unschedule @id, returns false if it was not scheduled */
+  bool erase(id_t id)
+  {
+    if (not contains(id)) return false;
+    unlink(id, nodes_[id]);
+    count_--;
+    return true;
+  }
+
+  /**
+   * @brief Reschedule @id to expire at @when
+   * @details Later deadlines only update the node. Earlier deadlines
+   * move the node to its new slot. Unscheduled ids are inserted.
+   */
+  void update(id_t id, time_t when)
+  {
+    if (not contains(id)) {
+      insert(id, when);
+      return;
+    }
+    auto& node = nodes_[id];
+    if (when >= node.time) {
+      node.time = when;
+      return;
+    }
+    unlink(id, node);
+    node.time = when;
+    link(id, node);
+  }
+
+  bool contains(id_t id) const noexcept {
+    return id >= 0 && (size_t) id < nodes_.size() && nodes_[id].slot >= 0;
+  }
+
+  /** Returns the deadline of a scheduled @id */
+  time_t deadline(id_t id) const noexcept {
+    return nodes_[id].time;
+  }
+
+  size_t size() const noexcept { return count_; }
+  bool  empty() const noexcept { return count_ == 0; }
+
+  /**
+   * @brief Expire all ids with deadline <= @now
+   * @details Expired ids are unscheduled and handed to @on_expire in
+   * deadline order after the wheel has been advanced, so the handler
+   * can freely insert, update and erase ids.
+   *
+   * @return the number of expired ids
+   */
+  template <typename Func>
+  size_t expire(time_t now, Func on_expire)
+  {
+    const int64_t target = tick_of(now);
+    if (count_ == 0) {
+      advance(now);
+      return 0;
+    }
+    expired_.clear();
+    // first expire the slot we are at, in case we were here before
+    expire_slot(now);
+    while (current_ < target)
+    {
+      // skip ahead to the next occupied level 0 slot, but no further
+      // than the next cascade point
+      const int64_t boundary = (current_ | (SLOTS-1)) + 1;
+      const int64_t limit    = std::min(boundary, target);
+      const int64_t dist     = next_occupied(0, current_ & (SLOTS-1));
+      current_ = (dist > 0) ? std::min(current_ + dist, limit) : limit;
+
+      if ((current_ & (SLOTS-1)) == 0) cascade();
+      expire_slot(now);
+    }
+    // restore deadline order
+    if (expired_.size() > 1) {
+      std::sort(expired_.begin(), expired_.end(),
+        [this] (id_t a, id_t b) { return nodes_[a].time < nodes_[b].time; });
+    }
+    // handlers can insert, so keep the batch separate
+    batch_.swap(expired_);
+    const size_t count = batch_.size();
+    for (auto id : batch_) on_expire(id);
+    batch_.clear();
+    return count;
+  }
+
+  /**
+   * @brief Returns the time the wheel should be expired next, or NEVER
+   * @details This is the earliest deadline due within the level 0 wheel,
+   * or the time of the next cascade of an upper wheel slot when that
+   * comes first, as the slot can hold an earlier deadline.
+   */
+  time_t next() const noexcept
+  {
+    if (count_ == 0) return NEVER;
+    const int idx = current_ & (SLOTS-1);
+    time_t best = NEVER;
+    // deadlines hashed in the current slot
+    if (occupied(0, idx)) {
+      const time_t min = min_deadline(slots_[0][idx]);
+      best = (tick_of(min) <= current_) ? min : time_of(current_);
+    }
+    else if (const int64_t dist = next_occupied(0, idx); dist > 0) {
+      const int64_t tick = current_ + dist;
+      const time_t  min  = min_deadline(slots_[0][tick & (SLOTS-1)]);
+      // lazily moved deadlines are re-hashed when the slot is reached
+      best = (tick_of(min) == tick) ? min : time_of(tick);
+    }
+    return std::min(best, next_cascade());
+  }
+
+private:
+  struct Node {
+    time_t  time = 0;
+    id_t    prev = NONE;
+    id_t    next = NONE;
+    int16_t slot = -1; // level * SLOTS + index, or -1 when unscheduled
+  };
+  std::vector<Node> nodes_;
+  std::array<std::array<id_t, SLOTS>, LEVELS>        slots_;
+  std::array<std::array<uint64_t, SLOTS/64>, LEVELS> occupied_;
+  std::vector<id_t> expired_;
+  std::vector<id_t> batch_;
+  int64_t current_;
+  size_t  count_ = 0;
+
+  static int64_t tick_of(time_t t) noexcept {
+    return (t > 0) ? (t >> TICK_SHIFT) : 0;
+  }
+  static time_t time_of(int64_t tick) noexcept {
+    return tick << TICK_SHIFT;
+  }
+
+  bool occupied(int lvl, int idx) const noexcept {
+    return occupied_[lvl][idx >> 6] & (uint64_t(1) << (idx & 63));
+  }
+
+  /** Distance (1..SLOTS) to the next occupied slot after @idx, or 0 */
+  int64_t next_occupied(int lvl, int idx) const noexcept
+  {
+    const auto& bits = occupied_[lvl];
+    for (int i = 1; i <= SLOTS; )
+    {
+      const int pos  = (idx + i) & (SLOTS-1);
+      const uint64_t word = bits[pos >> 6] >> (pos & 63);
+      if (word) return i + __builtin_ctzll(word);
+      i += 64 - (pos & 63);
+    }
+    return 0;
+  }
+
+  time_t min_deadline(id_t id) const noexcept
+  {
+    time_t min = NEVER;
+    for (; id != NONE; id = nodes_[id].next)
+      min = std::min(min, nodes_[id].time);
+    return min;
+  }
+
+  void link(id_t id, Node& node) noexcept
+  {
+    int64_t tick  = std::max(tick_of(node.time), current_);
+    int64_t delta = tick - current_;
+    if (UNLIKELY(delta > MAX_TICKS)) {
+      // too far out, park it as far as possible and re-hash it later
+      delta = MAX_TICKS;
+      tick  = current_ + delta;
+    }
+    int lvl = 0;
+    while (delta >= (int64_t(1) << (SLOT_BITS * (lvl+1)))) lvl++;
+    const int idx = (tick >> (SLOT_BITS * lvl)) & (SLOTS-1);
+
+    auto& head = slots_[lvl][idx];
+    node.slot = lvl * SLOTS + idx;
+    node.prev = NONE;
+    node.next = head;
+    if (head != NONE) nodes_[head].prev = id;
+    head = id;
+    occupied_[lvl][idx >> 6] |= uint64_t(1) << (idx & 63);
+  }
+
+  void unlink(id_t id, Node& node) noexcept
+  {
+    const int lvl = node.slot / SLOTS;
+    const int idx = node.slot % SLOTS;
+    if (node.prev != NONE) nodes_[node.prev].next = node.next;
+    else slots_[lvl][idx] = node.next;
+    if (node.next != NONE) nodes_[node.next].prev = node.prev;
+    if (slots_[lvl][idx] == NONE)
+      occupied_[lvl][idx >> 6] &= ~(uint64_t(1) << (idx & 63));
+    node.slot = -1;
+  }
+
+  /** Detach the whole list of a slot */
+  id_t take_slot(int lvl, int idx) noexcept
+  {
+    const id_t head = slots_[lvl][idx];
+    slots_[lvl][idx] = NONE;
+    occupied_[lvl][idx >> 6] &= ~(uint64_t(1) << (idx & 63));
+    return head;
+  }
+
+  /** The time the next occupied upper wheel slot is cascaded, or NEVER */
+  time_t next_cascade() const noexcept
+  {
+    int64_t best = NEVER;
+    for (int lvl = 1; lvl < LEVELS; lvl++)
+    {
+      const int shift = lvl * SLOT_BITS;
+      const int64_t d = next_occupied(lvl, (current_ >> shift) & (SLOTS-1));
+      if (d > 0) best = std::min(best, ((current_ >> shift) + d) << shift);
+    }
+    return (best != NEVER) ? time_of(best) : NEVER;
+  }
+
+  /** Re-hash the upper wheel slots that begin at the current tick */
+  void cascade() noexcept
+  {
+    for (int lvl = 1; lvl < LEVELS; lvl++)
+    {
+      const int shift = lvl * SLOT_BITS;
+      const int idx = (current_ >> shift) & (SLOTS-1);
+      for (id_t id = take_slot(lvl, idx); id != NONE; )
+      {
+        auto& node = nodes_[id];
+        const id_t next = node.next;
+        link(id, node);
+        id = next;
+      }
+      // only cascade further when this wheel wrapped around
+      if (idx != 0) break;
+    }
+  }
+
+  void expire_slot(time_t now)
+  {
+    const int idx = current_ & (SLOTS-1);
+    if (not occupied(0, idx)) return;
+    for (id_t id = take_slot(0, idx); id != NONE; )
+    {
+      auto& node = nodes_[id];
+      const id_t next = node.next;
+      if (node.time <= now) {
+        node.slot = -1;
+        count_--;
+        expired_.push_back(id);
+      }
+      else {
+        // not yet due (or lazily moved), re-hash
+        link(id, node);
+      }
+      id = next;
+    }
+  }
+};
+
+#endif
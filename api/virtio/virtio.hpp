@@ -57,6 +57,7 @@
 #define VIRTIO_PCI_ISR                  19  // Interrupt status register
 #define VIRTIO_PCI_CONFIG               20  // Configuration data offset
 #define VIRTIO_PCI_CONFIG_MSIX          24  // .. when MSI-X is enabled
+#define VIRTIO_MSI_NO_VECTOR            0xffff
 
 
 #define VIRTIO_CONFIG_S_ACKNOWLEDGE     1
@@ -205,8 +206,23 @@ public:
 
     /** Kick hypervisor.
 
-        Will notify the host (Qemu/Virtualbox etc.) about pending data  */
-    void kick();
+        Will notify the host (Qemu/Virtualbox etc.) about pending data,
+        unless the device has asked not to be. Returns true if notified. */
+    bool kick();
+
+    /** Use the used_event / avail_event fields to suppress notifications
+        and interrupts, when VIRTIO_F_RING_EVENT_IDX is negotiated.
+        Virtio std. §2.4.7 */
+    void set_event_idx(bool on) noexcept
+    { _event_idx = on; }
+
+    bool event_idx() const noexcept
+    { return _event_idx; }
+
+    /** Whether a device waiting for @event_idx must be notified of
+        the index moving from @old_idx to @new_idx. Virtio std. §2.4.7.2 */
+    static bool need_event(uint16_t event_idx, uint16_t new_idx, uint16_t old_idx) noexcept
+    { return (uint16_t) (new_idx - event_idx - 1) < (uint16_t) (new_idx - old_idx); }
 
     /** Constructor. @param size shuld be fetched from PCI device. */
     Queue() {}
@@ -225,8 +241,13 @@ public:
     Token dequeue();
 
     void disable_interrupts();
-    void enable_interrupts();
+    /** Enable interrupts. Returns false when buffers were used meanwhile,
+        which will not interrupt, so the queue must be polled again. */
+    bool enable_interrupts();
     bool interrupts_enabled() const noexcept;
+    /** Enable interrupts, but with EVENT_IDX only interrupt once three
+        quarters of the buffers now in flight are used */
+    void enable_interrupts_delayed();
 
     /** Release token. @param head : the token ID to release*/
     void release(uint32_t head);
@@ -278,6 +299,13 @@ public:
     /** Initialize the queue buffer */
     void init_queue(int size, char* buf);
 
+    /** Written by us: interrupt when the used index passes this */
+    volatile le16& used_event() noexcept
+    { return _queue.avail->ring[_size]; }
+    /** Written by the device: notify when the avail index passes this */
+    volatile le16& avail_event() noexcept
+    { return *(volatile le16*) &_queue.used->ring[_size]; }
+
     std::string qname;
 
     // The size as read from the PCI device
@@ -292,6 +320,7 @@ public:
     uint16_t _desc_in_flight = 0; // Entries in _queue_desc currently in use
     uint16_t _last_used_idx = 0; // Last known value of _queue.used->idx
     uint16_t _pci_index = 0; // Queue nr.
+    bool _event_idx = false; // VIRTIO_F_RING_EVENT_IDX negotiated
   };
 
 
@@ -327,6 +356,10 @@ public:
   /** Assign a queue descriptor to a PCI queue index */
   bool assign_queue(uint16_t index, const void* queue_desc);
 
+  /** Assign a queue descriptor to a PCI queue index, with its own
+      MSI-X vector (or VIRTIO_MSI_NO_VECTOR for no interrupts) */
+  bool assign_queue(uint16_t index, const void* queue_desc, uint16_t msix_vector);
+
   /** Tell Virtio device if we're OK or not. Virtio Std. § 3.1.1,step 8*/
   void setup_complete(bool ok);
 
@@ -347,6 +380,10 @@ public:
 
   void move_to_this_cpu();
 
+  /** Route MSI-X vector @index to @cpu, where it raises the returned IRQ.
+      The IRQ is subscribed (without a handler) on the events of @cpu. */
+  uint8_t route_msix_vector(uint16_t index, int cpu);
+
   /** Virtio device constructor.
 
       Should conform to Virtio std. §3.1.1, steps 1-6
@@ -374,6 +411,8 @@ private:
 
   uint8_t current_cpu;
   std::vector<uint8_t> irqs;
+  // the CPU each MSI-X vector is routed to
+  std::vector<uint8_t> irq_cpus;
 };
 
 #endif
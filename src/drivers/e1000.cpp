@@ -17,6 +17,7 @@
 
 #include "e1000.hpp"
 #include "e1000_defs.hpp"
+#include <net/packet_burst.hpp>
 #include <kernel/events.hpp>
 #include <kernel/timers.hpp>
 #include <os.hpp>
@@ -66,7 +67,8 @@ static inline uint16_t buffer_size_for_mtu(const uint16_t mtu)
 
 e1000::e1000(hw::PCI_Device& d, uint16_t mtu) :
     Link(Link_protocol{{this, &e1000::transmit}, mac()}),
-    m_pcidev(d), m_mtu(mtu), bufstore_{NUM_PACKET_BUFFERS, buffer_size_for_mtu(mtu)}
+    m_pcidev(d), m_mtu(mtu), bufstore_{NUM_PACKET_BUFFERS, buffer_size_for_mtu(mtu)},
+    tx_stats_{device_name()}
 {
   static_assert((NUM_RX_DESC * sizeof(rx_desc)) % 128 == 0, "Ring length must be 128-byte aligned");
   static_assert((NUM_TX_DESC * sizeof(tx_desc)) % 128 == 0, "Ring length must be 128-byte aligned");
@@ -208,6 +210,10 @@ e1000::e1000(hw::PCI_Device& d, uint16_t mtu) :
   write_cmd(REG_TXDESCLEN, NUM_TX_DESC * sizeof(tx_desc));
   write_cmd(REG_TXDESCHEAD, 0);
   write_cmd(REG_TXDESCTAIL, NUM_TX_DESC-1);
+  // delay TX interrupts, in 1.024 usec units, so one covers a burst
+  // of write-backs. Descriptors ask for it with IDE.
+  write_cmd(REG_TIDV, 32);
+  write_cmd(REG_TADV, 128);
   //write_cmd(REG_TIPG, 0x702008); // p.202
   //write_cmd(REG_TIPG, (10 | (10 << 10) | (10 << 20)));
   // enable, PSP, 0xF coll tresh, 0x3F coll distance
@@ -307,8 +313,7 @@ void e1000::config_msix()
   int m2 = m_pcidev.setup_msix_vector(SMP::cpu_id(), IRQ_BASE + vec2);
   ivar |= (IVAR_INT_ALLOC_VALID | m2) << 16;
 
-  // enable TX interrupts on every writeback regardless of RS bit
-  ivar |= 1 << 31;
+  // TX interrupts on write-back of RS descriptors, after the IDE delay
   write_cmd(REG_IVAR, ivar);
 }
 
@@ -431,6 +436,7 @@ void e1000::link_up()
 
 void e1000::intr_enable()
 {
+  this->intr_on = true;
   if (this->use_msix)
     write_cmd(REG_IMS, MSIX_INTR_MASK());
   else
@@ -438,6 +444,7 @@ void e1000::intr_enable()
 }
 void e1000::intr_disable()
 {
+  this->intr_on = false;
   if (this->use_msix)
     write_cmd(REG_IMC, MSIX_INTR_MASK());
   else
@@ -521,7 +528,7 @@ void e1000::receive_handler()
 {
   uint16_t old_idx = 0;
   uint32_t received = 0;
-  std::array<net::Packet_ptr, NUM_RX_DESC> recv_array;
+  net::Packet_burst recvq;
 
   while (true)
   {
@@ -538,7 +545,7 @@ void e1000::receive_handler()
     assert(buf != nullptr);
     PRINT("[e1000] recv %p -> %u bytes\n", buf, tk.length);
 
-    recv_array[received] = recv_packet(buf, tk.length);
+    recvq.push_back(recv_packet(buf, tk.length));
     received++;
 
     // give new buffer
@@ -553,14 +560,17 @@ void e1000::receive_handler()
   {
     // acknowledge all rx packets
     write_cmd(REG_RXDESCTAIL, old_idx);
-    // process rx packets
-    for (uint32_t i = 0; i < received; i++) {
-      Link_layer::receive(std::move(recv_array[i]));
-    }
+    // process rx packets, as one burst
+    Link_layer::receive_burst(recvq.release());
   }
 }
 
 void e1000::transmit_handler()
+{
+  tx_stats_.irq();
+  this->tx_complete();
+}
+void e1000::tx_complete()
 {
   // try to free transmitted buffers
   do_release_transmitted();
@@ -594,6 +604,9 @@ void e1000::transmit(net::Packet_ptr pckt)
         sendq->chain(std::move(pckt));
   }
 
+  // make room from what the device has sent since the last transmit
+  if (sendq != nullptr) do_release_transmitted();
+
   // send as much as possible from sendq
   while (sendq != nullptr && can_transmit())
   {
@@ -603,11 +616,12 @@ void e1000::transmit(net::Packet_ptr pckt)
     transmit_data(packet->buf() + DRIVER_OFFSET, packet->size());
     // add to sent packets
     tx.sent.push_back(packet);
+    tx_stats_.packets(1);
     // decrement send queue size
     assert(sendq_size > 0);
     sendq_size--;
-    // force kick if tx queue is exactly quarter full
-    if (this->free_transmit_descr() == NUM_TX_DESC / 4) {
+    // let the device start on a large burst
+    if (tx.batch.add(packet->size())) {
       this->xmit_kick();
     }
     // next is the new sendq
@@ -640,7 +654,8 @@ void e1000::transmit_data(uint8_t* data, uint16_t length)
   tk.addr   = (uint64_t) data;
   tk.length = length;
   tk.cso    = 0;
-  tk.cmd    = 0x3 | (1 << 3);
+  // EOP, IFCS, RS and IDE (delayed interrupt)
+  tk.cmd    = 0x3 | (1 << 3) | (1 << 7);
   tk.status = 0;
   tk.css    = 0;
   tk.vlan_tag = 0;
@@ -658,7 +673,9 @@ void e1000::xmit_kick()
 {
   if (tx.deferred) {
     tx.deferred = false;
+    tx.batch.rung();
     write_cmd(REG_TXDESCTAIL, tx.current);
+    tx_stats_.kick();
   }
 }
 void e1000::do_deferred_xmit()
@@ -672,9 +689,24 @@ void e1000::flush()
 {
   this->transmit(std::move(nullptr));
 }
-void e1000::poll()
+bool e1000::poll()
 {
-  this->receive_handler();
+  // one queue, so the interrupts follow the CPU polling it
+  if (busy_poll(SMP::cpu_id()) == this->intr_on) {
+    if (this->intr_on) this->intr_disable();
+    else               this->intr_enable();
+  }
+  bool work = false;
+  if (rx.desc[rx.current].status & 1) {
+    this->receive_handler();
+    work = true;
+  }
+  // sent packets are reclaimed here too, when the interrupts are off
+  if (not tx.sent.empty() and (tx.desc[tx.sent_id].status & 1)) {
+    this->tx_complete();
+    work = true;
+  }
+  return work;
 }
 void e1000::deactivate()
 {
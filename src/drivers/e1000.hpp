@@ -18,6 +18,7 @@
 #include <hw/pci_device.hpp>
 #include <net/link_layer.hpp>
 #include <net/ethernet/ethernet_8021q.hpp>
+#include <hw/tx_batch.hpp>
 #include <deque>
 #include <vector>
 
@@ -75,7 +76,7 @@ public:
 
   void move_to_this_cpu() override;
 
-  void poll() override;
+  bool poll() override;
 
 private:
   void intr_enable();
@@ -102,6 +103,7 @@ private:
   void event_handler();
   void receive_handler();
   void transmit_handler();
+  void tx_complete();
   uint16_t free_transmit_descr() const noexcept;
   bool can_transmit() const noexcept;
   void transmit_data(uint8_t*, uint16_t);
@@ -115,6 +117,7 @@ private:
   bool         use_eeprom = false;
   bool         use_msix = false;
   bool         link_state_up = false;
+  bool         intr_on = false;
   uint16_t     io_base;
   uintptr_t    shm_base;
   MAC::Addr      hw_addr;
@@ -151,10 +154,12 @@ private:
     uint16_t current = 0;
     uint16_t sent_id = 0;
     bool deferred = false;
+    hw::Tx_batch batch {NUM_TX_DESC};
   } tx;
 
   // sendq as packet chain
   net::Packet_ptr  sendq = nullptr;
   size_t           sendq_size = 0;
   net::BufferStore bufstore_;
+  hw::Tx_stats     tx_stats_;
 };
@@ -50,6 +50,8 @@
 #define REG_RDTR         0x2820 // RX Delay Timer Register
 #define REG_RADV         0x282C // RX Int. Absolute Delay Timer
 #define REG_RSRPD        0x2C00 // RX Small Packet Detect Interrupt
+#define REG_TIDV         0x3820 // TX Interrupt Delay Value
+#define REG_TADV         0x382C // TX Int. Absolute Delay Timer
 
 #define REG_RXDCTL(n)    0x2828 + ((n) * 0x100) // RX Descriptor Control
 #define REG_TXDCTL(n)    0x3828 + ((n) * 0x100) // TX Descriptor Control
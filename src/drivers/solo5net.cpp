@@ -88,13 +88,15 @@ net::Packet_ptr Solo5Net::recv_packet()
   return nullptr;
 }
 
-void Solo5Net::poll()
+bool Solo5Net::poll()
 {
   auto pckt_ptr = recv_packet();
 
   if (LIKELY(pckt_ptr != nullptr)) {
     Link::receive(std::move(pckt_ptr));
+    return true;
   }
+  return false;
 }
 
 void Solo5Net::deactivate()
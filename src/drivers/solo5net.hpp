@@ -80,7 +80,7 @@ public:
 
   void flush() override {};
 
-  void poll() override;
+  bool poll() override;
 
 private:
   MAC::Addr mac_addr;
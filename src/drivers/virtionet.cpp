@@ -39,6 +39,8 @@
 
 #include "virtionet.hpp"
 #include <kernel/events.hpp>
+#include <os>
+#include <net/checksum.hpp>
 #include <malloc.h>
 #include <cstring>
 
@@ -49,29 +51,51 @@ struct alignas(SMP_ALIGN) smp_deferred_kick
 {
   std::vector<VirtioNet*> devs;
   uint8_t irq;
+  bool init = false;
 };
 static std::array<smp_deferred_kick, SMP_MAX_CORES> deferred_devs;
 #endif
 
+static void init_deferred_kick(int cpu, Events::event_callback handler)
+{
+#ifndef NO_DEFERRED_KICK
+  auto& defkick = deferred_devs.at(cpu);
+  if (not defkick.init) {
+    defkick.init = true;
+    defkick.irq  = Events::get(cpu).subscribe(handler);
+  }
+#endif
+}
+
 using namespace net;
 
 void VirtioNet::get_config() {
   Virtio::get_config(&_conf, _config_length);
 }
-#define VNET_TOT_BUFFERS() (48 + (queue_size(0) + queue_size(1)) / 2)
+// Mergeable RX buffers: small packets fit in one, full frames span two
+#ifndef VNET_MRG_BUFSIZE
+#define VNET_MRG_BUFSIZE 1024
+#endif
+// TSO super-segments: 64kb of IP packet, plus headers
+#define VNET_TSO_BUFFERS 16
+#define VNET_TSO_BUFSIZE (65536 + 4096)
+// how long a control command is waited for (ns)
+#define VNET_CTRL_TIMEOUT 1000000000ull
 
 VirtioNet::VirtioNet(hw::PCI_Device& d, const uint16_t /*mtu*/)
   : Virtio(d),
     Link(Link_protocol{{this, &VirtioNet::transmit}, mac()}),
     m_pcidev(d),
-    bufstore_{VNET_TOT_BUFFERS(), 2048 /* half-page buffers */},
 
+    tx_stats_{device_name()},
     stat_sendq_max_{Statman::get().create(Stat::UINT64,
                 device_name() + ".sendq_max").get_uint64()},
     stat_sendq_now_{Statman::get().create(Stat::UINT64,
                 device_name() + ".sendq_now").get_uint64()},
     stat_sendq_limit_dropped_{Statman::get().create(Stat::UINT64,
                 device_name() + ".sendq_dropped").get_uint64()},
+    stat_tx_unpaired_dropped_{Statman::get().create(Stat::UINT64,
+                device_name() + ".tx_unpaired_dropped").get_uint64()},
     stat_rx_refill_dropped_{Statman::get().create(Stat::UINT64,
                 device_name() + ".rx_refill_dropped").get_uint64()},
     stat_bytes_rx_total_{Statman::get().create(Stat::UINT64,
@@ -81,17 +105,47 @@ VirtioNet::VirtioNet(hw::PCI_Device& d, const uint16_t /*mtu*/)
     stat_packets_rx_total_{Statman::get().create(Stat::UINT64,
                 device_name() + ".stat_rx_total_packets").get_uint64()},
     stat_packets_tx_total_{Statman::get().create(Stat::UINT64,
-                device_name() + ".stat_tx_total_packets").get_uint64()}
+                device_name() + ".stat_tx_total_packets").get_uint64()},
+    stat_rx_buffers_used_{Statman::get().create(Stat::UINT64,
+                device_name() + ".rx_buffers_used").get_uint64()},
+    stat_rx_buffer_bytes_{Statman::get().create(Stat::UINT64,
+                device_name() + ".rx_buffer_bytes").get_uint64()},
+    stat_rx_frames_merged_{Statman::get().create(Stat::UINT64,
+                device_name() + ".rx_frames_merged").get_uint64()},
+    stat_rx_oversize_dropped_{Statman::get().create(Stat::UINT64,
+                device_name() + ".rx_oversize_dropped").get_uint64()}
 
 {
   INFO("VirtioNet", "Driver initializing");
-#undef VNET_TOT_BUFFERS
+  cpu_pair_.fill(NO_PAIR);
 
   uint32_t needed_features = 0
     | (1 << VIRTIO_NET_F_MAC)
     | (1 << VIRTIO_NET_F_STATUS)
-    ;//| (1 << VIRTIO_NET_F_MRG_RXBUF); //Merge RX Buffers (Everything i 1 buffer)
-  uint32_t wanted_features = needed_features;
+    ;
+  // Offloads are optional, so only ask for the ones the device offers
+  const uint32_t offload_features = 0
+    | (1 << VIRTIO_NET_F_CSUM)
+    | (1 << VIRTIO_NET_F_GUEST_CSUM)
+    | (1 << VIRTIO_NET_F_HOST_TSO4)
+    | (1 << VIRTIO_NET_F_HOST_TSO6)
+    | (1 << VIRTIO_NET_F_MRG_RXBUF)
+    ;
+  // Notification suppression, Virtio 1.01 2.4.7
+  const uint32_t ring_features = 0
+    | (1 << VIRTIO_F_RING_EVENT_IDX)
+    ;
+  // Multiqueue is negotiated over the control queue
+  const uint32_t mq_features = 0
+    | (1 << VIRTIO_NET_F_CTRL_VQ)
+    | (1 << VIRTIO_NET_F_MQ)
+    ;
+  const uint32_t host_features = probe_features();
+  uint32_t wanted_features = needed_features
+    | (host_features & offload_features)
+    | (host_features & ring_features);
+  if ((host_features & mq_features) == mq_features)
+    wanted_features |= mq_features;
   negotiate_features(wanted_features);
 
 
@@ -107,6 +161,12 @@ VirtioNet::VirtioNet(hw::PCI_Device& d, const uint16_t /*mtu*/)
   CHECK(features() & (1 << VIRTIO_NET_F_GUEST_CSUM),
         "Guest handles packets w. partial checksum");
 
+  CHECK(features() & (1 << VIRTIO_NET_F_HOST_TSO4),
+        "Device handles TSOv4");
+
+  CHECK(features() & (1 << VIRTIO_NET_F_HOST_TSO6),
+        "Device handles TSOv6");
+
   CHECK(features() & (1 << VIRTIO_NET_F_CTRL_VQ),
         "There's a control queue");
 
@@ -122,98 +182,249 @@ VirtioNet::VirtioNet(hw::PCI_Device& d, const uint16_t /*mtu*/)
   CHECK(features() & (1 << VIRTIO_NET_F_MQ),
         "There are multiple queue pairs");
 
-  if (features() & (1 << VIRTIO_NET_F_MQ))
-    printf("\t\t* max_virtqueue_pairs: 0x%x \n",_conf.max_virtq_pairs);
-
   CHECK(features() & (1 << VIRTIO_NET_F_MRG_RXBUF),
         "Merge RX buffers");
 
+  // Step 4 - Set config length, based on whether there are multiple queues
+  if (wanted_features & (1 << VIRTIO_NET_F_MQ))
+    _config_length = sizeof(config);
+  else
+    _config_length = sizeof(config) - sizeof(uint16_t);
+
+  // Step 5 - get the mac address (we're demanding this feature)
+  // Step 6 - get the status - demanding this as well.
+  // Getting the MAC + status, and the number of queue pairs
+  get_config();
+
+  CHECK(_conf.mac.major > 0, "Valid Mac address: %s",
+        _conf.mac.str().c_str());
+
+  if (wanted_features & (1 << VIRTIO_NET_F_MQ))
+    printf("\t\t* max_virtqueue_pairs: 0x%x \n",_conf.max_virtq_pairs);
 
-  /** RX que is 0, TX Queue is 1 - Virtio Std. §5.1.2  */
-  new (&rx_q) Virtio::Queue(device_name() + ".rx_q", queue_size(0),0,iobase());
-  new (&tx_q) Virtio::Queue(device_name() + ".tx_q", queue_size(1),1,iobase());
-  new (&ctrl_q) Virtio::Queue(device_name() + ".ctl_q", queue_size(2),2,iobase());
+  /** RX queue N is 2N, TX queue N is 2N+1 - Virtio Std. §5.1.2  */
+  this->home_cpu_ = SMP::cpu_id();
+  const int num_pairs = supported_queue_pairs();
+  pairs_ = std::vector<Queue_pair>(num_pairs);
 
-  // Step 1 - Initialize RX/TX queues
-  auto success = assign_queue(0, rx_q.queue_desc());
-  CHECKSERT(success, "RX queue (%u) assigned (%p) to device",
-        rx_q.size(), rx_q.queue_desc());
+  // Step 1 - Initialize RX/TX queues, one pair per CPU
+  for (int i = 0; i < num_pairs; i++)
+  {
+    auto& qp = pairs_[i];
+    const uint16_t rx_idx = 2 * i, tx_idx = 2 * i + 1;
+    const auto sfx = (i > 0) ? std::to_string(i) : std::string{};
+    new (&qp.rx_q) Virtio::Queue(device_name() + ".rx_q" + sfx,
+                                 queue_size(rx_idx), rx_idx, iobase());
+    new (&qp.tx_q) Virtio::Queue(device_name() + ".tx_q" + sfx,
+                                 queue_size(tx_idx), tx_idx, iobase());
+
+    auto success = assign_queue(rx_idx, qp.rx_q.queue_desc());
+    CHECKSERT(success, "RX queue %d (%u) assigned (%p) to device",
+          i, qp.rx_q.size(), qp.rx_q.queue_desc());
+
+    success = assign_queue(tx_idx, qp.tx_q.queue_desc());
+    CHECKSERT(success, "TX queue %d (%u) assigned (%p) to device",
+          i, qp.tx_q.size(), qp.tx_q.queue_desc());
+
+    const bool event_idx = wanted_features & (1 << VIRTIO_F_RING_EVENT_IDX);
+    qp.rx_q.set_event_idx(event_idx);
+    qp.tx_q.set_event_idx(event_idx);
+    qp.tx_batch = hw::Tx_batch{qp.tx_q.size()};
+    // sent packets are reclaimed on the next transmit
+    qp.tx_q.disable_interrupts();
+  }
 
-  success = assign_queue(1, tx_q.queue_desc());
-  CHECKSERT(success, "TX queue (%u) assigned (%p) to device",
-        tx_q.size(), tx_q.queue_desc());
+  // Half-page buffers for every TX ring, and for the RX rings when the
+  // device does not merge buffers (then they come from rx_bufstore_)
+  const bool mrg_rxbuf = wanted_features & (1 << VIRTIO_NET_F_MRG_RXBUF);
+  uint32_t buffers = 48;
+  for (const auto& qp : pairs_)
+    buffers += (mrg_rxbuf ? 0 : qp.rx_q.size() / 2) + qp.tx_q.size() / 2;
+  this->bufstore_ = std::make_unique<net::BufferStore>(buffers, 2048);
 
   // Step 2 - Initialize Ctrl-queue if it exists
-  if (features() & (1 << VIRTIO_NET_F_CTRL_VQ)) {
-    success = assign_queue(2, tx_q.queue_desc());
+  // With MQ it comes after all the queue pairs, and is polled
+  if (wanted_features & (1 << VIRTIO_NET_F_CTRL_VQ))
+  {
+    const bool mq = wanted_features & (1 << VIRTIO_NET_F_MQ);
+    const uint16_t ctrl_idx = (mq) ? 2 * _conf.max_virtq_pairs : 2;
+    new (&ctrl_q) Virtio::Queue(device_name() + ".ctl_q",
+                                queue_size(ctrl_idx), ctrl_idx, iobase());
+    auto success = (mq)
+      ? assign_queue(ctrl_idx, ctrl_q.queue_desc(), VIRTIO_MSI_NO_VECTOR)
+      : assign_queue(ctrl_idx, ctrl_q.queue_desc());
+    this->has_ctrl_q_ = true;
     CHECKSERT(success, "CTRL queue (%u) assigned (%p) to device",
           ctrl_q.size(), ctrl_q.queue_desc());
   }
 
-  // Step 3 - Fill receive queue with buffers
-  // DEBUG: Disable
-  INFO("VirtioNet", "Adding %u receive buffers of size %u",
-       rx_q.size() / 2, (uint32_t) bufstore().bufsize());
-
-  for (int i = 0; i < rx_q.size() / 2; i++) {
-      add_receive_buffer(bufstore().get_buffer());
+  // Step 3 - Fill receive queues with buffers
+  // With mergeable buffers, frames can span several smaller buffers
+  // and the header has the number of buffers - Virtio 1.01 5.1.6.3
+  if (mrg_rxbuf)
+  {
+    this->vnet_hdr_len_ = sizeof(virtio_net_hdr_mrg_rxbuf);
+    this->rx_bufstore_ = std::make_unique<net::BufferStore>(
+        48 + num_pairs * (pairs_[0].rx_q.size() / 2), VNET_MRG_BUFSIZE);
   }
 
-  // Step 4 - If there are many queues, we should negotiate the number.
-  // Set config length, based on whether there are multiple queues
-  if (features() & (1 << VIRTIO_NET_F_MQ))
-    _config_length = sizeof(config);
-  else
-    _config_length = sizeof(config) - sizeof(uint16_t);
-  // @todo: Specify how many queues we're going to use.
-
-  // Step 5 - get the mac address (we're demanding this feature)
-  // Step 6 - get the status - demanding this as well.
-  // Getting the MAC + status
-  get_config();
+  INFO("VirtioNet", "Adding %u receive buffers of size %u to %d queue(s)",
+       pairs_[0].rx_q.size() / 2, (uint32_t) rx_bufstore().bufsize(), num_pairs);
 
-  CHECK(_conf.mac.major > 0, "Valid Mac address: %s",
-        _conf.mac.str().c_str());
+  // the extra pairs are filled once the device has agreed to use them
+  auto fill_rx = [this] (Queue_pair& qp) {
+    for (int i = 0; i < qp.rx_q.size() / 2; i++)
+      add_receive_buffer(qp.rx_q, rx_bufstore().get_buffer());
+  };
+  fill_rx(pairs_[0]);
 
+  // Step 7 - 9 - Checksum and segmentation offload.
+  // TSO depends on checksum offload, Virtio 1.01 5.1.3.1
+  // @todo: GUEST_TSO needs large (mergeable) receive buffers
+  if (wanted_features & (1 << VIRTIO_NET_F_CSUM))
+  {
+    offload_ |= hw::Nic::TX_CSUM;
+    if (wanted_features & (1 << VIRTIO_NET_F_HOST_TSO4))
+      offload_ |= hw::Nic::TSO4;
+    if (wanted_features & (1 << VIRTIO_NET_F_HOST_TSO6))
+      offload_ |= hw::Nic::TSO6;
+  }
+  if (wanted_features & (1 << VIRTIO_NET_F_GUEST_CSUM))
+    offload_ |= hw::Nic::RX_CSUM;
+  // the frame is a scatterlist anyway, external payload is one more token
+  offload_ |= hw::Nic::TX_SG;
 
-  // Step 7 - 9 - GSO: @todo Not using GSO features yet.
+  if (offload_ & (hw::Nic::TSO4 | hw::Nic::TSO6))
+  {
+    tso_bufstore_ = std::make_unique<net::BufferStore>(
+        VNET_TSO_BUFFERS, VNET_TSO_BUFSIZE);
+    INFO2("TSO enabled, %u buffers of size %u",
+          VNET_TSO_BUFFERS, VNET_TSO_BUFSIZE);
+  }
 
   // Signal setup complete.
   setup_complete((features() & needed_features) == needed_features);
   CHECK((features() & needed_features) == needed_features, "Signalled driver OK");
 
+  // Enable the extra queue pairs - Virtio 1.01 5.1.6.5.5
+  if (num_pairs > 1)
+  {
+    const uint16_t pairs = num_pairs;
+    const bool ok = ctrl_command(VIRTIO_NET_CTRL_MQ,
+                                 VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET,
+                                 &pairs, sizeof(pairs));
+    CHECK(ok, "Enabled %d queue pairs", num_pairs);
+    // the device keeps using the first pair only
+    if (not ok) pairs_.erase(pairs_.begin() + 1, pairs_.end());
+    for (size_t i = 1; i < pairs_.size(); i++)
+      fill_rx(pairs_[i]);
+  }
+
   // Hook up interrupts
   if (has_msix())
   {
     assert(get_msix_vectors() >= 3);
-    auto& irqs = this->get_irqs();
-    // update BSP IDT
-    Events::get().subscribe(irqs[0], {this, &VirtioNet::msix_recv_handler});
-    Events::get().subscribe(irqs[1], {this, &VirtioNet::msix_xmit_handler});
-    Events::get().subscribe(irqs[2], {this, &VirtioNet::msix_conf_handler});
+    this->setup_pair_irqs();
   }
   else
   {
     auto irq = Virtio::get_legacy_irq();
     Events::get().subscribe(irq, {this, &VirtioNet::legacy_handler});
+    pairs_[0].cpu = home_cpu_;
+    cpu_pair_.at(home_cpu_) = 0;
+    init_deferred_kick(home_cpu_, handle_deferred_devices);
   }
 
-#ifndef NO_DEFERRED_KICK
-  static bool init_deferred = false;
-  if (!init_deferred) {
-    init_deferred = true;
-    auto defirq = Events::get().subscribe(handle_deferred_devices);
-    PER_CPU(deferred_devs).irq = defirq;
-  }
-#endif
-
   CHECK(this->link_up(), "Link up");
   // Done
   if (this->link_up()) {
-    rx_q.kick();
+    for (auto& qp : pairs_) qp.rx_q.kick();
   }
 }
 
+int VirtioNet::supported_queue_pairs()
+{
+  if (not (features() & (1 << VIRTIO_NET_F_MQ)) or not has_msix())
+    return 1;
+  // one pair per CPU, within what the device has
+  int pairs = std::min<int>(SMP::active_cpus().size(), _conf.max_virtq_pairs);
+  // each pair needs an RX and a TX vector
+  pairs = std::min<int>(pairs, get_msix_vectors() / 2);
+  return std::max(pairs, 1);
+}
+
+bool VirtioNet::ctrl_command(uint8_t cls, uint8_t cmd,
+                             const void* data, size_t len)
+{
+  if (not has_ctrl_q_ or len > sizeof(ctrl_cmd_.data))
+    return false;
+  auto& c = ctrl_cmd_;
+  c.cls = cls;
+  c.cmd = cmd;
+  memcpy(c.data, data, len);
+  c.ack = VIRTIO_NET_ERR;
+
+  Token token1 {{&c.cls, 2}, Token::OUT };
+  Token token2 {{c.data, len}, Token::OUT };
+  Token token3 {{&c.ack, sizeof(c.ack)}, Token::IN };
+
+  std::array<Token, 3> tokens {{ token1, token2, token3 }};
+  ctrl_q.enqueue(tokens);
+  ctrl_q.kick();
+
+  // the control queue has no interrupts, wait a while for the device
+  const uint64_t deadline = os::nanos_since_boot() + VNET_CTRL_TIMEOUT;
+  while (ctrl_q.new_incoming() == 0)
+  {
+    if (os::nanos_since_boot() > deadline) {
+      // the command is still in the ring, so no more can follow it
+      INFO2("Control command %u:%u timed out", cls, cmd);
+      this->has_ctrl_q_ = false;
+      return false;
+    }
+    asm volatile("pause" ::: "memory");
+  }
+  ctrl_q.dequeue();
+
+  return c.ack == VIRTIO_NET_OK;
+}
+
+void VirtioNet::setup_pair_irqs()
+{
+  auto& irqs = this->get_irqs();
+  const auto& cpus = SMP::active_cpus();
+  // the first pair is serviced on the CPU owning the NIC, with the
+  // config handler, and the rest on the other CPUs in order
+  size_t next = 0;
+  for (size_t i = 0; i < pairs_.size(); i++)
+  {
+    auto& qp = pairs_[i];
+    if (i == 0) {
+      qp.cpu = home_cpu_;
+    }
+    else {
+      if (cpus.at(next) == home_cpu_) next++;
+      qp.cpu = cpus.at(next++);
+    }
+    cpu_pair_.at(qp.cpu) = i;
+
+    auto& events = Events::get(qp.cpu);
+    auto rx_irq = irqs[2*i];
+    auto tx_irq = irqs[2*i + 1];
+    if (qp.cpu != home_cpu_) {
+      rx_irq = this->route_msix_vector(2*i, qp.cpu);
+      tx_irq = this->route_msix_vector(2*i + 1, qp.cpu);
+    }
+    events.subscribe(rx_irq, {[this, &qp] { msix_recv_handler(qp); }});
+    events.subscribe(tx_irq, {[this, &qp] { msix_xmit_handler(qp); }});
+
+    init_deferred_kick(qp.cpu, handle_deferred_devices);
+  }
+  // with a single pair, vector 2 belongs to the control queue
+  if (pairs_.size() == 1)
+    Events::get().subscribe(irqs[2], {this, &VirtioNet::msix_conf_handler});
+}
+
 bool VirtioNet::link_up() const noexcept
 {
   return _conf.status & 1;
@@ -228,49 +439,140 @@ void VirtioNet::msix_conf_handler()
   get_config();
   VDBG("\t    New status: 0x%x \n",_conf.status);
 }
-void VirtioNet::msix_recv_handler()
+void VirtioNet::msix_recv_handler(Queue_pair& qp)
 {
-  auto rx = stat_packets_rx_total_;
+  auto& rx_q = qp.rx_q;
+  uint64_t rx = 0, rx_bytes = 0;
+  int refilled = 0;
+  net::Packet_ptr chain = nullptr;
+  net::Packet* last = nullptr;
   rx_q.disable_interrupts();
   // handle incoming packets as long as bufstore has available buffers
   int max = 128;
-  while (rx_q.new_incoming() && max-- > 0)
+  bool refill_ok = true;
+  while (true)
   {
-    auto res = rx_q.dequeue();
-    VDBG_RX("[virtionet] Recv %u bytes\n", (uint32_t) res.size());
-    auto pckt = recv_packet(res.data(), res.size());
+    while (refill_ok && rx_q.new_incoming() && max-- > 0)
+    {
+      auto res = rx_q.dequeue();
+      VDBG_RX("[virtionet] Recv %u bytes\n", (uint32_t) res.size());
+      int bufs = 1;
+      auto pckt = (mergeable())
+        ? recv_mergeable(rx_q, res, bufs) : recv_packet(res.data(), res.size());
+
+      if (pckt != nullptr)
+      {
+        rx++;
+        rx_bytes += pckt->size();
+
+        auto* next = pckt.get();
+        if (chain == nullptr) chain = std::move(pckt);
+        else last->chain(std::move(pckt));
+        last = next;
+      }
+
+      // Requeue new buffers unless threshold is reached
+      for (int i = 0; i < bufs; i++)
+      {
+        if (not Nic::buffers_still_available(rx_bufstore().buffers_in_use()))
+        {
+          __sync_fetch_and_add(&stat_rx_refill_dropped_, 1);
+          refill_ok = false;
+          break;
+        }
+        add_receive_buffer(rx_q, rx_bufstore().get_buffer());
+        refilled++;
+      }
+    }
+    // left off while busy polling
+    if (busy_poll(qp.cpu)) break;
+    // out of budget or buffers with packets left, which will not interrupt
+    // again, so run again after the other events
+    if (rx_q.new_incoming() and (max <= 0 or not refill_ok))
+    {
+      if (not qp.rx_deferred) {
+        qp.rx_deferred = true;
+        Events::get().defer({[this, &qp] {
+          qp.rx_deferred = false;
+          msix_recv_handler(qp);
+        }});
+      }
+      break;
+    }
+    // packets which arrived before interrupts were enabled again
+    if (rx_q.enable_interrupts()) break;
+    rx_q.disable_interrupts();
+  }
 
-    // Stat increase packets received
-    stat_packets_rx_total_++;
-    stat_bytes_rx_total_ += pckt->size();
+  // Stat increase packets received
+  __sync_fetch_and_add(&stat_packets_rx_total_, rx);
+  __sync_fetch_and_add(&stat_bytes_rx_total_, rx_bytes);
 
-    Link::receive(std::move(pckt));
+  if (refilled > 0) rx_q.kick();
+  if (chain != nullptr) this->deliver(qp, std::move(chain));
+  // sent packets are reclaimed here too, when there is no transmit
+  if (qp.tx_q.new_incoming()) this->tx_complete(qp);
+}
 
-    // Requeue a new buffer unless threshold is reached
-    if (not Nic::buffers_still_available(bufstore().buffers_in_use()))
-    {
-      stat_rx_refill_dropped_++;
-      break;
+void VirtioNet::deliver(Queue_pair& qp, net::Packet_ptr chain)
+{
+  // a receive path registered for this CPU
+  auto& upstream = Nic::cpu_upstream(qp.cpu);
+  if (upstream) {
+    Nic::capture_rx(chain.get());
+    while (chain != nullptr) {
+      auto tail = chain->detach_tail();
+      upstream(std::move(chain));
+      chain = std::move(tail);
     }
-    add_receive_buffer(bufstore().get_buffer());
+    return;
+  }
+  // otherwise the link layer, on the CPU that owns it
+  if (qp.cpu == home_cpu_) {
+    Link::receive_burst(std::move(chain));
+    return;
+  }
+  auto* pckts = chain.release();
+  auto task = [this, pckts] {
+    Link::receive_burst(net::Packet_ptr{pckts});
+  };
+  if (home_cpu_ == 0) {
+    SMP::add_bsp_task(task);
   }
-  rx_q.enable_interrupts();
-  if (rx != stat_packets_rx_total_) rx_q.kick();
+  else {
+    SMP::add_task(task, home_cpu_);
+    SMP::signal(home_cpu_);
+  }
+}
+
+void VirtioNet::msix_xmit_handler(Queue_pair& qp)
+{
+  tx_stats_.irq();
+  qp.tx_q.disable_interrupts();
+  this->tx_complete(qp);
 }
-void VirtioNet::msix_xmit_handler()
+
+int VirtioNet::reclaim_tx(Queue_pair& qp)
 {
+  auto& tx_q = qp.tx_q;
   int dequeued_tx = 0;
-  tx_q.disable_interrupts();
-  // Do one TX-packet
   while (tx_q.new_incoming())
   {
     auto res = tx_q.dequeue();
     assert(res.data() != nullptr);
-    // get packet offset, and call placement Packet deleter directly
-    net::Packet::operator delete(res.data() - sizeof(net::Packet));
+    // the header token is at the start of the packet buffer, and the
+    // packet is destroyed to release any payload attached to it
+    auto* packet = (net::Packet*) (res.data() - sizeof(net::Packet));
+    delete packet;
     dequeued_tx++;
   }
-  tx_q.enable_interrupts();
+  return dequeued_tx;
+}
+
+void VirtioNet::tx_complete(Queue_pair& qp)
+{
+  auto& tx_q = qp.tx_q;
+  const int dequeued_tx = reclaim_tx(qp);
 
   // If we have a transmit queue, eat from it, otherwise let the stack know we
   // have increased transmit capacity
@@ -279,29 +581,60 @@ void VirtioNet::msix_xmit_handler()
     VDBG_TX("[virtionet] %d transmitted\n", dequeued_tx);
 
     // transmit as much as possible from the buffer
-    if (! sendq.empty()) {
-      transmit(nullptr);
+    if (! qp.sendq.empty()) {
+      transmit_pair(qp, nullptr);
     }
 
-    // If we now emptied the buffer, offer packets to stack
-    if (sendq.empty() && tx_q.num_free() > 1) {
+    // If we now emptied the buffer, offer packets to the stack,
+    // which only transmits on the queue pair of its own CPU
+    if (qp.sendq.empty() && tx_q.num_free() > 1 && qp.cpu == home_cpu_) {
       transmit_queue_available_event(tx_q.num_free() / 2);
     }
   }
+  update_tx_interrupts(qp);
+}
+
+void VirtioNet::update_tx_interrupts(Queue_pair& qp)
+{
+  auto& tx_q = qp.tx_q;
+  // a busy polled queue is reclaimed by polling
+  const bool want = not busy_poll(qp.cpu) and hw::Tx_batch::want_interrupt(
+      tx_q.size() - tx_q.num_free(), tx_q.size(), not qp.sendq.empty());
+  // an interrupt already asked for is left alone, the handler renews it
+  if (want and not tx_q.interrupts_enabled())
+    tx_q.enable_interrupts_delayed();
+  else if (not want and tx_q.interrupts_enabled())
+    tx_q.disable_interrupts();
+}
+
+void VirtioNet::kick_tx(Queue_pair& qp)
+{
+  if (not qp.tx_batch.pending()) return;
+  qp.tx_batch.rung();
+  if (qp.tx_q.kick()) tx_stats_.kick();
 }
 
 void VirtioNet::legacy_handler()
 {
-  msix_recv_handler();
-  msix_xmit_handler();
+  msix_recv_handler(pairs_[0]);
+  msix_xmit_handler(pairs_[0]);
 }
 
-void VirtioNet::add_receive_buffer(uint8_t* pkt)
+void VirtioNet::add_receive_buffer(Virtio::Queue& rx_q, uint8_t* pkt)
 {
   assert(pkt >= (uint8_t*) 0x1000);
   // offset pointer to virtionet header
   auto* vnet = pkt + sizeof(Packet);
 
+  if (mergeable())
+  {
+    // header and data in one buffer, filled up by the device
+    Token token {{vnet, rx_bufstore().bufsize() - sizeof(Packet)}, Token::IN };
+    std::array<Token, 1> tokens {{ token }};
+    rx_q.enqueue(tokens);
+    return;
+  }
+
   Token token1 {{vnet, sizeof(virtio_net_hdr)}, Token::IN };
   Token token2 {{vnet + sizeof(virtio_net_hdr), max_packet_len()}, Token::IN };
 
@@ -320,28 +653,141 @@ VirtioNet::recv_packet(uint8_t* data, uint16_t size)
       size,
       &bufstore());
 
+  handle_rx_header(*(virtio_net_hdr*) data, *ptr);
+
   return net::Packet_ptr(ptr);
 }
 
+net::Packet_ptr
+VirtioNet::recv_mergeable(Virtio::Queue& rx_q, Token first, int& bufs)
+{
+  const auto hdr = *(virtio_net_hdr_mrg_rxbuf*) first.data();
+  const int num_buffers = std::max<int>(hdr.num_buffers, 1);
+  const int data_size = rx_bufstore().bufsize() - sizeof(net::Packet);
+
+  __sync_fetch_and_add(&stat_rx_buffers_used_, num_buffers);
+  __sync_fetch_and_add(&stat_rx_buffer_bytes_, num_buffers * data_size);
+
+  if (LIKELY(num_buffers == 1))
+  {
+    auto* ptr = (net::Packet*) (first.data() - sizeof(net::Packet));
+    new (ptr) net::Packet(
+        vnet_hdr_len_,
+        first.size() - vnet_hdr_len_,
+        data_size,
+        &rx_bufstore());
+    handle_rx_header((const virtio_net_hdr&) hdr, *ptr);
+    return net::Packet_ptr(ptr);
+  }
+
+  // The frame spans several buffers. The stack takes frames in one piece,
+  // so gather them into a full size packet and recycle the small buffers.
+  auto* ptr = (net::Packet*) bufstore().get_buffer();
+  new (ptr) net::Packet(
+      vnet_hdr_len_,
+      0,
+      bufstore().bufsize() - sizeof(net::Packet),
+      &bufstore());
+  net::Packet_ptr pckt(ptr);
+
+  int copied = 0;
+  bool fits  = true;
+  auto gather = [&] (Token tok, int offset) {
+    const int len = tok.size() - offset;
+    if (copied + len <= pckt->capacity())
+      memcpy(pckt->layer_begin() + copied, tok.data() + offset, len);
+    else
+      fits = false;
+    copied += len;
+    rx_bufstore().release(tok.data() - sizeof(net::Packet));
+  };
+
+  gather(first, vnet_hdr_len_);
+  // the device makes all buffers of a frame used at once
+  for (bufs = 1; bufs < num_buffers and rx_q.new_incoming(); bufs++)
+    gather(rx_q.dequeue(), 0);
+
+  if (UNLIKELY(not fits or bufs < num_buffers))
+  {
+    __sync_fetch_and_add(&stat_rx_oversize_dropped_, 1);
+    return nullptr;
+  }
+
+  pckt->set_data_end(copied);
+  handle_rx_header((const virtio_net_hdr&) hdr, *pckt);
+  __sync_fetch_and_add(&stat_rx_frames_merged_, 1);
+  return pckt;
+}
+
+void VirtioNet::handle_rx_header(const virtio_net_hdr& hdr,
+                                 net::Packet& pckt) const noexcept
+{
+  if (hdr.flags & VIRTIO_NET_HDR_F_DATA_VALID)
+  {
+    pckt.set_checksum_verified();
+  }
+  else if (hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM)
+  {
+    // The packet has a partial checksum, e.g. from a peer on the same host.
+    // The checksum field holds the pseudo-header sum, so completing it is
+    // a checksum over everything from csum_start.
+    auto* start = pckt.layer_begin() + hdr.csum_start;
+    if (UNLIKELY(start + hdr.csum_offset + sizeof(uint16_t) > pckt.data_end()))
+      return;
+    const uint16_t csum = net::checksum(start, pckt.data_end() - start);
+    memcpy(start + hdr.csum_offset, &csum, sizeof(csum));
+    pckt.set_checksum_verified();
+  }
+}
+
 net::Packet_ptr
 VirtioNet::create_packet(int link_offset)
 {
   auto* ptr = (net::Packet*) bufstore().get_buffer();
 
   new (ptr) net::Packet(
-        sizeof(virtio_net_hdr) + link_offset,
+        sizeof(virtio_net_hdr_mrg_rxbuf) + link_offset,
         0,
-        sizeof(virtio_net_hdr) + frame_offset_link() + MTU(),
+        sizeof(virtio_net_hdr_mrg_rxbuf) + frame_offset_link() + MTU(),
         &bufstore());
 
   return net::Packet_ptr(ptr);
 }
 
+net::Packet_ptr
+VirtioNet::create_gso_packet(int link_offset)
+{
+  if (tso_bufstore_ == nullptr)
+    return create_packet(link_offset);
+
+  auto* ptr = (net::Packet*) tso_bufstore_->get_buffer();
+
+  new (ptr) net::Packet(
+        sizeof(virtio_net_hdr_mrg_rxbuf) + link_offset,
+        0,
+        sizeof(virtio_net_hdr_mrg_rxbuf) + frame_offset_link() + gso_max_size(),
+        tso_bufstore_.get());
+
+  return net::Packet_ptr(ptr);
+}
+
 void VirtioNet::transmit(net::Packet_ptr pckt)
 {
+  auto* qp = this_cpu_pair();
+  if (UNLIKELY(qp == nullptr)) {
+    __sync_fetch_and_add(&stat_tx_unpaired_dropped_, pckt->chain_length());
+    return;
+  }
+  transmit_pair(*qp, std::move(pckt));
+}
+
+void VirtioNet::transmit_pair(Queue_pair& qp, net::Packet_ptr pckt)
+{
+  auto& sendq = qp.sendq;
+  auto& tx_q  = qp.tx_q;
   while (pckt != nullptr) {
     if (not Nic::sendq_still_available(sendq.size())) {
-      stat_sendq_limit_dropped_ += pckt->chain_length();
+      __sync_fetch_and_add(&stat_sendq_limit_dropped_, pckt->chain_length());
       break;
     }
     VDBG_TX("[virtionet] tx: Transmitting %#zu sized packet \n",
@@ -356,92 +802,151 @@ void VirtioNet::transmit(net::Packet_ptr pckt)
   if (sendq.size() > stat_sendq_max_)
     stat_sendq_max_ = sendq.size();
 
-  auto tx = this->stat_packets_tx_total_;
+  uint64_t tx = 0, tx_bytes = 0;
 
   VDBG_TX("[virtionet] tx: packets in send queue %#zu\n",
           sendq.size());
 
+  // make room from what the device has sent since the last transmit
+  reclaim_tx(qp);
+
   // Transmit all we can directly
-  while (tx_q.num_free() > 1 and !sendq.empty())
+  while (!sendq.empty() and tx_q.num_free() >= tx_tokens(*sendq.front()))
   {
     VDBG_TX("[virtionet] tx: %u tokens left in TX ring \n",
             tx_q.num_free());
 
     auto* next = sendq.front().release();
     sendq.pop_front();
-    enqueue_tx(next);
-
     // Increase TX-stats
-    stat_packets_tx_total_++;
-    stat_bytes_tx_total_ += next->size();
-    stat_packets_tx_total_++;
+    const uint32_t bytes = next->size() + next->ext_length();
+    tx++;
+    tx_bytes += bytes;
+
+    enqueue_tx(tx_q, next);
+    // let the device start on a large burst
+    if (qp.tx_batch.add(bytes)) kick_tx(qp);
   }
 
   VDBG_TX("[virtionet] tx: packet enqueued\n");
 
-  if (tx != this->stat_packets_tx_total_) {
+  if (tx > 0) {
+    __sync_fetch_and_add(&stat_packets_tx_total_, tx);
+    __sync_fetch_and_add(&stat_bytes_tx_total_, tx_bytes);
+    tx_stats_.packets(tx);
 #ifdef NO_DEFERRED_KICK
-    tx_q.kick();
+    kick_tx(qp);
 #else
-    if (!deferred_kick) {
-      deferred_kick = true;
-      PER_CPU(deferred_devs).devs.push_back(this);
-      Events::get().trigger_event(PER_CPU(deferred_devs).irq);
+    auto& defkick = PER_CPU(deferred_devs);
+    if (not defkick.init) {
+      kick_tx(qp);
+    }
+    else if (!qp.deferred_kick) {
+      qp.deferred_kick = true;
+      defkick.devs.push_back(this);
+      Events::get().trigger_event(defkick.irq);
     }
 #endif
   }
+  update_tx_interrupts(qp);
 }
 
-void VirtioNet::enqueue_tx(net::Packet* pckt)
+void VirtioNet::enqueue_tx(Virtio::Queue& tx_q, net::Packet* pckt)
 {
-  Expects(pckt->layer_begin() == pckt->buf() + sizeof(virtio_net_hdr));
+  // the header is a token of its own, at the start of the buffer in
+  // front of the frame, so reclaim_tx() finds the packet from it
+  // whatever the header length (12 bytes with MRG_RXBUF, else 10)
+  Expects(pckt->layer_begin() - pckt->buf() >= vnet_hdr_len_);
   auto* hdr = pckt->buf();
-  memset(hdr, 0, sizeof(virtio_net_hdr));
+  memset(hdr, 0, vnet_hdr_len_);
+  fill_tx_header(*(virtio_net_hdr*) hdr, *pckt);
   VDBG_TX("[virtionet] tx: Transmit %u bytes\n", (uint32_t) pckt->size());
 
-  Token token1 {{ hdr, sizeof(virtio_net_hdr)}, Token::OUT };
+  Token token1 {{ hdr, vnet_hdr_len_}, Token::OUT };
   Token token2 {{ pckt->layer_begin(), pckt->size()}, Token::OUT };
 
+  if (pckt->has_ext_payload())
+  {
+    // the payload is read from where it is, kept alive by the packet
+    Token token3 {{ (uint8_t*) pckt->ext_data(), pckt->ext_length()}, Token::OUT };
+    std::array<Token, 3> tokens {{ token1, token2, token3 }};
+    tx_q.enqueue(tokens);
+    return;
+  }
+
   std::array<Token, 2> tokens {{ token1, token2 }};
 
   // Enqueue scatterlist, 2 pieces readable, 0 writable.
   tx_q.enqueue(tokens);
 }
 
+void VirtioNet::fill_tx_header(virtio_net_hdr& hdr,
+                               const net::Packet& pckt) const noexcept
+{
+  if (pckt.checksum_state() != net::Packet::Checksum::PARTIAL)
+    return;
+
+  hdr.flags       = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+  hdr.csum_start  = pckt.csum_start() - pckt.layer_begin();
+  hdr.csum_offset = pckt.csum_offset();
+
+  if (pckt.gso_type() == net::Packet::GSO::NONE)
+    return;
+
+  hdr.gso_type = (pckt.gso_type() == net::Packet::GSO::TCPV6)
+    ? VIRTIO_NET_HDR_GSO_TCPV6 : VIRTIO_NET_HDR_GSO_TCPV4;
+  hdr.gso_size = pckt.gso_size();
+  // all headers, up to and including TCP (data offset in 32-bit words)
+  hdr.hdr_len  = hdr.csum_start + (pckt.csum_start()[12] >> 4) * 4;
+}
+
 void VirtioNet::handle_deferred_devices()
 {
 #ifndef NO_DEFERRED_KICK
   for (auto* dev : PER_CPU(deferred_devs).devs)
-  if (dev->deferred_kick)
   {
-    dev->deferred_kick = false;
-    // kick transmitq
-    dev->tx_q.kick();
+    auto* qp = dev->this_cpu_pair();
+    if (qp and qp->deferred_kick)
+    {
+      qp->deferred_kick = false;
+      // kick transmitq
+      dev->kick_tx(*qp);
+    }
   }
   PER_CPU(deferred_devs).devs.clear();
 #endif
 }
 
-void VirtioNet::poll()
+bool VirtioNet::poll()
 {
-  msix_recv_handler();
-  msix_xmit_handler();
+  auto* pair = this_cpu_pair();
+  if (pair == nullptr) return false;
+  auto& qp = *pair;
+  const bool work = qp.rx_q.new_incoming() or qp.tx_q.new_incoming()
+                 or qp.deferred_kick;
+  // while busy polling there are no interrupts to re-arm either
+  if (not work and busy_poll(qp.cpu)) return false;
+  msix_recv_handler(qp);
+  tx_complete(qp);
   // flush transmit_q immediately
-  if (this->deferred_kick)
+  if (qp.deferred_kick)
   {
-    this->deferred_kick = false;
-    this->tx_q.enable_interrupts();
-    this->tx_q.kick();
+    qp.deferred_kick = false;
+    kick_tx(qp);
   }
+  return work;
 }
 
 void VirtioNet::deactivate()
 {
   VDBG("[virtionet] Disabling device\n");
   /// disable interrupts on virtio queues
-  rx_q.disable_interrupts();
-  tx_q.disable_interrupts();
-  ctrl_q.disable_interrupts();
+  for (auto& qp : pairs_) {
+    qp.rx_q.disable_interrupts();
+    qp.tx_q.disable_interrupts();
+  }
+  if (has_ctrl_q_)
+    ctrl_q.disable_interrupts();
 
   // reset device
   this->Virtio::reset();
@@ -452,18 +957,22 @@ void VirtioNet::move_to_this_cpu()
   INFO("VirtioNet", "Moving to CPU %d", SMP::cpu_id());
   // update CPU id in bufferstore
   bufstore().move_to_this_cpu();
+  if (tso_bufstore_) tso_bufstore_->move_to_this_cpu();
+  if (rx_bufstore_) rx_bufstore_->move_to_this_cpu();
+  // the link layer is now serviced here
+  this->home_cpu_ = SMP::cpu_id();
+  cpu_pair_.fill(NO_PAIR);
   // virtio IRQ balancing
   this->Virtio::move_to_this_cpu();
-  // reset the IRQ handlers on this CPU
-  auto& irqs = this->Virtio::get_irqs();
-  Events::get().subscribe(irqs[0], {this, &VirtioNet::msix_recv_handler});
-  Events::get().subscribe(irqs[1], {this, &VirtioNet::msix_xmit_handler});
-  Events::get().subscribe(irqs[2], {this, &VirtioNet::msix_conf_handler});
-#ifndef NO_DEFERRED_KICK
-  // update deferred kick IRQ
-  auto defirq = Events::get().subscribe(handle_deferred_devices);
-  PER_CPU(deferred_devs).irq = defirq;
-#endif
+  // reset the IRQ handlers, with the first queue pair on this CPU
+  if (has_msix()) {
+    this->setup_pair_irqs();
+  }
+  else {
+    pairs_[0].cpu = home_cpu_;
+    cpu_pair_.at(home_cpu_) = 0;
+    init_deferred_kick(home_cpu_, handle_deferred_devices);
+  }
 }
 
 #include <kernel/pci_manager.hpp>
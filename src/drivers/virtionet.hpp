@@ -35,6 +35,7 @@
 
 #include <common>
 #include <hw/pci_device.hpp>
+#include <hw/tx_batch.hpp>
 #include <virtio/virtio.hpp>
 #include <net/packet.hpp>
 #include <net/buffer_store.hpp>
@@ -44,6 +45,7 @@
 #include <delegate>
 #include <deque>
 #include <statman>
+#include <smp>
 
 /** Virtio Net Features. From Virtio Std. 5.1.3 */
 
@@ -113,6 +115,20 @@
 #define VIRTIO_NET_S_LINK_UP  1
 #define VIRTIO_NET_S_ANNOUNCE 2
 
+// From Virtio 1.01, 5.1.6 (virtio_net_hdr flags and gso_type)
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM 1
+#define VIRTIO_NET_HDR_F_DATA_VALID 2
+#define VIRTIO_NET_HDR_GSO_NONE     0
+#define VIRTIO_NET_HDR_GSO_TCPV4    1
+#define VIRTIO_NET_HDR_GSO_UDP      3
+#define VIRTIO_NET_HDR_GSO_TCPV6    4
+
+// From Virtio 1.01, 5.1.6.5 (control virtqueue)
+#define VIRTIO_NET_OK  0
+#define VIRTIO_NET_ERR 1
+#define VIRTIO_NET_CTRL_MQ 4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET 0
+
 /** Virtio-net device driver.  */
 class VirtioNet : Virtio, public net::Link_layer<net::Ethernet> {
 public:
@@ -140,6 +156,15 @@ public:
 
   net::Packet_ptr create_packet(int) override;
 
+  uint32_t offload_features() const noexcept override
+  { return offload_; }
+
+  /** Largest IP packet handed to the device for segmentation */
+  uint32_t gso_max_size() const noexcept override
+  { return (tso_bufstore_) ? 65535 : MTU(); }
+
+  net::Packet_ptr create_gso_packet(int) override;
+
   net::downstream create_physical_downstream() override
   { return {this, &VirtioNet::transmit}; }
 
@@ -152,22 +177,26 @@ public:
 
   /** Space available in the transmit queue, in packets */
   size_t transmit_queue_available() override {
-    return tx_q.num_free() / 2;
+    auto* qp = this_cpu_pair();
+    return (qp) ? qp->tx_q.num_free() / 2 : 0;
   }
 
+  int queue_pairs() const noexcept override
+  { return pairs_.size(); }
+
   bool link_up() const noexcept;
 
-  auto& bufstore() noexcept { return bufstore_; }
+  auto& bufstore() noexcept { return *bufstore_; }
 
   void deactivate() override;
 
   void flush() override {
-    tx_q.kick();
+    if (auto* qp = this_cpu_pair()) kick_tx(*qp);
   };
 
   void move_to_this_cpu() override;
 
-  void poll() override;
+  bool poll() override;
 
 private:
   hw::PCI_Device& m_pcidev;
@@ -182,8 +211,8 @@ private:
   }__attribute__((packed));
 
   /** Virtio std. § 5.1.6.1:
-      "The legacy driver only presented num_buffers in the struct virtio_net_hdr when VIRTIO_NET_F_MRG_RXBUF was not negotiated; without that feature the structure was 2 bytes shorter." */
-  struct virtio_net_hdr_nomerge {
+      "The legacy driver only presented num_buffers in the struct virtio_net_hdr when VIRTIO_NET_F_MRG_RXBUF was negotiated; without that feature the structure was 2 bytes shorter." */
+  struct virtio_net_hdr_mrg_rxbuf {
     uint8_t flags;
     uint8_t gso_type;
     uint16_t hdr_len;          // Ethernet + IP + TCP/UDP headers
@@ -193,9 +222,43 @@ private:
     uint16_t num_buffers;
   }__attribute__((packed));
 
-  Virtio::Queue rx_q;
-  Virtio::Queue tx_q;
+  /** A receive and transmit queue pair, serviced by one CPU.
+      With VIRTIO_NET_F_MQ there is one pair per CPU - Virtio 1.01 § 5.1.2 */
+  struct alignas(SMP_ALIGN) Queue_pair {
+    Virtio::Queue rx_q;
+    Virtio::Queue tx_q;
+    std::deque<net::Packet_ptr> sendq;
+    hw::Tx_batch tx_batch;
+    int  cpu = 0;
+    bool deferred_kick = false;
+    // the receive handler is run again later, with work left
+    bool rx_deferred = false;
+  };
+  std::vector<Queue_pair> pairs_;
+  static constexpr uint8_t NO_PAIR = 0xff;
+  // the queue pair each CPU services, the rings are not locked
+  // so CPUs without a pair of their own can not transmit
+  SMP::Array<uint8_t> cpu_pair_;
+  // the CPU running the link layer and the stack above it
+  int home_cpu_ = 0;
+
+  /** The queue pair of this CPU, or nullptr if it has none */
+  Queue_pair* this_cpu_pair() noexcept
+  {
+    const auto idx = PER_CPU(cpu_pair_);
+    return (idx != NO_PAIR) ? &pairs_[idx] : nullptr;
+  }
+
   Virtio::Queue ctrl_q;
+  bool has_ctrl_q_ = false;
+  // a control command, where the device may still write the
+  // status after ctrl_command() has given up on it
+  struct Ctrl_command {
+    uint8_t cls;
+    uint8_t cmd;
+    uint8_t data[8];
+    uint8_t ack;
+  } __attribute__((packed)) ctrl_cmd_ {};
 
   // From Virtio 1.01, 5.1.4
   struct config{
@@ -212,41 +275,94 @@ private:
   /** Get virtio PCI config. @see Virtio::get_config.*/
   void get_config();
 
+  /** Number of queue pairs we can service, one per CPU */
+  int supported_queue_pairs();
+
+  /** Send a command on the control queue, waiting a while for the device to ack */
+  bool ctrl_command(uint8_t cls, uint8_t cmd, const void* data, size_t len);
+
+  /** Route each queue pair's MSI-X vectors to its CPU */
+  void setup_pair_irqs();
+
+  /** Transmit on the queue pair of a CPU */
+  void transmit_pair(Queue_pair&, net::Packet_ptr pckt);
+  /** Ring the TX doorbell, if there is anything the device doesn't know of */
+  void kick_tx(Queue_pair&);
+  /** Release the packets the device has sent, returns how many */
+  int  reclaim_tx(Queue_pair&);
+  /** Reclaim sent packets and send more, from the sendq or the stack */
+  void tx_complete(Queue_pair&);
+  /** Only take TX interrupts when the ring is filling up */
+  void update_tx_interrupts(Queue_pair&);
+
   /** Add packet to transmit ring */
-  void enqueue_tx(net::Packet* pckt);
+  void enqueue_tx(Virtio::Queue& tx_q, net::Packet* pckt);
+  /** Descriptors needed for a packet: header, frame and external payload */
+  static int tx_tokens(const net::Packet& pckt) noexcept
+  { return (pckt.has_ext_payload()) ? 3 : 2; }
+
+  /** Fill in checksum and segmentation offload for the device */
+  void fill_tx_header(virtio_net_hdr& hdr, const net::Packet& pckt) const noexcept;
+
+  /** Apply the receive checksum state from the device */
+  void handle_rx_header(const virtio_net_hdr& hdr, net::Packet& pckt) const noexcept;
 
   /** Handle device IRQ.
       Will look for config changes and service RX/TX queues as necessary.*/
-  void msix_recv_handler();
-  void msix_xmit_handler();
+  void msix_recv_handler(Queue_pair&);
+  void msix_xmit_handler(Queue_pair&);
   void msix_conf_handler();
 
+  /** Pass received packets up, on the CPU that should handle them */
+  void deliver(Queue_pair&, net::Packet_ptr chain);
+
   /** Legacy IRQ handler */
   void legacy_handler();
 
   /** Allocate and queue buffer from bufstore_ in RX queue. */
-  void add_receive_buffer(uint8_t*);
+  void add_receive_buffer(Virtio::Queue&, uint8_t*);
 
   std::unique_ptr<net::Packet> recv_packet(uint8_t* data, uint16_t sz);
 
-  void begin_deferred_kick();
-  bool deferred_kick = false;
+  /** Receive a frame from one or more mergeable buffers, counting the
+      buffers consumed. Returns nullptr if the frame had to be dropped. */
+  net::Packet_ptr recv_mergeable(Virtio::Queue& rx_q, Token first, int& bufs);
+
+  /** The store receive buffers come from */
+  net::BufferStore& rx_bufstore() noexcept
+  { return (rx_bufstore_) ? *rx_bufstore_ : *bufstore_; }
+
+  bool mergeable() const noexcept
+  { return rx_bufstore_ != nullptr; }
+
   static void handle_deferred_devices();
 
-  net::BufferStore bufstore_;
+  // sized by the queue pairs, so created with them
+  std::unique_ptr<net::BufferStore> bufstore_ = nullptr;
+  // large buffers for TSO super-segments, only when TSO is negotiated
+  std::unique_ptr<net::BufferStore> tso_bufstore_ = nullptr;
+  // offload features negotiated, see hw::Nic::Offload
+  uint32_t offload_ = 0;
+  // small receive buffers, only with VIRTIO_NET_F_MRG_RXBUF
+  std::unique_ptr<net::BufferStore> rx_bufstore_ = nullptr;
+  // size of the header in front of each frame, see virtio_net_hdr
+  uint16_t vnet_hdr_len_ = sizeof(virtio_net_hdr);
 
   /** Stats */
+  hw::Tx_stats tx_stats_;
   uint64_t& stat_sendq_max_;
   uint64_t& stat_sendq_now_;
   uint64_t& stat_sendq_limit_dropped_;
+  uint64_t& stat_tx_unpaired_dropped_;
   uint64_t& stat_rx_refill_dropped_;
   uint64_t& stat_bytes_rx_total_;
   uint64_t& stat_bytes_tx_total_;
   uint64_t& stat_packets_rx_total_;
   uint64_t& stat_packets_tx_total_;
-
-  std::deque<net::Packet_ptr> sendq{};
-
+  uint64_t& stat_rx_buffers_used_;
+  uint64_t& stat_rx_buffer_bytes_;
+  uint64_t& stat_rx_frames_merged_;
+  uint64_t& stat_rx_oversize_dropped_;
 };
 
 #endif
@@ -18,6 +18,7 @@
 // loosely based on iPXE driver as well as from Linux driver by VMware
 #include "vmxnet3.hpp"
 #include "vmxnet3_queues.hpp"
+#include <net/packet_burst.hpp>
 
 #include <kernel/events.hpp>
 #include <smp>
@@ -25,7 +26,23 @@
 #include <info>
 #include <cassert>
 #include <malloc.h>
-static std::vector<vmxnet3*> deferred_devs;
+
+struct alignas(SMP_ALIGN) smp_deferred_kick
+{
+  std::vector<vmxnet3*> devs;
+  uint8_t irq;
+  bool init = false;
+};
+static std::array<smp_deferred_kick, SMP_MAX_CORES> deferred_devs;
+
+static void init_deferred_kick(int cpu, Events::event_callback handler)
+{
+  auto& defkick = deferred_devs.at(cpu);
+  if (not defkick.init) {
+    defkick.init = true;
+    defkick.irq  = Events::get(cpu).subscribe(handler);
+  }
+}
 
 #define VMXNET3_REV1_MAGIC 0xbabefee1
 #define VMXNET3_MAX_BUFFER_LEN 0x4000
@@ -46,19 +63,24 @@ static const int VMXNET3_RX_FILL = vmxnet3::NUM_RX_DESC;
  * single allocation
  */
 struct vmxnet3_dma {
-  /** TX ring */
-  struct vmxnet3_tx_desc tx_desc[vmxnet3::NUM_TX_DESC];
-  struct vmxnet3_tx_comp tx_comp[VMXNET3_NUM_TX_COMP];
-  /** RX ring */
+  /** TX rings */
+  struct vmxnet3_tx {
+    struct vmxnet3_tx_desc desc[vmxnet3::NUM_TX_DESC];
+    struct vmxnet3_tx_comp comp[VMXNET3_NUM_TX_COMP];
+  };
+  struct vmxnet3_tx tx[vmxnet3::MAX_QUEUES];
+  /** RX rings */
   struct vmxnet3_rx {
     struct vmxnet3_rx_desc desc[vmxnet3::NUM_RX_DESC];
     struct vmxnet3_rx_comp comp[VMXNET3_NUM_RX_COMP];
   };
-  struct vmxnet3_rx rx[vmxnet3::NUM_RX_QUEUES];
+  struct vmxnet3_rx rx[vmxnet3::MAX_QUEUES];
   /** Queue descriptors */
   struct vmxnet3_queues queues;
   /** Shared area */
   struct vmxnet3_shared shared;
+  /** RSS configuration */
+  struct vmxnet3_rss_config rss;
 
 } __attribute__ ((aligned(VMXNET3_DMA_ALIGN)));
 
@@ -74,6 +96,9 @@ struct vmxnet3_dma {
 #define VMXNET3_VD_MAC_HI 0x30
 #define VMXNET3_VD_ECR    0x40
 
+/** Entries in use in the RSS indirection table */
+#define VMXNET3_RSS_IND_TABLE_SIZE (vmxnet3::MAX_QUEUES * 4)
+
 /** Commands */
 enum vmxnet3_command {
   VMXNET3_CMD_FIRST_SET = 0xcafe0000,
@@ -123,6 +148,7 @@ static inline uint16_t buffer_size_for_mtu(const uint16_t mtu)
 vmxnet3::vmxnet3(hw::PCI_Device& d, const uint16_t mtu) :
     Link(Link_protocol{{this, &vmxnet3::transmit}, mac()}),
     m_pcidev(d), m_mtu(mtu),
+    tx_stats_{device_name()},
     stat_sendq_cur{Statman::get().create(Stat::UINT32, device_name() + ".sendq_now").get_uint32()},
     stat_sendq_max{Statman::get().create(Stat::UINT32, device_name() + ".sendq_max").get_uint32()},
 
@@ -135,10 +161,12 @@ vmxnet3::vmxnet3(hw::PCI_Device& d, const uint16_t mtu) :
 
     stat_rx_refill_dropped{Statman::get().create(Stat::UINT64, device_name() + ".rx_refill_dropped").get_uint64()},
     stat_sendq_dropped{Statman::get().create(Stat::UINT64, device_name() + ".sendq_dropped").get_uint64()},
+    stat_tx_unpaired_dropped{Statman::get().create(Stat::UINT64, device_name() + ".tx_unpaired_dropped").get_uint64()},
     bufstore_{1024, buffer_size_for_mtu(mtu)}
 {
   INFO("vmxnet3", "Driver initializing (rev=%#x)", d.rev_id());
   assert(d.rev_id() == REVISION_ID);
+  cpu_pair_.fill(NO_PAIR);
   Statman::get().create(Stat::UINT32, device_name() + ".buffer_size")
       .get_uint32() = bufstore_.bufsize();
 
@@ -147,25 +175,15 @@ vmxnet3::vmxnet3(hw::PCI_Device& d, const uint16_t mtu) :
   // find BARs etc.
   d.probe_resources();
 
+  this->home_cpu_ = SMP::cpu_id();
   if (d.msix_cap())
   {
     d.init_msix();
     uint8_t msix_vectors = d.get_msix_vectors();
     INFO2("[x] Device has %u MSI-X vectors", msix_vectors);
     assert(msix_vectors >= 3);
-    if (msix_vectors > 2 + NUM_RX_QUEUES) msix_vectors = 2 + NUM_RX_QUEUES;
-
-    for (int i = 0; i < msix_vectors; i++)
-    {
-      auto irq = Events::get().subscribe(nullptr);
-      this->irqs.push_back(irq);
-      d.setup_msix_vector(SMP::cpu_id(), IRQ_BASE + irq);
-    }
-
-    Events::get().subscribe(irqs[0], {this, &vmxnet3::msix_evt_handler});
-    Events::get().subscribe(irqs[1], {this, &vmxnet3::msix_xmit_handler});
-    for (int q = 0; q < NUM_RX_QUEUES; q++)
-    Events::get().subscribe(irqs[2 + q], {this, &vmxnet3::msix_recv_handler});
+    pairs_ = std::vector<Queue_pair>(supported_queue_pairs(msix_vectors));
+    INFO2("[x] Using %zu queue pairs", pairs_.size());
   }
   else {
     assert(0 && "This driver does not support legacy IRQs");
@@ -206,34 +224,41 @@ vmxnet3::vmxnet3(hw::PCI_Device& d, const uint16_t mtu) :
   memset(this->dma, 0, sizeof(vmxnet3_dma));
 
   auto& queues = dma->queues;
-  // setup tx queues
-  queues.tx.cfg.desc_address = (uintptr_t) &dma->tx_desc;
-  queues.tx.cfg.comp_address = (uintptr_t) &dma->tx_comp;
-  queues.tx.cfg.num_desc     = vmxnet3::NUM_TX_DESC;
-  queues.tx.cfg.num_comp     = VMXNET3_NUM_TX_COMP;
-  queues.tx.cfg.intr_index   = 1;
-  // temp rxq buffer storage
-  memset(tx.buffers, 0, sizeof(tx.buffers));
-
-  // setup rx queues
-  for (int q = 0; q < NUM_RX_QUEUES; q++)
+  const int num_pairs = pairs_.size();
+  for (int q = 0; q < num_pairs; q++)
   {
-    memset(rx[q].buffers, 0, sizeof(rx[q].buffers));
-    rx[q].desc0 = &dma->rx[q].desc[0];
-    rx[q].desc1 = nullptr;
-    rx[q].comp  = &dma->rx[q].comp[0];
-    rx[q].index = q;
-
-    auto& queue = queues.rx[q];
-    queue.cfg.desc_address[0] = (uintptr_t) rx[q].desc0;
-    queue.cfg.desc_address[1] = (uintptr_t) rx[q].desc1;
-    queue.cfg.comp_address    = (uintptr_t) rx[q].comp;
+    auto& qp = pairs_[q];
+    qp.index = q;
+    // setup tx queue
+    qp.tx_desc = &dma->tx[q].desc[0];
+    qp.tx_comp = &dma->tx[q].comp[0];
+    auto& txq = queues.tx(q);
+    txq.cfg.desc_address = (uintptr_t) qp.tx_desc;
+    txq.cfg.comp_address = (uintptr_t) qp.tx_comp;
+    txq.cfg.num_desc     = vmxnet3::NUM_TX_DESC;
+    txq.cfg.num_comp     = VMXNET3_NUM_TX_COMP;
+    txq.cfg.intr_index   = 1 + 2 * q;
+    // temp rxq buffer storage
+    memset(qp.tx.buffers, 0, sizeof(qp.tx.buffers));
+
+    // setup rx queue
+    auto& rx = qp.rx;
+    memset(rx.buffers, 0, sizeof(rx.buffers));
+    rx.desc0 = &dma->rx[q].desc[0];
+    rx.desc1 = nullptr;
+    rx.comp  = &dma->rx[q].comp[0];
+    rx.index = q;
+
+    auto& queue = queues.rx(q, num_pairs);
+    queue.cfg.desc_address[0] = (uintptr_t) rx.desc0;
+    queue.cfg.desc_address[1] = (uintptr_t) rx.desc1;
+    queue.cfg.comp_address    = (uintptr_t) rx.comp;
     queue.cfg.num_desc[0]  = vmxnet3::NUM_RX_DESC;
     queue.cfg.num_desc[1]  = 0;
     queue.cfg.num_comp     = VMXNET3_NUM_RX_COMP;
     queue.cfg.driver_data_len = sizeof(vmxnet3_rx_desc)
                           + 2 * sizeof(vmxnet3_rx_desc);
-    queue.cfg.intr_index = 2 + q;
+    queue.cfg.intr_index = 2 + 2 * q;
   }
 
   auto& shared = dma->shared;
@@ -249,17 +274,20 @@ vmxnet3::vmxnet3(hw::PCI_Device& d, const uint16_t mtu) :
   shared.misc.driver_data_address = (uintptr_t) &dma;
   shared.misc.queue_desc_address  = (uintptr_t) &dma->queues;
   shared.misc.driver_data_len     = sizeof(vmxnet3_dma);
-  shared.misc.queue_desc_len      = sizeof(vmxnet3_queues);
+  shared.misc.queue_desc_len      = 2 * num_pairs * sizeof(vmxnet3_queue_desc);
   shared.misc.mtu = max_packet_len(); // 60-9000
-  shared.misc.num_tx_queues  = 1;
-  shared.misc.num_rx_queues  = NUM_RX_QUEUES;
+  shared.misc.num_tx_queues  = num_pairs;
+  shared.misc.num_rx_queues  = num_pairs;
   shared.interrupt.mask_mode = VMXNET3_IT_AUTO | (VMXNET3_IMM_AUTO << 2);
-  shared.interrupt.num_intrs = 2 + NUM_RX_QUEUES;
+  shared.interrupt.num_intrs = 1 + 2 * num_pairs;
   shared.interrupt.event_intr_index = 0;
   memset(shared.interrupt.moderation_level, UPT1_IML_ADAPTIVE, VMXNET3_MAX_INTRS);
   shared.interrupt.control   = 0x1; // disable all
   shared.rx_filter.mode =
       VMXNET3_RXM_UCAST | VMXNET3_RXM_BCAST | VMXNET3_RXM_ALL_MULTI;
+  if (num_pairs > 1) {
+    this->setup_rss();
+  }
 
   // location of shared area to device
   uintptr_t shabus = (uintptr_t) &shared;
@@ -272,20 +300,103 @@ vmxnet3::vmxnet3(hw::PCI_Device& d, const uint16_t mtu) :
     assert(0 && "Failed to activate device");
   }
 
-  // initialize and fill RX queue...
-  for (int q = 0; q < NUM_RX_QUEUES; q++)
+  // initialize and fill RX queues
+  for (auto& qp : pairs_)
   {
-    refill(rx[q]);
+    refill(qp.rx);
   }
 
-  // deferred transmit
-  this->deferred_irq = Events::get().subscribe(handle_deferred);
+  // service each queue pair on its own CPU
+  this->setup_pair_irqs();
 
-  // enable interrupts
+  // enable interrupts, TX only when the ring fills up
   enable_intr(0);
-  enable_intr(1);
-  for (int q = 0; q < NUM_RX_QUEUES; q++)
-      enable_intr(2 + q);
+  for (auto& qp : pairs_) {
+    disable_intr(1 + 2 * qp.index);
+    enable_intr(2 + 2 * qp.index);
+  }
+}
+
+int vmxnet3::supported_queue_pairs(const int msix_vectors)
+{
+  // one pair per CPU, each with a TX and an RX vector after the event vector
+  int pairs = std::min<int>(SMP::active_cpus().size(), MAX_QUEUES);
+  pairs = std::min<int>(pairs, (msix_vectors - 1) / 2);
+  // the device takes a power of two number of queues
+  while (pairs & (pairs - 1)) pairs &= pairs - 1;
+  return std::max(pairs, 1);
+}
+
+void vmxnet3::setup_pair_irqs()
+{
+  const auto& cpus = SMP::active_cpus();
+  // device events and the first pair are serviced on the CPU owning
+  // the NIC, and the rest of the pairs on the other CPUs in order
+  route_vector(0, home_cpu_, {this, &vmxnet3::msix_evt_handler});
+  size_t next = 0;
+  for (size_t i = 0; i < pairs_.size(); i++)
+  {
+    auto& qp = pairs_[i];
+    if (i == 0) {
+      qp.cpu = home_cpu_;
+    }
+    else {
+      if (cpus.at(next) == home_cpu_) next++;
+      qp.cpu = cpus.at(next++);
+    }
+    cpu_pair_.at(qp.cpu) = i;
+
+    route_vector(1 + 2*i, qp.cpu, {[this, &qp] { msix_xmit_handler(qp); }});
+    route_vector(2 + 2*i, qp.cpu, {[this, &qp] { msix_recv_handler(qp); }});
+    init_deferred_kick(qp.cpu, handle_deferred);
+  }
+}
+
+void vmxnet3::route_vector(const size_t index, const int cpu,
+                           delegate<void()> handler)
+{
+  auto& events = Events::get(cpu);
+  const uint8_t irq = events.subscribe(nullptr);
+  if (index < irqs.size())
+  {
+    Events::get(irq_cpus[index]).unsubscribe(irqs[index]);
+    this->irqs[index] = irq;
+    this->irq_cpus[index] = cpu;
+    m_pcidev.rebalance_msix_vector(index, cpu, IRQ_BASE + irq);
+  }
+  else
+  {
+    this->irqs.push_back(irq);
+    this->irq_cpus.push_back(cpu);
+    m_pcidev.setup_msix_vector(cpu, IRQ_BASE + irq);
+  }
+  events.subscribe(irq, handler);
+}
+
+void vmxnet3::setup_rss()
+{
+  // a symmetric key, so both directions of a flow hash to the same queue
+  static const uint8_t toeplitz_key[UPT1_RSS_MAX_KEY_SIZE] = {
+    0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+    0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+    0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+    0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+  };
+  auto& rss = dma->rss;
+  rss.hash_type = UPT1_RSS_HASH_TYPE_IPV4 | UPT1_RSS_HASH_TYPE_TCP_IPV4
+                | UPT1_RSS_HASH_TYPE_IPV6 | UPT1_RSS_HASH_TYPE_TCP_IPV6;
+  rss.hash_func = UPT1_RSS_HASH_FUNC_TOEPLITZ;
+  rss.hash_key_size = sizeof(toeplitz_key);
+  memcpy(rss.hash_key, toeplitz_key, sizeof(toeplitz_key));
+  rss.ind_table_size = VMXNET3_RSS_IND_TABLE_SIZE;
+  for (int i = 0; i < VMXNET3_RSS_IND_TABLE_SIZE; i++)
+    rss.ind_table[i] = i % pairs_.size();
+
+  auto& shared = dma->shared;
+  shared.misc.upt_features |= UPT1_F_RSS;
+  shared.rss.version = 1;
+  shared.rss.length  = sizeof(rss);
+  shared.rss.address = (uintptr_t) &rss;
 }
 
 uint32_t vmxnet3::command(uint32_t cmd)
@@ -393,7 +504,7 @@ void vmxnet3::refill(rxring_state& rxq)
   }
   if (added_buffers) {
     // send count to NIC
-    mmio_write32(this->ptbase + VMXNET3_PT_RXPROD1 + 0x200 * rxq.index,
+    mmio_write32(this->ptbase + VMXNET3_PT_RXPROD1 + 8 * rxq.index,
                  rxq.producers % vmxnet3::NUM_RX_DESC);
   }
 }
@@ -452,74 +563,97 @@ void vmxnet3::msix_evt_handler()
     printf("[vmxnet3] unknown events: %#x\n", evts);
   }
 }
-void vmxnet3::msix_xmit_handler()
+void vmxnet3::msix_xmit_handler(Queue_pair& qp)
 {
-  this->disable_intr(1);
-  this->transmit_handler();
-  this->enable_intr(1);
+  tx_stats_.irq();
+  this->disable_intr(1 + 2 * qp.index);
+  qp.tx_irq = false;
+  this->transmit_handler(qp);
 }
-void vmxnet3::msix_recv_handler()
+void vmxnet3::msix_recv_handler(Queue_pair& qp)
 {
-  for (int q = 0; q < NUM_RX_QUEUES; q++)
-  {
-      this->receive_handler(q);
-  }
+  this->receive_handler(qp);
 }
 
-bool vmxnet3::transmit_handler()
+void vmxnet3::reclaim_tx(Queue_pair& qp)
 {
-  bool transmitted = false;
+  auto& tx = qp.tx;
   while (true)
   {
     uint32_t idx = tx.consumers % VMXNET3_NUM_TX_COMP;
     uint32_t gen = (tx.consumers & VMXNET3_NUM_TX_COMP) ? 0 : VMXNET3_TXCF_GEN;
 
-    auto& comp = dma->tx_comp[idx];
+    auto& comp = qp.tx_comp[idx];
     if (gen != (comp.flags & VMXNET3_TXCF_GEN)) break;
 
     tx.consumers++;
 
-    int desc = comp.index % vmxnet3::NUM_TX_DESC;
-    if (tx.buffers[desc] == nullptr) {
-      printf("empty buffer? comp=%d, desc=%d\n", idx, desc);
-      continue;
-    }
-    auto* packet = (net::Packet*) (tx.buffers[desc] - DRIVER_OFFSET - sizeof(net::Packet));
-    delete packet; // call deleter on Packet to release it
-    tx.buffers[desc] = nullptr;
+    // release the descriptors of the packet, up to its end-of-packet
+    const int eop = comp.index % vmxnet3::NUM_TX_DESC;
+    int desc;
+    do {
+      desc = tx.released++ % vmxnet3::NUM_TX_DESC;
+      // only the first descriptor of a packet has its buffer
+      if (tx.buffers[desc] == nullptr) continue;
+      auto* packet = (net::Packet*) (tx.buffers[desc] - DRIVER_OFFSET - sizeof(net::Packet));
+      delete packet; // call deleter on Packet to release it
+      tx.buffers[desc] = nullptr;
+    } while (desc != eop);
+  }
+}
+
+void vmxnet3::update_tx_interrupts(Queue_pair& qp)
+{
+  // a busy polled queue is reclaimed by polling
+  const bool want = not busy_poll(qp.cpu) and hw::Tx_batch::want_interrupt(
+      qp.tx.producers - qp.tx.released, VMXNET3_TX_FILL, not qp.sendq.empty());
+  // masking is a register write, so only on changes
+  if (want != qp.tx_irq) {
+    qp.tx_irq = want;
+    if (want) this->enable_intr(1 + 2 * qp.index);
+    else      this->disable_intr(1 + 2 * qp.index);
   }
+}
+
+bool vmxnet3::transmit_handler(Queue_pair& qp)
+{
+  bool transmitted = false;
+  this->reclaim_tx(qp);
   // try to send sendq first
-  if (this->can_transmit() && !sendq.empty()) {
-    this->transmit(nullptr);
+  if (this->can_transmit(qp) && !qp.sendq.empty()) {
+    this->transmit_pair(qp, nullptr);
     transmitted = true;
   }
-  // if we can still send more, message network stack
-  //printf("There are now %d tokens free\n", tx_tokens_free());
-  if (this->can_transmit()) {
-    auto tok = tx_tokens_free();
+  // if we can still send more, message the network stack,
+  // which only transmits on the queue pair of its own CPU
+  if (this->can_transmit(qp) && qp.cpu == home_cpu_) {
+    auto tok = tx_tokens_free(qp);
     transmit_queue_available_event(tok);
-    if (tx_tokens_free() != tok) transmitted = true;
+    if (tx_tokens_free(qp) != tok) transmitted = true;
   }
+  update_tx_interrupts(qp);
   return transmitted;
 }
-bool vmxnet3::receive_handler(const int Q)
+bool vmxnet3::receive_handler(Queue_pair& qp)
 {
-  std::vector<net::Packet_ptr> recvq;
-  this->disable_intr(2 + Q);
+  auto& rx = qp.rx;
+  net::Packet_burst recvq;
+  uint64_t rx_bytes = 0;
+  if (qp.rx_irq) this->disable_intr(2 + 2 * qp.index);
   while (true)
   {
-    uint32_t idx = rx[Q].consumers % VMXNET3_NUM_RX_COMP;
-    uint32_t gen = (rx[Q].consumers & VMXNET3_NUM_RX_COMP) ? 0 : VMXNET3_RXCF_GEN;
+    uint32_t idx = rx.consumers % VMXNET3_NUM_RX_COMP;
+    uint32_t gen = (rx.consumers & VMXNET3_NUM_RX_COMP) ? 0 : VMXNET3_RXCF_GEN;
 
-    auto& comp = dma->rx[Q].comp[idx];
+    auto& comp = rx.comp[idx];
     // break when exiting this generation
     if (gen != (comp.flags & VMXNET3_RXCF_GEN)) break;
 
     /* prevent speculative pre read ahead of comp content*/
     os::Arch::read_memory_barrier();
 
-    rx[Q].consumers++;
-    rx[Q].prod_count--;
+    rx.consumers++;
+    rx.prod_count--;
 
     int desc = comp.index % vmxnet3::NUM_RX_DESC;
 
@@ -528,10 +662,10 @@ bool vmxnet3::receive_handler(const int Q)
       //TODO assert / log if eop and sop are not set in empty packet.
 
       //release unused buffer
-      auto* packet = (net::Packet*) (tx.buffers[desc] - DRIVER_OFFSET - sizeof(net::Packet));
+      auto* packet = (net::Packet*) (rx.buffers[desc] - DRIVER_OFFSET - sizeof(net::Packet));
       delete packet; // call deleter on Packet to release it
-      rx[Q].buffers[desc] = nullptr;
-      stat_rx_zero_dropped++;
+      rx.buffers[desc] = nullptr;
+      __sync_fetch_and_add(&stat_rx_zero_dropped, 1);
       break;
     }
 
@@ -539,77 +673,136 @@ bool vmxnet3::receive_handler(const int Q)
     int len = comp.len & (VMXNET3_MAX_BUFFER_LEN-1);
 
     // get buffer and construct packet
-    assert(rx[Q].buffers[desc] != nullptr);
-    recvq.push_back(recv_packet(rx[Q].buffers[desc], len));
+    assert(rx.buffers[desc] != nullptr);
+    recvq.push_back(recv_packet(rx.buffers[desc], len));
+    rx_bytes += len;
 
-    stat_rx_total_packets++;
-    stat_rx_total_bytes+=len;
-
-    rx[Q].buffers[desc] = nullptr;
+    rx.buffers[desc] = nullptr;
   }
-  this->enable_intr(2 + Q);
+  // left masked while busy polling
+  qp.rx_irq = not busy_poll(qp.cpu);
+  if (qp.rx_irq) this->enable_intr(2 + 2 * qp.index);
   // refill always
   if (!recvq.empty()) {
-    this->refill(rx[Q]);
+    this->refill(rx);
   }
-  // handle packets
-  for (auto& pckt : recvq) {
-    Link::receive(std::move(pckt));
+  // handle packets, as one burst
+  if (recvq.empty()) return false;
+  __sync_fetch_and_add(&stat_rx_total_packets, recvq.size());
+  __sync_fetch_and_add(&stat_rx_total_bytes, rx_bytes);
+  this->deliver(qp, recvq.release());
+  // sent packets are reclaimed here too, when there is no transmit
+  if (qp.tx.released != qp.tx.producers) this->transmit_handler(qp);
+  return true;
+}
+
+void vmxnet3::deliver(Queue_pair& qp, net::Packet_ptr chain)
+{
+  // a receive path registered for this CPU
+  auto& upstream = Nic::cpu_upstream(qp.cpu);
+  if (upstream) {
+    Nic::capture_rx(chain.get());
+    while (chain != nullptr) {
+      auto tail = chain->detach_tail();
+      upstream(std::move(chain));
+      chain = std::move(tail);
+    }
+    return;
+  }
+  // otherwise the link layer, on the CPU that owns it
+  if (qp.cpu == home_cpu_) {
+    Link::receive_burst(std::move(chain));
+    return;
+  }
+  auto* pckts = chain.release();
+  auto task = [this, pckts] {
+    Link::receive_burst(net::Packet_ptr{pckts});
+  };
+  if (home_cpu_ == 0) {
+    SMP::add_bsp_task(task);
+  }
+  else {
+    SMP::add_task(task, home_cpu_);
+    SMP::signal(home_cpu_);
   }
-  return recvq.empty() == false;
 }
 
 void vmxnet3::transmit(net::Packet_ptr pckt_ptr)
 {
+  auto* qp = this_cpu_pair();
+  if (UNLIKELY(qp == nullptr)) {
+    __sync_fetch_and_add(&stat_tx_unpaired_dropped, pckt_ptr->chain_length());
+    return;
+  }
+  transmit_pair(*qp, std::move(pckt_ptr));
+}
+
+void vmxnet3::transmit_pair(Queue_pair& qp, net::Packet_ptr pckt_ptr)
+{
+  auto& sendq = qp.sendq;
   while (pckt_ptr != nullptr)
   {
-    if (not Nic::sendq_still_available(this->sendq.size())) {
-      stat_sendq_dropped += pckt_ptr->chain_length();
+    if (not Nic::sendq_still_available(sendq.size())) {
+      __sync_fetch_and_add(&stat_sendq_dropped, pckt_ptr->chain_length());
       break;
     }
     auto tail = pckt_ptr->detach_tail();
     sendq.emplace_back(std::move(pckt_ptr));
     pckt_ptr = std::move(tail);
   }
+  // make room from what the device has sent since the last transmit
+  this->reclaim_tx(qp);
   // send as much as possible from sendq
-  while (!sendq.empty() && can_transmit())
+  while (!sendq.empty() && can_transmit(qp))
   {
+    // external payload takes a second descriptor
+    if (sendq.front()->has_ext_payload() && tx_tokens_free(qp) < 2) break;
     auto* packet = sendq.front().release();
     sendq.pop_front();
     // transmit released buffer
-    transmit_data(packet->buf() + DRIVER_OFFSET, packet->size());
+    const uint32_t bytes = packet->size() + packet->ext_length();
+    transmit_data(qp, packet->buf() + DRIVER_OFFSET, packet->size(),
+                  packet->ext_data(), packet->ext_length());
+    tx_stats_.packets(1);
+    // let the device start on a large burst
+    if (qp.tx_batch.add(bytes)) this->flush_pair(qp);
   }
+  update_tx_interrupts(qp);
   // update sendq stats
   stat_sendq_cur = sendq.size();
   stat_sendq_max = std::max(stat_sendq_max, stat_sendq_cur);
 
   // delay dma message until we have written as much as possible
-  if (!deferred_kick)
+  if (!qp.deferred_kick)
   {
-    deferred_kick = true;
-    if (this->already_polling == false) {
-        deferred_devs.push_back(this);
-        Events::get().trigger_event(deferred_irq);
+    qp.deferred_kick = true;
+    if (qp.already_polling == false) {
+        auto& defkick = PER_CPU(deferred_devs);
+        defkick.devs.push_back(this);
+        Events::get().trigger_event(defkick.irq);
     }
   }
 }
-inline int  vmxnet3::tx_flush_diff() const noexcept
+inline int  vmxnet3::tx_flush_diff(const Queue_pair& qp) const noexcept
 {
-  return tx.producers - tx.flushvalue;
+  return qp.tx.producers - qp.tx.flushvalue;
 }
-inline int  vmxnet3::tx_tokens_free() const noexcept
+inline int  vmxnet3::tx_tokens_free(const Queue_pair& qp) const noexcept
 {
-  return VMXNET3_TX_FILL - (tx.producers - tx.consumers);
+  return VMXNET3_TX_FILL - (qp.tx.producers - qp.tx.released);
 }
-inline bool vmxnet3::can_transmit() const noexcept
+inline bool vmxnet3::can_transmit(const Queue_pair& qp) const noexcept
 {
-  return tx_tokens_free() > 0 && this->link_state_up;
+  return tx_tokens_free(qp) > 0 && this->link_state_up;
 }
 
-void vmxnet3::transmit_data(uint8_t* data, uint16_t data_length)
+void vmxnet3::transmit_data(Queue_pair& qp,
+                            uint8_t* data, uint16_t data_length,
+                            const uint8_t* ext, uint32_t ext_length)
 {
 #define VMXNET3_TXF_EOP 0x000001000UL
 #define VMXNET3_TXF_CQ  0x000002000UL
+  auto& tx = qp.tx;
   auto idx = tx.producers % vmxnet3::NUM_TX_DESC;
   auto gen = (tx.producers & vmxnet3::NUM_TX_DESC) ? 0 : VMXNET3_TXF_GEN;
   tx.producers++;
@@ -617,57 +810,84 @@ void vmxnet3::transmit_data(uint8_t* data, uint16_t data_length)
   assert(tx.buffers[idx] == nullptr);
   tx.buffers[idx] = data;
 
-  auto& desc = dma->tx_desc[idx];
+  auto& desc = qp.tx_desc[idx];
   desc.address  = (uintptr_t) tx.buffers[idx];
   desc.flags[0] = gen | data_length;
-  desc.flags[1] = VMXNET3_TXF_CQ | VMXNET3_TXF_EOP;
+  desc.flags[1] = (ext_length == 0) ? VMXNET3_TXF_CQ | VMXNET3_TXF_EOP : 0;
 
-  stat_tx_total_packets++;
-  stat_tx_total_bytes+=data_length;
+  if (ext_length != 0)
+  {
+    // the payload is read from where it is, kept alive by the packet
+    assert(ext_length < VMXNET3_MAX_BUFFER_LEN);
+    idx = tx.producers % vmxnet3::NUM_TX_DESC;
+    gen = (tx.producers & vmxnet3::NUM_TX_DESC) ? 0 : VMXNET3_TXF_GEN;
+    tx.producers++;
+
+    assert(tx.buffers[idx] == nullptr);
+    auto& ext_desc = qp.tx_desc[idx];
+    ext_desc.address  = (uintptr_t) ext;
+    ext_desc.flags[0] = gen | ext_length;
+    ext_desc.flags[1] = VMXNET3_TXF_CQ | VMXNET3_TXF_EOP;
+  }
+
+  __sync_fetch_and_add(&stat_tx_total_packets, 1);
+  __sync_fetch_and_add(&stat_tx_total_bytes, data_length + ext_length);
 }
 
 void vmxnet3::flush()
 {
-  if (tx_flush_diff() > 0)
-  {
+  if (auto* qp = this_cpu_pair()) flush_pair(*qp);
+}
 
-    auto idx = tx.producers % vmxnet3::NUM_TX_DESC;
-    mmio_write32(ptbase + VMXNET3_PT_TXPROD, idx);
-    tx.flushvalue = tx.producers;
+void vmxnet3::flush_pair(Queue_pair& qp)
+{
+  if (tx_flush_diff(qp) > 0)
+  {
+    // each TX queue has its own producer register
+    auto idx = qp.tx.producers % vmxnet3::NUM_TX_DESC;
+    mmio_write32(ptbase + VMXNET3_PT_TXPROD + 8 * qp.index, idx);
+    qp.tx.flushvalue = qp.tx.producers;
+    qp.tx_batch.rung();
+    tx_stats_.kick();
   }
 }
 
 void vmxnet3::handle_deferred()
 {
-  for (auto* dev : deferred_devs)
+  for (auto* dev : PER_CPU(deferred_devs).devs)
   {
-    dev->flush();
-    dev->deferred_kick = false;
+    auto* qp = dev->this_cpu_pair();
+    if (qp == nullptr) continue;
+    dev->flush_pair(*qp);
+    qp->deferred_kick = false;
   }
-  deferred_devs.clear();
+  PER_CPU(deferred_devs).devs.clear();
 }
 
-void vmxnet3::poll()
+bool vmxnet3::poll()
 {
-  if (tqa_events_.empty()) return;
-  if (this->already_polling) return;
-  this->already_polling = true;
+  if (tqa_events_.empty()) return false;
+  auto* pair = this_cpu_pair();
+  if (pair == nullptr) return false;
+  auto& qp = *pair;
+  if (qp.already_polling) return false;
+  qp.already_polling = true;
 
-  bool work;
+  bool work, any = false;
   do {
-    work = false;
-    for (int q = 0; q < NUM_RX_QUEUES; q++)
-        work |= receive_handler(q);
+    work = receive_handler(qp);
     // transmit
-    work |= transmit_handler();
+    work |= transmit_handler(qp);
     // immediately flush when possible
-    if (this->deferred_kick) {
-        this->deferred_kick = false;
-        this->flush();
+    if (qp.deferred_kick) {
+        qp.deferred_kick = false;
+        this->flush_pair(qp);
     }
+    any |= work;
   } while (work);
 
-  this->already_polling = false;
+  qp.already_polling = false;
+  return any;
 }
 
 void vmxnet3::add_vlan(const int id)
@@ -681,9 +901,10 @@ void vmxnet3::deactivate()
 {
   // disable all queues
   this->disable_intr(0);
-  this->disable_intr(1);
-  for (int q = 0; q < NUM_RX_QUEUES; q++)
-    this->disable_intr(2 + q);
+  for (auto& qp : pairs_) {
+    this->disable_intr(1 + 2 * qp.index);
+    this->disable_intr(2 + 2 * qp.index);
+  }
 
   // reset this device
   this->reset();
@@ -692,14 +913,18 @@ void vmxnet3::deactivate()
 void vmxnet3::move_to_this_cpu()
 {
   bufstore().move_to_this_cpu();
-
-  if (m_pcidev.has_msix())
+  // the link layer is now serviced here
+  this->home_cpu_ = SMP::cpu_id();
+  cpu_pair_.fill(NO_PAIR);
+  // reset the IRQ handlers, with the first queue pair on this CPU
+  if (m_pcidev.has_msix() and not irqs.empty())
   {
-    for (size_t i = 0; i < irqs.size(); i++)
-    {
-      this->irqs[i] = Events::get().subscribe(nullptr);
-      m_pcidev.rebalance_msix_vector(i, SMP::cpu_id(), IRQ_BASE + this->irqs[i]);
-    }
+    this->setup_pair_irqs();
+  }
+  else
+  {
+    pairs_[0].cpu = home_cpu_;
+    cpu_pair_.at(home_cpu_) = 0;
   }
 }
 
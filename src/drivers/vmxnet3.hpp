@@ -18,11 +18,15 @@
 #include <hw/pci_device.hpp>
 #include <net/link_layer.hpp>
 #include <net/ethernet/ethernet_8021q.hpp>
+#include <hw/tx_batch.hpp>
+#include <smp>
 #include <deque>
 #include <vector>
 struct vmxnet3_dma;
 struct vmxnet3_rx_desc;
 struct vmxnet3_rx_comp;
+struct vmxnet3_tx_desc;
+struct vmxnet3_tx_comp;
 
 class vmxnet3 : public net::Link_layer<net::Ethernet>
 {
@@ -30,7 +34,8 @@ public:
   using Link          = net::Link_layer<net::Ethernet>;
   using Link_protocol = Link::Protocol;
   static const int DRIVER_OFFSET = 2;
-  static const int NUM_RX_QUEUES = 1;
+  /** Most queue pairs in use, one per CPU */
+  static const int MAX_QUEUES    = 8;
   static const int NUM_TX_DESC   = 128;
   static const int NUM_RX_DESC   = 512;
 
@@ -60,6 +65,10 @@ public:
 
   net::Packet_ptr create_packet(int) override;
 
+  /** External payload goes in a descriptor of its own */
+  uint32_t offload_features() const noexcept override
+  { return hw::Nic::TX_SG; }
+
   /** Linklayer input. Hooks into IP-stack bottom, w.DOWNSTREAM data.*/
   void transmit(net::Packet_ptr pckt);
 
@@ -68,9 +77,13 @@ public:
 
   /** Space available in the transmit queue, in packets */
   size_t transmit_queue_available() override {
-    return tx_tokens_free();
+    auto* qp = this_cpu_pair();
+    return (qp) ? tx_tokens_free(*qp) : 0;
   }
 
+  int queue_pairs() const noexcept override
+  { return pairs_.size(); }
+
   auto& bufstore() noexcept { return bufstore_; }
 
   void flush() override;
@@ -79,31 +92,18 @@ public:
 
   void move_to_this_cpu() override;
 
-  void poll() override;
+  bool poll() override;
 
   void add_vlan(const int id) override;
 
 private:
-  void msix_evt_handler();
-  void msix_xmit_handler();
-  void msix_recv_handler();
-  bool receive_handler(int);
-  bool transmit_handler();
-  void enable_intr(uint8_t idx) noexcept;
-  void disable_intr(uint8_t idx) noexcept;
-
-  inline int  tx_flush_diff() const noexcept;
-  inline int  tx_tokens_free() const noexcept;
-  inline bool can_transmit() const noexcept;
-  void transmit_data(uint8_t* data, uint16_t);
-  net::Packet_ptr recv_packet(uint8_t* data, uint16_t);
-
   // tx/rx ring state
   struct ring_stuff {
     uint8_t* buffers[NUM_TX_DESC];
     uint32_t producers  = 0;
     uint32_t prod_count = 0;
     uint32_t consumers  = 0;
+    uint32_t released   = 0; // descriptors, packets can have more than one
     uint32_t flushvalue = 0;
   };
   struct rxring_state {
@@ -116,6 +116,68 @@ private:
     uint32_t prod_count = 0;
     uint32_t consumers  = 0;
   };
+  /** A transmit and receive queue pair, serviced by one CPU.
+      Queue pair N uses vector 1 + 2N for TX and 2 + 2N for RX. */
+  struct alignas(SMP_ALIGN) Queue_pair {
+    ring_stuff   tx;
+    rxring_state rx;
+    std::deque<net::Packet_ptr> sendq;
+    hw::Tx_batch tx_batch {NUM_TX_DESC};
+    vmxnet3_tx_desc* tx_desc = nullptr;
+    vmxnet3_tx_comp* tx_comp = nullptr;
+    int  index = 0;
+    int  cpu   = 0;
+    bool deferred_kick   = false;
+    bool already_polling = false;
+    bool tx_irq          = false;
+    bool rx_irq          = true;
+  };
+  std::vector<Queue_pair> pairs_;
+  static constexpr uint8_t NO_PAIR = 0xff;
+  // the queue pair each CPU services, the rings are not locked
+  // so CPUs without a pair of their own can not transmit
+  SMP::Array<uint8_t> cpu_pair_;
+  // the CPU running the link layer and the stack above it
+  int home_cpu_ = 0;
+
+  /** The queue pair of this CPU, or nullptr if it has none */
+  Queue_pair* this_cpu_pair() noexcept
+  {
+    const auto idx = PER_CPU(cpu_pair_);
+    return (idx != NO_PAIR) ? &pairs_[idx] : nullptr;
+  }
+
+  /** Number of queue pairs we can service, one per CPU */
+  static int supported_queue_pairs(int msix_vectors);
+  /** Route each MSI-X vector to the CPU servicing it */
+  void setup_pair_irqs();
+  void route_vector(size_t index, int cpu, delegate<void()> handler);
+  /** Spread flows over the RX queues with a Toeplitz hash */
+  void setup_rss();
+
+  void msix_evt_handler();
+  void msix_xmit_handler(Queue_pair&);
+  void msix_recv_handler(Queue_pair&);
+  bool receive_handler(Queue_pair&);
+  bool transmit_handler(Queue_pair&);
+  /** Release the packets the device has sent */
+  void reclaim_tx(Queue_pair&);
+  /** Only take TX interrupts when the ring is filling up */
+  void update_tx_interrupts(Queue_pair&);
+  void enable_intr(uint8_t idx) noexcept;
+  void disable_intr(uint8_t idx) noexcept;
+
+  /** Pass received packets up, on the CPU that should handle them */
+  void deliver(Queue_pair&, net::Packet_ptr chain);
+
+  void transmit_pair(Queue_pair&, net::Packet_ptr pckt);
+  void flush_pair(Queue_pair&);
+  inline int  tx_flush_diff(const Queue_pair&) const noexcept;
+  inline int  tx_tokens_free(const Queue_pair&) const noexcept;
+  inline bool can_transmit(const Queue_pair&) const noexcept;
+  void transmit_data(Queue_pair&, uint8_t* data, uint16_t, const uint8_t* ext, uint32_t);
+  net::Packet_ptr recv_packet(uint8_t* data, uint16_t);
+
   void refill(rxring_state&);
 
   bool     check_version();
@@ -127,21 +189,17 @@ private:
 
   hw::PCI_Device& m_pcidev;
   std::vector<uint8_t> irqs;
+  std::vector<int>     irq_cpus;
   uintptr_t     iobase = 0;
   uintptr_t     ptbase = 0;
   MAC::Addr     hw_addr;
   uint16_t      m_mtu  = 0;
   vmxnet3_dma*  dma = nullptr;
 
-  ring_stuff tx;
-  rxring_state rx[NUM_RX_QUEUES];
-  // deferred transmit dma
-  uint8_t  deferred_irq  = 0;
-  bool     deferred_kick = false;
-  bool   already_polling = false;
   bool     link_state_up = false;
   static void handle_deferred();
 
+  hw::Tx_stats tx_stats_;
   // sendq as double-ended q
   uint32_t& stat_sendq_cur;
   uint32_t& stat_sendq_max;
@@ -152,6 +210,6 @@ private:
   uint64_t& stat_rx_zero_dropped;
   uint64_t& stat_rx_refill_dropped;
   uint64_t& stat_sendq_dropped;
-  std::deque<net::Packet_ptr> sendq;
+  uint64_t& stat_tx_unpaired_dropped;
   net::BufferStore bufstore_;
 };
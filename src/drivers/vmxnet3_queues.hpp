@@ -22,6 +22,8 @@
 #define VMXNET3_MAX_INTRS 25
 /** Adaptive Interrupt Moderation */
 #define UPT1_IML_ADAPTIVE 0x8
+/** Receive side scaling feature */
+#define UPT1_F_RSS        0x2
 /** VLAN tag stripping feature */
 #define UPT1_F_RXVLAN     0x4
 
@@ -289,11 +291,46 @@ struct vmxnet3_rx_queue {
 /**
  * Queue descriptor set
  *
- * We use only a single TX and RX queue
+ * The receive queue descriptors directly follow the transmit queue
+ * descriptors in use, so both are placed at run time
  */
-struct vmxnet3_queues {
-  /** Transmit queue descriptor(s) */
+union vmxnet3_queue_desc {
   struct vmxnet3_tx_queue tx;
-  /** Receive queue descriptor(s) */
-  struct vmxnet3_rx_queue rx[vmxnet3::NUM_RX_QUEUES];
+  struct vmxnet3_rx_queue rx;
+};
+static_assert(sizeof(vmxnet3_tx_queue) == sizeof(vmxnet3_rx_queue),
+              "TX and RX queue descriptors have the same size");
+
+struct vmxnet3_queues {
+  union vmxnet3_queue_desc desc[2 * vmxnet3::MAX_QUEUES];
+
+  vmxnet3_tx_queue& tx(int q) noexcept
+  { return desc[q].tx; }
+  vmxnet3_rx_queue& rx(int q, int num_tx) noexcept
+  { return desc[num_tx + q].rx; }
+} __attribute__ ((packed));
+
+/** RSS hash types */
+enum vmxnet3_rss_hash_type {
+  UPT1_RSS_HASH_TYPE_IPV4     = 0x01,
+  UPT1_RSS_HASH_TYPE_TCP_IPV4 = 0x02,
+  UPT1_RSS_HASH_TYPE_IPV6     = 0x04,
+  UPT1_RSS_HASH_TYPE_TCP_IPV6 = 0x08,
+};
+
+/** Toeplitz hash function */
+#define UPT1_RSS_HASH_FUNC_TOEPLITZ 0x01
+
+#define UPT1_RSS_MAX_KEY_SIZE       40
+#define UPT1_RSS_MAX_IND_TABLE_SIZE 128
+
+/** RSS configuration */
+struct vmxnet3_rss_config {
+  uint16_t hash_type;
+  uint16_t hash_func;
+  uint16_t hash_key_size;
+  uint16_t ind_table_size;
+  uint8_t  hash_key[UPT1_RSS_MAX_KEY_SIZE];
+  /** RX queue for each hash, indexed by its low bits */
+  uint8_t  ind_table[UPT1_RSS_MAX_IND_TABLE_SIZE];
 } __attribute__ ((packed));
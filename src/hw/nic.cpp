@@ -16,6 +16,7 @@
 // limitations under the License.
 
 #include <hw/nic.hpp>
+#include <net/capture.hpp>
 
 namespace hw
 {
@@ -25,4 +26,10 @@ namespace hw
     (void) idx;
     return default_MTU;
   }
+
+  void Nic::do_capture(const net::Packet* chain, bool outbound) const noexcept
+  {
+    using Direction = net::Capture::Direction;
+    capture_->capture(chain, outbound ? Direction::OUT : Direction::IN);
+  }
 }
@@ -41,6 +41,10 @@ void UserNet::receive(net::Packet_ptr packet)
   // wrap in packet, pass to Link-layer
   Link::receive( std::move(packet) );
 }
+void UserNet::receive_burst(net::Packet_ptr chain)
+{
+  Link::receive_burst( std::move(chain) );
+}
 void UserNet::receive(void* data, net::BufferStore* bufstore)
 {
   // wrap in packet, pass to Link-layer
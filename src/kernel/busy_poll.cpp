@@ -0,0 +1,107 @@
+#include <kernel/busy_poll.hpp>
+#include <kernel/rtc.hpp>
+#include <hw/nic.hpp>
+#include <algorithm>
+#include <statman>
+#include <os>
+
+static SMP::Array<Busy_poll> pollers;
+
+Busy_poll& Busy_poll::get()
+{
+  return PER_CPU(pollers);
+}
+
+static inline void cpu_relax() noexcept
+{
+#if defined(ARCH_x86) || defined(ARCH_x86_64) || defined(ARCH_i686)
+  asm volatile("pause");
+#elif defined(ARCH_aarch64)
+  asm volatile("yield");
+#endif
+}
+
+void Busy_poll::add(hw::Nic& nic)
+{
+  if (std::find(nics_.begin(), nics_.end(), &nic) != nics_.end()) return;
+
+  if (stat_polls_ == nullptr)
+  {
+    cpu_ = SMP::cpu_id();
+    const std::string CPU = "cpu" + std::to_string(cpu_);
+    stat_polls_ = &Statman::get().create(Stat::UINT64, CPU + ".busy_poll.polls").get_uint64();
+    stat_busy_  = &Statman::get().create(Stat::UINT64, CPU + ".busy_poll.busy").get_uint64();
+    stat_efficiency_ = &Statman::get().create(Stat::FLOAT, CPU + ".busy_poll.efficiency").get_float();
+    stat_halts_ = &Statman::get().create(Stat::UINT64, CPU + ".busy_poll.halts").get_uint64();
+  }
+  nics_.push_back(&nic);
+  // the interrupts are turned off by the next poll
+  nic.set_busy_poll(cpu_, true);
+  idle_since_ = 0;
+}
+
+void Busy_poll::remove(hw::Nic& nic)
+{
+  auto it = std::find(nics_.begin(), nics_.end(), &nic);
+  if (it == nics_.end()) return;
+  nics_.erase(it);
+  // polling it once more re-arms the interrupts
+  nic.set_busy_poll(cpu_, false);
+  nic.poll();
+}
+
+bool Busy_poll::poll()
+{
+  bool work = false;
+  for (auto* nic : nics_)
+    work |= nic->poll();
+
+  (*stat_polls_)++;
+  if (work) (*stat_busy_)++;
+  *stat_efficiency_ = (float) *stat_busy_ / *stat_polls_;
+  return work;
+}
+
+void Busy_poll::wait()
+{
+  if (nics_.empty()) {
+    os::halt();
+    return;
+  }
+  if (this->poll()) {
+    idle_since_ = 0;
+    spins_ = 1;
+    return;
+  }
+  const uint64_t now = RTC::nanos_now();
+  if (idle_since_ == 0) idle_since_ = now;
+
+  if ((int64_t) (now - idle_since_) < idle_timeout_)
+  {
+    // back off, each idle poll spinning twice as long as the last
+    for (int i = 0; i < spins_; i++) cpu_relax();
+    spins_ = std::min(spins_ * 2, MAX_SPINS);
+    return;
+  }
+  this->halt();
+}
+
+void Busy_poll::halt()
+{
+  // give the NICs their interrupts back, which also catches anything
+  // that arrived since the last poll
+  bool work = false;
+  for (auto* nic : nics_) {
+    nic->set_busy_poll(cpu_, false);
+    work |= nic->poll();
+  }
+  if (not work) {
+    (*stat_halts_)++;
+    os::halt();
+  }
+  // and take them again, the first poll turns the interrupts off
+  for (auto* nic : nics_)
+    nic->set_busy_poll(cpu_, true);
+  idle_since_ = 0;
+  spins_ = 1;
+}
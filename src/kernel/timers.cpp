@@ -6,8 +6,12 @@
 #include <service>
 #include <smp>
 #include <statman>
-#include <map>
 #include <vector>
+#ifdef INCLUDEOS_TIMER_WHEEL
+#include <util/timer_wheel.hpp>
+#else
+#include <map>
+#endif
 
 using namespace std::chrono;
 typedef Timers::duration_t duration_t;
@@ -49,6 +53,85 @@ struct SystemTimer
   bool already_dead = false;
 };
 
+#ifdef INCLUDEOS_TIMER_WHEEL
+// ~1ms ticks, covering ~52 days before deadlines are re-hashed
+typedef Timer_wheel<20, 4> schedule_t;
+#else
+/**
+ * Timers sorted by timestamp in a tree, with the same interface as the
+ * timer wheel. Each timer remembers its position in the tree, and moving
+ * a deadline later leaves it in place until its old deadline is reached.
+**/
+class schedule_t
+{
+public:
+  using id_t   = Timers::id_t;
+  using time_t = int64_t;
+  using tree_t = std::multimap<time_t, id_t>;
+  static constexpr time_t NEVER = INT64_MAX;
+
+  void insert(id_t id, time_t when)
+  {
+    if (UNLIKELY((size_t) id >= where.size())) {
+      where.resize(id + 1, tree.end());
+      times.resize(id + 1);
+    }
+    where[id] = tree.emplace(when, id);
+    times[id] = when;
+  }
+  bool erase(id_t id)
+  {
+    if (not contains(id)) return false;
+    tree.erase(where[id]);
+    where[id] = tree.end();
+    return true;
+  }
+  void update(id_t id, time_t when)
+  {
+    if (contains(id) && when >= times[id]) {
+      times[id] = when;
+      return;
+    }
+    erase(id);
+    insert(id, when);
+  }
+  bool contains(id_t id) const noexcept {
+    return id >= 0 && (size_t) id < where.size() && where[id] != tree.end();
+  }
+  size_t size() const noexcept { return tree.size(); }
+  bool  empty() const noexcept { return tree.empty(); }
+  void advance(time_t) noexcept {}
+
+  template <typename Func>
+  size_t expire(time_t now, Func on_expire)
+  {
+    size_t count = 0;
+    while (!tree.empty() && tree.begin()->first <= now)
+    {
+      auto it = tree.begin();
+      const id_t id = it->second;
+      tree.erase(it);
+      // the deadline was moved later, so re-insert it
+      if (times[id] > now) {
+        where[id] = tree.emplace(times[id], id);
+        continue;
+      }
+      where[id] = tree.end();
+      on_expire(id);
+      count++;
+    }
+    return count;
+  }
+  time_t next() const noexcept {
+    return (tree.empty()) ? NEVER : tree.begin()->first;
+  }
+private:
+  tree_t tree;
+  std::vector<tree_t::iterator> where;
+  std::vector<time_t> times;
+};
+#endif
+
 /**
  * 1. There are no restrictions on when timers can be started or stopped
  * 2. A period of 0 means start a one-shot timer
@@ -59,6 +142,8 @@ struct SystemTimer
  *     inflate the schedule container, as well as complicate stopping timers
  * 6. Free timer IDs are retrieved from a stack of free timer IDs (or through
  *     expanding the "fixed" vector)
+ * 7. Restarting a scheduled timer keeps its ID, and is O(1) when the
+ *     deadline moves later
 **/
 static bool signal_ready = false;
 
@@ -66,6 +151,7 @@ struct alignas(SMP_ALIGN) timer_system
 {
   void free_timer(Timers::id_t);
   void sched_timer(duration_t when, Timers::id_t);
+  void fire_timer(Timers::id_t);
 
   bool     is_running  = false;
   int      interrupt = 0;
@@ -73,8 +159,10 @@ struct alignas(SMP_ALIGN) timer_system
   Timers::stop_func_t  arch_stop_func;
   std::vector<SystemTimer>  timers;
   std::vector<Timers::id_t> free_timers;
-  // timers sorted by timestamp
-  std::multimap<duration_t, Timers::id_t> scheduled;
+  // timers by timestamp
+  schedule_t scheduled;
+  // the deadline the hardware timer was started for
+  duration_t armed = duration_t::max();
   /** Stats */
   union {
     int64_t  i64 = 0;
@@ -166,6 +254,25 @@ Timers::id_t Timers::periodic(duration_t when, duration_t period, handler_t hand
   return id;
 }
 
+bool Timers::restart(Timers::id_t id, duration_t when)
+{
+  auto& system = get();
+  // only timers that are waiting can be restarted
+  if (UNLIKELY(!system.scheduled.contains(id))) return false;
+
+  auto& timer = system.timers[id];
+  const auto real_time = now() + when;
+  const bool earlier = real_time < timer.time;
+  timer.time = real_time;
+  system.scheduled.update(id, real_time.count());
+
+  // a later deadline will be found when the old one is reached
+  if (earlier && signal_ready && real_time < system.armed) {
+    Events::get().trigger_event(system.interrupt);
+  }
+  return true;
+}
+
 void Timers::stop(Timers::id_t id)
 {
   auto& system = get();
@@ -176,17 +283,10 @@ void Timers::stop(Timers::id_t id)
   timer.already_dead = true;
   // free resources immediately
   timer.callback.reset();
-  // search for timer in scheduled
-  auto it = system.scheduled.find(timer.time);
-  for (; it != system.scheduled.end(); ++it) {
-    // found dead timer
-    if (id == it->second) {
-      // erase from schedule
-      system.scheduled.erase(it);
-      // free from system
-      system.free_timer(id);
-      break;
-    }
+  // erase from schedule and free from system, unless the
+  // timer is currently being handled
+  if (system.scheduled.erase(id)) {
+    system.free_timer(id);
   }
   // timer stats
   if (system.timers[id].is_oneshot())
@@ -212,8 +312,7 @@ duration_t Timers::next()
   auto& system = get();
   if (LIKELY(!system.scheduled.empty()))
   {
-    auto it   = system.scheduled.begin();
-    auto when = it->first;
+    auto when = nanoseconds(system.scheduled.next());
     auto diff = when - now();
     // avoid returning zero or negative diff
     if (diff < nanoseconds(1)) return nanoseconds(1);
@@ -227,62 +326,59 @@ void Timers::timers_handler()
   auto& system = get();
   // assume the hardware timer called this function
   system.is_running = false;
+  system.armed = duration_t::max();
 
-  while (LIKELY(!system.scheduled.empty()))
-  {
-    auto it         = system.scheduled.begin();
-    auto when       = it->first;
-    Timers::id_t id = it->second;
-
-    auto ts_now = now();
-    if (ts_now >= when) {
-      // erase immediately
-      system.scheduled.erase(it);
-
-      // call the users callback function
-      system.timers[id].callback(id);
-      // if the timers struct was modified in callback, eg. due to
-      // creating a timer, then the timer reference below would have
-      // been invalidated, hence why its BELOW, AND MUST STAY THERE
-      auto& timer = system.timers[id];
-
-      // oneshot timers are automatically freed
-      if (timer.already_dead || timer.is_oneshot())
-      {
-        system.free_timer(id);
-      }
-      else
-      {
-        // if the timer is recurring, we will simply reschedule it
-        // NOTE: we are carefully using (when + period) to avoid drift
-        auto new_time = when + timer.period;
-        // update timers self-time
-        timer.time = new_time;
-        // reschedule
-        system.scheduled.
-          emplace(std::piecewise_construct,
-                  std::forward_as_tuple(new_time),
-                  std::forward_as_tuple(id));
-      }
+  // expire until nothing is due, as periodic timers can be due again
+  while (system.scheduled.expire(now().count(),
+          [&system] (Timers::id_t id) { system.fire_timer(id); }) > 0);
 
-    } else {
-      // not yet time, so schedule it for later
-      system.is_running = true;
-      system.arch_start_func(when - ts_now);
-      // exit early, because we have nothing more to do,
-      // and there is a deferred handler
-      return;
-    }
+  if (LIKELY(!system.scheduled.empty()))
+  {
+    auto when = nanoseconds(system.scheduled.next());
+    auto diff = when - now();
+    // not yet time, so schedule it for later
+    system.is_running = true;
+    system.armed = when;
+    system.arch_start_func(std::max(diff, duration_t(1)));
+    // exit early, because we have nothing more to do,
+    // and there is a deferred handler
+    return;
   }
   // stop hardware timer, since no timers are enabled
   system.arch_stop_func();
 }
+void timer_system::fire_timer(Timers::id_t id)
+{
+  // stopped after it expired, but before it was handled
+  if (UNLIKELY(this->timers[id].already_dead)) {
+    this->free_timer(id);
+    return;
+  }
+  // call the users callback function
+  this->timers[id].callback(id);
+  // if the timers struct was modified in callback, eg. due to
+  // creating a timer, then the timer reference below would have
+  // been invalidated, hence why its BELOW, AND MUST STAY THERE
+  auto& timer = this->timers[id];
+
+  // oneshot timers are automatically freed
+  if (timer.already_dead || timer.is_oneshot())
+  {
+    this->free_timer(id);
+  }
+  else if (!this->scheduled.contains(id))
+  {
+    // if the timer is recurring, we will simply reschedule it
+    // NOTE: we are carefully using (when + period) to avoid drift
+    timer.time += timer.period;
+    this->scheduled.insert(id, timer.time.count());
+  }
+}
 void timer_system::sched_timer(duration_t when, Timers::id_t id)
 {
-  this->scheduled.
-    emplace(std::piecewise_construct,
-            std::forward_as_tuple(when),
-            std::forward_as_tuple(id));
+  // an empty schedule can start over from the current time
+  if (this->scheduled.empty()) this->scheduled.advance(now().count());
+  this->scheduled.insert(id, when.count());
 
   // dont start any hardware until after calibration
   if (UNLIKELY(!signal_ready)) return;
@@ -293,8 +389,7 @@ void timer_system::sched_timer(duration_t when, Timers::id_t id)
     return;
   }
   // if the scheduled timer is the new front, restart timer
-  auto it = this->scheduled.begin();
-  if (it->second == id) {
+  if (when < this->armed) {
     Events::get().trigger_event(this->interrupt);
   }
 }
@@ -0,0 +1,88 @@
+#include "common.hpp"
+#include <posix/epoll_fd.hpp>
+#include <posix/fd_map.hpp>
+#include <posix/readiness.hpp>
+#include <signal.h>
+
+static long sys_epoll_create1(int flags)
+{
+  if (UNLIKELY(flags & ~EPOLL_CLOEXEC))
+    return -EINVAL;
+
+  return FD_map::_open<Epoll_FD>().get_id();
+}
+
+static long sys_epoll_create(int size)
+{
+  // size is only a hint, but must be positive
+  if (UNLIKELY(size <= 0))
+    return -EINVAL;
+
+  return sys_epoll_create1(0);
+}
+
+static Epoll_FD* get_epoll(int epfd)
+{
+  return dynamic_cast<Epoll_FD*>(FD_map::_get(epfd));
+}
+
+static long sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+  auto* fildes = FD_map::_get(epfd);
+  if (UNLIKELY(fildes == nullptr))
+    return -EBADF;
+
+  auto* ep = get_epoll(epfd);
+  if (UNLIKELY(ep == nullptr))
+    return -EINVAL;
+
+  return ep->ctl(op, fd, event);
+}
+
+static long sys_epoll_pwait(int epfd, struct epoll_event *events, int maxevents,
+                            int timeout, const sigset_t * /*sigmask*/)
+{
+  if (UNLIKELY(maxevents <= 0))
+    return -EINVAL;
+  if (UNLIKELY(events == nullptr))
+    return -EFAULT;
+
+  if (UNLIKELY(FD_map::_get(epfd) == nullptr))
+    return -EBADF;
+
+  auto* ep = get_epoll(epfd);
+  if (UNLIKELY(ep == nullptr))
+    return -EINVAL;
+
+  // there are no signals to mask
+  return posix::block_until_ready(timeout,
+    [ep, events, maxevents] { return ep->ready(events, maxevents); });
+}
+
+static long sys_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+  return sys_epoll_pwait(epfd, events, maxevents, timeout, nullptr);
+}
+
+extern "C" {
+long syscall_SYS_epoll_create(int size) {
+  return strace(sys_epoll_create, "epoll_create", size);
+}
+
+long syscall_SYS_epoll_create1(int flags) {
+  return strace(sys_epoll_create1, "epoll_create1", flags);
+}
+
+long syscall_SYS_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event) {
+  return strace(sys_epoll_ctl, "epoll_ctl", epfd, op, fd, event);
+}
+
+long syscall_SYS_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout) {
+  return strace(sys_epoll_wait, "epoll_wait", epfd, events, maxevents, timeout);
+}
+
+long syscall_SYS_epoll_pwait(int epfd, struct epoll_event *events, int maxevents,
+                             int timeout, const sigset_t *sigmask) {
+  return strace(sys_epoll_pwait, "epoll_pwait", epfd, events, maxevents, timeout, sigmask);
+}
+} // extern "C"
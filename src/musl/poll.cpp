@@ -1,32 +1,65 @@
-#include "stub.hpp"
+#include "common.hpp"
+#include <posix/fd_map.hpp>
+#include <posix/readiness.hpp>
 #include <poll.h>
 #include <signal.h>
+#include <algorithm>
 
-
-static long sys_poll(struct pollfd *fds, nfds_t nfds, int /*timeout*/)
+// check every fd once, returning the number of fds with events
+static long poll_ready(struct pollfd *fds, nfds_t nfds)
 {
+  long count = 0;
   for (nfds_t i = 0; i < nfds; i++)
   {
-    fds[i].revents = fds[i].events;
+    auto& pfd = fds[i];
+    // negative fds are ignored
+    if (pfd.fd < 0) {
+      pfd.revents = 0;
+      continue;
+    }
+    if (auto* fildes = FD_map::_get(pfd.fd); fildes)
+      pfd.revents = fildes->poll_events(pfd.events);
+    else
+      pfd.revents = POLLNVAL;
+
+    if (pfd.revents != 0) count++;
   }
-  return nfds;
+  return count;
 }
-static long sys_ppoll(struct pollfd *fds, nfds_t nfds, const struct timespec * /*timeout_ts*/, const sigset_t * /*sigmask*/)
+
+static long sys_poll(struct pollfd *fds, nfds_t nfds, int timeout)
 {
-  for (nfds_t i = 0; i < nfds; i++)
+  if (UNLIKELY(fds == nullptr and nfds > 0))
+    return -EFAULT;
+
+  return posix::block_until_ready(timeout,
+    [fds, nfds] { return poll_ready(fds, nfds); });
+}
+
+static long sys_ppoll(struct pollfd *fds, nfds_t nfds, const struct timespec *timeout_ts, const sigset_t * /*sigmask*/)
+{
+  int timeout = -1;
+  if (timeout_ts != nullptr)
   {
-    fds[i].revents = fds[i].events;
+    if (UNLIKELY(timeout_ts->tv_sec < 0 or timeout_ts->tv_nsec < 0
+              or timeout_ts->tv_nsec >= 1000000000))
+      return -EINVAL;
+    // round up, so we never wake before the timeout
+    const int64_t ms = timeout_ts->tv_sec * 1000 + (timeout_ts->tv_nsec + 999999) / 1000000;
+    timeout = std::min(ms, (int64_t) INT32_MAX);
   }
-  return nfds;
+  // there are no signals to mask
+  return sys_poll(fds, nfds, timeout);
 }
+
 extern "C"
 long syscall_SYS_poll(struct pollfd *fds, nfds_t nfds, int timeout)
 {
-  return stubtrace(sys_poll, "poll", fds, nfds, timeout);
+  return strace(sys_poll, "poll", fds, nfds, timeout);
 }
 
 extern "C"
 int syscall_SYS_ppoll(struct pollfd *fds, nfds_t nfds, const struct timespec *timeout_ts, const sigset_t *sigmask)
 {
-	return stubtrace(sys_ppoll, "ppoll", fds, nfds, timeout_ts,sigmask);
+  return strace(sys_ppoll, "ppoll", fds, nfds, timeout_ts, sigmask);
 }
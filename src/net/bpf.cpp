@@ -0,0 +1,177 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <net/bpf.hpp>
+#include <net/inet_common.hpp>
+#include <cstring>
+
+namespace net {
+
+  Bpf::Bpf(Program program)
+    : prog_{std::move(program)}
+  {
+    if (const char* err = validate(prog_))
+      throw Bpf_error{std::string("Invalid BPF program: ") + err};
+  }
+
+  const char* Bpf::validate(const Program& prog) noexcept
+  {
+    if (prog.empty() or prog.size() > MAX_INSNS)
+      return "bad length";
+
+    const size_t len = prog.size();
+    for (size_t pc = 0; pc < len; pc++)
+    {
+      const auto& insn = prog[pc];
+      switch (insn.code)
+      {
+      case LD|W|IMM: case LD|W|ABS: case LD|H|ABS: case LD|B|ABS:
+      case LD|W|IND: case LD|H|IND: case LD|B|IND: case LD|W|LEN:
+      case LDX|W|IMM: case LDX|W|LEN: case LDX|B|MSH:
+      case RET|K: case RET|A:
+      case MISC|TAX: case MISC|TXA:
+        break;
+      case LD|MEM: case LDX|MEM: case ST: case STX:
+        if (insn.k >= MEMWORDS) return "scratch memory out of range";
+        break;
+      case ALU|ADD|K: case ALU|SUB|K: case ALU|MUL|K: case ALU|OR|K:
+      case ALU|AND|K: case ALU|LSH|K: case ALU|RSH|K: case ALU|XOR|K:
+      case ALU|ADD|X: case ALU|SUB|X: case ALU|MUL|X: case ALU|DIV|X:
+      case ALU|OR|X:  case ALU|AND|X: case ALU|LSH|X: case ALU|RSH|X:
+      case ALU|MOD|X: case ALU|XOR|X: case ALU|NEG:
+        break;
+      case ALU|DIV|K: case ALU|MOD|K:
+        if (insn.k == 0) return "division by zero";
+        break;
+      case JMP|JA:
+        if (insn.k >= len - pc - 1) return "jump out of range";
+        break;
+      case JMP|JEQ|K: case JMP|JGT|K: case JMP|JGE|K: case JMP|JSET|K:
+      case JMP|JEQ|X: case JMP|JGT|X: case JMP|JGE|X: case JMP|JSET|X:
+        if (insn.jt >= len - pc - 1 or insn.jf >= len - pc - 1)
+          return "jump out of range";
+        break;
+      default:
+        return "unknown instruction";
+      }
+    }
+    const auto last = prog.back().code;
+    if (last != (RET|K) and last != (RET|A))
+      return "does not end with return";
+    return nullptr;
+  }
+
+  static inline bool load(const uint8_t* data, uint32_t buflen,
+                          uint32_t off, uint32_t size, uint32_t& out) noexcept
+  {
+    if (UNLIKELY(off > buflen or buflen - off < size))
+      return false;
+    switch (size) {
+    case 4: {
+      uint32_t val;
+      std::memcpy(&val, data + off, 4);
+      out = ntohl(val);
+      break;
+    }
+    case 2: {
+      uint16_t val;
+      std::memcpy(&val, data + off, 2);
+      out = ntohs(val);
+      break;
+    }
+    default:
+      out = data[off];
+    }
+    return true;
+  }
+
+  uint32_t Bpf::run(const uint8_t* data, uint32_t buflen, uint32_t wirelen) const noexcept
+  {
+    if (prog_.empty())
+      return wirelen;
+
+    uint32_t acc = 0, idx = 0; // the A and X registers
+    uint32_t M[MEMWORDS] {};
+    // validated, so every path ends with a return
+    for (const Insn* insn = prog_.data();; insn++)
+    {
+      const uint32_t k = insn->k;
+      switch (insn->code)
+      {
+      case LD|W|IMM:  acc = k; break;
+      case LD|W|ABS:  if (not load(data, buflen, k, 4, acc)) return 0; break;
+      case LD|H|ABS:  if (not load(data, buflen, k, 2, acc)) return 0; break;
+      case LD|B|ABS:  if (not load(data, buflen, k, 1, acc)) return 0; break;
+      case LD|W|IND:  if (not load(data, buflen, idx + k, 4, acc)) return 0; break;
+      case LD|H|IND:  if (not load(data, buflen, idx + k, 2, acc)) return 0; break;
+      case LD|B|IND:  if (not load(data, buflen, idx + k, 1, acc)) return 0; break;
+      case LD|W|LEN:  acc = wirelen; break;
+      case LD|MEM:    acc = M[k]; break;
+      case LDX|W|IMM: idx = k; break;
+      case LDX|W|LEN: idx = wirelen; break;
+      case LDX|MEM:   idx = M[k]; break;
+      case LDX|B|MSH:
+        if (not load(data, buflen, k, 1, idx)) return 0;
+        idx = (idx & 0xf) << 2;
+        break;
+      case ST:  M[k] = acc; break;
+      case STX: M[k] = idx; break;
+
+      case ALU|ADD|K: acc += k; break;
+      case ALU|SUB|K: acc -= k; break;
+      case ALU|MUL|K: acc *= k; break;
+      case ALU|DIV|K: acc /= k; break;
+      case ALU|MOD|K: acc %= k; break;
+      case ALU|OR|K:  acc |= k; break;
+      case ALU|AND|K: acc &= k; break;
+      case ALU|XOR|K: acc ^= k; break;
+      case ALU|LSH|K: acc = (k < 32) ? acc << k : 0; break;
+      case ALU|RSH|K: acc = (k < 32) ? acc >> k : 0; break;
+      case ALU|ADD|X: acc += idx; break;
+      case ALU|SUB|X: acc -= idx; break;
+      case ALU|MUL|X: acc *= idx; break;
+      case ALU|DIV|X: if (idx == 0) return 0; acc /= idx; break;
+      case ALU|MOD|X: if (idx == 0) return 0; acc %= idx; break;
+      case ALU|OR|X:  acc |= idx; break;
+      case ALU|AND|X: acc &= idx; break;
+      case ALU|XOR|X: acc ^= idx; break;
+      case ALU|LSH|X: acc = (idx < 32) ? acc << idx : 0; break;
+      case ALU|RSH|X: acc = (idx < 32) ? acc >> idx : 0; break;
+      case ALU|NEG:   acc = -acc; break;
+
+      case JMP|JA:        insn += k; break;
+      case JMP|JEQ|K:     insn += (acc == k) ? insn->jt : insn->jf; break;
+      case JMP|JGT|K:     insn += (acc > k)  ? insn->jt : insn->jf; break;
+      case JMP|JGE|K:     insn += (acc >= k) ? insn->jt : insn->jf; break;
+      case JMP|JSET|K:    insn += (acc & k)  ? insn->jt : insn->jf; break;
+      case JMP|JEQ|X:     insn += (acc == idx) ? insn->jt : insn->jf; break;
+      case JMP|JGT|X:     insn += (acc > idx)  ? insn->jt : insn->jf; break;
+      case JMP|JGE|X:     insn += (acc >= idx) ? insn->jt : insn->jf; break;
+      case JMP|JSET|X:    insn += (acc & idx)  ? insn->jt : insn->jf; break;
+
+      case RET|K: return std::min(k, wirelen);
+      case RET|A: return std::min(acc, wirelen);
+
+      case MISC|TAX: idx = acc; break;
+      case MISC|TXA: acc = idx; break;
+      default:
+        return 0;
+      }
+    }
+  }
+
+} //< namespace net
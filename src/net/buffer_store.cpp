@@ -23,6 +23,8 @@
 #include <cassert>
 #include <smp>
 #include <cstddef>
+#include <algorithm>
+#include <util/bitops.hpp>
 #ifdef __MACH__
 extern void* aligned_alloc(size_t alignment, size_t size);
 #endif
@@ -42,10 +44,13 @@ namespace net {
   {
     assert(num != 0);
     assert(bufsize != 0);
+    // pools are aligned to their (power of two) span, for O(1) lookup
+    pool_span_  = std::max((uintptr_t) util::bits::next_pow2(poolsize_),
+                           (uintptr_t) os::mem::min_psize());
+    pool_shift_ = util::bits::ctz(pool_span_);
     available_.reserve(num);
 
     this->create_new_pool();
-    assert(this->available_.capacity() == num);
     assert(available() == num);
 
     static int bsidx = 0;
@@ -58,33 +63,71 @@ namespace net {
   }
 
   uint8_t* BufferStore::get_buffer()
+  {
+    auto& mag = PER_CPU(this->cache_);
+    if (UNLIKELY(mag.count == 0)) this->refill(mag);
+
+    auto* addr = mag.bufs[--mag.count];
+    BSD_PRINT("%d: Gave away %p, %d buffers remain in CPU cache\n",
+            this->index, addr, mag.count);
+    return addr;
+  }
+
+  void BufferStore::refill(Magazine& mag)
   {
 #ifdef INCLUDEOS_SMP_ENABLE
     scoped_spinlock spinlock(this->plock);
 #endif
-
     if (UNLIKELY(available_.empty())) {
       if (this->growth_enabled())
           this->create_new_pool();
       else
           throw std::runtime_error("This BufferStore has run out of buffers");
     }
+    // take half a magazine, so that alternating get/release
+    // on the boundary doesn't bounce buffers to and from the depot
+    const int count = std::min((size_t) MAGAZINE_SIZE / 2, available_.size());
+    const auto it = available_.end() - count;
+    std::copy(it, available_.end(), &mag.bufs[mag.count]);
+    available_.erase(it, available_.end());
+    mag.count += count;
+  }
 
-    auto* addr = available_.back();
-    available_.pop_back();
-    BSD_PRINT("%d: Gave away %p, %zu buffers remain\n",
-            this->index, addr, available());
-    return addr;
+  void BufferStore::drain(Magazine& mag)
+  {
+#ifdef INCLUDEOS_SMP_ENABLE
+    scoped_spinlock spinlock(this->plock);
+#endif
+    const int count = MAGAZINE_SIZE / 2;
+    mag.count -= count;
+    available_.insert(available_.end(),
+                      &mag.bufs[mag.count], &mag.bufs[mag.count + count]);
+    BSD_PRINT("%d: Drained %d buffers to depot, %zu buffers in depot\n",
+              this->index, count, available_.size());
   }
 
   void BufferStore::create_new_pool()
   {
-    auto* pool = (uint8_t*) aligned_alloc(os::mem::min_psize(), poolsize_);
+    if (UNLIKELY(this->pools_.size() >= MAX_POOLS)) {
+      throw std::runtime_error("This BufferStore has reached its pool limit");
+    }
+    auto* pool = (uint8_t*) aligned_alloc(pool_span_, poolsize_);
     if (UNLIKELY(pool == nullptr)) {
       throw std::runtime_error("Buffer store failed to allocate memory");
     }
     this->pools_.push_back(pool);
 
+    // publish the pool for is_valid(), before any buffer is handed out
+    const auto base = (uintptr_t) pool;
+    for (uint32_t i = 0; i < POOL_SLOTS; i++)
+    {
+      auto& slot = pool_table_[(pool_slot(base, pool_shift_) + i) & (POOL_SLOTS-1)];
+      if (slot.load(std::memory_order_relaxed) == 0) {
+        slot.store(base, std::memory_order_release);
+        break;
+      }
+    }
+
     for (uint8_t* b = pool; b < pool + poolsize_; b += bufsize_) {
         this->available_.push_back(b);
     }
@@ -94,7 +137,8 @@ namespace net {
 
   void BufferStore::move_to_this_cpu() noexcept
   {
-    // TODO: hmm
+    // buffers are cached per CPU, and every CPU refills from
+    // the same depot, so there is no CPU affinity to update
   }
 
   __attribute__((weak))
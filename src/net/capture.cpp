@@ -0,0 +1,200 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <net/capture.hpp>
+#include <net/stream.hpp>
+#include <posix/capture_fd.hpp>
+#include <posix/fd_map.hpp>
+#include <fs/vfs.hpp>
+#include <kernel/rtc.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace net {
+
+  static inline uint32_t pad4(uint32_t len) noexcept
+  { return (len + 3) & ~3u; }
+
+  template <typename T>
+  static inline void put(os::mem::buffer& out, T value)
+  {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+  }
+
+  static void put_option(os::mem::buffer& out, uint16_t code,
+                         const void* data, uint16_t len)
+  {
+    put(out, code);
+    put(out, len);
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    out.insert(out.end(), bytes, bytes + len);
+    out.resize(out.size() + pad4(len) - len, 0);
+  }
+
+  Capture::Capture(std::string ifname, Config config, Bpf filter)
+    : ifname_{std::move(ifname)}, filter_{std::move(filter)},
+      snaplen_{std::max(config.snaplen, 1u)}
+  {
+    Expects(config.slots > 0);
+    uint64_t slots = 1;
+    while (slots < config.slots) slots <<= 1;
+    mask_   = slots - 1;
+    stride_ = (sizeof(Slot) + snaplen_ + alignof(Slot) - 1) & ~(alignof(Slot) - 1);
+    ring_.reset(new uint8_t[slots * stride_]);
+    // each slot is ready for the first lap around the ring
+    for (uint64_t pos = 0; pos < slots; pos++)
+      new (&slot(pos)) Slot{{pos}, 0, 0, 0, Direction::IN, {}};
+  }
+
+  Capture::~Capture()
+  {
+    for (uint64_t pos = 0; pos <= mask_; pos++)
+      slot(pos).~Slot();
+  }
+
+  void Capture::capture(const Packet* chain, Direction dir) noexcept
+  {
+    for (auto* pkt = chain; pkt != nullptr; pkt = const_cast<Packet*>(pkt)->tail())
+      record(*pkt, dir);
+  }
+
+  void Capture::record(const Packet& pkt, Direction dir) noexcept
+  {
+    const uint32_t buflen  = pkt.size();
+    const uint32_t wirelen = buflen + pkt.ext_length();
+    const uint32_t keep = filter_.run(pkt.layer_begin(), buflen, wirelen);
+    if (keep == 0) {
+      filtered_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    // claim a slot (a bounded MPMC queue, with the reader on its own)
+    uint64_t pos = head_.load(std::memory_order_relaxed);
+    Slot* s;
+    while (true)
+    {
+      s = &slot(pos);
+      const int64_t diff = s->seq.load(std::memory_order_acquire) - pos;
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0) {
+        // not yet read since the last lap
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+
+    const uint32_t caplen = std::min(keep, snaplen_);
+    const uint32_t inbuf  = std::min(caplen, buflen);
+    std::memcpy(s->data, pkt.layer_begin(), inbuf);
+    // scatter-gather payload follows the buffer
+    if (caplen > inbuf)
+      std::memcpy(s->data + inbuf, pkt.ext_data(), caplen - inbuf);
+    s->timestamp = RTC::nanos_now();
+    s->wirelen   = wirelen;
+    s->caplen    = caplen;
+    s->dir       = dir;
+    s->seq.store(pos + 1, std::memory_order_release);
+    captured_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void Capture::write_header(os::mem::buffer& out) const
+  {
+    // section header block
+    put<uint32_t>(out, BLOCK_SHB);
+    put<uint32_t>(out, 28);
+    put<uint32_t>(out, 0x1A2B3C4D);
+    put<uint16_t>(out, 1);
+    put<uint16_t>(out, 0);
+    put<int64_t>(out, -1);
+    put<uint32_t>(out, 28);
+
+    // interface description block, with nanosecond timestamps
+    const size_t begin = out.size();
+    put<uint32_t>(out, BLOCK_IDB);
+    put<uint32_t>(out, 0);
+    put<uint16_t>(out, LINKTYPE_ETHERNET);
+    put<uint16_t>(out, 0);
+    put<uint32_t>(out, snaplen_);
+    put_option(out, 2, ifname_.data(), ifname_.size()); // if_name
+    const uint8_t tsresol = 9;
+    put_option(out, 9, &tsresol, 1);                    // if_tsresol
+    put_option(out, 0, nullptr, 0);                     // opt_endofopt
+    const uint32_t len = out.size() - begin + 4;
+    std::memcpy(out.data() + begin + 4, &len, 4);
+    put<uint32_t>(out, len);
+  }
+
+  size_t Capture::read(os::mem::buffer& out, size_t max_packets)
+  {
+    if (not header_written_) {
+      write_header(out);
+      header_written_ = true;
+    }
+    size_t count = 0;
+    for (; count < max_packets; count++)
+    {
+      auto& s = slot(tail_);
+      if (s.seq.load(std::memory_order_acquire) != tail_ + 1) break;
+
+      // enhanced packet block
+      const uint32_t len = 28 + pad4(s.caplen) + 12 + 4;
+      put<uint32_t>(out, BLOCK_EPB);
+      put<uint32_t>(out, len);
+      put<uint32_t>(out, 0);
+      put<uint32_t>(out, s.timestamp >> 32);
+      put<uint32_t>(out, s.timestamp);
+      put<uint32_t>(out, s.caplen);
+      put<uint32_t>(out, s.wirelen);
+      out.insert(out.end(), s.data, s.data + s.caplen);
+      out.resize(out.size() + pad4(s.caplen) - s.caplen, 0);
+      const uint32_t flags = (uint32_t) s.dir;
+      put_option(out, 2, &flags, 4);                    // epb_flags
+      put_option(out, 0, nullptr, 0);
+      put<uint32_t>(out, len);
+
+      // free for the next lap
+      s.seq.store(tail_ + mask_ + 1, std::memory_order_release);
+      tail_++;
+    }
+    return count;
+  }
+
+  size_t Capture::write_to(Stream& stream)
+  {
+    auto buf = std::make_shared<os::mem::buffer>();
+    const size_t count = read(*buf);
+    if (not buf->empty())
+      stream.write(std::move(buf));
+    return count;
+  }
+
+  void Capture::mount(const std::string& path)
+  {
+    this->open_fd = [this] () -> FD& {
+      return FD_map::_open<Capture_fd>(*this);
+    };
+    fs::mount(path, *this, "Packet capture (pcapng)");
+  }
+
+} //< namespace net
@@ -113,6 +113,7 @@ Conntrack::Conntrack(size_t max_entries)
  : maximum_entries{max_entries},
    tcp_in{&dumb_in},
    tcp6_in{&dumb6_in},
+   expiry{static_cast<Expiry_wheel::time_t>(RTC::now())},
    flush_timer({this, &Conntrack::on_timeout})
 {
 }
@@ -156,7 +157,7 @@ Conntrack::Entry* Conntrack::get(const Quadruple& quad, const Protocol proto) co
   auto it = entries.find({quad, proto});
 
   if(it != entries.end())
-    return it->second.get();
+    return it->second;
 
   return nullptr;
 }
@@ -167,7 +168,13 @@ Conntrack::Entry* Conntrack::in(const PacketIP4& pkt)
   switch(proto)
   {
     case Protocol::TCP:
-      return tcp_in(*this, get_quadruple(pkt), pkt);
+    {
+      auto* entry = tcp_in(*this, get_quadruple(pkt), pkt);
+      // the tracker sets the timeout on the entry
+      if(entry != nullptr)
+        schedule(*entry);
+      return entry;
+    }
 
     case Protocol::UDP:
       return simple_track_in(get_quadruple(pkt), proto);
@@ -186,7 +193,12 @@ Conntrack::Entry* Conntrack::in(const PacketIP6& pkt)
   switch(proto)
   {
     case Protocol::TCP:
-      return tcp6_in(*this, get_quadruple(pkt), pkt);
+    {
+      auto* entry = tcp6_in(*this, get_quadruple(pkt), pkt);
+      if(entry != nullptr)
+        schedule(*entry);
+      return entry;
+    }
 
     case Protocol::UDP:
       return simple_track_in(get_quadruple(pkt), proto);
@@ -285,7 +297,7 @@ Conntrack::Entry* Conntrack::add_entry(
   // because it should be called from in()
 
   // create the entry
-  auto entry = std::make_shared<Entry>(quad, proto);
+  auto* entry = create_entry(quad, proto);
 
   entries.emplace(std::piecewise_construct,
     std::forward_as_tuple(entry->first, proto),
@@ -299,7 +311,15 @@ Conntrack::Entry* Conntrack::add_entry(
 
   update_timeout(*entry, timeout.unconfirmed);
 
-  return entry.get();
+  return entry;
+}
+
+Conntrack::Entry* Conntrack::create_entry(const Quadruple& quad, const Protocol proto)
+{
+  const auto id = pool.create(quad, proto);
+  auto& entry = pool[id];
+  entry.id = id;
+  return &entry;
 }
 
 Conntrack::Entry* Conntrack::update_entry(
@@ -315,7 +335,7 @@ Conntrack::Entry* Conntrack::update_entry(
     return nullptr;
   }
 
-  auto entry = it->second;
+  auto* entry = it->second;
 
   // determine if the old quant hits the first or second quantuple
   auto& quad = (entry->first == oldq)
@@ -342,31 +362,84 @@ Conntrack::Entry* Conntrack::update_entry(
 
   CTDBG("<Conntrack> Entry updated: %s\n", entry->to_string().c_str());
 
-  return entry.get();
+  return entry;
 }
 
 void Conntrack::remove_expired()
 {
   CTDBG("<Conntrack> Removing expired entries\n");
   const auto NOW = RTC::now();
-  // entries data structure
-  for(auto it = entries.begin(); it != entries.end();)
+  // every entry is visited, so nothing needs to wait for reaping
+  reap_queue.clear();
+  pool.for_each([this, NOW] (Entry& ent)
   {
-    if(it->second->timeout > NOW) {
-      ++it;
-    }
-    else {
-      CTDBG("<Conntrack> Erasing %s\n", it->second->to_string().c_str());
-      it = entries.erase(it);
+    if(ent.timeout > NOW)
+      schedule(ent);
+    else
+      erase(ent);
+  });
+}
+
+size_t Conntrack::reap(size_t budget)
+{
+  const auto NOW = RTC::now();
+  // only the entries that are due, once the last round is done
+  if(reap_queue.empty())
+  {
+    expiry.expire(NOW, [this, NOW] (const int32_t id)
+    {
+      auto& ent = pool[id];
+      // timeouts that were pushed back are moved to the new deadline
+      if(ent.timeout > NOW)
+        expiry.insert(id, ent.timeout);
+      else
+        reap_queue.push_back(id);
+    });
+  }
+
+  size_t removed = 0;
+  while(not reap_queue.empty() and removed < budget)
+  {
+    const auto id = reap_queue.back();
+    reap_queue.pop_back();
+
+    // seen again since it expired
+    if(expiry.contains(id))
+      continue;
+
+    auto& ent = pool[id];
+    if(ent.timeout > NOW) {
+      schedule(ent);
+      continue;
     }
+    erase(ent);
+    removed++;
   }
+  return removed;
+}
+
+void Conntrack::erase(Entry& ent)
+{
+  CTDBG("<Conntrack> Erasing %s\n", ent.to_string().c_str());
+  // a key can have been taken over by another entry (update or restore)
+  for(const auto* quad : {&ent.first, &ent.second})
+  {
+    auto it = entries.find({*quad, ent.proto});
+    if(it != entries.end() and it->second == &ent)
+      entries.erase(it);
+  }
+  expiry.erase(ent.id);
+  pool.destroy(ent.id);
 }
 
 void Conntrack::on_timeout()
 {
-  remove_expired();
+  reap(reap_budget);
 
-  if(not entries.empty())
+  // continue on the next event loop iteration, unless all is done
+  if(not reap_queue.empty())
+    flush_timer.restart(std::chrono::seconds{0});
+  else if(not pool.empty())
     flush_timer.restart(flush_interval);
 }
 
@@ -402,8 +475,9 @@ int Conntrack::deserialize_from(void* addr)
   for(auto i = size; i > 0; i--)
   {
     // create the entry
-    auto entry = std::make_shared<Entry>();
+    auto* entry = create_entry(Quadruple{}, Protocol{});
     buffer += entry->deserialize_from(buffer);
+    schedule(*entry);
 
     bool insert = false;
     insert = entries.insert_or_assign({entry->first, entry->proto}, entry).second;
@@ -416,6 +490,9 @@ int Conntrack::deserialize_from(void* addr)
 
   Ensures(entries.size() - (prev_size-dupes) == size * 2);
 
+  if(size > 0 and not flush_timer.is_running())
+    flush_timer.start(flush_interval);
+
   return buffer - reinterpret_cast<uint8_t*>(addr);
 }
 
@@ -428,7 +505,7 @@ void Conntrack::serialize_to(std::vector<char>& buf) const
   std::set<Entry*> to_serialize;
   for(auto& i : entries)
   {
-    auto* ent = i.second.get();
+    auto* ent = i.second;
 
     // We cannot restore delegates, so just ignore
     // the ones with close handler set
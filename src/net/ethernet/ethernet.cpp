@@ -24,6 +24,7 @@
 
 #include <net/util.hpp>
 #include <net/ethernet/ethernet.hpp>
+#include <net/packet_burst.hpp>
 #include <statman>
 
 #ifdef ntohs
@@ -182,4 +183,39 @@ namespace net {
 
   }
 
+  void Ethernet::receive_burst(Packet_ptr chain)
+  {
+    // a replaced IPv4 upstream (eg. a capture) sees every packet
+    if (UNLIKELY(not ip4_burst_upstream_ or not ip4_burst_paired_)) {
+      while (chain != nullptr)
+        receive(Packet_burst::pop_front(chain));
+      return;
+    }
+
+    Packet_burst ip4;
+    while (chain != nullptr)
+    {
+      auto pckt = Packet_burst::pop_front(chain);
+      Expects(pckt->size() > 0);
+      auto* eth = reinterpret_cast<header*>(pckt->layer_begin());
+
+      // Unicast IPv4 is collected, everything else takes the single path
+      if (LIKELY(eth->type() == Ethertype::IP4 and eth->dest() != MAC::BROADCAST))
+      {
+#ifdef ARP_PASSTHROUGH
+        linux_tap_device = eth->src();
+#endif
+        packets_rx_++;
+        pckt->increment_layer_begin(sizeof(header));
+        ip4.push_back(std::move(pckt));
+      }
+      else {
+        receive(std::move(pckt));
+      }
+    }
+
+    if (not ip4.empty())
+      ip4_burst_upstream_(ip4.release());
+  }
+
 } // namespace net
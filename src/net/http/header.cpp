@@ -19,28 +19,65 @@
 
 namespace http {
 
+static bool equal_nocase(util::csview a, util::csview b) noexcept {
+  return a.size() == b.size() and
+    std::equal(a.cbegin(), a.cend(), b.cbegin(),
+      [](const auto x, const auto y) { return std::tolower(x) == std::tolower(y); });
+}
+
+///////////////////////////////////////////////////////////////////////////////
+Header::Header()
+  : limit_{25}
+{
+  fields_.reserve(limit_);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
-Header::Header() {
-  fields_.reserve(25);
+Header::Header(const std::size_t limit)
+  : limit_{limit}
+{
+  fields_.reserve(limit_);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-Header::Header(const std::size_t limit) {
-  fields_.reserve(limit);
+Header::Header(const Header& other)
+  : fields_{other.fields_}
+  , limit_{other.limit_}
+  , source_{other.source_}
+{
+  fields_.reserve(limit_);
+  for (auto& entry : fields_)
+    if (entry.owned) entry = own(entry.name, entry.value, entry.id);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+Header& Header::operator = (const Header& other) {
+  if (this not_eq &other) {
+    Header copy{other};
+    *this = std::move(copy);
+  }
+  return *this;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 bool Header::add_field(std::string field, std::string value) {
   if (field.empty()) return false;
   //-----------------------------------
-  if (size() < fields_.capacity()) {
-    fields_.emplace_back(std::move(field), std::move(value));
+  if (size() < limit_) {
+    fields_.push_back(own(field, value, header::intern(field)));
     return true;
   }
   //-----------------------------------
   return false;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+bool Header::add_parsed(util::sview field, util::sview value) {
+  if (field.empty() or size() >= limit_) return false;
+  fields_.push_back({field, value, header::intern(field), false});
+  return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 bool Header::set_field(std::string field, std::string value) {
   if (field.empty() || value.empty()) return false;
@@ -48,7 +85,10 @@ bool Header::set_field(std::string field, std::string value) {
   const auto target = find(field);
   //-----------------------------------
   if (target not_eq fields_.cend()) {
-    const_cast<std::string&>(target->second) = std::move(value);
+    auto& entry = fields_[target - fields_.cbegin()];
+    auto replaced = own(entry.name, value, entry.id);
+    disown(entry);
+    entry = replaced;
     return true;
   }
   //-----------------------------------
@@ -64,7 +104,7 @@ bool Header::has_field(util::csview field) const noexcept {
 util::sview Header::value(util::csview field) const noexcept {
   if (field.empty()) return field;
   const auto it = find(field);
-  return (it not_eq fields_.cend()) ? util::csview{it->second} : util::sview();
+  return (it not_eq fields_.cend()) ? it->value : util::sview();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -80,12 +120,17 @@ std::size_t Header::size() const noexcept {
 ///////////////////////////////////////////////////////////////////////////////
 void Header::erase(util::csview field) noexcept {
   Const_iterator target;
-  while ((target = find(field)) not_eq fields_.cend()) fields_.erase(target);
+  while ((target = find(field)) not_eq fields_.cend()) {
+    disown(*target);
+    fields_.erase(target);
+  }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 void Header::clear() noexcept {
   fields_.clear();
+  owned_.clear();
+  source_.reset();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -108,11 +153,31 @@ bool Header::set_content_length(const size_t len) {
 Header::Const_iterator Header::find(util::csview field) const noexcept {
   if (field.empty()) return fields_.cend();
   //-----------------------------------
+  // the interned fields are found by address
   return
-    std::find_if(fields_.cbegin(), fields_.cend(), [&field](const auto _) {
-      return std::equal(_.first.cbegin(), _.first.cend(), field.cbegin(), field.cend(),
-        [](const auto a, const auto b) { return std::tolower(a) == std::tolower(b); });
+    std::find_if(fields_.cbegin(), fields_.cend(), [&field](const auto& entry) {
+      return (entry.id != nullptr and entry.id == field.data())
+          or equal_nocase(entry.name, field);
     });
 }
 
+///////////////////////////////////////////////////////////////////////////////
+Header::Field_entry Header::own(util::csview field, util::csview value, header::Field id) {
+  // name and value in one copy
+  std::string copy;
+  copy.reserve(field.size() + value.size());
+  copy.append(field.data(), field.size()).append(value.data(), value.size());
+  owned_.push_front(std::move(copy));
+  const util::sview both{owned_.front()};
+  return {both.substr(0, field.size()), both.substr(field.size()), id, true};
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Header::disown(const Field_entry& entry) noexcept {
+  if (not entry.owned) return;
+  owned_.remove_if([&entry](const auto& copy) {
+    return copy.data() == entry.name.data();
+  });
+}
+
 } //< namespace http
@@ -15,6 +15,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <net/http/header_fields.hpp>
+#include <cstring>
+#include <strings.h>
+
 namespace http {
 namespace header {
 //------------------------------------------------
@@ -73,6 +77,32 @@ Field Content_Range       {"Content-Range"};
 Field Content_Type        {"Content-Type"};
 Field Expires             {"Expires"};
 Field Last_Modified       {"Last-Modified"};
+Field Transfer_Encoding   {"Transfer-Encoding"};
+//------------------------------------------------
+// Lookup of the fields above by name
+//------------------------------------------------
+Field intern(util::csview name) noexcept {
+  // sorted by length, so most names are ruled out by it
+  static const Field* const fields[] {
+    &TE, &Age, &Date, &ETag, &From, &Host, &Vary, &Allow, &Range,
+    &Accept, &Cookie, &Expect, &Origin, &Server, &Expires, &Referer,
+    &Upgrade, &Location, &If_Match, &If_Range, &Connection, &Set_Cookie,
+    &User_Agent, &Retry_After, &Content_MD5, &Max_Forwards, &Content_Type,
+    &Authorization, &Accept_Ranges, &If_None_Match, &Content_Range,
+    &Last_Modified, &HTTP2_Settings, &Accept_Charset, &Content_Length,
+    &Accept_Encoding, &Accept_Language, &WWW_Authenticate,
+    &Content_Encoding, &Content_Language, &Content_Location,
+    &If_Modified_Since, &Transfer_Encoding, &Proxy_Authenticate, &Proxy_Authorization,
+    &If_Unmodified_Since
+  };
+  for (const auto* field : fields) {
+    const size_t len = std::strlen(*field);
+    if (len > name.size()) break;
+    if (len == name.size() and strncasecmp(*field, name.data(), len) == 0)
+      return *field;
+  }
+  return nullptr;
+}
 //------------------------------------------------
 //------------------------------------------------
 } //< namespace header
@@ -42,9 +42,9 @@ Message& Message::add_body(const Message_body& message_body) {
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-Message& Message::add_chunk(const std::string& chunk) {
+Message& Message::add_chunk(util::csview chunk) {
   if (chunk.empty()) return *this;
-  message_body_.append(chunk);
+  message_body_.append(chunk.data(), chunk.size());
   return *this;
 }
 
@@ -0,0 +1,266 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <net/http/request_parser.hpp>
+#include <common>
+
+namespace http {
+
+static constexpr util::csview CRLF {"\r\n"};
+// longest chunk size line, with extensions
+static constexpr std::size_t MAX_CHUNK_LINE = 1024;
+
+static bool is_token(util::csview str) noexcept {
+  if (str.empty()) return false;
+  for (const auto c : str)
+    if (c <= ' ' or c >= 127 or std::strchr("\"(),/:;<=>?@[\\]{}", c))
+      return false;
+  return true;
+}
+
+static util::sview trim(util::sview str) noexcept {
+  while (not str.empty() and (str.front() == ' ' or str.front() == '\t'))
+    str.remove_prefix(1);
+  while (not str.empty() and (str.back() == ' ' or str.back() == '\t'))
+    str.remove_suffix(1);
+  return str;
+}
+
+static bool equal_nocase(util::csview a, util::csview b) noexcept {
+  return a.size() == b.size() and strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+Request_parser::Request_parser() noexcept
+  : Request_parser{Limits{}}
+{}
+
+///////////////////////////////////////////////////////////////////////////////
+void Request_parser::feed(buffer_t buf) {
+  if (state_ == State::ERROR or buf == nullptr or buf->empty()) return;
+  //-----------------------------------
+  if (available() == 0) {
+    // parsed where it is
+    buf_ = std::move(buf);
+    pos_ = 0;
+    return;
+  }
+  //-----------------------------------
+  // a line split over reads, joined with what came before
+  auto joined = std::make_shared<os::mem::buffer>();
+  joined->reserve(available() + buf->size());
+  joined->insert(joined->end(), buf_->begin() + pos_, buf_->end());
+  joined->insert(joined->end(), buf->begin(), buf->end());
+  buf_ = std::move(joined);
+  pos_ = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+Request_ptr Request_parser::next() {
+  while (true)
+  {
+    switch (state_)
+    {
+    case State::HEAD: {
+      // empty lines before a request are ignored
+      while (available() >= 2 and unparsed().substr(0, 2) == CRLF)
+        pos_ += 2;
+      if (available() == 0) {
+        buf_.reset();
+        pos_ = 0;
+        return nullptr;
+      }
+      const auto data = unparsed();
+      const auto from = (scanned_ > 3) ? scanned_ - 3 : 0;
+      const auto end  = data.find("\r\n\r\n", from);
+      if (end == util::sview::npos) {
+        if (data.size() > limits_.max_head) fail("Request head too long");
+        scanned_ = data.size();
+        return nullptr;
+      }
+      if (end + 4 > limits_.max_head) fail("Request head too long");
+      auto req = parse_head(data.substr(0, end + 2));
+      pos_    += end + 4;
+      scanned_ = 0;
+      read_framing(*req);
+      if (state_ == State::HEAD) return req;
+      req_ = std::move(req);
+      break;
+    }
+    case State::BODY:
+    case State::CHUNK_DATA:
+      if (not read_body()) return nullptr;
+      if (state_ == State::BODY) {
+        state_ = State::HEAD;
+        return std::move(req_);
+      }
+      state_ = State::CHUNK_END;
+      break;
+
+    case State::CHUNK_END:
+      if (available() < 2) return nullptr;
+      if (unparsed().substr(0, 2) != CRLF) fail("Invalid chunk");
+      pos_  += 2;
+      state_ = State::CHUNK_SIZE;
+      break;
+
+    case State::CHUNK_SIZE: {
+      util::sview line;
+      if (not read_line(line, MAX_CHUNK_LINE)) return nullptr;
+      line = trim(line.substr(0, line.find(';')));
+      std::size_t size = 0;
+      if (line.empty() or line.size() > 8) fail("Invalid chunk size");
+      for (const auto c : line) {
+        if (not std::isxdigit((unsigned char) c)) fail("Invalid chunk size");
+        size = (size << 4) | (std::isdigit((unsigned char) c) ? c - '0' : (std::tolower(c) - 'a' + 10));
+      }
+      if (req_->body().size() + size > limits_.max_body) fail("Request body too large");
+      remaining_ = size;
+      state_ = (size == 0) ? State::TRAILER : State::CHUNK_DATA;
+      break;
+    }
+    case State::TRAILER: {
+      // trailer fields are not kept
+      util::sview line;
+      if (not read_line(line, limits_.max_head)) return nullptr;
+      if (line.empty()) {
+        state_ = State::HEAD;
+        return std::move(req_);
+      }
+      break;
+    }
+    case State::ERROR:
+      return nullptr;
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Request_parser::reset() noexcept {
+  state_     = State::HEAD;
+  pos_       = 0;
+  scanned_   = 0;
+  remaining_ = 0;
+  buf_.reset();
+  req_.reset();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+Request_ptr Request_parser::parse_head(util::sview head) {
+  // request-line
+  auto eol = head.find(CRLF);
+  auto line = head.substr(0, eol);
+  head.remove_prefix(eol + 2);
+
+  const auto sp1 = line.find(' ');
+  const auto sp2 = line.find(' ', sp1 + 1);
+  if (sp1 == util::sview::npos or sp2 == util::sview::npos)
+    fail("Invalid request line");
+  const auto method  = method::code(line.substr(0, sp1));
+  const auto target  = line.substr(sp1 + 1, sp2 - sp1 - 1);
+  const auto version = line.substr(sp2 + 1);
+  if (method == INVALID) fail("Invalid method");
+  if (target.empty() or target.find(' ') != util::sview::npos)
+    fail("Invalid request target");
+  if (version.size() != 8 or version.substr(0, 5) != "HTTP/" or version[6] != '.'
+      or not std::isdigit((unsigned char) version[5])
+      or not std::isdigit((unsigned char) version[7]))
+    fail("Invalid version");
+
+  auto req = std::make_unique<Request>(std::string{}, limits_.max_fields, false);
+  req->set_method(method);
+  req->set_uri(URI{target});
+  req->set_version(Version(version[5] - '0', version[7] - '0'));
+
+  // header fields, as views into the buffer
+  auto& header = req->header();
+  while (not head.empty())
+  {
+    eol  = head.find(CRLF);
+    line = head.substr(0, eol);
+    head.remove_prefix(eol + 2);
+    // no line folding, nor whitespace before the colon
+    const auto colon = line.find(':');
+    if (colon == util::sview::npos or not is_token(line.substr(0, colon)))
+      fail("Invalid header field");
+    header.add_parsed(line.substr(0, colon), trim(line.substr(colon + 1)));
+  }
+  header.set_source(buf_);
+  return req;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Request_parser::read_framing(Request& req) {
+  const auto& header = req.header();
+  const auto te = header.value(header::Transfer_Encoding);
+  const auto cl = header.value(header::Content_Length);
+  // both would let a proxy and the server disagree on where it ends
+  if (not te.empty() and not cl.empty()) fail("Both Transfer-Encoding and Content-Length");
+  //-----------------------------------
+  if (not te.empty()) {
+    if (te.size() < 7 or not equal_nocase(te.substr(te.size() - 7), "chunked"))
+      fail("Unsupported Transfer-Encoding");
+    state_ = State::CHUNK_SIZE;
+    return;
+  }
+  //-----------------------------------
+  std::size_t length = 0;
+  for (const auto c : cl) {
+    if (not std::isdigit((unsigned char) c) or length > limits_.max_body)
+      fail("Invalid Content-Length");
+    length = length * 10 + (c - '0');
+  }
+  if (length > limits_.max_body) fail("Request body too large");
+  remaining_ = length;
+  state_ = (length > 0) ? State::BODY : State::HEAD;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool Request_parser::read_body() {
+  if (available() == 0) return remaining_ == 0;
+  const auto data = unparsed().substr(0, remaining_);
+  req_->add_chunk(data);
+  pos_       += data.size();
+  remaining_ -= data.size();
+  if (available() == 0) {
+    buf_.reset();
+    pos_ = 0;
+  }
+  return remaining_ == 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool Request_parser::read_line(util::sview& line, const std::size_t max) {
+  const auto data = (available() > 0) ? unparsed() : util::sview{};
+  const auto eol  = data.find(CRLF);
+  if (eol == util::sview::npos) {
+    if (data.size() > max) fail("Line too long");
+    return false;
+  }
+  line  = data.substr(0, eol);
+  pos_ += eol + 2;
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Request_parser::fail(const char* reason) {
+  reset();
+  state_ = State::ERROR;
+  throw Request_error{reason};
+}
+
+} //< namespace http
@@ -17,7 +17,6 @@
 
 #include <net/http/response_writer.hpp>
 
-#include <sstream>
 
 namespace http {
 
@@ -28,6 +27,14 @@ namespace http {
     Ensures(not connection_.released());
   }
 
+  Response_writer::Response_writer(Response_ptr res, std::unique_ptr<Connection> conn)
+    : response_(std::move(res)),
+      connection_(*conn),
+      owned_(std::move(conn))
+  {
+    Ensures(not connection_.released());
+  }
+
   void Response_writer::write(std::string data)
   {
     pre_write(data.size());
@@ -78,10 +85,7 @@ namespace http {
     {
       response_->set_status_code(code);
 
-      std::ostringstream header;
-      header << response_->status_line() << "\r\n" << response_->header();
-
-      connection_.stream()->write(header.str());
+      connection_.write_header(*response_);
 
       // disable keep alive if "Connection: close" is present
       if(response_->header().value(http::header::Connection) == "close")
@@ -26,14 +26,16 @@ namespace http {
   Server::Server(TCP& tcp, Request_handler cb, idle_duration timeout)
     : tcp_(tcp),
       on_request_(std::move(cb)),
+      idle_{static_cast<Idle_wheel::time_t>(RTC::now())},
+      idle_timer_({this, &Server::timeout_clients}),
       keep_alive_(true),
-      timer_id_(Timers::UNUSED_ID),
       idle_timeout_(timeout),
       stat_conns_{Statman::get().create(Stat::UINT32, tcp.stack().ifname() + ".http_server.connections")},
       stat_req_rx_{Statman::get().create(Stat::UINT64, tcp.stack().ifname() + ".http_server.requests_rx")},
       stat_req_bad_{Statman::get().create(Stat::UINT32, tcp.stack().ifname() + ".http_server.requests_bad")},
       stat_timeouts_{Statman::get().create(Stat::UINT32, tcp.stack().ifname() + ".http_server.timeouts")}
   {
+    connections_.reserve(DEFAULT_CONNECTIONS);
   }
 
   void Server::listen(uint16_t port)
@@ -41,11 +43,6 @@ namespace http {
     assert(on_request_ != nullptr && "You must set 'on_request' on the server to receive requests!");
 
     bind(port);
-
-    using namespace std::chrono;
-
-    if(idle_timeout_ != idle_duration::zero())
-      timer_id_ = Timers::periodic(30s, 1min, {this, &Server::timeout_clients});
   }
 
   Response_ptr Server::create_response(status_t code) const
@@ -57,10 +54,7 @@ namespace http {
 
   Server::~Server()
   {
-    if(timer_id_ != Timers::UNUSED_ID)
-    {
-      Timers::stop(timer_id_);
-    }
+    idle_timer_.stop();
   }
 
   void Server::bind(const uint16_t port)
@@ -75,36 +69,49 @@ namespace http {
   void Server::connect(Connection::Stream_ptr stream)
   {
     debug("Connection attempt from %s\n", stream->remote().to_string().c_str());
-    // if there is a free spot in connections
-    if(free_idx_.size() > 0) {
-      auto idx = free_idx_.back();
-      Ensures(connections_[idx] == nullptr);
-      connections_[idx] = std::make_unique<Server_connection>(*this, std::move(stream), idx);
-      free_idx_.pop_back();
-    }
-    // if not, add a new shared ptr
-    else {
-      connections_.emplace_back(std::make_unique<Server_connection>(*this, std::move(stream), connections_.size()));
-    }
+    // freed ids are reused first, and the pool only grows by whole slabs
+    const auto id = connections_.create(*this, std::move(stream), 0);
+    auto& conn = connections_[id];
+    conn.idx_ = id;
+    conn.update_idle();
     ++stat_conns_;
   }
 
   void Server::close(Server_connection& conn)
   {
-    const auto idx = conn.idx();
-    connections_[idx] = nullptr;
-    free_idx_.push_back(idx);
+    const auto id = conn.idx();
+    if(not connections_.alive(id) or &connections_[id] != &conn)
+      return;
+    idle_.erase(id);
+    connections_.destroy(id);
   }
 
-  void Server::timeout_clients(int32_t)
+  void Server::update_idle(Server_connection& conn)
   {
-    const auto count = idle_timeout_.count();
-    for(auto& conn : connections_) {
-      if(conn != nullptr and RTC::now() > (conn->idle_since() + count))
-      {
-        conn->timeout();
-        ++stat_timeouts_;
-      }
+    if(idle_timeout_ == idle_duration::zero())
+      return;
+    const auto now = RTC::now();
+    if(UNLIKELY(idle_.empty()))
+      idle_.advance(now);
+    idle_.update(conn.idx(), now + idle_timeout_.count());
+    if(not idle_timer_.is_running())
+      idle_timer_.start(idle_timeout_);
+  }
+
+  void Server::timeout_clients()
+  {
+    const auto now = RTC::now();
+    idle_.expire(now, [this] (Idle_wheel::id_t id) {
+      auto& conn = connections_[id];
+      // a released stream belongs to someone else now
+      if(conn.released()) return;
+      conn.timeout();
+      ++stat_timeouts_;
+    });
+    // until the next deadline, or when lazily moved deadlines are re-hashed
+    if(not idle_.empty()) {
+      const auto next = std::max<Idle_wheel::time_t>(idle_.next() - now, 1);
+      idle_timer_.restart(std::chrono::seconds(next));
     }
   }
 
@@ -118,10 +125,19 @@ namespace http {
     else
     {
       ++stat_req_bad_;
-      // an error occured when parsing
-      // call user on_error or something
-      conn.send(create_response(code));
+      // an error occured when parsing, where the next request
+      // begins is unknown, so the connection ends after the answer
+      auto res = create_response(code);
+      res->header().set_field(header::Connection, "close");
+      conn.send(std::move(res));
+      conn.shutdown();
     }
   }
 
+  void Server::receive_h2(Request_ptr req, std::unique_ptr<Connection> conn)
+  {
+    ++stat_req_rx_;
+    on_request_(std::move(req), std::make_unique<Response_writer>(create_response(), std::move(conn)));
+  }
+
 }
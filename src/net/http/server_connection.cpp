@@ -17,13 +17,13 @@
 
 #include <net/http/server_connection.hpp>
 #include <net/http/server.hpp>
+#include <cstring>
 
 namespace http {
 
  Server_connection::Server_connection(Server& server, Stream_ptr stream, size_t idx, const size_t bufsize)
     : Connection(std::move(stream)),
       server_(server),
-      req_(nullptr),
       idx_(idx),
       idle_since_{0}
   {
@@ -43,59 +43,51 @@ namespace http {
       //end_response({Error::NO_REPLY});
       return;
     }
-
-    const std::string data{(char*) buf->data(), buf->size()};
-
-    // create response if not exist
-    if(req_ == nullptr)
-    {
-      try {
-        req_ = make_request(data); // this also parses
-        update_idle();
-      }
-      catch(...)
-      {
-        // Invalid request, just return (?)
-        //end_request(http::Bad_Request);
-        return;
-      }
+    update_idle();
+    if (h2_ != nullptr) {
+      h2_->receive(buf->data(), buf->size());
+      return;
     }
-    // if there already is a request
-    else
+    // a client starting with the HTTP/2 preface, either after ALPN
+    // chose h2 or with prior knowledge (h2c), gets HTTP/2 from here on
+    const auto len = std::min(buf->size(), http2::PREFACE.size());
+    if (not parser_.partial() and len >= 3
+        and std::memcmp(buf->data(), http2::PREFACE.data(), len) == 0)
     {
-      // note: need to validate that the method is allowed, etc.
-      // add chunks of body data
-      req_->add_chunk(std::move(data));
-      update_idle();
+      h2_ = std::make_unique<http2::Connection>(*stream_,
+        http2::Connection::Request_handler{this, &Server_connection::recv_h2});
+      h2_->receive(buf->data(), buf->size());
+      return;
     }
+    parser_.feed(std::move(buf));
 
-    const auto& header = req_->header();
-
-    if(not header.is_empty() && header.has_field(header::Content_Length))
+    try
     {
-      try
+      // pipelined requests are handed over in order, until the
+      // stream is taken over (eg. by a WebSocket upgrade)
+      while (not released())
       {
-        const unsigned conlen = std::stoul(std::string(header.value(header::Content_Length)));
-        // risk buffering forever if no timeout
-        if(conlen == req_->body().size())
-        {
-          end_request();
-        }
-      }
-      catch(...)
-      {
-        end_request(http::Bad_Request);
+        auto req = parser_.next();
+        if (req == nullptr) break;
+        end_request(std::move(req));
       }
     }
-    else
+    catch(const Request_error&)
     {
-      end_request();
+      // the rest of the stream can not be made sense of, so it is not
+      // parsed any further (the parser stays failed) and is closed
+      end_request(nullptr, http::Bad_Request);
     }
   }
 
-  void Server_connection::end_request(const status_t code)
+  void Server_connection::end_request(Request_ptr req, const status_t code)
+  {
+    server_.receive(std::move(req), code, *this);
+  }
+
+  void Server_connection::recv_h2(Request_ptr req, std::unique_ptr<http2::Exchange> exchange)
   {
-    server_.receive(std::move(req_), code, *this);
+    server_.receive_h2(std::move(req), std::move(exchange));
   }
 
   void Server_connection::close()
@@ -103,4 +95,10 @@ namespace http {
     server_.close(*this);
   }
 
+  void Server_connection::update_idle()
+  {
+    idle_since_ = RTC::now();
+    server_.update_idle(*this);
+  }
+
 }
@@ -0,0 +1,823 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2016-2017 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <net/http2/connection.hpp>
+#include <common>
+#include <algorithm>
+#include <cctype>
+#include <strings.h>
+
+namespace http2 {
+
+  // fields that only make sense on a HTTP/1.1 connection (RFC 7540 8.1.2.2)
+  static bool connection_specific(util::csview name) noexcept
+  {
+    const auto field = http::header::intern(name);
+    if (field == http::header::Connection or field == http::header::Transfer_Encoding
+        or field == http::header::Upgrade)
+      return true;
+    return (name.size() == 10 and strncasecmp(name.data(), "keep-alive", 10) == 0)
+        or (name.size() == 16 and strncasecmp(name.data(), "proxy-connection", 16) == 0);
+  }
+
+  // the payload without padding
+  static const uint8_t* unpad(const Frame_header& hdr, const uint8_t* payload, uint32_t& len)
+  {
+    len = hdr.length;
+    if (not hdr.has(flag::PADDED))
+      return payload;
+    if (len < 1 or payload[0] >= len)
+      throw Connection_error{Error::PROTOCOL_ERROR, "Invalid padding"};
+    len -= 1 + payload[0];
+    return payload + 1;
+  }
+
+  /// Stream ///
+
+  Stream::~Stream()
+  {
+    if (conn_ == nullptr) return;
+    if (auto* st = conn_->find(id_); st != nullptr)
+      conn_->detach(*st);
+  }
+
+  void Stream::write_header(const http::Response& res)
+  {
+    if (not is_writable()) return;
+    if (auto* st = conn_->find(id_); st != nullptr) {
+      conn_->send_headers(*st, res);
+      conn_->flush();
+    }
+  }
+
+  void Stream::write(const void* buf, size_t n)
+  {
+    if (not is_writable()) return;
+    if (auto* st = conn_->find(id_); st != nullptr)
+      conn_->send_data(*st, buf, n);
+  }
+
+  void Stream::close()
+  {
+    if (not is_writable()) return;
+    closing_ = true;
+    // may close the connection, it is not touched after
+    if (auto* st = conn_->find(id_); st != nullptr)
+      conn_->end_stream(*st);
+  }
+
+  net::Socket Stream::local() const
+  { return conn_ ? conn_->transport_.local() : net::Socket{}; }
+
+  net::Socket Stream::remote() const
+  { return conn_ ? conn_->transport_.remote() : net::Socket{}; }
+
+  std::string Stream::to_string() const
+  {
+    return "HTTP/2 stream " + std::to_string(id_)
+      + (conn_ ? " on " + conn_->transport_.to_string() : std::string{});
+  }
+
+  int Stream::get_cpuid() const noexcept
+  { return conn_ ? conn_->transport_.get_cpuid() : -1; }
+
+  net::Stream* Stream::transport() noexcept
+  { return conn_ ? &conn_->transport_ : nullptr; }
+
+  /// Connection ///
+
+  Connection::Connection(net::Stream& transport, Request_handler on_request)
+    : Connection(transport, std::move(on_request), Limits{})
+  {}
+
+  Connection::Connection(net::Stream& transport, Request_handler on_request, Limits limits)
+    : transport_{transport},
+      on_request_{std::move(on_request)},
+      limits_{limits},
+      decoder_{hpack::DEFAULT_TABLE_SIZE, limits.max_header_list},
+      recv_window_{DEFAULT_WINDOW}
+  {
+    // the server connection preface, sent with the reply to the client's
+    send_settings();
+    if (limits_.connection_window > DEFAULT_WINDOW) {
+      send_window_update(0, limits_.connection_window - DEFAULT_WINDOW);
+      recv_window_ = limits_.connection_window;
+    }
+  }
+
+  Connection::~Connection()
+  {
+    for (auto& entry : streams_)
+      if (entry.second.view) entry.second.view->conn_ = nullptr;
+  }
+
+  size_t Connection::active_streams() const noexcept
+  {
+    return std::count_if(streams_.begin(), streams_.end(), [] (const auto& entry) {
+      return not entry.second.local_closed or not entry.second.remote_closed;
+    });
+  }
+
+  void Connection::receive(const uint8_t* data, size_t len)
+  {
+    if (close_pending_)
+      return;
+    receiving_ = true;
+    try
+    {
+      for (; preface_ < PREFACE.size() and len > 0; preface_++, data++, len--)
+        if (*data != (uint8_t) PREFACE[preface_])
+          throw Connection_error{Error::PROTOCOL_ERROR, "Invalid connection preface"};
+
+      // frames are parsed where they are, only a partial frame is kept
+      if (in_.empty()) {
+        const size_t used = process(data, len);
+        in_.append((const char*) data + used, len - used);
+      }
+      else {
+        in_.append((const char*) data, len);
+        in_.erase(0, process((const uint8_t*) in_.data(), in_.size()));
+      }
+    }
+    catch (const Connection_error& err)
+    {
+      goaway(err.code());
+    }
+    catch (const Hpack_error&)
+    {
+      goaway(Error::COMPRESSION_ERROR);
+    }
+    // one write for all the frames sent in reply
+    receiving_ = false;
+    flush();
+  }
+
+  size_t Connection::process(const uint8_t* data, size_t len)
+  {
+    size_t off = 0;
+    while (len - off >= Frame_header::SIZE and not close_pending_)
+    {
+      const auto hdr = Frame_header::read(data + off);
+      // we never allow larger frames than the default
+      if (hdr.length > MIN_FRAME_SIZE)
+        throw Connection_error{Error::FRAME_SIZE_ERROR, "Frame too large"};
+      if (len - off < Frame_header::SIZE + hdr.length)
+        break;
+      frame(hdr, data + off + Frame_header::SIZE);
+      off += Frame_header::SIZE + hdr.length;
+    }
+    return off;
+  }
+
+  void Connection::frame(const Frame_header& hdr, const uint8_t* payload)
+  {
+    if (headers_stream_ and (hdr.type != Frame_type::CONTINUATION or hdr.stream != headers_stream_))
+      throw Connection_error{Error::PROTOCOL_ERROR, "Header block interrupted"};
+    if (not settings_seen_ and hdr.type != Frame_type::SETTINGS)
+      throw Connection_error{Error::PROTOCOL_ERROR, "Expected SETTINGS"};
+
+    switch (hdr.type)
+    {
+    case Frame_type::DATA:          on_data(hdr, payload); break;
+    case Frame_type::HEADERS:       on_headers(hdr, payload); break;
+    case Frame_type::PRIORITY:      on_priority(hdr, payload); break;
+    case Frame_type::RST_STREAM:    on_rst_stream(hdr, payload); break;
+    case Frame_type::SETTINGS:      on_settings(hdr, payload); break;
+    case Frame_type::PING:          on_ping(hdr, payload); break;
+    case Frame_type::GOAWAY:        on_goaway(hdr, payload); break;
+    case Frame_type::WINDOW_UPDATE: on_window_update(hdr, payload); break;
+    case Frame_type::CONTINUATION:  on_continuation(hdr, payload); break;
+    case Frame_type::PUSH_PROMISE:
+      throw Connection_error{Error::PROTOCOL_ERROR, "PUSH_PROMISE from client"};
+    default:
+      // unknown frame types are ignored
+      break;
+    }
+  }
+
+  void Connection::on_data(const Frame_header& hdr, const uint8_t* payload)
+  {
+    if (hdr.stream == 0)
+      throw Connection_error{Error::PROTOCOL_ERROR, "DATA on stream 0"};
+    // padding counts against the windows too
+    if (hdr.length > recv_window_)
+      throw Connection_error{Error::FLOW_CONTROL_ERROR, "Connection window exceeded"};
+    recv_window_  -= hdr.length;
+    recv_unacked_ += hdr.length;
+    if (recv_unacked_ >= limits_.connection_window / 2) {
+      send_window_update(0, recv_unacked_);
+      recv_window_ += recv_unacked_;
+      recv_unacked_ = 0;
+    }
+
+    uint32_t len;
+    const uint8_t* data = unpad(hdr, payload, len);
+    auto* st = find(hdr.stream);
+    if (st == nullptr or st->remote_closed)
+    {
+      if (hdr.stream > last_stream_)
+        throw Connection_error{Error::PROTOCOL_ERROR, "DATA on idle stream"};
+      if (st) reset(*st, Error::STREAM_CLOSED);
+      else    reset(hdr.stream, Error::STREAM_CLOSED);
+      return;
+    }
+    if (hdr.length > st->recv_window) {
+      reset(*st, Error::FLOW_CONTROL_ERROR);
+      return;
+    }
+    st->recv_window -= hdr.length;
+    if (st->request->body().size() + len > limits_.max_body
+        or held_ + len > limits_.max_buffered) {
+      reset(*st, Error::REFUSED_STREAM);
+      return;
+    }
+    st->request->add_chunk({(const char*) data, len});
+    st->held += len;
+    held_    += len;
+
+    if (hdr.has(flag::END_STREAM)) {
+      dispatch(*st);
+      return;
+    }
+    st->recv_unacked += hdr.length;
+    if (st->recv_unacked >= limits_.stream_window / 2) {
+      send_window_update(st->id, st->recv_unacked);
+      st->recv_window += st->recv_unacked;
+      st->recv_unacked = 0;
+    }
+  }
+
+  void Connection::on_headers(const Frame_header& hdr, const uint8_t* payload)
+  {
+    if (hdr.stream == 0 or hdr.stream % 2 == 0)
+      throw Connection_error{Error::PROTOCOL_ERROR, "HEADERS on a server stream"};
+    uint32_t len;
+    const uint8_t* block = unpad(hdr, payload, len);
+
+    auto* st = find(hdr.stream);
+    if (st == nullptr)
+    {
+      if (hdr.stream <= last_stream_)
+        throw Connection_error{Error::STREAM_CLOSED, "HEADERS on closed stream"};
+      last_stream_ = hdr.stream;
+      st = &streams_.emplace(std::piecewise_construct, std::forward_as_tuple(hdr.stream),
+        std::forward_as_tuple(hdr.stream, peer_window_, limits_.stream_window)).first->second;
+      st->vtime = vtime_;
+    }
+    if (hdr.has(flag::PRIORITY))
+    {
+      if (len < 5)
+        throw Connection_error{Error::FRAME_SIZE_ERROR, "HEADERS too short"};
+      const uint32_t dep = read_u32(block);
+      set_priority(hdr.stream, dep & MAX_WINDOW, block[4] + 1, dep >> 31);
+      block += 5;
+      len   -= 5;
+    }
+    headers_stream_     = hdr.stream;
+    headers_end_stream_ = hdr.has(flag::END_STREAM);
+    header_block_.assign((const char*) block, len);
+    if (hdr.has(flag::END_HEADERS))
+      end_headers();
+  }
+
+  void Connection::on_continuation(const Frame_header& hdr, const uint8_t* payload)
+  {
+    if (hdr.stream == 0 or hdr.stream != headers_stream_)
+      throw Connection_error{Error::PROTOCOL_ERROR, "Unexpected CONTINUATION"};
+    if (header_block_.size() + hdr.length > limits_.max_header_list)
+      throw Connection_error{Error::ENHANCE_YOUR_CALM, "Header block too large"};
+    header_block_.append((const char*) payload, hdr.length);
+    if (hdr.has(flag::END_HEADERS))
+      end_headers();
+  }
+
+  void Connection::end_headers()
+  {
+    auto* st = find(headers_stream_);
+    headers_stream_ = 0;
+
+    // trailers, and blocks on closed streams, are decoded to keep the table in sync
+    if (st == nullptr or st->remote_closed or st->request != nullptr)
+    {
+      decoder_.decode((const uint8_t*) header_block_.data(), header_block_.size(),
+                      [] (util::csview, util::csview) {});
+      if (st == nullptr)
+        return;
+      if (st->remote_closed)
+        reset(*st, Error::STREAM_CLOSED);
+      else if (headers_end_stream_)
+        dispatch(*st);
+      else
+        reset(*st, Error::PROTOCOL_ERROR);
+      return;
+    }
+
+    st->request = make_request();
+    if (st->request == nullptr) {
+      reset(*st, Error::PROTOCOL_ERROR);
+      return;
+    }
+    if (goaway_sent_ or active_streams() > limits_.max_streams) {
+      reset(*st, Error::REFUSED_STREAM);
+      return;
+    }
+    if (headers_end_stream_)
+      dispatch(*st);
+  }
+
+  http::Request_ptr Connection::make_request()
+  {
+    struct Fields {
+      http::Request_ptr req;
+      std::string method, path, scheme, authority, cookie;
+      bool regular = false;
+      bool malformed = false;
+    } f;
+    f.req = std::make_unique<http::Request>(std::string{}, limits_.max_fields, false);
+
+    decoder_.decode((const uint8_t*) header_block_.data(), header_block_.size(),
+    [&f] (util::csview name, util::csview value)
+    {
+      if (not name.empty() and name[0] == ':')
+      {
+        // pseudo-header fields go first, once each
+        std::string* field = nullptr;
+        if (name == ":method")         field = &f.method;
+        else if (name == ":path")      field = &f.path;
+        else if (name == ":scheme")    field = &f.scheme;
+        else if (name == ":authority") field = &f.authority;
+        if (f.regular or field == nullptr or not field->empty())
+          f.malformed = true;
+        else
+          field->assign(value);
+        return;
+      }
+      f.regular = true;
+      if (std::any_of(name.begin(), name.end(), [] (char c) { return std::isupper((unsigned char) c); })
+          or connection_specific(name) or (name == "te" and value != "trailers"))
+      {
+        f.malformed = true;
+        return;
+      }
+      // split cookies are joined again for HTTP/1.1 (RFC 7540 8.1.2.5)
+      if (name == "cookie") {
+        if (not f.cookie.empty()) f.cookie += "; ";
+        f.cookie.append(value);
+        return;
+      }
+      f.req->header().add_field(std::string(name), std::string(value));
+    });
+
+    const auto method = http::method::code(f.method);
+    if (f.malformed or method == http::INVALID
+        or (method != http::CONNECT and (f.path.empty() or f.scheme.empty())))
+      return nullptr;
+
+    auto& req = *f.req;
+    req.set_method(method);
+    req.set_uri(http::URI{method == http::CONNECT ? f.authority : f.path});
+    req.set_version(http::Version(2, 0));
+    if (not f.authority.empty() and not req.header().has_field(http::header::Host))
+      req.header().add_field(http::header::Host, f.authority);
+    if (not f.cookie.empty())
+      req.header().add_field(http::header::Cookie, std::move(f.cookie));
+    return std::move(f.req);
+  }
+
+  void Connection::dispatch(Stream_state& st)
+  {
+    // the body is the handler's now
+    held_ -= st.held;
+    st.held = 0;
+    st.remote_closed = true;
+    auto view = std::make_unique<Stream>(*this, st.id);
+    st.view = view.get();
+    // the handler may end the stream right away, st is not touched after
+    on_request_(std::move(st.request), std::make_unique<Exchange>(std::move(view)));
+  }
+
+  void Connection::on_priority(const Frame_header& hdr, const uint8_t* payload)
+  {
+    if (hdr.stream == 0)
+      throw Connection_error{Error::PROTOCOL_ERROR, "PRIORITY on stream 0"};
+    if (hdr.length != 5) {
+      reset(hdr.stream, Error::FRAME_SIZE_ERROR);
+      return;
+    }
+    // the priority of idle and closed streams is not kept
+    if (find(hdr.stream) == nullptr)
+      return;
+    const uint32_t dep = read_u32(payload);
+    set_priority(hdr.stream, dep & MAX_WINDOW, payload[4] + 1, dep >> 31);
+  }
+
+  bool Connection::depends_on(uint32_t id, const uint32_t ancestor) const
+  {
+    for (size_t n = streams_.size(); n > 0 and id != 0; n--)
+    {
+      auto it = streams_.find(id);
+      if (it == streams_.end()) return false;
+      id = it->second.parent;
+      if (id == ancestor) return true;
+    }
+    return false;
+  }
+
+  void Connection::set_priority(const uint32_t id, uint32_t parent, const uint16_t weight, const bool exclusive)
+  {
+    auto& st = streams_.at(id);
+    if (parent == id) {
+      reset(st, Error::PROTOCOL_ERROR);
+      return;
+    }
+    // a dependency on an unknown stream is a dependency on the root
+    if (parent != 0 and find(parent) == nullptr)
+      parent = 0;
+    // moving below a descendant first moves the descendant up (RFC 7540 5.3.3)
+    if (parent != 0 and depends_on(parent, id))
+      streams_.at(parent).parent = st.parent;
+    if (exclusive)
+      for (auto& entry : streams_)
+        if (entry.second.parent == parent and entry.first != id)
+          entry.second.parent = id;
+    st.parent = parent;
+    st.weight = weight;
+  }
+
+  void Connection::on_rst_stream(const Frame_header& hdr, const uint8_t*)
+  {
+    if (hdr.stream == 0 or hdr.stream > last_stream_)
+      throw Connection_error{Error::PROTOCOL_ERROR, "RST_STREAM on stream 0 or idle stream"};
+    if (hdr.length != 4)
+      throw Connection_error{Error::FRAME_SIZE_ERROR, "Invalid RST_STREAM"};
+    if (auto* st = find(hdr.stream); st != nullptr)
+      terminate(*st);
+  }
+
+  void Connection::on_settings(const Frame_header& hdr, const uint8_t* payload)
+  {
+    if (hdr.stream != 0)
+      throw Connection_error{Error::PROTOCOL_ERROR, "SETTINGS on a stream"};
+    if (hdr.has(flag::ACK))
+    {
+      if (hdr.length != 0)
+        throw Connection_error{Error::FRAME_SIZE_ERROR, "SETTINGS ACK with payload"};
+      return;
+    }
+    if (hdr.length % 6 != 0)
+      throw Connection_error{Error::FRAME_SIZE_ERROR, "Invalid SETTINGS"};
+
+    for (const uint8_t* p = payload; p < payload + hdr.length; p += 6)
+    {
+      const uint16_t id    = p[0] << 8 | p[1];
+      const uint32_t value = read_u32(p + 2);
+      switch (id)
+      {
+      case HEADER_TABLE_SIZE:
+        encoder_.set_max_table_size(value);
+        break;
+      case ENABLE_PUSH:
+        if (value > 1)
+          throw Connection_error{Error::PROTOCOL_ERROR, "Invalid SETTINGS_ENABLE_PUSH"};
+        break;
+      case INITIAL_WINDOW_SIZE:
+      {
+        if (value > MAX_WINDOW)
+          throw Connection_error{Error::FLOW_CONTROL_ERROR, "Invalid SETTINGS_INITIAL_WINDOW_SIZE"};
+        // applies to the streams already open too
+        const int64_t delta = int64_t(value) - peer_window_;
+        for (auto& entry : streams_)
+          if ((entry.second.send_window += delta) > MAX_WINDOW)
+            throw Connection_error{Error::FLOW_CONTROL_ERROR, "Stream window too large"};
+        peer_window_ = value;
+        break;
+      }
+      case MAX_FRAME_SIZE:
+        if (value < MIN_FRAME_SIZE or value > MAX_FRAME_SIZE_LIMIT)
+          throw Connection_error{Error::PROTOCOL_ERROR, "Invalid SETTINGS_MAX_FRAME_SIZE"};
+        peer_frame_size_ = value;
+        break;
+      default:
+        // MAX_CONCURRENT_STREAMS only limits pushes, which are not sent
+        break;
+      }
+    }
+    settings_seen_ = true;
+    send_frame(Frame_type::SETTINGS, flag::ACK, 0, nullptr, 0);
+    schedule();
+  }
+
+  void Connection::on_ping(const Frame_header& hdr, const uint8_t* payload)
+  {
+    if (hdr.stream != 0)
+      throw Connection_error{Error::PROTOCOL_ERROR, "PING on a stream"};
+    if (hdr.length != 8)
+      throw Connection_error{Error::FRAME_SIZE_ERROR, "Invalid PING"};
+    if (not hdr.has(flag::ACK))
+      send_frame(Frame_type::PING, flag::ACK, 0, payload, 8);
+  }
+
+  void Connection::on_goaway(const Frame_header& hdr, const uint8_t*)
+  {
+    if (hdr.stream != 0)
+      throw Connection_error{Error::PROTOCOL_ERROR, "GOAWAY on a stream"};
+    if (hdr.length < 8)
+      throw Connection_error{Error::FRAME_SIZE_ERROR, "Invalid GOAWAY"};
+    // the responses under way are finished, then the connection is closed
+    goaway_received_ = true;
+    if (streams_.empty())
+      close_pending_ = true;
+  }
+
+  void Connection::on_window_update(const Frame_header& hdr, const uint8_t* payload)
+  {
+    if (hdr.length != 4)
+      throw Connection_error{Error::FRAME_SIZE_ERROR, "Invalid WINDOW_UPDATE"};
+    const uint32_t increment = read_u32(payload) & MAX_WINDOW;
+    if (hdr.stream == 0)
+    {
+      if (increment == 0)
+        throw Connection_error{Error::PROTOCOL_ERROR, "WINDOW_UPDATE of 0"};
+      if ((send_window_ += increment) > MAX_WINDOW)
+        throw Connection_error{Error::FLOW_CONTROL_ERROR, "Connection window too large"};
+    }
+    else
+    {
+      if (hdr.stream > last_stream_)
+        throw Connection_error{Error::PROTOCOL_ERROR, "WINDOW_UPDATE on idle stream"};
+      auto* st = find(hdr.stream);
+      if (st == nullptr)
+        return;
+      if (increment == 0) {
+        reset(*st, Error::PROTOCOL_ERROR);
+        return;
+      }
+      if ((st->send_window += increment) > MAX_WINDOW) {
+        reset(*st, Error::FLOW_CONTROL_ERROR);
+        return;
+      }
+    }
+    schedule();
+  }
+
+  Connection::Stream_state* Connection::find(const uint32_t id) noexcept
+  {
+    auto it = streams_.find(id);
+    return (it != streams_.end()) ? &it->second : nullptr;
+  }
+
+  void Connection::reset(const uint32_t id, const Error code)
+  {
+    uint8_t payload[4];
+    const uint32_t err = uint32_t(code);
+    payload[0] = err >> 24; payload[1] = err >> 16; payload[2] = err >> 8; payload[3] = err;
+    send_frame(Frame_type::RST_STREAM, 0, id, payload, sizeof(payload));
+  }
+
+  void Connection::reset(Stream_state& st, const Error code)
+  {
+    reset(st.id, code);
+    terminate(st);
+  }
+
+  void Connection::terminate(Stream_state& st)
+  {
+    st.remote_closed = true;
+    st.local_closed  = true;
+    st.end_pending   = false;
+    st.pending.clear();
+    st.pending_off   = 0;
+    st.request.reset();
+    held_ -= st.held;
+    st.held = 0;
+    auto* view = st.view;
+    maybe_erase(st);
+    // the owner of the view may destroy it from the callback
+    if (view)
+    {
+      view->reset_ = true;
+      if (view->on_close_) view->on_close_();
+    }
+  }
+
+  void Connection::maybe_erase(Stream_state& st)
+  {
+    if (not st.remote_closed or not st.local_closed or st.view != nullptr)
+      return;
+    for (auto& entry : streams_)
+      if (entry.second.parent == st.id) entry.second.parent = st.parent;
+    streams_.erase(st.id);
+    if ((goaway_received_ or goaway_sent_) and streams_.empty())
+      close_pending_ = true;
+  }
+
+  void Connection::detach(Stream_state& st)
+  {
+    st.view = nullptr;
+    // a response that was never ended is cancelled
+    if (not st.local_closed and not st.end_pending)
+      reset(st, Error::CANCEL);
+    else
+      maybe_erase(st);
+    flush();
+  }
+
+  void Connection::goaway(const Error code)
+  {
+    if (goaway_sent_)
+      return;
+    goaway_sent_ = true;
+    uint8_t payload[8];
+    const uint32_t err = uint32_t(code);
+    payload[0] = last_stream_ >> 24; payload[1] = last_stream_ >> 16;
+    payload[2] = last_stream_ >> 8;  payload[3] = last_stream_;
+    payload[4] = err >> 24; payload[5] = err >> 16; payload[6] = err >> 8; payload[7] = err;
+    send_frame(Frame_type::GOAWAY, 0, 0, payload, sizeof(payload));
+    if (code != Error::NO_ERROR or streams_.empty())
+      close_pending_ = true;
+    flush();
+  }
+
+  void Connection::send_frame(const Frame_type type, const uint8_t flags, const uint32_t stream,
+                              const void* payload, const size_t len)
+  {
+    uint8_t hdr[Frame_header::SIZE];
+    Frame_header{uint32_t(len), type, flags, stream}.write(hdr);
+    out_.append((const char*) hdr, sizeof(hdr));
+    out_.append((const char*) payload, len);
+  }
+
+  void Connection::send_settings()
+  {
+    const std::pair<uint16_t, uint32_t> settings[] {
+      {MAX_CONCURRENT_STREAMS, limits_.max_streams},
+      {INITIAL_WINDOW_SIZE,    limits_.stream_window},
+      {MAX_HEADER_LIST_SIZE,   limits_.max_header_list}
+    };
+    uint8_t payload[sizeof(settings) / sizeof(settings[0]) * 6];
+    uint8_t* p = payload;
+    for (const auto& s : settings)
+    {
+      p[0] = s.first >> 8; p[1] = s.first;
+      p[2] = s.second >> 24; p[3] = s.second >> 16; p[4] = s.second >> 8; p[5] = s.second;
+      p += 6;
+    }
+    send_frame(Frame_type::SETTINGS, 0, 0, payload, sizeof(payload));
+  }
+
+  void Connection::send_window_update(const uint32_t stream, const uint32_t increment)
+  {
+    const uint8_t payload[4] {uint8_t(increment >> 24), uint8_t(increment >> 16),
+                              uint8_t(increment >> 8), uint8_t(increment)};
+    send_frame(Frame_type::WINDOW_UPDATE, 0, stream, payload, sizeof(payload));
+  }
+
+  void Connection::send_headers(Stream_state& st, const http::Response& res)
+  {
+    if (st.headers_sent or st.local_closed)
+      return;
+    std::string block;
+    encoder_.begin(block);
+    encoder_.encode(block, ":status", std::to_string(res.status_code()));
+    res.header().for_each([this, &block] (util::csview name, util::csview value) {
+      if (not connection_specific(name))
+        encoder_.encode(block, name, value);
+    });
+
+    // one block, split to the peer's frame size
+    size_t off = 0;
+    do {
+      const size_t n = std::min<size_t>(block.size() - off, peer_frame_size_);
+      const auto type = (off == 0) ? Frame_type::HEADERS : Frame_type::CONTINUATION;
+      send_frame(type, (off + n == block.size()) ? flag::END_HEADERS : 0, st.id, block.data() + off, n);
+      off += n;
+    } while (off < block.size());
+    st.headers_sent = true;
+  }
+
+  void Connection::send_data(Stream_state& st, const void* data, const size_t len)
+  {
+    if (not st.headers_sent or st.local_closed or st.end_pending)
+      return;
+    // drop what has been sent before it grows
+    if (st.pending_off > st.pending.size() / 2) {
+      st.pending.erase(0, st.pending_off);
+      st.pending_off = 0;
+    }
+    st.pending.append((const char*) data, len);
+    schedule();
+    flush();
+  }
+
+  void Connection::end_stream(Stream_state& st)
+  {
+    if (st.local_closed or st.end_pending)
+      return;
+    if (not st.headers_sent)
+      reset(st, Error::INTERNAL_ERROR);
+    else {
+      st.end_pending = true;
+      schedule();
+    }
+    flush();
+  }
+
+  bool Connection::ready(const Stream_state& st) const noexcept
+  {
+    if (st.local_closed)
+      return false;
+    if (st.pending_bytes() == 0)
+      return st.end_pending;
+    return st.send_window > 0 and send_window_ > 0;
+  }
+
+  bool Connection::blocked(const Stream_state& st) const
+  {
+    uint32_t parent = st.parent;
+    for (size_t n = streams_.size(); n > 0 and parent != 0; n--)
+    {
+      auto it = streams_.find(parent);
+      if (it == streams_.end()) return false;
+      if (ready(it->second)) return true;
+      parent = it->second.parent;
+    }
+    return false;
+  }
+
+  void Connection::schedule()
+  {
+    for (;;)
+    {
+      // the ready stream furthest behind its share, among those with
+      // no ancestor ready to send
+      Stream_state* next = nullptr;
+      for (auto& entry : streams_)
+      {
+        auto& st = entry.second;
+        if (not ready(st) or blocked(st)) continue;
+        st.vtime = std::max(st.vtime, vtime_);
+        if (next == nullptr or st.vtime < next->vtime
+            or (st.vtime == next->vtime and st.id < next->id))
+          next = &st;
+      }
+      if (next == nullptr)
+        return;
+
+      auto& st = *next;
+      const size_t n = std::min<int64_t>({int64_t(st.pending_bytes()), st.send_window,
+                                          send_window_, int64_t(peer_frame_size_)});
+      const bool last = st.end_pending and n == st.pending_bytes();
+      send_frame(Frame_type::DATA, last ? flag::END_STREAM : 0, st.id,
+                 st.pending.data() + st.pending_off, n);
+      st.pending_off += n;
+      st.send_window -= n;
+      send_window_   -= n;
+      if (st.pending_off == st.pending.size()) {
+        st.pending.clear();
+        st.pending_off = 0;
+      }
+      // weighted fair queueing, in bytes sent per weight
+      vtime_   = st.vtime;
+      st.vtime += n * 256 / st.weight + 1;
+
+      auto* view = st.view;
+      if (last) {
+        st.local_closed = true;
+        st.end_pending  = false;
+        maybe_erase(st);
+      }
+      if (view and view->on_write_ and n > 0)
+        view->on_write_(n);
+    }
+  }
+
+  void Connection::flush()
+  {
+    if (receiving_)
+      return;
+    if (not out_.empty()) {
+      transport_.write(out_);
+      out_.clear();
+    }
+    // closing may end up destroying this connection
+    if (close_pending_ and not closed_) {
+      closed_ = true;
+      transport_.close();
+    }
+  }
+
+} //< namespace http2
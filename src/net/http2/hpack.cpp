@@ -0,0 +1,452 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2016-2017 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <net/http2/hpack.hpp>
+#include <common>
+#include <algorithm>
+#include <array>
+
+namespace http2 {
+namespace hpack {
+
+  using Field = std::pair<util::sview, util::sview>;
+
+  static const std::array<Field, STATIC_ENTRIES> static_table {{
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""}
+  }};
+
+  // code lengths of the Huffman code in RFC 7541 appendix B, with EOS last.
+  // The code is canonical, so the codes follow from the lengths.
+  static constexpr int EOS = 256;
+  static constexpr int MAX_LEN = 30;
+  static constexpr uint8_t code_lengths[EOS + 1] {
+    13,23,28,28,28,28,28,28,28,24,30,28,28,30,28,28,
+    28,28,28,28,28,28,30,28,28,28,28,28,28,28,28,28,
+     6,10,10,12,13, 6, 8,11,10,10, 8,11, 8, 6, 6, 6,
+     5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8,15, 6,12,10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+     7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8,13,19,13,14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+     6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7,15,11,14,13,28,
+    20,22,20,20,22,22,22,23,22,23,23,23,23,23,24,23,
+    24,24,22,23,24,23,23,23,23,21,22,23,22,23,23,24,
+    22,21,20,22,22,23,23,21,23,22,22,24,21,22,23,23,
+    21,21,22,21,23,22,23,23,20,22,22,22,23,22,22,23,
+    26,26,20,19,22,23,22,25,26,26,26,27,27,26,24,25,
+    19,21,26,27,27,26,27,24,21,21,26,26,28,27,27,27,
+    20,24,20,21,22,21,21,23,22,22,25,25,24,24,26,23,
+    26,27,26,26,27,27,27,27,27,28,27,27,27,27,27,26,
+    30
+  };
+
+  struct Huffman {
+    uint32_t code[EOS + 1];
+    // the codes of each length are consecutive, starting at first[len]
+    uint32_t first[MAX_LEN + 1] {};
+    uint16_t count[MAX_LEN + 1] {};
+    uint16_t offset[MAX_LEN + 1] {};
+    // symbols in code order
+    uint16_t symbols[EOS + 1];
+
+    Huffman() noexcept
+    {
+      for (int sym = 0; sym <= EOS; sym++)
+        count[code_lengths[sym]]++;
+      for (int len = 1, n = 0; len <= MAX_LEN; len++) {
+        offset[len] = n;
+        n += count[len];
+      }
+      uint16_t next[MAX_LEN + 1];
+      std::copy(std::begin(offset), std::end(offset), std::begin(next));
+      for (int sym = 0; sym <= EOS; sym++)
+        symbols[next[code_lengths[sym]]++] = sym;
+
+      uint32_t c = 0;
+      int prev = code_lengths[symbols[0]];
+      for (int i = 0; i <= EOS; i++)
+      {
+        const int len = code_lengths[symbols[i]];
+        if (i > 0) c = (c + 1) << (len - prev);
+        if (i == offset[len]) first[len] = c;
+        code[symbols[i]] = c;
+        prev = len;
+      }
+    }
+  };
+  static const Huffman huffman;
+
+  void encode_int(std::string& out, const int prefix, const uint8_t first, uint32_t value)
+  {
+    const uint32_t max = (1u << prefix) - 1;
+    if (value < max) {
+      out += char(first | value);
+      return;
+    }
+    out += char(first | max);
+    value -= max;
+    while (value >= 128) {
+      out += char((value & 0x7f) | 0x80);
+      value >>= 7;
+    }
+    out += char(value);
+  }
+
+  uint32_t decode_int(const uint8_t*& p, const uint8_t* end, const int prefix)
+  {
+    if (UNLIKELY(p >= end))
+      throw Hpack_error{"Truncated integer"};
+    const uint32_t max = (1u << prefix) - 1;
+    uint64_t value = *p++ & max;
+    if (value < max)
+      return value;
+    for (int shift = 0; ; shift += 7)
+    {
+      if (UNLIKELY(p >= end or shift > 28))
+        throw Hpack_error{"Truncated or too large integer"};
+      const uint8_t b = *p++;
+      value += uint64_t(b & 0x7f) << shift;
+      if (UNLIKELY(value > UINT32_MAX))
+        throw Hpack_error{"Integer overflow"};
+      if ((b & 0x80) == 0)
+        return value;
+    }
+  }
+
+  size_t huffman_size(util::csview str) noexcept
+  {
+    size_t bits = 0;
+    for (const unsigned char c : str)
+      bits += code_lengths[c];
+    return (bits + 7) / 8;
+  }
+
+  void huffman_encode(util::csview str, std::string& out)
+  {
+    uint64_t acc = 0;
+    int bits = 0;
+    for (const unsigned char c : str)
+    {
+      acc = (acc << code_lengths[c]) | huffman.code[c];
+      bits += code_lengths[c];
+      while (bits >= 8) {
+        bits -= 8;
+        out += char(acc >> bits);
+      }
+      acc &= (uint64_t(1) << bits) - 1;
+    }
+    // padded with the most significant bits of EOS, which are all ones
+    if (bits > 0)
+      out += char((acc << (8 - bits)) | ((1u << (8 - bits)) - 1));
+  }
+
+  void huffman_decode(const uint8_t* data, const size_t len, std::string& out)
+  {
+    uint32_t code = 0;
+    int bits = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+      for (int b = 7; b >= 0; b--)
+      {
+        code = (code << 1) | ((data[i] >> b) & 1);
+        if (UNLIKELY(++bits > MAX_LEN))
+          throw Hpack_error{"Invalid Huffman code"};
+        // codes shorter than this one were already tried, so a code
+        // below first[bits] wraps around here
+        const uint32_t idx = code - huffman.first[bits];
+        if (idx < huffman.count[bits])
+        {
+          const int sym = huffman.symbols[huffman.offset[bits] + idx];
+          if (UNLIKELY(sym == EOS))
+            throw Hpack_error{"EOS in Huffman string"};
+          out += char(sym);
+          code = 0;
+          bits = 0;
+        }
+      }
+    }
+    if (UNLIKELY(bits > 7 or code != (1u << bits) - 1))
+      throw Hpack_error{"Invalid Huffman padding"};
+  }
+
+  void Table::add(util::csview name, util::csview value)
+  {
+    const size_t size = name.size() + value.size() + ENTRY_OVERHEAD;
+    // an entry larger than the table empties it (the strings may be in it)
+    if (size > max_size_) {
+      evict(max_size_);
+      return;
+    }
+    Entry entry {std::string(name), std::string(value)};
+    evict(size);
+    entries_.push_front(std::move(entry));
+    size_ += size;
+  }
+
+  void Table::resize(size_t max_size)
+  {
+    max_size_ = max_size;
+    evict(0);
+  }
+
+  void Table::evict(size_t room)
+  {
+    while (not entries_.empty() and size_ + room > max_size_)
+    {
+      const auto& e = entries_.back();
+      size_ -= e.name.size() + e.value.size() + ENTRY_OVERHEAD;
+      entries_.pop_back();
+    }
+  }
+
+} //< namespace hpack
+
+  using namespace hpack;
+
+  std::pair<util::sview, util::sview> Hpack_decoder::entry(uint32_t index) const
+  {
+    if (UNLIKELY(index == 0))
+      throw Hpack_error{"Index 0"};
+    if (index <= STATIC_ENTRIES)
+      return static_table[index - 1];
+    index -= STATIC_ENTRIES + 1;
+    if (UNLIKELY(index >= table_.count()))
+      throw Hpack_error{"Index out of range"};
+    const auto& e = table_[index];
+    return {e.name, e.value};
+  }
+
+  void Hpack_decoder::read_string(const uint8_t*& p, const uint8_t* end, std::string& out)
+  {
+    out.clear();
+    if (UNLIKELY(p >= end))
+      throw Hpack_error{"Truncated string"};
+    const bool huff = *p & 0x80;
+    const uint32_t len = decode_int(p, end, 7);
+    if (UNLIKELY(len > size_t(end - p) or len > max_list_))
+      throw Hpack_error{"Truncated or too long string"};
+    if (huff)
+      huffman_decode(p, len, out);
+    else
+      out.assign(reinterpret_cast<const char*>(p), len);
+    p += len;
+  }
+
+  void Hpack_decoder::decode(const uint8_t* data, size_t len, Field_handler on_field)
+  {
+    const uint8_t* p = data;
+    const uint8_t* end = data + len;
+    size_t list = 0;
+    bool first = true;
+
+    auto emit = [&] (util::csview name, util::csview value) {
+      list += name.size() + value.size() + Table::ENTRY_OVERHEAD;
+      if (UNLIKELY(list > max_list_))
+        throw Hpack_error{"Header list too large"};
+      on_field(name, value);
+      first = false;
+    };
+    // a literal field, with the name either indexed or as a string
+    auto literal = [&] (int prefix) {
+      const uint32_t index = decode_int(p, end, prefix);
+      if (index)
+        name_.assign(entry(index).first);
+      else
+        read_string(p, end, name_);
+      read_string(p, end, value_);
+    };
+
+    while (p < end)
+    {
+      const uint8_t b = *p;
+      if (b & 0x80)
+      {
+        const auto field = entry(decode_int(p, end, 7));
+        emit(field.first, field.second);
+      }
+      else if (b & 0x40)
+      {
+        literal(6);
+        table_.add(name_, value_);
+        emit(name_, value_);
+      }
+      else if (b & 0x20)
+      {
+        // only allowed before the first field
+        if (UNLIKELY(not first))
+          throw Hpack_error{"Table size update after a field"};
+        const uint32_t size = decode_int(p, end, 5);
+        if (UNLIKELY(size > max_table_))
+          throw Hpack_error{"Table size update above the limit"};
+        table_.resize(size);
+      }
+      else
+      {
+        // without indexing, or never indexed
+        literal(4);
+        emit(name_, value_);
+      }
+    }
+  }
+
+  // fields that must not be stored by intermediaries either
+  static bool sensitive(util::csview name) noexcept
+  {
+    return name == "authorization" or name == "proxy-authorization"
+        or name == "cookie" or name == "set-cookie";
+  }
+
+  void Hpack_encoder::set_max_table_size(size_t size)
+  {
+    size = std::min(size, DEFAULT_TABLE_SIZE);
+    if (size == table_.max_size())
+      return;
+    // the decoder has to see the smallest size too, as it evicts
+    min_size_ = size_update_ ? std::min(min_size_, size) : size;
+    size_update_ = true;
+    table_.resize(size);
+  }
+
+  void Hpack_encoder::begin(std::string& out)
+  {
+    if (not size_update_)
+      return;
+    if (min_size_ < table_.max_size())
+      encode_int(out, 5, 0x20, min_size_);
+    encode_int(out, 5, 0x20, table_.max_size());
+    size_update_ = false;
+  }
+
+  void Hpack_encoder::write_string(std::string& out, util::csview str)
+  {
+    const size_t huff = huffman_size(str);
+    if (huff < str.size()) {
+      encode_int(out, 7, 0x80, huff);
+      huffman_encode(str, out);
+    }
+    else {
+      encode_int(out, 7, 0, str.size());
+      out.append(str.data(), str.size());
+    }
+  }
+
+  void Hpack_encoder::encode(std::string& out, util::csview name_in, util::csview value)
+  {
+    lower_.resize(name_in.size());
+    std::transform(name_in.begin(), name_in.end(), lower_.begin(),
+                   [] (unsigned char c) { return std::tolower(c); });
+    const util::csview name {lower_};
+
+    uint32_t name_index = 0;
+    for (uint32_t i = 0; i < STATIC_ENTRIES; i++)
+    {
+      if (static_table[i].first != name) continue;
+      if (static_table[i].second == value) {
+        encode_int(out, 7, 0x80, i + 1);
+        return;
+      }
+      if (name_index == 0) name_index = i + 1;
+    }
+    for (uint32_t i = 0; i < table_.count(); i++)
+    {
+      const auto& e = table_[i];
+      if (e.name != name) continue;
+      if (e.value == value) {
+        encode_int(out, 7, 0x80, STATIC_ENTRIES + 1 + i);
+        return;
+      }
+      if (name_index == 0) name_index = STATIC_ENTRIES + 1 + i;
+    }
+
+    // large fields would only push out the others
+    const size_t size = name.size() + value.size() + Table::ENTRY_OVERHEAD;
+    const bool index = not sensitive(name) and size <= table_.max_size() / 4;
+    if (index)
+      encode_int(out, 6, 0x40, name_index);
+    else if (sensitive(name))
+      encode_int(out, 4, 0x10, name_index);
+    else
+      encode_int(out, 4, 0x00, name_index);
+
+    if (name_index == 0)
+      write_string(out, name);
+    write_string(out, value);
+
+    if (index)
+      table_.add(name, value);
+  }
+
+} //< namespace http2
@@ -73,11 +73,11 @@ namespace http
 
   void Botan_server::on_connect(TCP_conn conn)
   {
-    connect(
-      std::make_unique<net::botan::Server> (
+    auto tls = std::make_unique<net::botan::Server> (
         std::make_unique<net::tcp::Stream>(
-          std::move(conn)), rng, *credman)
-    );
+          std::move(conn)), rng, *credman);
+    tls->set_app_protocols({"h2", "http/1.1"});
+    connect(std::move(tls));
   }
 
 }
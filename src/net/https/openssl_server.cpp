@@ -5,6 +5,29 @@
 
 namespace http
 {
+  // HTTP/2 when the client offers it (RFC 7301), except over the
+  // suites it does not allow (RFC 7540 9.2.2), which are chosen first
+  static int select_alpn(SSL* ssl, const unsigned char** out, unsigned char* outlen,
+                         const unsigned char* in, unsigned int inlen, void*)
+  {
+    static const unsigned char protocols[] = "\x02h2\x08http/1.1";
+    const unsigned char* offer = protocols;
+    unsigned int offer_len = sizeof(protocols) - 1;
+  #if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    const auto* cipher = SSL_get_pending_cipher(ssl);
+    if (cipher != nullptr and not SSL_CIPHER_is_aead(cipher)) {
+      offer += 3;
+      offer_len -= 3;
+    }
+  #else
+    (void) ssl;
+  #endif
+    if (SSL_select_next_proto((unsigned char**) out, outlen,
+          offer, offer_len, in, inlen) != OPENSSL_NPN_NEGOTIATED)
+      return SSL_TLSEXT_ERR_NOACK;
+    return SSL_TLSEXT_ERR_OK;
+  }
+
   void OpenSSL_server::openssl_initialize(const std::string& certif,
                                           const std::string& key)
   {
@@ -20,6 +43,19 @@ namespace http
     openssl::verify_rng();
 
     this->m_ctx = openssl::create_server(certif.c_str(), key.c_str());
+    auto* ctx = (SSL_CTX*) this->m_ctx;
+  #if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    // the CBC suite is kept for HTTP/1.1 clients, see select_alpn
+    SSL_CTX_set_cipher_list(ctx, "ECDHE-RSA-AES256-GCM-SHA384:ECDHE-RSA-AES128-GCM-SHA256:AES256-SHA");
+  #else
+    // the suite is not known when choosing the protocol, and
+    // HTTP/2 does not allow the CBC suites (RFC 7540 9.2.2)
+    SSL_CTX_set_cipher_list(ctx, "ECDHE-RSA-AES256-GCM-SHA384:ECDHE-RSA-AES128-GCM-SHA256");
+  #endif
+  #if OPENSSL_VERSION_NUMBER < 0x10100000L
+    SSL_CTX_set_ecdh_auto(ctx, 1);
+  #endif
+    SSL_CTX_set_alpn_select_cb(ctx, select_alpn, nullptr);
     assert(ERR_get_error() == 0);
   }
   OpenSSL_server::~OpenSSL_server()
@@ -55,6 +55,14 @@ namespace http
       print_s2n_error("Error setting verify-host callback");
       exit(1);
     }
+
+    static const char* protocols[] {"h2", "http/1.1"};
+    res =
+    s2n_config_set_protocol_preferences(config, protocols, 2);
+    if (res < 0) {
+      print_s2n_error("Error setting ALPN protocols");
+      exit(1);
+    }
   }
   
   S2N_server::~S2N_server()
@@ -44,12 +44,15 @@ Inet::Inet(hw::Nic& nic)
   /** Upstream delegates */
   auto arp_bottom(upstream{arp_, &Arp::receive});
   auto ip4_bottom(upstream_ip{ip4_, &IP4::receive});
+  auto ip4_burst_bottom(upstream{ip4_, &IP4::receive_burst});
   auto ip6_bottom(upstream_ip{ip6_, &IP6::receive});
   auto icmp4_bottom(upstream{icmp_, &ICMPv4::receive});
   auto icmp6_bottom(upstream{icmp6_, &ICMPv6::receive});
   auto udp4_bottom(upstream{udp_, &UDP::receive4});
+  auto udp4_burst_bottom(upstream{udp_, &UDP::receive4_burst});
   auto udp6_bottom(upstream{udp_, &UDP::receive6});
   auto tcp4_bottom(upstream{tcp_, &TCP::receive4});
+  auto tcp4_burst_bottom(upstream{tcp_, &TCP::receive4_burst});
   auto tcp6_bottom(upstream{tcp_, &TCP::receive6});
   auto ndp_bottom(upstream{ndp_, &Ndp::receive});
   auto mld_bottom(upstream{mld_, &Mld::receive});
@@ -63,6 +66,7 @@ Inet::Inet(hw::Nic& nic)
 
   // Link -> IP4
   nic_.set_ip4_upstream(ip4_bottom);
+  nic_.set_ip4_burst_upstream(ip4_burst_bottom);
 
   // Link -> IP6
   nic_.set_ip6_upstream(ip6_bottom);
@@ -75,12 +79,14 @@ Inet::Inet(hw::Nic& nic)
 
   // IP4 -> UDP
   ip4_.set_udp_handler(udp4_bottom);
+  ip4_.set_udp_burst_handler(udp4_burst_bottom);
 
   // IP6 -> UDP
   ip6_.set_udp_handler(udp6_bottom);
 
   // IP4 -> TCP
   ip4_.set_tcp_handler(tcp4_bottom);
+  ip4_.set_tcp_burst_handler(tcp4_burst_bottom);
 
   // IP6 -> TCP
   ip6_.set_tcp_handler(tcp6_bottom);
@@ -26,6 +26,7 @@
 #include <net/inet>
 #include <net/ip4/packet_ip4.hpp>
 #include <net/packet.hpp>
+#include <net/packet_burst.hpp>
 #include <statman>
 #include <net/ip4/icmp4.hpp>
 
@@ -118,6 +119,36 @@ namespace net {
   }
 
   void IP4::receive(Packet_ptr pckt, [[maybe_unused]]const bool link_bcast)
+  {
+    auto packet = ingress(std::move(pckt));
+    if (UNLIKELY(packet == nullptr)) return;
+    dispatch(std::move(packet));
+  }
+
+  void IP4::receive_burst(Packet_ptr chain)
+  {
+    Packet_burst tcp, udp;
+    // Run the whole burst through ingress, sorting out TCP and UDP
+    while (chain != nullptr)
+    {
+      auto packet = ingress(Packet_burst::pop_front(chain));
+      if (UNLIKELY(packet == nullptr)) continue;
+
+      if (packet->ip_protocol() == Protocol::TCP and tcp_burst_handler_)
+        tcp.push_back(std::move(packet));
+      else if (packet->ip_protocol() == Protocol::UDP and udp_burst_handler_)
+        udp.push_back(std::move(packet));
+      else
+        dispatch(std::move(packet));
+    }
+
+    if (not tcp.empty())
+      tcp_burst_handler_(tcp.release());
+    if (not udp.empty())
+      udp_burst_handler_(udp.release());
+  }
+
+  IP4::IP_packet_ptr IP4::ingress(Packet_ptr pckt)
   {
     // Cast to IP4 Packet
     auto packet = static_unique_ptr_cast<net::PacketIP4>(std::move(pckt));
@@ -144,7 +175,7 @@ namespace net {
     packet->adjust_size_from_header();
 
     packet = drop_invalid_in(std::move(packet));
-    if (UNLIKELY(packet == nullptr)) return;
+    if (UNLIKELY(packet == nullptr)) return nullptr;
 
     /* PREROUTING */
     // Track incoming packet if conntrack is active
@@ -153,7 +184,7 @@ namespace net {
     auto res = prerouting_chain_(std::move(packet), stack_, ct);
     if (UNLIKELY(res == Filter_verdict_type::DROP)) {
       prerouting_dropped_++;
-      return;
+      return nullptr;
     }
 
     Ensures(res.packet != nullptr);
@@ -174,7 +205,7 @@ namespace net {
         PRINT("Forwarding packet \n");
         forward_packet_(std::move(packet), stack_, ct);
       }
-      return;
+      return nullptr;
     }
 
     PRINT("* Packet was for me (flags=%x)\n", (int) packet->ip_flags());
@@ -184,7 +215,7 @@ namespace net {
               || packet->ip_frag_offs() != 0))
     {
       packet = this->reassemble(std::move(packet));
-      if (packet == nullptr) return;
+      if (packet == nullptr) return nullptr;
     }
 
     /* INPUT */
@@ -199,13 +230,16 @@ namespace net {
     res = input_chain_(std::move(packet), stack_, ct);
     if (UNLIKELY(res == Filter_verdict_type::DROP)) {
       input_dropped_++;
-      return;
+      return nullptr;
     }
 
     Ensures(res.packet != nullptr);
-    packet = res.release();
     PRINT("* Done parsing the packet header\n");
+    return res.release();
+  }
 
+  void IP4::dispatch(IP_packet_ptr packet)
+  {
     // Pass packet to it's respective protocol controller
     switch (packet->ip_protocol()) {
     case Protocol::ICMPv4:
@@ -282,6 +316,11 @@ namespace net {
             );
       // to avoid loops, lets decrement hop count here
       packet->decrement_ttl();
+      // the receive path reads the payload from the buffer
+      if (UNLIKELY(not packet->linearize())) {
+        drop(std::move(packet), Direction::Downstream, Drop_reason::Bad_destination);
+        return;
+      }
       IP4::receive(std::move(packet), false);
       return;
     }
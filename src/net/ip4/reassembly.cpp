@@ -1,7 +1,246 @@
 #include <net/ip4/ip4.hpp>
+#include <net/ip4/reassembly.hpp>
+#include <cstring>
 
 namespace net
 {
+namespace ip4
+{
+  // the IP header at a 4 byte boundary, as with a link layer header
+  static const int IP_ALIGN = 2;
+
+  static Reassembly::Packet_ptr create_packet(uint32_t length)
+  {
+    size_t buffer_len = sizeof(Packet) + IP_ALIGN + length;
+    auto  buffer = new uint8_t[buffer_len];
+    auto* ptr    = (Packet*) buffer;
+
+    new (ptr) Packet(IP_ALIGN, 0, IP_ALIGN + length, nullptr);
+    return static_unique_ptr_cast<PacketIP4> (net::Packet_ptr(ptr));
+  }
+
+  Reassembly::Reassembly(Config config)
+    : config_{config}, table_{config.max_datagrams}
+  {
+    Expects(config_.max_datagrams > 0);
+  }
+
+  Reassembly::Packet_ptr Reassembly::process(Packet_ptr frag, timestamp_t now)
+  {
+    Expects(frag != nullptr);
+    this->expire(now);
+
+    const uint32_t len   = frag->ip_data_length();
+    const uint32_t first = frag->ip_frag_offs() * 8;
+    const uint32_t last  = first + len - 1;
+    const bool     more  = (uint8_t) frag->ip_flags() & (uint8_t) Flags::MF;
+    const uint32_t cost  = frag->bufsize();
+
+    // all but the last fragment are multiples of 8 bytes, and not tiny
+    if (UNLIKELY(len == 0 or first + len > MAX_DATAGRAM or cost > config_.max_bytes
+              or (more and (len % 8 != 0 or len < MIN_FRAGMENT))))
+    {
+      stats_.dropped++;
+      return nullptr;
+    }
+
+    const Key key {frag->ip_src().whole, frag->ip_dst().whole,
+                   frag->ip_id(), (uint8_t) frag->ip_protocol()};
+    auto it = table_.find(key);
+    if (it == table_.end())
+    {
+      if (table_.size() >= config_.max_datagrams)
+        this->evict_oldest(nullptr);
+      Datagram dgram;
+      dgram.serial  = ++serial_;
+      dgram.created = now;
+      ages_.push_back({key, dgram.serial});
+      if (ages_.size() > 2 * config_.max_datagrams + 16)
+        this->compact_ages();
+      it = table_.emplace(key, std::move(dgram)).first;
+    }
+    auto& dgram = it->second;
+
+    // the last fragment decides the length, and no data may follow it
+    const bool bad_length = (more)
+        ? dgram.last_seen and last >= dgram.end
+        : dgram.end > last + 1 or (dgram.last_seen and dgram.end != last + 1);
+    const auto fill = (bad_length) ? Fill::OVERLAP
+                                   : fill_holes(dgram, first, last, more);
+    if (fill == Fill::DUPLICATE) {
+      stats_.dropped++;
+      return nullptr;
+    }
+    if (fill == Fill::OVERLAP) {
+      stats_.overlapped++;
+      this->drop(key);
+      return nullptr;
+    }
+
+    // make room for the fragment, older datagrams first
+    while (bytes_ + cost > config_.max_bytes)
+    {
+      if (not this->evict_oldest(&key)) {
+        stats_.evicted++;
+        this->drop(key);
+        return nullptr;
+      }
+    }
+    if (not more) dgram.last_seen = true;
+    dgram.end    = std::max(dgram.end, last + 1);
+    dgram.bytes += cost;
+    bytes_      += cost;
+    insert(dgram, std::move(frag));
+
+    if (not dgram.holes.empty())
+      return nullptr;
+
+    auto result = assemble(dgram);
+    bytes_ -= dgram.bytes;
+    table_.erase(it);
+    stats_.reassembled++;
+    return result;
+  }
+
+  Reassembly::Fill Reassembly::fill_holes(Datagram& dgram,
+                                          uint32_t first, uint32_t last,
+                                          bool more)
+  {
+    auto& holes = dgram.holes;
+    for (size_t i = 0; i < holes.size(); i++)
+    {
+      const Hole hole = holes[i];
+      if (first > hole.last or last < hole.first)
+        continue;
+      // any part outside of the hole was already received
+      if (first < hole.first or last > hole.last)
+        return Fill::OVERLAP;
+      // RFC 815: the hole is replaced by what is left of it on either side
+      holes[i] = holes.back();
+      holes.pop_back();
+      if (first > hole.first)
+        holes.push_back({hole.first, first - 1});
+      if (last < hole.last and more)
+        holes.push_back({last + 1, hole.last});
+      return Fill::ADDED;
+    }
+    // entirely within received data
+    return Fill::DUPLICATE;
+  }
+
+  void Reassembly::insert(Datagram& dgram, Packet_ptr frag)
+  {
+    const auto offs = frag->ip_frag_offs();
+    if (dgram.frags == nullptr or offs < dgram.frags->ip_frag_offs())
+    {
+      if (dgram.frags != nullptr)
+        frag->chain(std::move(dgram.frags));
+      dgram.frags = std::move(frag);
+      return;
+    }
+    Packet* prev = dgram.frags.get();
+    while (prev->tail() != nullptr
+       and static_cast<PacketIP4*>(prev->tail())->ip_frag_offs() < offs)
+      prev = prev->tail();
+
+    auto rest = prev->detach_tail();
+    if (rest != nullptr)
+      frag->chain(std::move(rest));
+    prev->chain(std::move(frag));
+  }
+
+  Reassembly::Packet_ptr Reassembly::assemble(Datagram& dgram)
+  {
+    // sorted by offset, so the first fragment is at the head
+    auto head = std::move(dgram.frags);
+    auto rest = head->detach_tail();
+    const int hlen   = head->ip_header_length();
+    const int length = hlen + dgram.end;
+
+    Packet_ptr result;
+    if (head->capacity() >= length) {
+      result = std::move(head);
+    }
+    else {
+      result = create_packet(length);
+      std::memcpy(result->layer_begin(), head->layer_begin(), head->size());
+    }
+    result->set_data_end(length);
+
+    while (rest != nullptr)
+    {
+      auto* frag = static_cast<PacketIP4*>(rest.get());
+      std::memcpy(result->layer_begin() + hlen + frag->ip_frag_offs() * 8,
+                  frag->layer_begin() + frag->ip_header_length(),
+                  frag->ip_data_length());
+      // releases the fragment
+      rest = rest->detach_tail();
+    }
+
+    result->set_ip_total_length(length);
+    result->clear_ip_fragment();
+    result->set_ip_checksum();
+    return result;
+  }
+
+  void Reassembly::expire(timestamp_t now)
+  {
+    while (not ages_.empty())
+    {
+      const Age age = ages_.front();
+      auto it = table_.find(age.key);
+      if (it != table_.end() and it->second.serial == age.serial)
+      {
+        if (now - it->second.created < config_.timeout) break;
+        stats_.timed_out++;
+        this->drop(age.key);
+      }
+      ages_.pop_front();
+    }
+  }
+
+  bool Reassembly::evict_oldest(const Key* keep)
+  {
+    while (not ages_.empty())
+    {
+      const Age age = ages_.front();
+      auto it = table_.find(age.key);
+      if (it != table_.end() and it->second.serial == age.serial)
+      {
+        // nothing is older than the datagram making room
+        if (keep != nullptr and age.key == *keep) return false;
+        stats_.evicted++;
+        this->drop(age.key);
+        ages_.pop_front();
+        return true;
+      }
+      ages_.pop_front();
+    }
+    return false;
+  }
+
+  void Reassembly::drop(const Key& key)
+  {
+    auto it = table_.find(key);
+    if (it == table_.end()) return;
+    bytes_ -= it->second.bytes;
+    table_.erase(it);
+  }
+
+  void Reassembly::compact_ages()
+  {
+    std::deque<Age> live;
+    for (const auto& age : ages_)
+    {
+      auto it = table_.find(age.key);
+      if (it != table_.end() and it->second.serial == age.serial)
+        live.push_back(age);
+    }
+    ages_.swap(live);
+  }
+
+} // < namespace ip4
+
   __attribute__((weak))
   IP4::IP_packet_ptr IP4::reassemble(IP4::IP_packet_ptr packet)
   {
@@ -261,6 +261,11 @@ namespace net
     // Send loopback packets right back
     if (UNLIKELY(stack_.is_valid_source(packet->ip_dst()))) {
       PRINT("<IP6> Destination address is loopback \n");
+      // the receive path reads the payload from the buffer
+      if (UNLIKELY(not packet->linearize())) {
+        drop(std::move(packet), Direction::Downstream, Drop_reason::Bad_destination);
+        return;
+      }
       IP6::receive(std::move(packet), false);
       return;
     }
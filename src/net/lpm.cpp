@@ -0,0 +1,130 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <net/lpm.hpp>
+#include <numeric>
+
+namespace net {
+
+  /**
+   * Prefix indices in insertion order: shorter prefixes first, so longer
+   * ones overwrite them, and equal prefixes last to first, so the first wins.
+   */
+  template <typename Prefix>
+  static std::vector<int> insertion_order(const std::vector<Prefix>& prefixes)
+  {
+    std::vector<int> order(prefixes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+      [&prefixes] (int a, int b) {
+        if (prefixes[a].len != prefixes[b].len)
+          return prefixes[a].len < prefixes[b].len;
+        return a > b;
+      });
+    return order;
+  }
+
+  static inline uint32_t mask_of(int len) noexcept
+  { return (len == 0) ? 0 : ~uint32_t(0) << (32 - len); }
+
+  void Lpm4::build(const std::vector<Prefix>& prefixes)
+  {
+    auto order = insertion_order(prefixes);
+    small_.clear();
+    tbl8_.clear();
+
+    if (prefixes.size() <= SMALL_TABLE)
+    {
+      std::vector<uint32_t>().swap(tbl24_);
+      // searched longest first
+      for (auto it = order.rbegin(); it != order.rend(); ++it)
+      {
+        const auto& pfx = prefixes[*it];
+        if (pfx.len < 0) continue;
+        const uint32_t mask = mask_of(pfx.len);
+        small_.push_back({ntohl(pfx.net.whole) & mask, mask, *it});
+      }
+      return;
+    }
+
+    tbl24_.assign(1 << 24, 0);
+    for (const int idx : order)
+    {
+      const auto& pfx = prefixes[idx];
+      if (pfx.len < 0) continue;
+      const uint32_t net   = ntohl(pfx.net.whole) & mask_of(pfx.len);
+      const uint32_t value = idx + 1;
+
+      if (pfx.len <= 24)
+      {
+        // every shorter prefix comes before the first tbl8 group
+        const uint32_t first = net >> 8;
+        std::fill_n(&tbl24_[first], size_t(1) << (24 - pfx.len), value);
+        continue;
+      }
+
+      auto& entry = tbl24_[net >> 8];
+      if (not (entry & TBL8))
+      {
+        // a group inheriting the route covering all of it
+        const uint32_t group = tbl8_groups();
+        tbl8_.resize(tbl8_.size() + 256, entry);
+        entry = TBL8 | group;
+      }
+      const uint32_t first = ((entry & ~TBL8) << 8) | (net & 0xff);
+      std::fill_n(&tbl8_[first], size_t(1) << (32 - pfx.len), value);
+    }
+  }
+
+  void Lpm6::build(const std::vector<Prefix>& prefixes)
+  {
+    nodes_.clear();
+    default_ = NONE;
+
+    for (const int idx : insertion_order(prefixes))
+    {
+      const auto& pfx = prefixes[idx];
+      if (pfx.len < 0) continue;
+      if (pfx.len == 0) {
+        default_ = idx;
+        continue;
+      }
+      const auto net = pfx.net & static_cast<uint8_t>(pfx.len);
+      // the byte the prefix ends in
+      const int last = (pfx.len - 1) / 8;
+
+      if (nodes_.empty()) nodes_.emplace_back();
+      int node = 0;
+      for (int depth = 0; depth < last; depth++)
+      {
+        int child = nodes_[node][net.i8[depth]].child;
+        if (child == NONE) {
+          child = nodes_.size();
+          nodes_.emplace_back();
+          nodes_[node][net.i8[depth]].child = child;
+        }
+        node = child;
+      }
+      // expand the prefix to the stride
+      const int span  = 1 << (8 * (last + 1) - pfx.len);
+      const int first = net.i8[last] & ~(span - 1);
+      for (int i = first; i < first + span; i++)
+        nodes_[node][i].route = idx;
+    }
+  }
+
+} //< namespace net
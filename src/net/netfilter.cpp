@@ -0,0 +1,134 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <net/netfilter.hpp>
+#include <algorithm>
+#include <climits>
+
+namespace net {
+
+  // every compile gets a new tag, so verdicts cached by old rules are not used
+  static uint32_t next_tag = 0;
+
+  static inline ip4::Addr mask_addr(const ip4::Addr& addr, int len) noexcept
+  { return addr & ip4::Addr{htonl(len ? ~uint32_t(0) << (32 - len) : 0)}; }
+
+  static inline ip6::Addr mask_addr(const ip6::Addr& addr, int len) noexcept
+  { return addr & static_cast<uint8_t>(len); }
+
+  static inline uint16_t mask_port(uint16_t port, int len) noexcept
+  { return len ? port & (0xffff << (16 - len)) : 0; }
+
+  static inline size_t hash_addr(const ip4::Addr& addr) noexcept
+  { return addr.whole; }
+
+  static inline size_t hash_addr(const ip6::Addr& addr) noexcept
+  { return addr.i64[0] ^ (addr.i64[1] * 0x9E3779B97F4A7C15ull); }
+
+  struct Port_prefix {
+    uint16_t port;
+    int      len;
+  };
+
+  /** The smallest set of prefixes covering a port range */
+  static std::vector<Port_prefix> port_prefixes(uint32_t first, uint32_t last)
+  {
+    std::vector<Port_prefix> prefixes;
+    while (first <= last)
+    {
+      // the largest aligned block starting at first, inside the range
+      int bits = first ? __builtin_ctz(first) : 16;
+      while (first + (1u << bits) - 1 > last) bits--;
+      prefixes.push_back({static_cast<uint16_t>(first), 16 - bits});
+      first += 1u << bits;
+    }
+    return prefixes;
+  }
+
+  template <typename Addr>
+  size_t Filter_rules<Addr>::Key_hasher::operator()(const Key& key) const noexcept
+  {
+    const uint64_t ports = (uint64_t(key.sport) << 24) | (uint64_t(key.dport) << 8) | key.proto;
+    return (hash_addr(key.src) * 0x9E3779B97F4A7C15ull)
+         ^ (hash_addr(key.dst) + ports) * 0xC2B2AE3D27D4EB4Full;
+  }
+
+  template <typename Addr>
+  typename Filter_rules<Addr>::Key
+  Filter_rules<Addr>::mask(const Key& key, const Tuple& tuple) noexcept
+  {
+    return {mask_addr(key.src, tuple.src_len), mask_addr(key.dst, tuple.dst_len),
+            mask_port(key.sport, tuple.sport_len), mask_port(key.dport, tuple.dport_len),
+            static_cast<uint8_t>(tuple.proto ? key.proto : 0)};
+  }
+
+  template <typename Addr>
+  void Filter_rules<Addr>::compile()
+  {
+    tuples_.clear();
+    for (int idx = 0; idx < (int) rules_.size(); idx++)
+    {
+      const auto& rule = rules_[idx];
+      if (rule.sport.first > rule.sport.last or rule.dport.first > rule.dport.last)
+        continue;
+
+      const auto sports = port_prefixes(rule.sport.first, rule.sport.last);
+      const auto dports = port_prefixes(rule.dport.first, rule.dport.last);
+      for (const auto& sp : sports)
+      for (const auto& dp : dports)
+      {
+        const Tuple tuple{rule.src_len, rule.dst_len, sp.len, dp.len,
+                          rule.proto.has_value()};
+        auto group = std::find_if(tuples_.begin(), tuples_.end(),
+          [&tuple] (const Group& g) { return g.tuple == tuple; });
+        if (group == tuples_.end())
+          group = tuples_.insert(tuples_.end(), Group{tuple, idx, {}});
+
+        const Key key{rule.src, rule.dst, sp.port, dp.port,
+                      static_cast<uint8_t>(rule.proto.value_or(Protocol{}))};
+        // an earlier rule with the same match wins
+        group->table.emplace(mask(key, tuple), idx);
+      }
+    }
+    // the groups with the first rules are looked up first
+    std::sort(tuples_.begin(), tuples_.end(),
+      [] (const Group& a, const Group& b) { return a.first < b.first; });
+
+    if (UNLIKELY(++next_tag >= (1u << 31))) next_tag = 1;
+    tag_   = next_tag;
+    dirty_ = false;
+  }
+
+  template <typename Addr>
+  Filter_verdict_type Filter_rules<Addr>::classify(const Key& key) const noexcept
+  {
+    int best = INT_MAX;
+    for (const auto& group : tuples_)
+    {
+      // the rest can only match later rules
+      if (group.first >= best) break;
+      auto it = group.table.find(mask(key, group.tuple));
+      if (it != group.table.end())
+        best = std::min(best, it->second);
+    }
+    return (best != INT_MAX) ? rules_[best].verdict : policy;
+  }
+
+  template class Filter_rules<ip4::Addr>;
+  template class Filter_rules<ip6::Addr>;
+
+} //< namespace net
@@ -1,14 +1,16 @@
 #include <net/openssl/tls_stream.hpp>
+#include <algorithm>
+#include <cstring>
 
 using namespace openssl;
 
+// room for the record header, nonce, tag and padding of one record
+static constexpr size_t RECORD_OVERHEAD = 64;
+
 TLS_stream::TLS_stream(SSL_CTX* ctx, Stream_ptr t, bool outgoing)
   : m_transport(std::move(t))
 {
   ERR_clear_error(); // prevent old errors from mucking things up
-  this->m_bio_rd = BIO_new(BIO_s_mem());
-  this->m_bio_wr = BIO_new(BIO_s_mem());
-  assert(ERR_get_error() == 0 && "Initializing BIOs");
   this->m_ssl = SSL_new(ctx);
   assert(this->m_ssl != nullptr);
   assert(ERR_get_error() == 0 && "Initializing SSL");
@@ -18,7 +20,7 @@ TLS_stream::TLS_stream(SSL_CTX* ctx, Stream_ptr t, bool outgoing)
   else
       SSL_set_connect_state(this->m_ssl);
 
-  SSL_set_bio(this->m_ssl, this->m_bio_rd, this->m_bio_wr);
+  this->attach_bio();
 
   // always-on callbacks
   m_transport->on_data({this,&TLS_stream::handle_data});
@@ -30,9 +32,10 @@ TLS_stream::TLS_stream(SSL_CTX* ctx, Stream_ptr t, bool outgoing)
     if (this->tls_perform_handshake() < 0) return;
   }
 }
-TLS_stream::TLS_stream(Stream_ptr t, SSL* ssl, BIO* rd, BIO* wr)
-  : m_transport(std::move(t)), m_ssl(ssl), m_bio_rd(rd), m_bio_wr(wr)
+TLS_stream::TLS_stream(Stream_ptr t, SSL* ssl)
+  : m_transport(std::move(t)), m_ssl(ssl)
 {
+  this->attach_bio();
   // always-on callbacks
   m_transport->on_data({this, &TLS_stream::handle_data});
   m_transport->on_close({this, &TLS_stream::close_callback_once});
@@ -43,85 +46,143 @@ TLS_stream::~TLS_stream()
   SSL_free(this->m_ssl);
 }
 
-void TLS_stream::write(buffer_t buffer)
+void TLS_stream::attach_bio()
 {
+  BIO* bio = BIO_new(bio_method());
+  assert(bio != nullptr && "Initializing BIO");
+  BIO_set_data(bio, this);
+  BIO_set_init(bio, 1);
+  // the same BIO both ways, owned by the session
+  SSL_set_bio(this->m_ssl, bio, bio);
+  // read as much as is queued in one go, not a record header at a time
+  SSL_set_read_ahead(this->m_ssl, 1);
+}
 
-  if (UNLIKELY(this->is_connected() == false)) {
-    TLS_PRINT("::write() called on closed stream\n");
-    return;
+BIO_METHOD* TLS_stream::bio_method()
+{
+  static BIO_METHOD* method = [] {
+    auto* meth = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK,
+                              "IncludeOS stream");
+    BIO_meth_set_read(meth, bio_read);
+    BIO_meth_set_write(meth, bio_write);
+    BIO_meth_set_ctrl(meth, bio_ctrl);
+    return meth;
+  }();
+  return method;
+}
+
+int TLS_stream::bio_read(BIO* bio, char* out, int len)
+{
+  auto* self = (TLS_stream*) BIO_get_data(bio);
+  BIO_clear_retry_flags(bio);
+  auto& readq = self->m_readq;
+  int total = 0;
+  while (total < len and not readq.empty())
+  {
+    auto& front = *readq.front();
+    const size_t n = std::min<size_t>(len - total, front.size() - self->m_read_ofs);
+    memcpy(out + total, front.data() + self->m_read_ofs, n);
+    total += n;
+    self->m_read_ofs += n;
+    if (self->m_read_ofs == front.size()) {
+      readq.pop_front();
+      self->m_read_ofs = 0;
+    }
   }
-  int n = SSL_write(this->m_ssl, buffer->data(), buffer->size());
+  if (total == 0) {
+    BIO_set_retry_read(bio);
+    return -1;
+  }
+  return total;
+}
+
+int TLS_stream::bio_write(BIO* bio, const char* in, int len)
+{
+  auto* self = (TLS_stream*) BIO_get_data(bio);
+  BIO_clear_retry_flags(bio);
+  auto& buf = self->m_write_buf;
+  if (buf == nullptr)
+  {
+    buf = self->construct_write_buffer();
+    if (UNLIKELY(buf == nullptr)) {
+      BIO_set_retry_write(bio);
+      return -1;
+    }
+    buf->reserve(len + RECORD_OVERHEAD);
+  }
+  buf->insert(buf->end(), in, in + len);
+  return len;
+}
+
+long TLS_stream::bio_ctrl(BIO*, int cmd, long, void*)
+{
+  // the records are written out after each SSL call
+  return (cmd == BIO_CTRL_FLUSH) ? 1 : 0;
+}
+
+int TLS_stream::encrypt(const void* data, const size_t len)
+{
+  if (UNLIKELY(len == 0)) return 0;
+  // all the records of this write go in one buffer
+  if (this->m_write_buf == nullptr)
+  {
+    this->m_write_buf = StreamBuffer::construct_write_buffer();
+    if (this->m_write_buf != nullptr) {
+      const size_t records = len / READ_BUFFER_SIZE + 1;
+      this->m_write_buf->reserve(len + records * RECORD_OVERHEAD);
+    }
+  }
+  int n = SSL_write(this->m_ssl, data, len);
   auto status = this->status(n);
   if (status == STATUS_FAIL) {
     TLS_PRINT("::write() Fail status %d\n",n);
     this->close();
-    return;
+    return -1;
   }
+  return n;
+}
 
-  do {
-    n = tls_perform_stream_write();
-  } while (n > 0);
+void TLS_stream::write(buffer_t buffer)
+{
+  this->write(buffer->data(), buffer->size());
 }
 
 void TLS_stream::write(const std::string& str)
 {
-  //TODO handle failed alloc
-  write(net::StreamBuffer::construct_write_buffer(str.data(),str.data()+str.size()));
+  this->write(str.data(), str.size());
 }
 
 void TLS_stream::write(const void* data, const size_t len)
 {
-  //TODO handle failed alloc
-  auto* buf = static_cast<const uint8_t*> (data);
-  write(net::StreamBuffer::construct_write_buffer(buf, buf + len));
+  if (UNLIKELY(this->is_connected() == false)) {
+    TLS_PRINT("::write() called on closed stream\n");
+    return;
+  }
+  if (this->encrypt(data, len) < 0) return;
+  tls_perform_stream_write();
 }
 
-int TLS_stream::decrypt(const void *indata, int size)
+void TLS_stream::writev(const buffer_t* bufs, const size_t count)
 {
-  int n = BIO_write(this->m_bio_rd, indata, size);
-  if (UNLIKELY(n < 0)) {
-    //TODO can we handle this more gracefully?
-    TLS_PRINT("BIO_write failed\n");
-    this->close();
-    return -1;
+  if (UNLIKELY(this->is_connected() == false)) {
+    TLS_PRINT("::writev() called on closed stream\n");
+    return;
   }
-
-  // if we aren't finished initializing session
-  if (UNLIKELY(!handshake_completed()))
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++) total += bufs[i]->size();
+  // make room for all of them up front
+  if (this->m_write_buf == nullptr)
   {
-    int num = SSL_do_handshake(this->m_ssl);
-    auto status = this->status(num);
-
-    // OpenSSL wants to write
-    if (status == STATUS_WANT_IO)
-    {
-      tls_perform_stream_write();
-    }
-    else if (status == STATUS_FAIL)
-    {
-      if (num < 0) {
-        TLS_PRINT("TLS_stream::SSL_do_handshake() returned %d\n", num);
-        #ifdef VERBOSE_OPENSSL
-          ERR_print_errors_fp(stdout);
-        #endif
-      }
-      this->close();
-      return -1;
-    }
-    // nothing more to do if still not finished
-    if (handshake_completed() == false) return 0;
-    // handshake success
-    this->m_busy=true;
-    connected();
-    this->m_busy=false;
-
-    if (this->m_deferred_close) {
-      TLS_PRINT("::read() close on m_deferred_close after tls_perform_stream_write\n");
-      this->close();
-      return -1;
-    }
+    this->m_write_buf = StreamBuffer::construct_write_buffer();
+    if (this->m_write_buf != nullptr)
+      this->m_write_buf->reserve(total + (total / READ_BUFFER_SIZE + count) * RECORD_OVERHEAD);
   }
-  return n;
+  for (size_t i = 0; i < count; i++)
+  {
+    if (bufs[i]->empty()) continue;
+    if (this->encrypt(bufs[i]->data(), bufs[i]->size()) < 0) return;
+  }
+  tls_perform_stream_write();
 }
 
 int TLS_stream::send_decrypted()
@@ -129,13 +190,23 @@ int TLS_stream::send_decrypted()
   int n;
   // read decrypted data
   do {
-    //TODO "increase the size or constructor based ??")
-    auto buffer=StreamBuffer::construct_read_buffer(8192);
-    if (!buffer) return 0;
-    n = SSL_read(this->m_ssl,buffer->data(),buffer->size());
-    if (n > 0) {
-      buffer->resize(n);
-      enqueue_data(buffer);
+    if (this->m_read_buf == nullptr) {
+      this->m_read_buf = StreamBuffer::construct_read_buffer(READ_BUFFER_SIZE);
+      if (!this->m_read_buf) return 0;
+    }
+    auto& buffer = *this->m_read_buf;
+    // as many records as there is room for
+    size_t used = 0;
+    while (used < buffer.size()
+        && (n = SSL_read(this->m_ssl, buffer.data() + used, buffer.size() - used)) > 0)
+    {
+      used += n;
+    }
+    // a buffer with nothing in it is kept for next time
+    if (used > 0) {
+      buffer.resize(used);
+      enqueue_data(std::move(this->m_read_buf));
+      this->m_read_buf = nullptr;
     }
   } while (n > 0);
   return n;
@@ -160,10 +231,11 @@ void TLS_stream::handle_write_congestion()
 {
   //this should resolve the potential malloc congestion
   //might be missing some TLS signalling but without malloc we cant do that either
-  while(tls_perform_stream_write() >  0);
+  tls_perform_stream_write();
 }
 void TLS_stream::handle_data()
 {
+  // queue everything there is, and decrypt it in one pass
   while (m_transport->next_size() > 0)
   {
     if (UNLIKELY(read_congested())){
@@ -171,71 +243,71 @@ void TLS_stream::handle_data()
     }
     auto buffer = m_transport->read_next();
     if (UNLIKELY(!buffer)) break;
-    bool closed = tls_read(buffer);
-    // tls_read can close this stream
-    if (closed) break;
+    m_readq.push_back(std::move(buffer));
   }
+  if (not m_readq.empty()) tls_read();
 }
 
-bool TLS_stream::tls_read(buffer_t buffer)
+bool TLS_stream::tls_read()
 {
-  if (buffer == nullptr ) {
-    return false;
-  }
   ERR_clear_error();
-  uint8_t* buf_ptr = buffer->data();
-  int      len = buffer->size();
 
-  while (len > 0)
+  // if we aren't finished initializing session
+  if (UNLIKELY(!handshake_completed()))
   {
-    if (this->m_deferred_close) {
-      TLS_PRINT("::read() close on m_deferred_close");
-      this->close();
-      return true;
-    }
+    int num = SSL_do_handshake(this->m_ssl);
+    auto status = this->status(num);
 
-    const int decrypted_bytes = decrypt(buf_ptr, len);
-    if (UNLIKELY(decrypted_bytes == 0)) {
-      return false;
-    }
-    else if (UNLIKELY(decrypted_bytes < 0)) {
+    if (status == STATUS_FAIL)
+    {
+      if (num < 0) {
+        TLS_PRINT("TLS_stream::SSL_do_handshake() returned %d\n", num);
+        #ifdef VERBOSE_OPENSSL
+          ERR_print_errors_fp(stdout);
+        #endif
+      }
+      this->close();
       return true;
     }
-    buf_ptr += decrypted_bytes;
-    len -= decrypted_bytes;
-
-    //enqueues decrypted data
-    int ret=send_decrypted();
+    // the next flight of the handshake, or the last one
+    if (tls_perform_stream_write() < 0) return true;
+    // nothing more to do if still not finished by this call, as writing
+    // may have had the peer answer, finishing it in a nested read
+    if (num != 1) return false;
+    // handshake success
+    this->m_busy=true;
+    connected();
+    this->m_busy=false;
 
-    // this goes here?
-    if (UNLIKELY(this->is_closing() || this->is_closed())) {
-      TLS_PRINT("TLS_stream::SSL_read closed during read\n");
-      return true;
-    }
     if (this->m_deferred_close) {
-      TLS_PRINT("::read() close on m_deferred_close");
+      TLS_PRINT("::read() close on m_deferred_close after tls_perform_stream_write\n");
       this->close();
       return true;
     }
+  }
 
-    auto status = this->status(ret);
-    // did peer request stream renegotiation?
-    if (status == STATUS_WANT_IO)
-    {
-      TLS_PRINT("::read() STATUS_WANT_IO\n");
-      int ret;
-      do {
-        ret = tls_perform_stream_write();
-      } while (ret > 0);
-    }
-    else if (status == STATUS_FAIL)
-    {
-      TLS_PRINT("::read() close on STATUS_FAIL after tls_perform_stream_write\n");
-      this->close();
-      return true;
-    }
+  //enqueues decrypted data
+  int ret=send_decrypted();
 
-  } // while it < end
+  // this goes here?
+  if (UNLIKELY(this->is_closing() || this->is_closed())) {
+    TLS_PRINT("TLS_stream::SSL_read closed during read\n");
+    return true;
+  }
+
+  auto status = this->status(ret);
+  // anything OpenSSL wrote while reading, e.g. for renegotiation
+  if (status == STATUS_WANT_IO)
+  {
+    TLS_PRINT("::read() STATUS_WANT_IO\n");
+    if (tls_perform_stream_write() < 0) return true;
+  }
+  else if (status == STATUS_FAIL)
+  {
+    TLS_PRINT("::read() close on STATUS_FAIL after tls_perform_stream_write\n");
+    this->close();
+    return true;
+  }
 
   //forward data
   this->m_busy=true;
@@ -253,65 +325,44 @@ bool TLS_stream::tls_read(buffer_t buffer)
 
 int TLS_stream::tls_perform_stream_write()
 {
-  ERR_clear_error();
-  int pending = BIO_ctrl_pending(this->m_bio_wr);
-  if (pending > 0)
-  {
-    TLS_PRINT("::tls_perform_stream_write() pending=%d bytes\n",pending);
-    auto buffer = net::StreamBuffer::construct_write_buffer(pending);
-    if (buffer == nullptr) {
-      return 0;
-    }
-    int n = BIO_read(this->m_bio_wr, buffer->data(), buffer->size());
-    assert(n == pending);
-    //What if we cant write..
-    if (m_transport->is_writable())
-    {
-      m_transport->write(buffer);
+  if (this->m_write_buf == nullptr or this->m_write_buf->empty())
+    return 0;
 
-      this->m_busy = true;
-      stream_on_write(n);
-      this->m_busy = false;
+  auto buffer = std::move(this->m_write_buf);
+  this->m_write_buf = nullptr;
+  const int n = buffer->size();
+  TLS_PRINT("::tls_perform_stream_write() pending=%d bytes\n", n);
+  //What if we cant write..
+  if (m_transport->is_writable())
+  {
+    m_transport->write(std::move(buffer));
 
-      if (this->m_deferred_close) {
-        TLS_PRINT("::read() close on m_deferred_close after tls_perform_stream_write\n");
-        this->close(); return 0;
-      }
-    }
+    this->m_busy = true;
+    stream_on_write(n);
+    this->m_busy = false;
 
-    if (UNLIKELY((pending = BIO_ctrl_pending(this->m_bio_wr)) > 0))
-    {
-      return pending;
+    if (this->m_deferred_close) {
+      TLS_PRINT("::read() close on m_deferred_close after tls_perform_stream_write\n");
+      this->close();
+      return -1;
     }
-    return 0;
-  }
-
-  BIO_read(this->m_bio_wr, nullptr, 0);
-
-  if (!BIO_should_retry(this->m_bio_wr))
-  {
-    TLS_PRINT("::tls_perform_stream_write() close on !BIO_should_retry\n");
-    this->close();
-    return -1;
   }
-  return 0;
+  return n;
 }
 
 int TLS_stream::tls_perform_handshake()
 {
   ERR_clear_error(); // prevent old errors from mucking things up
-  // will return -1:SSL_ERROR_WANT_WRITE
+  // will return -1:SSL_ERROR_WANT_READ
   int ret = SSL_do_handshake(this->m_ssl);
   int n = this->status(ret);
   ERR_print_errors_fp(stderr);
   if (n == STATUS_WANT_IO)
   {
-    do {
-      n = tls_perform_stream_write();
-      if (n < 0) {
-        TLS_PRINT("TLS_stream::tls_perform_handshake() stream write failed\n");
-      }
-    } while (n > 0);
+    n = tls_perform_stream_write();
+    if (n < 0) {
+      TLS_PRINT("TLS_stream::tls_perform_handshake() stream write failed\n");
+    }
     return n;
   }
   else {
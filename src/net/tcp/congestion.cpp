@@ -0,0 +1,315 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <net/tcp/congestion.hpp>
+#include <algorithm>
+#include <cmath>
+
+using namespace net::tcp;
+
+constexpr float Cubic::C;
+constexpr float Cubic::beta;
+constexpr float Bbr::high_gain;
+constexpr float Bbr::cwnd_gain;
+
+std::unique_ptr<Congestion_control> Congestion_control::create(Algorithm algo)
+{
+  switch (algo)
+  {
+  case Algorithm::CUBIC:
+    return std::make_unique<Cubic>();
+  case Algorithm::BBR:
+    return std::make_unique<Bbr>();
+  case Algorithm::RENO:
+  default:
+    return std::make_unique<Reno>();
+  }
+}
+
+/// --- New Reno --- ///
+
+void Reno::on_ack(Window& w, const Ack& ack)
+{
+  if (w.cwnd < w.ssthresh)
+  {
+    slow_start(w, ack.bytes_acked);
+  }
+  // congestion avoidance
+  else
+  {
+    // increase cwnd once per RTT
+    w.cwnd += std::max(w.smss * w.smss / w.cwnd, (uint32_t) 1);
+  }
+}
+
+/*
+  [RFC 5681] p. 7
+
+    ssthresh = max (FlightSize / 2, 2*SMSS)
+*/
+void Reno::on_loss(Window& w, uint32_t flight_size)
+{
+  w.ssthresh = std::max(flight_size / 2, 2 * (uint32_t) w.smss);
+}
+
+/// --- CUBIC --- ///
+
+/*
+  [RFC 8312] 4.1
+
+    W_cubic(t) = C*(t-K)^3 + W_max
+
+  where t is the time since the start of the current congestion
+  avoidance period, and K is the time W_cubic takes to reach W_max.
+  The window is in segments and time in seconds.
+*/
+void Cubic::on_ack(Window& w, const Ack& ack)
+{
+  if (rounds_.update(ack) and rounds_.rtt > 0)
+    min_rtt_ = (min_rtt_ == 0) ? rounds_.rtt : std::min(min_rtt_, rounds_.rtt);
+
+  if (w.cwnd < w.ssthresh)
+  {
+    slow_start(w, ack.bytes_acked);
+    return;
+  }
+
+  const float cwnd = (float) w.cwnd / w.smss;
+  // start of a congestion avoidance period
+  if (epoch_start_ < 0)
+  {
+    epoch_start_ = ack.now;
+    cwnd_acc_ = 0;
+    w_est_ = cwnd;
+    if (cwnd < w_max_) {
+      k_ = std::cbrt((w_max_ - cwnd) / C);
+      origin_ = w_max_;
+    }
+    else {
+      k_ = 0;
+      origin_ = cwnd;
+    }
+  }
+
+  const float rtt = min_rtt_ / 1000000.0f;
+  const float t   = (ack.now - epoch_start_) / 1000000.0f;
+  float target = w_cubic(t + rtt);
+
+  // TCP-friendly region [RFC 8312] 4.2, grows as Reno would
+  w_est_ += 3 * (1 - beta) / (1 + beta) * ((float) ack.bytes_acked / w.smss) / cwnd;
+  target = std::max(target, w_est_);
+  // never more than 1.5 times the window per RTT
+  target = std::min(target, 1.5f * cwnd);
+
+  // concave and convex region [RFC 8312] 4.3, 4.4
+  if (target > cwnd)
+    cwnd_acc_ += (target - cwnd) / cwnd * ack.bytes_acked;
+  else
+    cwnd_acc_ += ack.bytes_acked / (100.0f * cwnd);
+
+  if (cwnd_acc_ >= 1.0f)
+  {
+    const auto inc = static_cast<uint32_t>(cwnd_acc_);
+    w.cwnd += inc;
+    cwnd_acc_ -= inc;
+  }
+}
+
+/*
+  [RFC 8312] 4.5, 4.6
+
+    ssthresh = cwnd * beta_cubic
+
+  with fast convergence, releasing bandwidth to new flows when
+  the window is reduced before reaching the previous W_max.
+*/
+void Cubic::on_loss(Window& w, uint32_t)
+{
+  w_max_ = (float) w.cwnd / w.smss;
+  if (w_max_ < w_last_max_) {
+    w_last_max_ = w_max_;
+    w_max_ = w_max_ * (1.0f + beta) / 2.0f;
+  }
+  else {
+    w_last_max_ = w_max_;
+  }
+  w.ssthresh = std::max((uint32_t) (w.cwnd * beta), 2 * (uint32_t) w.smss);
+  epoch_start_ = -1;
+}
+
+void Cubic::on_rto(Window& w)
+{
+  Congestion_control::on_rto(w);
+  epoch_start_ = -1;
+}
+
+/// --- BBR --- ///
+
+/*
+  Each round trip gives a delivery rate sample (bytes acked during the
+  round over its duration) and a RTT sample (the duration of the round).
+  The bottleneck bandwidth is the max rate over the last 10 rounds, and
+  the propagation delay the min RTT over the last 10 seconds.
+*/
+uint64_t Bbr::btl_bw() const noexcept
+{
+  return *std::max_element(bw_samples_.begin(), bw_samples_.end());
+}
+
+void Bbr::update_model(const Ack& ack)
+{
+  delivered_ += ack.bytes_acked;
+  if (not rounds_.update(ack)) return;
+
+  const uint64_t delivered = delivered_ - round_delivered_;
+  round_delivered_ = delivered_;
+  // the first round has no duration
+  if (rounds_.count == 1) return;
+  // a round shorter than the clock resolution still gives a model
+  const uint32_t rtt = std::max(rounds_.rtt, 1u);
+
+  bw_samples_[rounds_.count % bw_window_rounds] = delivered * 1000000 / rtt;
+
+  const bool expired = ack.now - min_rtt_stamp_ > min_rtt_window;
+  if (min_rtt_ == 0 or rtt <= min_rtt_ or expired)
+  {
+    min_rtt_ = rtt;
+    min_rtt_stamp_ = ack.now;
+  }
+
+  // the pipe is full when the bandwidth stops growing by 25%
+  if (not filled_pipe_)
+  {
+    if (btl_bw() >= full_bw_ * 5 / 4) {
+      full_bw_ = btl_bw();
+      full_bw_count_ = 0;
+    }
+    else if (++full_bw_count_ >= 3) {
+      filled_pipe_ = true;
+    }
+  }
+}
+
+void Bbr::update_mode(Window& w, const Ack& ack)
+{
+  switch (mode_)
+  {
+  case Mode::STARTUP:
+    if (filled_pipe_) mode_ = Mode::DRAIN;
+    break;
+  case Mode::DRAIN:
+    // the queue built during startup is drained
+    if (ack.flight_size <= bdp()) {
+      mode_ = Mode::PROBE_BW;
+      cycle_index_ = 0;
+      cycle_stamp_ = ack.now;
+    }
+    break;
+  case Mode::PROBE_BW:
+    // move through the gain cycle once per min RTT
+    if (ack.now - cycle_stamp_ > min_rtt_) {
+      cycle_index_ = (cycle_index_ + 1) % 8;
+      cycle_stamp_ = ack.now;
+    }
+    break;
+  case Mode::PROBE_RTT:
+    if (ack.now >= probe_rtt_done_) {
+      min_rtt_stamp_ = ack.now;
+      w.cwnd = std::max(w.cwnd, prior_cwnd_);
+      mode_ = (filled_pipe_) ? Mode::PROBE_BW : Mode::STARTUP;
+      cycle_stamp_ = ack.now;
+    }
+    break;
+  }
+
+  // the min RTT has not been seen for a while, drain the pipe to find it
+  if (mode_ != Mode::PROBE_RTT and min_rtt_ > 0
+      and ack.now - min_rtt_stamp_ > min_rtt_window)
+  {
+    mode_ = Mode::PROBE_RTT;
+    prior_cwnd_ = w.cwnd;
+    probe_rtt_done_ = ack.now + std::max(probe_rtt_time, (int64_t) min_rtt_);
+  }
+}
+
+float Bbr::gain() const noexcept
+{
+  // pacing gain cycle, applied to the window as there is no pacing
+  static constexpr float cycle[8] {1.25f, 0.75f, 1, 1, 1, 1, 1, 1};
+  switch (mode_)
+  {
+  case Mode::STARTUP:
+    return high_gain;
+  case Mode::DRAIN:
+    return 1.0f;
+  case Mode::PROBE_BW:
+    return cwnd_gain * cycle[cycle_index_];
+  default:
+    return 1.0f;
+  }
+}
+
+void Bbr::on_ack(Window& w, const Ack& ack)
+{
+  update_model(ack);
+  update_mode(w, ack);
+
+  const uint32_t min_cwnd = min_cwnd_segs * w.smss;
+  if (mode_ == Mode::PROBE_RTT)
+  {
+    w.cwnd = min_cwnd;
+    return;
+  }
+
+  // no model yet, grow as in slow start
+  if (min_rtt_ == 0)
+  {
+    w.cwnd += ack.bytes_acked;
+  }
+  else
+  {
+    // allow a few segments in the ACK path, except when draining the queue
+    const uint32_t quanta = (mode_ == Mode::DRAIN) ? 0 : 3 * w.smss;
+    const auto target = static_cast<uint32_t>(gain() * bdp()) + quanta;
+    if (filled_pipe_)
+      w.cwnd = std::min(w.cwnd + ack.bytes_acked, target);
+    else if (w.cwnd < target)
+      w.cwnd += ack.bytes_acked;
+  }
+  w.cwnd = std::max(w.cwnd, min_cwnd);
+}
+
+/*
+  Packet conservation during recovery, cwnd is set to ssthresh + 3*SMSS
+  when entering fast recovery, and restored when recovery ends.
+*/
+void Bbr::on_loss(Window& w, uint32_t flight_size)
+{
+  prior_cwnd_ = w.cwnd;
+  w.ssthresh = std::max(flight_size, 2 * (uint32_t) w.smss);
+}
+
+void Bbr::on_recovery_exit(Window& w)
+{
+  w.cwnd = std::max(w.ssthresh, prior_cwnd_);
+}
+
+void Bbr::on_rto(Window& w)
+{
+  prior_cwnd_ = w.cwnd;
+  Congestion_control::on_rto(w);
+}
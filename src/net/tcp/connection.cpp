@@ -23,10 +23,58 @@
 #include <net/tcp/connection_states.hpp>
 #include <net/tcp/tcp.hpp>
 #include <net/tcp/tcp_errors.hpp>
+#include <rtc>
 
 using namespace net::tcp;
 using namespace std;
 
+// Insert @length bytes of payload at @seq, from the segment
+// and then from the segments coalesced with it
+static size_t insert_payload(Read_request& req, const Packet_view& in,
+                             const seq_t seq, const size_t length)
+{
+  size_t inserted = 0;
+  in.for_each_payload([&] (const uint8_t* data, size_t len) {
+    len = std::min(len, length - inserted);
+    if(len == 0)
+      return;
+    const bool push = in.isset(PSH) and inserted + len == length;
+    inserted += req.insert(seq + inserted, data, len, push);
+  });
+  return inserted;
+}
+
+// Take the packets of the segment, and of the segments coalesced with it,
+// as slices of @length bytes of payload in total. @emit gets each slice
+// with its offset in the payload.
+template <typename Emit>
+static void capture_payload(Zerocopy_rx& zc, Packet_view& in, size_t length, Emit emit)
+{
+  const auto* data = in.tcp_data();
+  auto pkt  = in.detach();
+  auto rest = pkt->detach_tail();
+  const int hdrs = data - pkt->layer_begin();
+
+  size_t offset = 0;
+  auto len = std::min(length, (size_t) (pkt->size() - hdrs));
+  auto first = zc.capture(std::move(pkt), data, len);
+  // the first packet has the header being processed
+  auto processing = first.packet();
+  emit(std::move(first), offset);
+  offset += len;
+
+  while(rest != nullptr and offset < length)
+  {
+    pkt  = std::move(rest);
+    rest = pkt->detach_tail();
+    data = pkt->layer_begin() + hdrs;
+    len  = std::min(length - offset, (size_t) (pkt->size() - hdrs));
+    emit(zc.capture(std::move(pkt), data, len), offset);
+    offset += len;
+  }
+  zc.processing = std::move(processing);
+}
+
 Connection::Connection(TCP& host, Socket local, Socket remote, ConnectCallback callback)
   : host_(host),
     local_{std::move(local)}, remote_{std::move(remote)},
@@ -111,6 +159,30 @@ void Connection::_on_data(DataCallback cb) {
   }
 }
 
+void Connection::_on_read_zerocopy(size_t max_held, ZerocopyCallback cb)
+{
+  if(zc_rx_ == nullptr)
+  {
+    zc_rx_ = std::make_unique<Zerocopy_rx>(max_held, cb);
+    zc_rx_->account->on_release = {this, &Connection::zerocopy_released};
+  }
+  else
+  {
+    zc_rx_->callback = cb;
+    zc_rx_->max_held = max_held;
+  }
+
+  // data is no longer put in buffers, flush what is there to the user
+  if(read_request != nullptr)
+  {
+    read_request->reset(this->cb.RCV.NXT);
+    read_request = nullptr;
+    // the out of order data in the buffers is thrown away
+    if(sack_list)
+      sack_list->clear();
+  }
+}
+
 
 Connection_ptr Connection::retrieve_shared() {
   return host_.retrieve_shared(this);
@@ -141,6 +213,19 @@ Connection::TCB::TCB(const uint16_t mss)
 {
 }
 
+void Connection::setup_congestion_control()
+{
+  if (cc_ == nullptr)
+    cc_ = Congestion_control::create(host_.congestion_control());
+  cc_update([] (auto& cc, auto& w) { cc.init(w); });
+}
+
+void Connection::set_congestion_control(Congestion_control::Algorithm algo)
+{
+  cc_ = Congestion_control::create(algo);
+  setup_congestion_control();
+}
+
 void Connection::reset_callbacks()
 {
   on_disconnect_ = {this, &Connection::default_on_disconnect};
@@ -152,6 +237,9 @@ void Connection::reset_callbacks()
     read_request->on_read_callback.reset();
     read_request->on_data_callback.reset();
   }
+  if(zc_rx_) {
+    zc_rx_->callback.reset();
+  }
 }
 
 uint16_t Connection::MSS() const noexcept {
@@ -199,6 +287,24 @@ void Connection::write(buffer_t buffer)
   }
 }
 
+void Connection::writev(const buffer_t* bufs, size_t count)
+{
+  if(not state_->is_writable())
+    return;
+
+  bool queued = false;
+  for(size_t i = 0; i < count; i++)
+  {
+    if(bufs[i] == nullptr or bufs[i]->empty())
+      continue;
+    writeq.push_back(bufs[i]);
+    queued = true;
+  }
+
+  if(queued and state_->is_connected())
+    host_.request_offer(*this);
+}
+
 void Connection::offer(size_t& packets)
 {
   debug2("<Connection::offer> %s got offered [%u] packets. Usable window is %u.\n",
@@ -209,22 +315,42 @@ void Connection::offer(size_t& packets)
 
   while(can_send() and packets)
   {
-    auto packet = create_outgoing_packet();
+    const bool tso = use_tso();
+    const bool sg  = use_sg();
+    // with scatter-gather the packet only holds the headers
+    auto packet = create_outgoing_packet(tso and not sg);
     packets--;
 
     size_t written{0};
-    size_t x{0};
-    // fill the packet with data
-    while(can_send() and
-      (x = fill_packet(*packet, writeq.nxt_data(), writeq.nxt_rem()) ))
+    if(sg)
     {
-      written += x;
-      cb.SND.NXT += x;
-      writeq.advance(x);
+      // reference the data where it is in the write queue
+      const auto n = std::min(writeq.nxt_rem(), sg_max_data(*packet, tso));
+      written = attach_packet(*packet, writeq.nxt(), writeq.offset(), n);
+      cb.SND.NXT += written;
+      writeq.advance(written);
+    }
+    else
+    {
+      size_t x{0};
+      // fill the packet with data
+      while(can_send() and
+        (x = fill_packet(*packet, writeq.nxt_data(), writeq.nxt_rem()) ))
+      {
+        written += x;
+        cb.SND.NXT += x;
+        writeq.advance(x);
+      }
     }
 
     packet->set_flag(ACK);
 
+    // let the NIC split the super-segment into full segments,
+    // each of them carrying the options
+    const auto seg = segment_data(*packet);
+    if(tso and packet->tcp_data_length() > seg)
+      packet->set_segmentation_offload(seg);
+
     debug2("<Connection::offer> Wrote %u bytes (%u remaining) with [%u] packets left and a usable window of %u.\n",
            written, buf.remaining, packets, usable_window());
 
@@ -332,7 +458,13 @@ void Connection::segment_arrived(Packet_view& incoming)
   //  printf("predicted\n");
 
   // Let state handle what to do when incoming packet arrives, and modify the outgoing packet.
-  switch(state_->handle(*this, incoming))
+  const auto result = state_->handle(*this, incoming);
+
+  // the segment is done, the packet is now only held by the user (if taken)
+  if(zc_rx_ != nullptr)
+    zc_rx_->processing = nullptr;
+
+  switch(result)
   {
     case State::OK:
       return; // // Do nothing.
@@ -355,11 +487,36 @@ void Connection::deserialize_from(void*) {}
 __attribute__((weak))
 int  Connection::serialize_to(void*) const {  return 0;  }
 
-Packet_view_ptr Connection::create_outgoing_packet()
+bool Connection::use_sg() const noexcept
+{
+  return writeq.nxt_rem() >= SMSS()
+    and host_.sg_offload(remote_);
+}
+
+size_t Connection::sg_max_data(const Packet_view& packet, bool tso) const noexcept
+{
+  const size_t seg = segment_data(packet);
+  if(not tso)
+    return seg;
+  const size_t hdrs = ((is_ipv6_) ? sizeof(ip6::Header) : sizeof(ip4::Header))
+    + packet.tcp_header_length();
+  const size_t gso_max = host_.gso_max_size() - hdrs;
+  const size_t max = std::min(gso_max, (size_t) usable_window());
+  return std::max(seg, max - (max % seg));
+}
+
+bool Connection::use_tso() const noexcept
+{
+  return host_.tso_offload(ipv())
+    and usable_window() >= 2 * (uint32_t) SMSS()
+    and writeq.bytes_remaining() > SMSS();
+}
+
+Packet_view_ptr Connection::create_outgoing_packet(bool gso)
 {
   update_rcv_wnd();
   auto packet = (is_ipv6_) ?
-    host_.create_outgoing_packet6() : host_.create_outgoing_packet();
+    host_.create_outgoing_packet6(gso) : host_.create_outgoing_packet(gso);
   // Set Source (local == the current connection)
   packet->set_source(local_);
   // Set Destination (remote)
@@ -490,21 +647,14 @@ void Connection::congestion_control(const Packet_view& in)
   // update recover
   cb.recover = cb.SND.NXT;
 
-  // slow start
-  if(cb.slow_start())
-  {
-    reno_increase_cwnd(bytes_acked);
-    debug2("<Connection::handle_ack> Slow start. cwnd=%u uw=%u\n",
-      cb.cwnd, usable_window());
-  }
-  // congestion avoidance
-  else
-  {
-    // increase cwnd once per RTT
-    cb.cwnd += std::max(SMSS()*SMSS()/cb.cwnd, (uint32_t)1);
-    debug2("<Connection::handle_ack> Congestion avoidance. cwnd=%u uw=%u\n",
-      cb.cwnd, usable_window());
-  } // < congestion avoidance
+  // slow start or congestion avoidance, decided by the algorithm
+  const Congestion_control::Ack ack {
+    static_cast<uint32_t>(bytes_acked), flight_size(), in.ack(), cb.SND.NXT,
+    static_cast<int64_t>(RTC::nanos_now() / 1000)
+  };
+  cc_update([&ack] (auto& cc, auto& w) { cc.on_ack(w, ack); });
+  debug2("<Connection::handle_ack> %s. cwnd=%u uw=%u\n",
+    cc_->name(), cb.cwnd, usable_window());
 
   // try to write
   if(can_send() and (!in.has_tcp_data() or cb.RCV.WND < in.tcp_data_length()))
@@ -709,6 +859,14 @@ void Connection::trigger_window_update(os::mem::Pmr_resource& res)
 
 uint32_t Connection::calculate_rcv_wnd() const
 {
+  // the window is what can still be held in packets
+  if(zc_rx_ != nullptr)
+  {
+    const auto held = zc_rx_->held();
+    const auto win = (held < zc_rx_->max_held) ? zc_rx_->max_held - held : 0;
+    return (win < SMSS()) ? 0 : std::min(win, (size_t) UINT32_MAX);
+  }
+
   // PRECISE REPORTING
   if(UNLIKELY(read_request == nullptr))
     return 0xffff;
@@ -773,7 +931,7 @@ uint32_t Connection::calculate_rcv_wnd() const
   This acknowledgment should be piggybacked on a segment being
   transmitted if possible without incurring undue delay.
 */
-void Connection::recv_data(const Packet_view& in)
+void Connection::recv_data(Packet_view& in)
 {
   Expects(in.has_tcp_data());
 
@@ -828,20 +986,29 @@ void Connection::recv_data(const Packet_view& in)
     // only actually recv the data if there is a read request (created with on_read)
     if(read_request != nullptr)
     {
-      const auto recv = read_request->insert(in.seq(), in.tcp_data(), length, in.isset(PSH));
+      const auto recv = insert_payload(*read_request, in, in.seq(), length);
       // this ensures that the data we ACK is actually put in our buffer.
       Ensures(recv == length);
     }
+    else if(zc_rx_ != nullptr)
+    {
+      recv_zerocopy(in, length);
+    }
   }
   // Packet out of order
   else if(( (in.seq() + in.tcp_data_length()) - cb.RCV.NXT) < cb.RCV.WND)
   {
     // only accept the data if we have a read request
-    if(read_request != nullptr)
+    if(read_request != nullptr or zc_rx_ != nullptr)
       recv_out_of_order(in);
   }
 
 
+  // a coalesced segment counts as the full-sized segments it was made of,
+  // so it is ACKed right away [RFC 5681] p. 11
+  if(in.coalesced_segments() > 0 and use_dack())
+    dack_ += in.coalesced_segments();
+
   // User callback didnt result in transmitting an ACK
   if(cb.SND.NXT == snd_nxt)
     ack_data();
@@ -858,7 +1025,7 @@ void Connection::recv_data(const Packet_view& in)
 // For now, only full segments are allowed (not partial),
 // meaning the data will get thrown away if the read buffer not fully fits it.
 // This makes everything much easier.
-void Connection::recv_out_of_order(const Packet_view& in)
+void Connection::recv_out_of_order(Packet_view& in)
 {
   // Packets before this point would totally ruin the buffer
   Expects((in.seq() - cb.RCV.NXT) < cb.RCV.WND);
@@ -881,7 +1048,9 @@ void Connection::recv_out_of_order(const Packet_view& in)
     return;
   }
 
-  auto fits = read_request->fits(seq);
+  // without buffers, the segment is kept as long as it can be held
+  const size_t fits = (read_request != nullptr) ? read_request->fits(seq)
+    : ((zc_rx_->held() < zc_rx_->max_held) ? zc_rx_->max_held - zc_rx_->held() : 0);
   // TODO: if our packet partial fits, we just ignores it for now
   // to avoid headache
   if(fits >= length)
@@ -895,9 +1064,20 @@ void Connection::recv_out_of_order(const Packet_view& in)
     if(UNLIKELY(length == 0))
       return;
 
-    const auto inserted = read_request->insert(seq, in.tcp_data(), length, in.isset(PSH));
-    Ensures(inserted == length && "No partial insertion support");
-    bytes_sacked_ += inserted;
+    if(read_request != nullptr)
+    {
+      const auto inserted = insert_payload(*read_request, in, seq, length);
+      Ensures(inserted == length && "No partial insertion support");
+    }
+    else
+    {
+      auto& ooo = zc_rx_->out_of_order;
+      capture_payload(*zc_rx_, in, length,
+        [&ooo, seq] (Packet_slice slice, size_t offset) {
+          ooo.emplace(seq + offset, std::move(slice));
+        });
+    }
+    bytes_sacked_ += length;
   }
 
   /*
@@ -919,6 +1099,49 @@ void Connection::recv_out_of_order(const Packet_view& in)
   }*/
 }
 
+void Connection::recv_zerocopy(Packet_view& in, size_t length)
+{
+  auto& zc = *zc_rx_;
+  Zerocopy_rx::Seq_less before;
+
+  Packet_chain chain;
+  capture_payload(zc, in, length,
+    [&chain] (Packet_slice slice, size_t) { chain.push_back(std::move(slice)); });
+
+  // the out of order segments now before RCV.NXT follow this one,
+  // skipping what overlaps with the data already in the chain
+  seq_t next = in.seq() + length;
+  auto it = zc.out_of_order.begin();
+  while(it != zc.out_of_order.end() and before(it->first, cb.RCV.NXT))
+  {
+    auto slice = std::move(it->second);
+    const seq_t seq = it->first;
+    const seq_t end = seq + (seq_t) slice.size();
+    it = zc.out_of_order.erase(it);
+
+    if(not before(next, end))
+      continue;
+    if(before(seq, next))
+      slice.consume(next - seq);
+
+    next = end;
+    chain.push_back(std::move(slice));
+  }
+
+  if(zc.callback)
+    zc.callback(std::move(chain));
+}
+
+void Connection::zerocopy_released()
+{
+  // only when the released packets opens a closed window
+  if(cb.RCV.WND == 0 and zc_rx_->processing == nullptr and is_readable()
+     and calculate_rcv_wnd() > 0)
+  {
+    send_window_update();
+  }
+}
+
 void Connection::ack_data()
 {
   const auto snd_nxt = cb.SND.NXT;
@@ -1003,8 +1226,13 @@ void Connection::retransmit() {
 
     //printf("<Connection::retransmit> With data (wq.sz=%zu) buf.size=%zu buf.unacked=%zu SND.WND=%u CWND=%u\n",
     //       writeq.size(), buf->size(), buf->size() - writeq.acked(), cb.SND.WND, cb.cwnd);
-    fill_packet(*packet, buf->data() + writeq.acked(), buf->size() - writeq.acked());
-      packet->set_flag(PSH);
+    const auto rem = buf->size() - writeq.acked();
+    const auto seg = segment_data(*packet);
+    if(rem >= seg and host_.sg_offload(remote_))
+      attach_packet(*packet, buf, writeq.acked(), seg);
+    else
+      fill_packet(*packet, buf->data() + writeq.acked(), rem);
+    packet->set_flag(PSH);
   }
   packet->set_seq(cb.SND.UNA);
 
@@ -1136,7 +1364,7 @@ void Connection::rtx_timeout() {
     finish_fast_recovery();
 
   //cb.cwnd = SMSS();
-  reno_init_cwnd(3); // experimental
+  cc_update([] (auto& cc, auto& w) { cc.on_rto(w); }); // experimental
   /*
     NOTE: It's unclear which one comes first, or if finish_fast_recovery includes changing the cwnd.
   */
@@ -1229,6 +1457,12 @@ void Connection::clean_up() {
     read_request->on_read_callback.reset();
     read_request->on_data_callback.reset();
   }
+  // the packets held by the user may be released after we're gone
+  if(zc_rx_) {
+    zc_rx_->callback.reset();
+    zc_rx_->account->on_release.reset();
+    zc_rx_->out_of_order.clear();
+  }
 
 
   debug2("<Connection::clean_up> Call clean_up delg on %s\n", to_string().c_str());
@@ -1424,7 +1658,7 @@ void Connection::reduce_ssthresh() {
   if(limited_tx_)
     fs = (fs >= two_seg) ? fs - two_seg : 0;
 
-  cb.ssthresh = std::max( (fs / 2), two_seg );
+  cc_update([fs] (auto& cc, auto& w) { cc.on_loss(w, fs); });
   //printf("<TCP::Connection::reduce_ssthresh> Slow start threshold reduced: %u\n",
   //  cb.ssthresh);
 }
@@ -1444,6 +1678,6 @@ void Connection::finish_fast_recovery() {
   reno_fpack_seen = false;
   fast_recovery_ = false;
   //cb.cwnd = std::min(cb.ssthresh, std::max(flight_size(), (uint32_t)SMSS()) + SMSS());
-  cb.cwnd = cb.ssthresh;
+  cc_update([] (auto& cc, auto& w) { cc.on_recovery_exit(w); });
   //printf("<TCP::Connection::finish_fast_recovery> Finished Fast Recovery - Cwnd: %u\n", cb.cwnd);
 }
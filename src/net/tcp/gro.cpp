@@ -0,0 +1,161 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2018 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <net/tcp/gro.hpp>
+#include <net/tcp/packet4_view.hpp>
+#include <cstring>
+
+namespace net {
+namespace tcp {
+
+  static uint16_t flags_of(const Header& hdr) noexcept
+  { return ntohs(hdr.offset_flags.whole) & 0x1ff; }
+
+  /** Whether a segment can be coalesced with others at all */
+  static bool coalescable(PacketIP4& ip)
+  {
+    if (ip.ip_header_length() != sizeof(ip4::Header)
+        or ip.ip_flags() == ip4::Flags::MF or ip.ip_frag_offs() != 0
+        or ip.ext_length() != 0
+        or ip.ip_data_length() < sizeof(Header))
+      return false;
+
+    const Packet4_view_raw seg{&ip};
+    if (not seg.validate_length() or not seg.has_tcp_data()
+        or (flags_of(seg.tcp_header()) & ~PSH) != ACK)
+      return false;
+
+    // a coalesced segment is not checksummed again
+    if (not ip.checksum_verified()) {
+      if (seg.compute_tcp_checksum() != 0)
+        return false;
+      ip.set_checksum_verified();
+    }
+    return true;
+  }
+
+  /** Whether @b has the same headers as @a, apart from sequence number and PSH */
+  static bool same_headers(const PacketIP4& a, const PacketIP4& b) noexcept
+  {
+    const auto& ha = *reinterpret_cast<const Header*>(a.ip_data().data());
+    const auto& hb = *reinterpret_cast<const Header*>(b.ip_data().data());
+    const int hlen = (ha.offset_flags.offset_reserved >> 4) * 4;
+    return a.ip_dscp() == b.ip_dscp() and a.ip_ecn() == b.ip_ecn()
+      and ha.offset_flags.offset_reserved == hb.offset_flags.offset_reserved
+      and ha.ack_nr == hb.ack_nr
+      and ha.window_size == hb.window_size
+      and memcmp(ha.options, hb.options, hlen - sizeof(Header)) == 0;
+  }
+
+  Gro::Run* Gro::find(const net::Packet& pkt) noexcept
+  {
+    const auto& ip = static_cast<const PacketIP4&>(pkt);
+    const auto ports = *reinterpret_cast<const uint32_t*>(ip.ip_data().data());
+    for (int i = 0; i < count_; i++)
+    {
+      const auto& head = static_cast<const PacketIP4&>(*runs_[i].head);
+      if (ports == *reinterpret_cast<const uint32_t*>(head.ip_data().data())
+          and ip.ip_src() == head.ip_src() and ip.ip_dst() == head.ip_dst())
+        return &runs_[i];
+    }
+    return nullptr;
+  }
+
+  void Gro::receive(net::Packet_ptr ptr)
+  {
+    auto& ip = static_cast<PacketIP4&>(*ptr);
+    const bool coalesce = coalescable(ip);
+    Run* run = (ip.ip_data_length() >= 4) ? find(ip) : nullptr;
+
+    if (not coalesce)
+    {
+      // the segments before it go first
+      if (run != nullptr) deliver(*run);
+      deliver_(std::move(ptr), 0, 0);
+      return;
+    }
+
+    Packet4_view_raw seg{&ip};
+    const uint16_t length = seg.tcp_data_length();
+    const bool push = seg.isset(PSH);
+
+    if (run != nullptr)
+    {
+      auto& head = static_cast<PacketIP4&>(*run->head);
+      if (seg.seq() == run->next and length <= run->mss
+          and size_t{run->mss} + run->length + length <= MAX_LENGTH
+          and run->segments < 0xff
+          and same_headers(head, ip))
+      {
+        auto* last = ptr.get();
+        run->last->chain(std::move(ptr));
+        run->last = last;
+        run->next += length;
+        run->length += length;
+        run->segments++;
+        coalesced_++;
+        // the run can only end with a PSH or short segment
+        if (push) {
+          // checksums are verified, so the header can change
+          Packet4_view_raw{&head}.set_flag(PSH);
+        }
+        if (push or length < run->mss)
+          deliver(*run);
+        return;
+      }
+      deliver(*run);
+    }
+
+    if (push) {
+      deliver_(std::move(ptr), 0, 0);
+      return;
+    }
+    if (count_ == MAX_RUNS)
+      deliver(runs_[0]);
+
+    auto& added = runs_[count_++];
+    added.last     = ptr.get();
+    added.head     = std::move(ptr);
+    added.next     = seg.seq() + length;
+    added.mss      = length;
+    added.length   = 0;
+    added.segments = 0;
+  }
+
+  void Gro::flush()
+  {
+    while (count_ > 0)
+      deliver(runs_[0]);
+  }
+
+  void Gro::deliver(Run& run)
+  {
+    auto head = std::move(run.head);
+    const auto length   = run.length;
+    const auto segments = run.segments;
+    // keep the rest in order
+    const int idx = &run - runs_.data();
+    for (int i = idx; i < count_ - 1; i++)
+      runs_[i] = std::move(runs_[i+1]);
+    runs_[--count_] = Run{};
+
+    deliver_(std::move(head), length, segments);
+  }
+
+} // < namespace tcp
+} // < namespace net
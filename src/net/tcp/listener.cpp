@@ -106,6 +106,8 @@ void Listener::segment_arrived(Packet_view& packet) {
       )
     );
     conn->_on_cleanup({this, &Listener::remove});
+    if (congestion_)
+      conn->set_congestion_control(*congestion_);
     // Open connection
     conn->open(false);
     Ensures(conn->is_listening());
@@ -26,9 +26,11 @@
 #include <net/inet>
 #include <net/inet_common.hpp> // checksum
 #include <statman>
+#include <algorithm>
 #include <rtc> // nanos_now (get_ts_value)
 #include <net/tcp/packet4_view.hpp>
 #include <net/tcp/packet6_view.hpp>
+#include <net/packet_burst.hpp>
 
 using namespace std;
 using namespace net;
@@ -48,8 +50,11 @@ TCP::TCP(IPStack& inet, bool smp_enable) :
   wscale_{default_window_scaling},      // 5
   timestamps_{default_timestamps},      // true
   sack_{default_sack},                  // true
+  congestion_{tcp::Congestion_control::Algorithm::RENO},
   dack_timeout_{default_dack_timeout},  // 40ms
-  max_syn_backlog_{default_max_syn_backlog} // 64
+  max_syn_backlog_{default_max_syn_backlog}, // 64
+  gro_active_{default_gro},             // true
+  gro_{{this, &TCP::receive4_coalesced}}
 {
   Expects(wscale_ <= 14 && "WScale factor cannot exceed 14");
   Expects(win_size_ <= 0x40000000 && "Invalid size");
@@ -94,7 +99,7 @@ Listener& TCP::listen(const Socket& socket, ConnectCallback cb)
 {
   bind(socket);
 
-  auto& listener = listeners_.emplace(socket,
+  auto& listener = add_listener(socket,
     std::make_unique<tcp::Listener>(*this, socket, std::move(cb))
     ).first->second;
   debug("<TCP::listen> Bound to socket %s \n", socket.to_string().c_str());
@@ -107,13 +112,13 @@ Listener& TCP::listen(const tcp::port_t port, ConnectCallback cb, const bool ipv
   bind(socket);
 
   auto ptr = std::make_shared<tcp::Listener>(*this, socket, std::move(cb), ipv6_only);
-  auto& listener = listeners_.emplace(socket, ptr).first->second;
+  auto& listener = add_listener(socket, ptr).first->second;
 
   if(not ipv6_only)
   {
     Socket ip4_sock{ip4::Addr::addr_any, port};
     bind(ip4_sock);
-    Ensures(listeners_.emplace(ip4_sock, ptr).second && "Could not insert IPv4 listener");
+    Ensures(add_listener(ip4_sock, ptr).second && "Could not insert IPv4 listener");
   }
 
   return *listener;
@@ -199,10 +204,7 @@ Connection_ptr TCP::connect(Socket local, Socket remote)
 
 void TCP::insert_connection(Connection_ptr conn)
 {
-  connections_.emplace(
-      std::piecewise_construct,
-      std::forward_as_tuple(conn->local(), conn->remote()),
-      std::forward_as_tuple(conn));
+  connections_.emplace(Connection::Tuple{conn->local(), conn->remote()}, conn);
 }
 
 void TCP::receive4(net::Packet_ptr ptr)
@@ -216,6 +218,33 @@ void TCP::receive4(net::Packet_ptr ptr)
   receive(pkt);
 }
 
+void TCP::receive4_burst(net::Packet_ptr chain)
+{
+  // rerouted packets are passed on as they are
+  const bool gro = gro_active_ and packet_rerouter == nullptr;
+  while (chain != nullptr)
+  {
+    auto pkt = net::Packet_burst::pop_front(chain);
+    // the next header is needed right after this segment
+    if (chain != nullptr)
+      __builtin_prefetch(chain->layer_begin());
+    if (gro)
+      gro_.receive(std::move(pkt));
+    else
+      receive4(std::move(pkt));
+  }
+  gro_.flush();
+}
+
+void TCP::receive4_coalesced(net::Packet_ptr ptr, uint16_t length, uint8_t segments)
+{
+  auto ip4 = static_unique_ptr_cast<PacketIP4>(std::move(ptr));
+  Packet4_view pkt{std::move(ip4)};
+  pkt.set_coalesced(length, segments);
+  (*packets_rx_) += segments;
+  receive(pkt);
+}
+
 void TCP::receive6(net::Packet_ptr ptr)
 {
   auto ip6 = static_unique_ptr_cast<PacketIP6>(std::move(ptr));
@@ -244,8 +273,9 @@ void TCP::receive(Packet_view& packet)
   }
 
 #if !defined(DISABLE_INET_CHECKSUMS)
-  // Validate checksum
-  if (UNLIKELY(packet.compute_tcp_checksum() != 0)) {
+  // Validate checksum, unless the NIC already did
+  if (not packet.packet_ptr()->checksum_verified()
+      and UNLIKELY(packet.compute_tcp_checksum() != 0)) {
     PRINT("<TCP::receive> TCP Packet Checksum %#x != %#x\n",
           packet.compute_tcp_checksum(), 0x0);
     drop(packet);
@@ -394,8 +424,11 @@ void TCP::reset_pmtu(Socket dest, IP4::PMTU pmtu) {
 
 void TCP::transmit(tcp::Packet_view_ptr packet)
 {
-  // Generate checksum.
-  packet->set_tcp_checksum();
+  // Generate checksum, or leave it to the NIC
+  if (csum_offload())
+    packet->set_tcp_checksum_partial();
+  else
+    packet->set_tcp_checksum();
 
   // Stat increment bytes transmitted and packets transmitted
   (*bytes_tx_) += packet->tcp_data_length();
@@ -409,20 +442,46 @@ void TCP::transmit(tcp::Packet_view_ptr packet)
   }
 }
 
-tcp::Packet_view_ptr TCP::create_outgoing_packet()
+tcp::Packet_view_ptr TCP::create_outgoing_packet(bool gso)
 {
-  auto packet = std::make_unique<tcp::Packet4_view>(inet_.create_ip_packet(Protocol::TCP));
+  auto packet = std::make_unique<tcp::Packet4_view>((gso)
+    ? inet_.create_gso_ip_packet(Protocol::TCP) : inet_.create_ip_packet(Protocol::TCP));
   packet->init();
   return packet;
 }
 
-tcp::Packet_view_ptr TCP::create_outgoing_packet6()
+tcp::Packet_view_ptr TCP::create_outgoing_packet6(bool gso)
 {
-  auto packet = std::make_unique<tcp::Packet6_view>(inet_.create_ip6_packet(Protocol::TCP));
+  auto packet = std::make_unique<tcp::Packet6_view>((gso)
+    ? inet_.create_gso_ip6_packet(Protocol::TCP) : inet_.create_ip6_packet(Protocol::TCP));
   packet->init();
   return packet;
 }
 
+bool TCP::csum_offload() const
+{
+  return inet_.nic_offload(hw::Nic::TX_CSUM)
+    and not network().forward_delg();
+}
+
+bool TCP::tso_offload(const Protocol ipv) const
+{
+  const auto tso = (ipv == Protocol::IPv6) ? hw::Nic::TSO6 : hw::Nic::TSO4;
+  return csum_offload() and inet_.nic_offload(tso);
+}
+
+uint32_t TCP::gso_max_size() const
+{
+  return inet_.nic_gso_max_size();
+}
+
+bool TCP::sg_offload(const Socket& remote) const
+{
+  return inet_.nic_offload(hw::Nic::TX_SG)
+    and not network().forward_delg()
+    and not inet_.is_valid_source(remote.address());
+}
+
 void TCP::send_reset(const tcp::Packet_view& in)
 {
   // TODO: maybe worth to just swap the fields in
@@ -628,7 +687,7 @@ void TCP::close_listener(tcp::Listener& listener)
 {
   const auto& socket = listener.local();
   unbind(socket);
-  listeners_.erase(socket);
+  erase_listener(socket);
 
   // if the listener is "dual-stack", make sure to clean up the
   // ip4 any addr copy as well
@@ -636,32 +695,71 @@ void TCP::close_listener(tcp::Listener& listener)
   {
     Socket ip4_sock{ip4::Addr::addr_any, socket.port()};
     unbind(ip4_sock);
-    listeners_.erase(ip4_sock);
+    erase_listener(ip4_sock);
   }
 }
 
+/*
+  Listeners are looked up through the port index, which holds the
+  (few) listeners bound to a port. An exact address match is preferred
+  over the any address of the same family.
+*/
 TCP::Listeners::iterator TCP::find_listener(const Socket& socket)
 {
-  Listeners::iterator it = listeners_.find(socket);
-  if(it != listeners_.end())
-    return it;
-
-  if(not socket.address().is_any())
-    it = listeners_.find({socket.address().any_addr(), socket.port()});
+  const auto* bound = listener_ports_.find(socket.port());
+  if (bound == nullptr)
+    return listeners_.end();
 
-  return it;
+  const auto& addr = socket.address();
+  auto found = listeners_.end();
+  for (auto it : *bound)
+  {
+    const auto& laddr = it->first.address();
+    if (laddr == addr)
+      return it;
+    if (laddr.is_any() and laddr.is_v4() == addr.is_v4())
+      found = it;
+  }
+  return found;
 }
 
 TCP::Listeners::const_iterator TCP::cfind_listener(const Socket& socket) const
 {
-  Listeners::const_iterator it = listeners_.find(socket);
-  if(it != listeners_.cend())
-    return it;
+  const auto* bound = listener_ports_.find(socket.port());
+  if (bound == nullptr)
+    return listeners_.cend();
 
-  if(not socket.address().is_any())
-    it = listeners_.find({socket.address().any_addr(), socket.port()});
+  const auto& addr = socket.address();
+  Listeners::const_iterator found = listeners_.cend();
+  for (Listeners::const_iterator it : *bound)
+  {
+    const auto& laddr = it->first.address();
+    if (laddr == addr)
+      return it;
+    if (laddr.is_any() and laddr.is_v4() == addr.is_v4())
+      found = it;
+  }
+  return found;
+}
+
+std::pair<TCP::Listeners::iterator, bool>
+TCP::add_listener(const Socket& socket, std::shared_ptr<tcp::Listener> listener)
+{
+  auto res = listeners_.emplace(socket, std::move(listener));
+  if (res.second)
+    listener_ports_[socket.port()].push_back(res.first);
+  return res;
+}
+
+void TCP::erase_listener(const Socket& socket)
+{
+  auto it = listeners_.find(socket);
+  if (it == listeners_.end())
+    return;
 
-  return it;
+  auto& bound = listener_ports_[socket.port()];
+  bound.erase(std::find(bound.begin(), bound.end(), it));
+  listeners_.erase(it);
 }
 
 
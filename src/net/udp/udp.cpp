@@ -25,6 +25,7 @@
 #include <net/udp/udp.hpp>
 #include <net/udp/packet4_view.hpp>
 #include <net/udp/packet6_view.hpp>
+#include <net/packet_burst.hpp>
 #include <common>
 #include <net/inet>
 #include <net/util.hpp>
@@ -52,6 +53,18 @@ namespace net {
     receive(std::move(pkt), is_bcast);
   }
 
+  void UDP::receive4_burst(net::Packet_ptr chain)
+  {
+    while (chain != nullptr)
+    {
+      auto pkt = Packet_burst::pop_front(chain);
+      // the next header is needed right after this datagram
+      if (chain != nullptr)
+        __builtin_prefetch(chain->layer_begin());
+      receive4(std::move(pkt));
+    }
+  }
+
   void UDP::receive6(net::Packet_ptr ptr)
   {
     auto ip6 = static_unique_ptr_cast<PacketIP6>(std::move(ptr));
@@ -61,11 +74,13 @@ namespace net {
       // TODO: call drop()
       return;
     }
-    // Validate checksum
+    // Validate checksum, unless the NIC already did
     // TODO: Maybe wasteful to do checksum calc before other checks
-    if (auto csum = pkt->compute_udp_checksum(); UNLIKELY(csum != 0)) {
-      PRINT("<UDP::receive> UDP Packet Checksum %#x != %#x\n", csum, 0x0);
-      return;
+    if (not pkt->packet_ptr()->checksum_verified()) {
+      if (auto csum = pkt->compute_udp_checksum(); UNLIKELY(csum != 0)) {
+        PRINT("<UDP::receive> UDP Packet Checksum %#x != %#x\n", csum, 0x0);
+        return;
+      }
     }
 
     const bool is_bcast = false; // TODO: multicast?
@@ -188,126 +188,209 @@ void WebSocket::read_data(Stream::buffer_t buf)
   // silently ignore data for reset connection
   if (this->stream == nullptr) return;
 
-  size_t len = buf->size();
-  const uint8_t* data = buf->data();
+  uint8_t* data = buf->data();
+  size_t   len  = buf->size();
   while (len)
   {
-    if (message != nullptr)
+    if (not frame.in_payload)
     {
-      const size_t written = message->append(data, len);
-      len -= written;
-      data += len;
+      const size_t used = read_header(data, len);
+      // invalid frame, error has been called and stream closed
+      if (UNLIKELY(used == 0))
+        return;
+      data += used; len -= used;
+      // an incomplete header, or an empty frame which is already done
+      if (not frame.in_payload) {
+        if (is_done()) return;
+        continue;
+      }
     }
-    // create new message
-    else
+    // the payload stays in the buffer, unmasked in place
+    const size_t n = std::min(frame.remaining, len);
+    if (frame.key != 0)
+      ws_mask((char*) data, n, frame.key, frame.unmasked);
+    auto& msg = (frame.code >= op_code::CLOSE) ? control : message;
+    msg->append(buf, data, n);
+    frame.unmasked  += n;
+    frame.remaining -= n;
+    data += n; len -= n;
+
+    if (frame.remaining == 0)
     {
-      const size_t written = create_message(data, len);
-
-      if(UNLIKELY(message == nullptr))
-        return; // Something was invalid, error has been called and stream closed.
-
-      len -= written;
-      data += len;
-    }
-
-    if (message->is_complete()) {
-      finalize_message();
+      end_frame();
+      if (is_done()) return;
     }
   }
 }
 
-size_t WebSocket::Message::append(const uint8_t* data, size_t len)
+size_t WebSocket::read_header(const uint8_t* data, size_t len)
 {
-  size_t total = 0;
-  // more partial header
-  if (UNLIKELY(this->header_complete() == false))
+  // the whole header is in this buffer, parse it in place
+  if (frame.header_len == 0 and len >= 2
+      and len >= ((const ws_header*) data)->header_length())
   {
-    auto hdr_bytes = std::min(header().header_length() - this->header_length, (int) len);
-    memcpy(&header_[this->header_length], data, hdr_bytes);
-    this->header_length += hdr_bytes;
-    // move forward in buffer
-    data += hdr_bytes; len -= hdr_bytes; total += hdr_bytes;
-    // if the header became complete, reserve data
-    if (this->header_complete()) {
-      data_.reserve(header().data_length());
-    }
+    const auto& hdr = *(const ws_header*) data;
+    return begin_frame(hdr) ? hdr.header_length() : 0;
   }
-  // fill data with remainder
-  if (this->header_complete())
+  // otherwise gather it, the first two bytes tell the length of the rest
+  const auto& hdr = *(const ws_header*) frame.header.data();
+  size_t used = 0;
+  while (used < len)
   {
-    const size_t insert_size = std::min(data_.capacity() - data_.size(), len);
-    data_.insert(data_.end(), data, data + insert_size);
-    total += insert_size;
+    const size_t want = (frame.header_len < 2) ? 2 : hdr.header_length();
+    const size_t n = std::min(want - frame.header_len, len - used);
+    memcpy(&frame.header[frame.header_len], data + used, n);
+    frame.header_len += n;
+    used += n;
+    if (frame.header_len >= 2 and frame.header_len == hdr.header_length())
+      return begin_frame(hdr) ? used : 0;
   }
-  return total;
+  return used;
 }
 
-size_t WebSocket::create_message(const uint8_t* buf, size_t len)
+bool WebSocket::begin_frame(const ws_header& hdr)
 {
-  // parse header
-  if (len < sizeof(ws_header)) {
-    failure("read_data: Header was too short");
+  frame.header_len = 0;
+  frame.in_payload = false;
 
-    // Consider the remaining buffer as garbage
-    return len;
+  // discard invalid messages
+  if (hdr.is_masked()) {
+    if (clientside == true) {
+      failure("Read masked message from server");
+      return false;
+    }
+  } else if (clientside == false) {
+    failure("Read unmasked message from client");
+    return false;
   }
 
-  const auto& hdr = *(const ws_header*) buf;
+  const op_code code = hdr.opcode();
+  const size_t  len  = hdr.data_length();
+  if (UNLIKELY(code > op_code::PONG
+      or (code > op_code::BINARY and code < op_code::CLOSE))) {
+    failure("read: Reserved opcode");
+    return false;
+  }
+  if (code >= op_code::CLOSE)
+  {
+    if (UNLIKELY(not hdr.is_final() or len > 125)) {
+      failure("read: Fragmented or too long control frame");
+      return false;
+    }
+    control = std::make_unique<Message>(code);
+  }
+  else if (code == op_code::CONTINUE)
+  {
+    if (UNLIKELY(message == nullptr)) {
+      failure("read: Continuation frame without a message");
+      return false;
+    }
+  }
+  else
+  {
+    if (UNLIKELY(message != nullptr)) {
+      failure("read: New message before the last one was complete");
+      return false;
+    }
+    message = std::make_unique<Message>(code);
+  }
 
-  if(max_msg_size != 0 and hdr.data_length() > max_msg_size)
+  if (code < op_code::CLOSE and max_msg_size != 0
+      and message->size() + len > max_msg_size)
   {
     std::string msg{"read: Maximum message size exceeded: "};
     msg.append(std::to_string(max_msg_size)).append(" bytes");
 
     failure(std::move(msg));
-    return 0;
+    return false;
   }
 
-  /*
-    printf("Code: %hhu  (%s) (final=%d)\n",
-    hdr.opcode(), opcode_string(hdr.opcode()), hdr.is_final());
-    printf("Mask: %d  len=%u\n", hdr.is_masked(), hdr.mask_length());
-    printf("Payload: len=%u dataofs=%u\n",
-    hdr.data_length(), hdr.data_offset());
-  */
+  frame.in_payload = true;
+  frame.code      = code;
+  frame.fin       = hdr.is_final();
+  frame.key       = hdr.mask_key();
+  frame.remaining = len;
+  frame.unmasked  = 0;
+  // empty frames are done right away
+  if (len == 0) end_frame();
+  return true;
+}
 
-  // discard invalid messages
-  if (hdr.is_masked()) {
-    if (clientside == true) {
-      failure("Read masked message from server");
-      return std::min(hdr.data_length(), len);
-    }
-  } else if (clientside == false) {
-    failure("Read unmasked message from client");
-    return std::min(hdr.data_length(), len);
+void WebSocket::end_frame()
+{
+  frame.in_payload = false;
+  if (frame.code >= op_code::CLOSE) {
+    finalize_control();
   }
+  else if (frame.fin) {
+    message->finish();
+    finalize_message();
+  }
+}
 
-  this->message = std::make_unique<Message>(buf, len);
-  return len;
+Stream::buffer_t WebSocket::Message::extract_buffer()
+{
+  Stream::buffer_t buf;
+  // the only slice is a whole buffer, which is handed over as is
+  if (chain_.size() == 1 and chain_[0].data == chain_[0].buf->data()
+      and chain_[0].len == chain_[0].buf->size())
+  {
+    buf = std::move(chain_[0].buf);
+  }
+  else
+  {
+    buf = tcp::construct_buffer();
+    buf->reserve(size_);
+    for (const auto& slice : chain_)
+      buf->insert(buf->end(), slice.data, slice.data + slice.len);
+  }
+  chain_.clear();
+  size_ = 0;
+  return buf;
+}
+
+uint8_t* WebSocket::Message::flatten() const
+{
+  if (chain_.size() == 1)
+    return chain_[0].data;
+  static uint8_t empty = 0;
+  if (chain_.empty())
+    return &empty;
+  auto buf = tcp::construct_buffer();
+  buf->reserve(size_);
+  for (const auto& slice : chain_)
+    buf->insert(buf->end(), slice.data, slice.data + slice.len);
+  chain_.clear();
+  chain_.push_back({buf, buf->data(), buf->size()});
+  return chain_[0].data;
 }
 
 void WebSocket::finalize_message()
 {
   Expects(message != nullptr and message->is_complete());
-  message->unmask();
-  const auto& hdr = message->header();
-  switch (hdr.opcode()) {
-  case op_code::TEXT:
-  case op_code::BINARY:
-    /// .. call on_read
-    if (this->on_read) {
-      this->m_busy = true;
-      this->on_read(std::move(message));
-      this->m_busy = false;
-      if (this->m_deferred_close) this->close(this->m_deferred_close);
-    }
-    return;
+  /// .. call on_read
+  if (this->on_read) {
+    this->m_busy = true;
+    this->on_read(std::move(message));
+    this->m_busy = false;
+    if (this->m_deferred_close) this->close(this->m_deferred_close);
+  }
+  message.reset();
+}
+
+void WebSocket::finalize_control()
+{
+  Expects(control != nullptr);
+  auto msg = std::move(control);
+  msg->finish();
+  switch (msg->opcode()) {
   case op_code::CLOSE:
     // there is a message behind the reason, hmm..
-    if (hdr.data_length() >= 2) {
+    if (msg->size() >= 2) {
       // provide reason to user
-      uint16_t reason = htons(*(uint16_t*) message->data());
-      this->close(reason);
+      uint16_t reason;
+      memcpy(&reason, msg->data(), sizeof(reason));
+      this->close(ntohs(reason));
     }
     else {
       this->close(1000);
@@ -315,19 +398,18 @@ void WebSocket::finalize_message()
     // the websocket is DEAD after close()
     return;
   case op_code::PING:
-    if (on_ping(hdr.data(), hdr.data_length())) // if return true, pong back
-      write_opcode(op_code::PONG, hdr.data(), hdr.data_length());
+    if (on_ping(msg->data(), msg->size())) // if return true, pong back
+      write_opcode(op_code::PONG, msg->data(), msg->size());
     break;
   case op_code::PONG:
     ping_timer.stop();
     if (on_pong != nullptr)
-      on_pong(hdr.data(), hdr.data_length());
+      on_pong(msg->data(), msg->size());
     break;
   default:
-    //printf("Unknown opcode: %d\n", (int) hdr.opcode());
+    //printf("Unknown opcode: %d\n", (int) msg->opcode());
     break;
   }
-  message.reset();
 }
 
 /** create a websocket message with only the header present
@@ -390,31 +472,40 @@ void WebSocket::write(Stream::buffer_t buffer, op_code code)
     failure("write: Connection not writable");
     return;
   }
-  if (UNLIKELY(clientside == true)) {
-    failure("write: Client-side does not support sending shared buffers");
-    return;
-  }
 
   Expects((code == op_code::TEXT or code == op_code::BINARY)
         && "Write currently only supports TEXT or BINARY");
 
-  /// write header
-  auto header = create_wsmsg(buffer->size(), code, false);
-  this->stream->write(header);
-  /// write shared buffer
-  this->stream->write(buffer);
+  // the client masks, which needs a copy of the data
+  if (clientside)
+  {
+    this->write((const char*) buffer->data(), buffer->size(), code);
+    return;
+  }
+  /// header and shared buffer as one write, without copying the data
+  const Stream::buffer_t bufs[] {
+    create_wsmsg(buffer->size(), code, false),
+    std::move(buffer)
+  };
+  this->stream->writev(bufs, 2);
 }
 bool WebSocket::write_opcode(op_code code, const char* buffer, size_t datalen)
 {
   if (UNLIKELY(stream == nullptr || stream->is_writable() == false)) {
     return false;
   }
-  /// write header
-  auto header = create_wsmsg(datalen, code, clientside);
-  this->stream->write(header);
-  /// write buffer (if present)
+  /// control frames are small, so header and data go in one buffer
+  auto buf = create_wsmsg(datalen, code, clientside);
   if (buffer != nullptr && datalen > 0)
-      this->stream->write(buffer, datalen);
+  {
+    buf->insert(buf->end(), buffer, buffer + datalen);
+    if (clientside)
+    {
+      auto& hdr = *(ws_header*) buf->data();
+      hdr.masking_algorithm(hdr.data());
+    }
+  }
+  this->stream->write(buf);
   return true;
 }
 
@@ -3,6 +3,7 @@
 #include "apic_timer.hpp"
 #include "clocks.hpp"
 #include "idt.hpp"
+#include <kernel/busy_poll.hpp>
 #include <kernel/events.hpp>
 //#include <kernel/os.hpp>
 #include <os.hpp>
@@ -122,7 +123,7 @@ void revenant_main(int cpu)
   while (true)
   {
     Events::get().process_events();
-    os::halt();
+    Busy_poll::get().wait();
   }
   __builtin_unreachable();
 }
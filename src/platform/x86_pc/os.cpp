@@ -22,6 +22,7 @@
 #include <kernel.hpp>
 #include <os.hpp>
 #include <rtc>
+#include <kernel/busy_poll.hpp>
 #include <kernel/events.hpp>
 #include <kernel/memory.hpp>
 #include <kprint>
@@ -171,7 +172,8 @@ void os::event_loop()
 {
   Events::get(0).process_events();
   do {
-    os::halt();
+    // halts, unless there are NICs to busy poll
+    Busy_poll::get().wait();
     Events::get(0).process_events();
   } while (kernel::is_running());
 
@@ -0,0 +1,123 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <posix/epoll_fd.hpp>
+#include <posix/fd_map.hpp>
+#include <errno.h>
+
+// the event bits, EPOLLET and the other flags are in the upper bits
+static constexpr uint32_t EVENT_MASK = 0xffff;
+// reported even when not asked for
+static constexpr uint32_t ALWAYS = EPOLLERR | EPOLLHUP;
+
+int Epoll_FD::close()
+{
+  interest_.clear();
+  return 0;
+}
+
+int Epoll_FD::ctl(int op, int fd, struct epoll_event* event)
+{
+  if (fd == get_id())
+    return -EINVAL;
+  if (FD_map::_get(fd) == nullptr)
+    return -EBADF;
+  if (op != EPOLL_CTL_DEL and event == nullptr)
+    return -EFAULT;
+
+  auto it = interest_.find(fd);
+  switch (op)
+  {
+  case EPOLL_CTL_ADD:
+    if (it != interest_.end())
+      return -EEXIST;
+    interest_.emplace(fd, Interest{*event});
+    return 0;
+  case EPOLL_CTL_MOD:
+    if (it == interest_.end())
+      return -ENOENT;
+    // re-arms edge-triggered and one-shot fds
+    it->second = Interest{*event};
+    return 0;
+  case EPOLL_CTL_DEL:
+    if (it == interest_.end())
+      return -ENOENT;
+    interest_.erase(it);
+    return 0;
+  default:
+    return -EINVAL;
+  }
+}
+
+uint32_t Epoll_FD::check(int fd, Interest& in, bool consume)
+{
+  if (in.disabled)
+    return 0;
+  auto* fildes = FD_map::_get(fd);
+  const uint32_t wanted = in.event.events & EVENT_MASK;
+  uint32_t revents = (uint16_t) fildes->poll_events(wanted) & (wanted | ALWAYS);
+
+  if (in.event.events & EPOLLET)
+  {
+    // only what became ready since it was last reported
+    const uint32_t fresh = revents & ~in.reported;
+    if (consume) in.reported = revents;
+    revents = fresh;
+  }
+  if (revents and consume and (in.event.events & EPOLLONESHOT))
+    in.disabled = true;
+  return revents;
+}
+
+int Epoll_FD::ready(struct epoll_event* events, int max)
+{
+  if (interest_.empty())
+    return 0;
+
+  int count = 0;
+  auto it = interest_.lower_bound(cursor_);
+  for (size_t n = interest_.size(); n > 0 and count < max; n--)
+  {
+    if (it == interest_.end())
+      it = interest_.begin();
+    // closed fds leave the set
+    if (FD_map::_get(it->first) == nullptr) {
+      it = interest_.erase(it);
+      continue;
+    }
+    if (const uint32_t revents = check(it->first, it->second, true); revents)
+    {
+      events[count].events = revents;
+      events[count].data   = it->second.event.data;
+      count++;
+    }
+    ++it;
+  }
+  cursor_ = (it != interest_.end()) ? it->first : 0;
+  return count;
+}
+
+short Epoll_FD::poll_events(short events)
+{
+  for (auto& entry : interest_)
+  {
+    if (FD_map::_get(entry.first) == nullptr) continue;
+    if (check(entry.first, entry.second, false))
+      return events & (POLLIN | POLLRDNORM);
+  }
+  return 0;
+}
@@ -94,16 +94,24 @@ long TCP_FD::connect(const struct sockaddr* address, socklen_t address_len)
 
   auto outgoing = net_stack().tcp().connect({addr, port});
 
-  bool refused = false;
-  outgoing->on_connect([&refused](auto conn) {
-    refused = (conn == nullptr);
-  });
   // O_NONBLOCK is set for the file descriptor for the socket and the connection
   // cannot be immediately established; the connection shall be established asynchronously.
+  // Keep the connection, so poll() can report when it is established (POLLOUT)
   if (this->is_blocking() == false) {
+    this->cd = std::make_unique<TCP_FD_Conn>(outgoing);
+    cd->set_default_read();
+    // a refused connect is reported by poll() (POLLERR) and SO_ERROR
+    outgoing->on_connect([cd = this->cd.get()] (auto conn) {
+      if (conn == nullptr) cd->so_error = ECONNREFUSED;
+    });
     return -EINPROGRESS;
   }
 
+  bool refused = false;
+  outgoing->on_connect([&refused](auto conn) {
+    refused = (conn == nullptr);
+  });
+
   // wait for connection state to change
   while (not (outgoing->is_connected() or
               outgoing->is_closing() or
@@ -210,6 +218,49 @@ int TCP_FD::shutdown(int mode)
   return cd->shutdown(mode);
 }
 
+int TCP_FD::getsockopt(int level, int option_name,
+  void *option_value, socklen_t *option_len)
+{
+  PRINT("TCP: getsockopt(%d, %d)\n", level, option_name);
+  if(level != SOL_SOCKET)
+  {
+    errno = ENOPROTOOPT;
+    return -1;
+  }
+
+  switch(option_name)
+  {
+    case SO_ERROR:
+    {
+      if(*option_len < (int)sizeof(int))
+      {
+        errno = EINVAL;
+        return -1;
+      }
+      // reading the error clears it
+      int err = 0;
+      if (cd) std::swap(err, cd->so_error);
+      *((int*)option_value) = err;
+      *option_len = sizeof(int);
+      return 0;
+    }
+    default:
+      errno = ENOPROTOOPT;
+      return -1;
+  }
+}
+
+short TCP_FD::poll_events(short events)
+{
+  if (this->cd)
+    return cd->poll_events(events);
+  // readable when there are connections to accept
+  if (this->ld)
+    return (ld->connq.empty()) ? 0 : (events & (POLLIN | POLLRDNORM));
+  // not connected, as on Linux
+  return (events & (POLLOUT | POLLWRNORM)) | POLLHUP;
+}
+
 /// socket as connection
 TCP_FD_Conn::TCP_FD_Conn(net::tcp::Connection_ptr c)
   : conn{std::move(c)},
@@ -290,6 +341,23 @@ ssize_t TCP_FD_Conn::recv(void* dest, size_t len, int)
 
   return count;
 }
+short TCP_FD_Conn::poll_events(short events)
+{
+  short revents = 0;
+  if (buffer != nullptr or conn->next_size() > 0)
+    revents |= POLLIN | POLLRDNORM;
+  // reading returns 0 (end of file) when closed
+  if (conn->is_closed() or recv_disc)
+    revents |= POLLIN | POLLRDNORM | POLLHUP;
+  // e.g. a refused connect
+  if (so_error != 0)
+    revents |= POLLERR;
+  // writes are queued, so writable as long as the state allows it
+  else if (conn->is_connected() and conn->is_writable())
+    revents |= POLLOUT | POLLWRNORM;
+
+  return revents & (events | POLLERR | POLLHUP);
+}
 int TCP_FD_Conn::close()
 {
   conn->close();
@@ -186,6 +186,14 @@ ssize_t UDP_FD::sendto(const void* message, size_t len, int,
 
   return len;
 }
+short UDP_FD::poll_events(short events)
+{
+  // datagrams are buffered on arrival, and sending never waits for room
+  short revents = POLLOUT | POLLWRNORM;
+  if (not buffer_.empty())
+    revents |= POLLIN | POLLRDNORM;
+  return revents & events;
+}
 ssize_t UDP_FD::recv(void* buffer, size_t len, int flags)
 {
   PRINT("UDP: recv(%lu, %x)\n", len, flags);
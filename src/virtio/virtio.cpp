@@ -115,6 +115,7 @@ Virtio::Virtio(hw::PCI_Device& dev)
         dev.setup_msix_vector(current_cpu, IRQ_BASE + irq);
         // store IRQ for later
         this->irqs.push_back(irq);
+        this->irq_cpus.push_back(current_cpu);
       }
     }
     else
@@ -173,6 +174,12 @@ uint32_t Virtio::queue_size(uint16_t index) {
 }
 
 bool Virtio::assign_queue(uint16_t index, const void* queue_desc)
+{
+  return assign_queue(index, queue_desc, index);
+}
+
+bool Virtio::assign_queue(uint16_t index, const void* queue_desc,
+                          uint16_t msix_vector)
 {
   hw::outpw(iobase() + VIRTIO_PCI_QUEUE_SEL, index);
   hw::outpd(iobase() + VIRTIO_PCI_QUEUE_PFN, kernel::addr_to_page((uintptr_t) queue_desc));
@@ -180,10 +187,10 @@ bool Virtio::assign_queue(uint16_t index, const void* queue_desc)
   if (_pcidev.has_msix())
   {
     // also update virtio MSI-X queue vector
-    hw::outpw(iobase() + VIRTIO_MSI_QUEUE_VECTOR, index);
+    hw::outpw(iobase() + VIRTIO_MSI_QUEUE_VECTOR, msix_vector);
     // the programming could fail, and the reason is allocation failed on vmm
     // in which case we probably don't wanna continue anyways
-    assert(hw::inpw(iobase() + VIRTIO_MSI_QUEUE_VECTOR) == index);
+    assert(hw::inpw(iobase() + VIRTIO_MSI_QUEUE_VECTOR) == msix_vector);
   }
 
   return hw::inpd(iobase() + VIRTIO_PCI_QUEUE_PFN) == kernel::addr_to_page((uintptr_t) queue_desc);
@@ -206,10 +213,10 @@ void Virtio::move_to_this_cpu()
 {
   if (has_msix())
   {
-    // unsubscribe IRQs on old CPU
+    // unsubscribe IRQs on old CPU(s)
     for (size_t i = 0; i < irqs.size(); i++)
     {
-      auto& oldman = Events::get(this->current_cpu);
+      auto& oldman = Events::get(this->irq_cpus[i]);
       oldman.unsubscribe(this->irqs[i]);
     }
     // resubscribe on the new CPU
@@ -217,11 +224,23 @@ void Virtio::move_to_this_cpu()
     for (size_t i = 0; i < irqs.size(); i++)
     {
       this->irqs[i] = Events::get().subscribe(nullptr);
+      this->irq_cpus[i] = current_cpu;
       _pcidev.rebalance_msix_vector(i, current_cpu, IRQ_BASE + this->irqs[i]);
     }
   }
 }
 
+uint8_t Virtio::route_msix_vector(uint16_t index, int cpu)
+{
+  Expects(has_msix() and index < irqs.size());
+  Events::get(this->irq_cpus[index]).unsubscribe(this->irqs[index]);
+
+  this->irqs[index] = Events::get(cpu).subscribe(nullptr);
+  this->irq_cpus[index] = cpu;
+  _pcidev.rebalance_msix_vector(index, cpu, IRQ_BASE + this->irqs[index]);
+  return this->irqs[index];
+}
+
 void Virtio::setup_complete(bool ok)
 {
   uint8_t value = hw::inp(_iobase + VIRTIO_PCI_STATUS);
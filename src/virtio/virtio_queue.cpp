@@ -159,34 +159,53 @@ Virtio::Token Virtio::Queue::dequeue()
   return {{(uint8_t*) _queue.desc[e.id].addr, e.len }, Token::IN};
 }
 
+// with EVENT_IDX the flag is ignored by the device, and leaving used_event
+// behind the used index keeps it from interrupting until it is moved again
 void Virtio::Queue::disable_interrupts() {
-  _queue.avail->flags |= (1 << VIRTQ_AVAIL_F_NO_INTERRUPT);
+  _queue.avail->flags |= VIRTQ_AVAIL_F_NO_INTERRUPT;
 }
-void Virtio::Queue::enable_interrupts() {
-  _queue.avail->flags &= ~(1 << VIRTQ_AVAIL_F_NO_INTERRUPT);
+bool Virtio::Queue::enable_interrupts() {
+  _queue.avail->flags &= ~VIRTQ_AVAIL_F_NO_INTERRUPT;
+  if (_event_idx) used_event() = _last_used_idx;
+  __arch_hw_barrier();
+  // buffers used before the device saw used_event will not interrupt
+  return new_incoming() == 0;
+}
+void Virtio::Queue::enable_interrupts_delayed() {
+  _queue.avail->flags &= ~VIRTQ_AVAIL_F_NO_INTERRUPT;
+  if (_event_idx) {
+    const uint16_t pending = (uint16_t) (_queue.avail->idx + _num_added - _last_used_idx);
+    used_event() = _last_used_idx + pending * 3 / 4;
+  }
+  __arch_hw_barrier();
 }
 bool Virtio::Queue::interrupts_enabled() const noexcept {
-  return (_queue.avail->flags & (1 << VIRTQ_AVAIL_F_NO_INTERRUPT)) == 0;
+  return (_queue.avail->flags & VIRTQ_AVAIL_F_NO_INTERRUPT) == 0;
 }
 
 // this will force most of the implementation to not use PCI
 // and thus be more easily testable
 #include <hw/pci.hpp>
-void Virtio::Queue::kick()
+bool Virtio::Queue::kick()
 {
+  const uint16_t old_idx = _queue.avail->idx;
   update_avail_idx();
-#if defined (PLATFORM_UNITTEST)
-  // do nothing here
-#elif defined(ARCH_x86)
   // Std. §3.2.1 pt. 4
   __arch_hw_barrier();
-  if (!(_queue.used->flags & VIRTQ_USED_F_NO_NOTIFY)){
-    debug("<%s> Kicking virtio. Iobase 0x%x \n", qname.c_str(), _iobase);
-    hw::outpw(_iobase + VIRTIO_PCI_QUEUE_NOTIFY , _pci_index);
-  }else{
+  const bool notify = (_event_idx)
+    ? need_event(avail_event(), _queue.avail->idx, old_idx)
+    : !(_queue.used->flags & VIRTQ_USED_F_NO_NOTIFY);
+  if (not notify) {
     debug("<%s> Virtio device says we can't kick!\n", qname.c_str());
+    return false;
   }
+#if defined (PLATFORM_UNITTEST)
+  // do nothing here
+#elif defined(ARCH_x86)
+  debug("<%s> Kicking virtio. Iobase 0x%x \n", qname.c_str(), _iobase);
+  hw::outpw(_iobase + VIRTIO_PCI_QUEUE_NOTIFY , _pci_index);
 #else
 #warning "kick() not implemented for selected arch"
 #endif
+  return true;
 }
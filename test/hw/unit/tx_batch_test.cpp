@@ -0,0 +1,59 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2016-2017 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <common.cxx>
+#include <hw/tx_batch.hpp>
+
+CASE("Tx_batch rings the doorbell on thresholds")
+{
+  hw::Tx_batch batch {64};
+  EXPECT(not batch.pending());
+  // a quarter of the ring
+  for (int i = 0; i < 15; i++)
+    EXPECT(not batch.add(100));
+  EXPECT(batch.pending());
+  EXPECT(batch.add(100));
+  batch.rung();
+  EXPECT(not batch.pending());
+
+  // or enough bytes
+  EXPECT(not batch.add(60000));
+  EXPECT(batch.add(9000));
+}
+
+CASE("Tx_batch wants interrupts when the ring fills up")
+{
+  EXPECT(not hw::Tx_batch::want_interrupt(0, 256, false));
+  EXPECT(not hw::Tx_batch::want_interrupt(191, 256, false));
+  EXPECT(hw::Tx_batch::want_interrupt(192, 256, false));
+  EXPECT(hw::Tx_batch::want_interrupt(0, 256, true));
+}
+
+CASE("Tx_stats counts per packet")
+{
+  hw::Tx_stats stats {"tx_batch_test"};
+  stats.packets(4);
+  stats.kick();
+  stats.irq();
+  stats.irq();
+  EXPECT(stats.kicks() == 1u);
+  EXPECT(stats.irqs() == 2u);
+  auto& kpp = Statman::get().get_by_name("tx_batch_test.tx_kicks_per_packet");
+  auto& ipp = Statman::get().get_by_name("tx_batch_test.tx_irqs_per_packet");
+  EXPECT(kpp.get_float() == 0.25f);
+  EXPECT(ipp.get_float() == 0.5f);
+}
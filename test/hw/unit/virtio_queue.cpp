@@ -39,7 +39,8 @@ CASE("Virtio Queue enqueue")
 CASE("Virtio Queue interrupts")
 {
   Virtio::Queue q("Test queue", 4096, 0, 0x1000);
-  q.enable_interrupts();
+  // nothing was used meanwhile, so no need to poll again
+  EXPECT(q.enable_interrupts());
   EXPECT(q.interrupts_enabled());
   q.disable_interrupts();
   EXPECT(!q.interrupts_enabled());
@@ -55,3 +56,42 @@ CASE("Virtio Queue dequeue")
   EXPECT(res.size() == 0);
   EXPECT(res.data() == nullptr);
 }
+
+CASE("Virtio Queue event index")
+{
+  // the device asked to be notified when idx passes 10
+  EXPECT(Virtio::Queue::need_event(10, 11, 10));
+  EXPECT(Virtio::Queue::need_event(10, 15, 8));
+  EXPECT(not Virtio::Queue::need_event(10, 10, 8));
+  EXPECT(not Virtio::Queue::need_event(10, 14, 11));
+  // with wrap-around
+  EXPECT(Virtio::Queue::need_event(0xffff, 2, 0xfff0));
+  EXPECT(not Virtio::Queue::need_event(0xfff0, 2, 0xfff1));
+
+  Virtio::Queue q("Test queue", 256, 0, 0x1000);
+  uint8_t buffer[16];
+  Virtio::Token token {{buffer, sizeof(buffer)}, Virtio::Token::OUT };
+  std::array<Virtio::Token, 1> tokens {{ token }};
+
+  // without EVENT_IDX every kick notifies
+  q.enqueue(tokens);
+  EXPECT(q.kick());
+  q.enqueue(tokens);
+  EXPECT(q.kick());
+
+  // with it, only when passing the index the device waits for (0)
+  Virtio::Queue eq("Test queue", 256, 0, 0x1000);
+  eq.set_event_idx(true);
+  EXPECT(eq.event_idx());
+  eq.enqueue(tokens);
+  EXPECT(eq.kick());
+  eq.enqueue(tokens);
+  EXPECT(not eq.kick());
+  // nothing new
+  EXPECT(not eq.kick());
+
+  eq.disable_interrupts();
+  EXPECT(not eq.interrupts_enabled());
+  eq.enable_interrupts_delayed();
+  EXPECT(eq.interrupts_enabled());
+}
@@ -0,0 +1,110 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2016-2017 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <common.cxx>
+#include <kernel/busy_poll.hpp>
+#include <nic_mock.hpp>
+#include <statman>
+using namespace std::chrono;
+
+extern delegate<uint64_t()> systime_override;
+static uint64_t current_time = 1000;
+
+CASE("Busy polled NICs have their interrupts off")
+{
+  Nic_mock nic;
+  auto& bp = Busy_poll::get();
+  EXPECT(not bp.active());
+  EXPECT(not nic.busy_poll(0));
+
+  bp.add(nic);
+  EXPECT(bp.active());
+  EXPECT(nic.busy_poll(0));
+
+  // removing it re-arms the interrupts with one last poll
+  const int polls = nic.polls_;
+  bp.remove(nic);
+  EXPECT(not bp.active());
+  EXPECT(not nic.busy_poll(0));
+  EXPECT(nic.polls_ == polls + 1);
+}
+
+CASE("Busy polling reports its efficiency")
+{
+  Nic_mock nic;
+  auto& bp = Busy_poll::get();
+  bp.add(nic);
+  const uint64_t polls = bp.polls();
+
+  nic.poll_work_ = 1;
+  EXPECT(bp.poll() == true);
+  EXPECT(bp.poll() == false);
+  EXPECT(bp.poll() == false);
+  EXPECT(bp.polls() == polls + 3);
+  EXPECT(bp.efficiency() > 0.0f);
+  EXPECT(bp.efficiency() <= 1.0f);
+
+  auto& stat = Statman::get().get_by_name("cpu0.busy_poll.polls");
+  EXPECT(stat.get_uint64() == bp.polls());
+  auto& eff = Statman::get().get_by_name("cpu0.busy_poll.efficiency");
+  EXPECT(eff.get_float() == bp.efficiency());
+  bp.remove(nic);
+}
+
+CASE("Busy polling backs off to halting when idle")
+{
+  systime_override =
+    [] () -> uint64_t { return current_time; };
+
+  Nic_mock nic;
+  auto& bp = Busy_poll::get();
+  bp.set_idle_timeout(microseconds(100));
+  bp.add(nic);
+  const uint64_t halts = bp.halts();
+
+  // idle, but not for long enough
+  bp.wait();
+  current_time += 50'000;
+  bp.wait();
+  EXPECT(bp.halts() == halts);
+  EXPECT(nic.busy_poll(0));
+
+  // work resets the idle time
+  nic.poll_work_ = 1;
+  current_time += 60'000;
+  bp.wait();
+  bp.wait();
+  EXPECT(bp.halts() == halts);
+
+  // idle for longer than the timeout halts, and polls again after
+  current_time += 150'000;
+  bp.wait();
+  EXPECT(bp.halts() == halts + 1);
+  EXPECT(nic.busy_poll(0));
+
+  // no halting when work arrived just before
+  bp.wait();
+  current_time += 150'000;
+  nic.poll_work_ = 1;
+  bp.wait();
+  EXPECT(bp.halts() == halts + 1);
+
+  bp.remove(nic);
+  bp.set_idle_timeout(Busy_poll::DEFAULT_IDLE_TIMEOUT);
+  systime_override =
+    [] () -> uint64_t { return 0; };
+}
@@ -156,6 +156,162 @@ CASE("Test a periodic timer")
   current_time = 0;
 }
 
+CASE("Restart a timer")
+{
+  current_time = 0;
+  magic_performed = 0;
+  // start timer, then move it later
+  int id = Timers::oneshot(1ms, perform_magic);
+  EXPECT(Timers::restart(id, 2ms));
+  EXPECT(Timers::active() == 1);
+  current_time = 1000000;
+  Timers::timers_handler();
+  EXPECT(magic_performed == 0);
+  EXPECT(Timers::active() == 1);
+  current_time = 2000000;
+  Timers::timers_handler();
+  EXPECT(magic_performed == 1);
+  // restarting an expired timer fails
+  EXPECT(Timers::restart(id, 1ms) == false);
+
+  // start timer, then move it earlier
+  id = Timers::oneshot(5ms, perform_magic);
+  EXPECT(Timers::restart(id, 1ms));
+  current_time = 3000000;
+  Timers::timers_handler();
+  EXPECT(magic_performed == 2);
+  EXPECT(Timers::active() == 0);
+  current_time = 0;
+}
+
+#include <util/timer_wheel.hpp>
+#include <random>
+CASE("Timer wheel expires every deadline exactly once")
+{
+  Timer_wheel<10, 3> wheel;
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<int64_t> dist(0, 1LL << 34);
+  static const int N = 10000;
+  std::vector<int64_t> deadline(N);
+  std::vector<int64_t> fired(N, -1);
+
+  for (int i = 0; i < N; i++) {
+    deadline[i] = dist(rng);
+    wheel.insert(i, deadline[i]);
+  }
+  // move every other deadline later, and every third earlier
+  for (int i = 0; i < N; i += 2) {
+    deadline[i] += dist(rng) / 4;
+    wheel.update(i, deadline[i]);
+  }
+  for (int i = 0; i < N; i += 3) {
+    deadline[i] /= 2;
+    wheel.update(i, deadline[i]);
+  }
+  // stop a few
+  for (int i = 1; i < N; i += 7) {
+    EXPECT(wheel.erase(i));
+    deadline[i] = -1;
+  }
+  EXPECT(wheel.erase(1) == false);
+
+  int64_t now = 0;
+  while (!wheel.empty())
+  {
+    const int64_t next = wheel.next();
+    EXPECT(next >= now);
+    now = next + dist(rng) % 5000;
+    wheel.expire(now, [&] (int id) {
+      EXPECT(fired[id] == -1);
+      fired[id] = now;
+    });
+  }
+  for (int i = 0; i < N; i++) {
+    if (deadline[i] < 0) {
+      EXPECT(fired[i] == -1);
+      continue;
+    }
+    // never early, and at the latest by the wakeup after the deadline
+    EXPECT(fired[i] >= deadline[i]);
+    EXPECT(fired[i] < deadline[i] + 5000);
+  }
+}
+
+CASE("Timer wheel re-hashes deadlines beyond its range")
+{
+  Timer_wheel<0, 1> wheel;
+  int64_t now = 0, fired = -1;
+  wheel.insert(0, 100000);
+  while (!wheel.empty())
+  {
+    // woken up at most 256 ticks apart, to re-hash the deadline
+    const int64_t next = wheel.next();
+    EXPECT(next > now);
+    EXPECT(next <= now + 256);
+    now = next;
+    wheel.expire(now, [&] (int) { fired = now; });
+  }
+  EXPECT(fired == 100000);
+}
+
+CASE("Timer wheel wakes up for a cascade before a later level 0 deadline")
+{
+  Timer_wheel<0, 2> wheel;
+  int64_t fired = -1;
+  wheel.insert(1, 300);
+  EXPECT(wheel.expire(250, [] (int) {}) == 0u);
+  wheel.insert(2, 500);
+  // 1 is still in the upper wheel, and comes down at tick 256
+  EXPECT(wheel.next() == 256);
+  wheel.expire(256, [&] (int) {});
+  EXPECT(wheel.next() == 300);
+  wheel.expire(300, [&] (int id) { fired = id; });
+  EXPECT(fired == 1);
+  EXPECT(wheel.next() == 500);
+}
+
+#include <map>
+CASE("Benchmark timer restarts, timer wheel versus multimap")
+{
+  static const int N = 100000;
+  static const int ROUNDS = 5;
+  using clock = std::chrono::steady_clock;
+  std::vector<int64_t> deadline(N);
+  for (int i = 0; i < N; i++) deadline[i] = 200000000 + i * 1000;
+
+  // the previous schedule, where restarts are a search, erase and insert
+  auto t0 = clock::now();
+  std::multimap<int64_t, int> tree;
+  for (int i = 0; i < N; i++) tree.emplace(deadline[i], i);
+  for (int r = 1; r <= ROUNDS; r++)
+  for (int i = 0; i < N; i++) {
+    auto it = tree.find(deadline[i]);
+    while (it->second != i) ++it;
+    tree.erase(it);
+    deadline[i] += 1000000;
+    tree.emplace(deadline[i], i);
+  }
+  auto tree_time = clock::now() - t0;
+
+  for (int i = 0; i < N; i++) deadline[i] = 200000000 + i * 1000;
+  t0 = clock::now();
+  Timer_wheel<> wheel;
+  for (int i = 0; i < N; i++) wheel.insert(i, deadline[i]);
+  for (int r = 1; r <= ROUNDS; r++)
+  for (int i = 0; i < N; i++) {
+    deadline[i] += 1000000;
+    wheel.update(i, deadline[i]);
+  }
+  auto wheel_time = clock::now() - t0;
+
+  EXPECT(tree.size() == wheel.size());
+  using std::chrono::duration_cast;
+  printf("%d timers, %d restarts each: multimap %lld us, timer wheel %lld us\n",
+         N, ROUNDS,
+         (long long) duration_cast<microseconds>(tree_time).count(),
+         (long long) duration_cast<microseconds>(wheel_time).count());
+}
+
 #include <util/timer.hpp>
 CASE("Test util timer")
 {
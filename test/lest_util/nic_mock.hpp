@@ -123,6 +123,9 @@ public:
   static constexpr size_t frame_offs_link_ = 14;
 
   std::vector<net::Packet_ptr> tx_queue_;
+  // number of polls, and how many of the next ones find work
+  int polls_ = 0;
+  int poll_work_ = 0;
 
   void transmit_link(net::Packet_ptr pkt, MAC::Addr, net::Ethertype)
   {
@@ -146,7 +149,13 @@ public:
   }
 
   void flush() override {}
-  void poll() override {}
+  bool poll() override
+  {
+    polls_++;
+    if (poll_work_ == 0) return false;
+    poll_work_--;
+    return true;
+  }
 
 private:
   net::BufferStore bufstore_;
@@ -18,6 +18,7 @@
 #include <common.cxx>
 #include <net/buffer_store.hpp>
 #include <stdlib.h>
+#include <algorithm>
 
 using namespace net;
 #define BUFFER_CNT 32
@@ -52,3 +53,43 @@ CASE("Randomly release bufferstore buffers")
     EXPECT(bufstore.available() == BUFFER_CNT * BS_CHAINS);
   }
 }
+
+CASE("Bufferstore only accepts its own buffers")
+{
+  BufferStore bufstore(BUFFER_CNT, BUFFER_SZ);
+  BufferStore other(BUFFER_CNT, BUFFER_SZ);
+
+  auto* buffer = bufstore.get_buffer();
+  auto* foreign = other.get_buffer();
+  EXPECT(bufstore.is_valid(buffer));
+  EXPECT(not bufstore.is_valid(buffer + 1));
+  EXPECT(not bufstore.is_valid(foreign));
+  EXPECT(other.is_valid(foreign));
+  EXPECT_THROWS(bufstore.release(foreign));
+
+  bufstore.release(buffer);
+  other.release(foreign);
+  EXPECT(bufstore.available() == BUFFER_CNT);
+  EXPECT(other.available() == BUFFER_CNT);
+}
+
+CASE("Bufferstore buffers cycle through the CPU cache and depot")
+{
+  BufferStore bufstore(BUFFER_CNT * 4, BUFFER_SZ);
+  std::vector<uint8_t*> buffers;
+
+  // allocate more than one magazine worth, forcing refills
+  for (int i = 0; i < BUFFER_CNT * 3; i++) {
+    buffers.push_back(bufstore.get_buffer());
+    EXPECT(bufstore.buffers_in_use() == buffers.size());
+  }
+  // all buffers are unique
+  std::sort(buffers.begin(), buffers.end());
+  EXPECT(std::unique(buffers.begin(), buffers.end()) == buffers.end());
+
+  // release all of them, forcing drains
+  for (auto* buffer : buffers) bufstore.release(buffer);
+  EXPECT(bufstore.buffers_in_use() == 0);
+  EXPECT(bufstore.available() == BUFFER_CNT * 4);
+  EXPECT(bufstore.total_buffers() == BUFFER_CNT * 4);
+}
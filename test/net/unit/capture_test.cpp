@@ -0,0 +1,209 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2017 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <packet_factory.hpp>
+#include <common.cxx>
+#include <net/capture.hpp>
+#include <cstring>
+
+using namespace net;
+
+// tcpdump -dd "udp dst port 53"
+static const Bpf::Program udp_dst_53 {
+  { 0x28, 0, 0, 0x0000000c },
+  { 0x15, 0, 4, 0x000086dd },
+  { 0x30, 0, 0, 0x00000014 },
+  { 0x15, 0, 11, 0x00000011 },
+  { 0x28, 0, 0, 0x00000038 },
+  { 0x15, 8, 9, 0x00000035 },
+  { 0x15, 0, 8, 0x00000800 },
+  { 0x30, 0, 0, 0x00000017 },
+  { 0x15, 0, 6, 0x00000011 },
+  { 0x28, 0, 0, 0x00000014 },
+  { 0x45, 4, 0, 0x00001fff },
+  { 0xb1, 0, 0, 0x0000000e },
+  { 0x48, 0, 0, 0x00000010 },
+  { 0x15, 0, 1, 0x00000035 },
+  { 0x6, 0, 0, 0x00040000 },
+  { 0x6, 0, 0, 0x00000000 },
+};
+
+// an ethernet frame with an IPv4 header and 8 bytes of UDP or TCP
+static Packet_ptr frame(uint8_t proto, uint16_t dport, int payload = 0)
+{
+  auto pkt = create_packet();
+  const int len = 14 + 20 + 8 + payload;
+  pkt->set_data_end(len);
+  auto* p = pkt->layer_begin();
+  std::memset(p, 0, len);
+  p[12] = 0x08; p[13] = 0x00;
+  p[14] = 0x45;
+  p[14 + 9] = proto;
+  p[34 + 2] = dport >> 8;
+  p[34 + 3] = dport & 0xff;
+  for (int i = 0; i < payload; i++) p[42 + i] = i;
+  return pkt;
+}
+
+static uint32_t word(const os::mem::buffer& buf, size_t off)
+{
+  uint32_t v;
+  std::memcpy(&v, buf.data() + off, 4);
+  return v;
+}
+
+CASE("BPF programs are validated when loaded")
+{
+  using B = Bpf;
+  EXPECT(Bpf::validate(udp_dst_53) == nullptr);
+  // no return at the end
+  EXPECT(Bpf::validate({B::stmt(B::LD|B::W|B::LEN, 0)}) != nullptr);
+  EXPECT_THROWS_AS(Bpf(Bpf::Program{}), Bpf_error);
+  // jumps past the end
+  EXPECT_THROWS_AS(Bpf({B::jump(B::JMP|B::JEQ|B::K, 1, 0, 1),
+                        B::stmt(B::RET|B::K, 0)}), Bpf_error);
+  EXPECT_THROWS_AS(Bpf({B::stmt(B::JMP|B::JA, 5),
+                        B::stmt(B::RET|B::K, 0)}), Bpf_error);
+  // scratch memory out of range, division by zero, unknown opcodes
+  EXPECT_THROWS_AS(Bpf({B::stmt(B::ST, B::MEMWORDS),
+                        B::stmt(B::RET|B::K, 0)}), Bpf_error);
+  EXPECT_THROWS_AS(Bpf({B::stmt(B::ALU|B::DIV|B::K, 0),
+                        B::stmt(B::RET|B::K, 0)}), Bpf_error);
+  EXPECT_THROWS_AS(Bpf({B::stmt(0xffff, 0),
+                        B::stmt(B::RET|B::K, 0)}), Bpf_error);
+}
+
+CASE("BPF filters packets like tcpdump")
+{
+  const Bpf filter {udp_dst_53};
+  auto dns  = frame(17, 53);
+  auto http = frame(6, 80);
+  auto udp  = frame(17, 54);
+  EXPECT(filter.run(dns->layer_begin(), dns->size(), dns->size()) == (uint32_t) dns->size());
+  EXPECT(filter.run(http->layer_begin(), http->size(), http->size()) == 0u);
+  EXPECT(filter.run(udp->layer_begin(), udp->size(), udp->size()) == 0u);
+  // loads past the data reject the packet
+  EXPECT(filter.run(dns->layer_begin(), 30, 30) == 0u);
+
+  // the default filter keeps everything
+  EXPECT(Bpf{}.run(http->layer_begin(), http->size(), 1000) == 1000u);
+
+  // scratch memory, the index register and arithmetic
+  using B = Bpf;
+  const Bpf calc {{
+    B::stmt(B::LD|B::B|B::ABS, 14),
+    B::stmt(B::ALU|B::AND|B::K, 0xf),
+    B::stmt(B::ALU|B::LSH|B::K, 2),
+    B::stmt(B::ST, 3),
+    B::stmt(B::LDX|B::MEM, 3),
+    B::stmt(B::MISC|B::TXA, 0),
+    B::stmt(B::ALU|B::ADD|B::K, 14),
+    B::stmt(B::RET|B::A, 0)
+  }};
+  EXPECT(calc.run(dns->layer_begin(), dns->size(), dns->size()) == 34u);
+}
+
+CASE("Capture writes pcapng with snap length and direction")
+{
+  Capture cap {"eth0", {4, 40}, Bpf{udp_dst_53}};
+  EXPECT(cap.snaplen() == 40u);
+  EXPECT(not cap.pending());
+
+  // a chain, with one packet rejected by the filter
+  auto chain = frame(17, 53, 100);
+  chain->chain(frame(6, 80));
+  cap.capture(chain.get(), Capture::Direction::IN);
+  auto out = frame(17, 53, 1);
+  cap.capture(out.get(), Capture::Direction::OUT);
+  EXPECT(cap.captured() == 2u);
+  EXPECT(cap.filtered() == 1u);
+  EXPECT(cap.pending());
+
+  os::mem::buffer buf;
+  EXPECT(cap.read(buf) == 2u);
+  EXPECT(not cap.pending());
+
+  // section header, then the interface
+  EXPECT(word(buf, 0) == Capture::BLOCK_SHB);
+  EXPECT(word(buf, 8) == 0x1A2B3C4Du);
+  size_t off = word(buf, 4);
+  EXPECT(word(buf, off) == Capture::BLOCK_IDB);
+  EXPECT(word(buf, off + 12) == 40u);
+  const uint32_t idb_len = word(buf, off + 4);
+  EXPECT(idb_len % 4 == 0u);
+  EXPECT(word(buf, off + idb_len - 4) == idb_len);
+  off += idb_len;
+
+  // the first packet is cut at the snap length
+  EXPECT(word(buf, off) == Capture::BLOCK_EPB);
+  const uint32_t len1 = word(buf, off + 4);
+  EXPECT(word(buf, off + 20) == 40u);
+  EXPECT(word(buf, off + 24) == 142u);
+  EXPECT(buf[off + 28 + 12] == 0x08);
+  EXPECT(word(buf, off + 28 + 40 + 4) == (uint32_t) Capture::Direction::IN);
+  EXPECT(word(buf, off + len1 - 4) == len1);
+  off += len1;
+
+  // the second is padded to 32 bits
+  EXPECT(word(buf, off) == Capture::BLOCK_EPB);
+  const uint32_t len2 = word(buf, off + 4);
+  EXPECT(word(buf, off + 20) == 40u);
+  EXPECT(word(buf, off + 24) == 43u);
+  EXPECT(word(buf, off + 28 + 40 + 4) == (uint32_t) Capture::Direction::OUT);
+  EXPECT(off + len2 == buf.size());
+
+  // the header is only written once
+  buf.clear();
+  EXPECT(cap.read(buf) == 0u);
+  EXPECT(buf.empty());
+}
+
+CASE("Capture drops packets when the ring is full")
+{
+  Capture cap {"eth1", {3, 64}};
+  auto pkt = frame(6, 80);
+  for (int i = 0; i < 6; i++)
+    cap.capture(pkt.get(), Capture::Direction::IN);
+  // rounded up to 4 slots
+  EXPECT(cap.captured() == 4u);
+  EXPECT(cap.dropped() == 2u);
+
+  os::mem::buffer buf;
+  EXPECT(cap.read(buf, 3) == 3u);
+  // room for the next lap
+  cap.capture(pkt.get(), Capture::Direction::OUT);
+  cap.capture(pkt.get(), Capture::Direction::OUT);
+  EXPECT(cap.captured() == 6u);
+  EXPECT(cap.read(buf) == 3u);
+  EXPECT(not cap.pending());
+}
+
+CASE("Scatter-gather payload is captured after the buffer")
+{
+  Capture cap {"eth0", {4, 128}};
+  auto pkt = frame(17, 53);
+  static const uint8_t ext[] = {0xde, 0xad, 0xbe, 0xef};
+  pkt->set_ext_payload(nullptr, ext, sizeof(ext));
+  cap.capture(pkt.get(), Capture::Direction::OUT);
+
+  os::mem::buffer buf;
+  EXPECT(cap.read(buf) == 1u);
+  const size_t epb = 28 + word(buf, 28 + 4);
+  EXPECT(word(buf, epb + 20) == 46u);
+  EXPECT(word(buf, epb + 24) == 46u);
+  EXPECT(std::memcmp(&buf[epb + 28 + 42], ext, sizeof(ext)) == 0);
+}
@@ -208,3 +208,59 @@ CASE("Testing Conntrack serialization")
 
   EXPECT(ct->number_of_entries() == 4);
 }
+
+CASE("Testing Conntrack incremental expiry")
+{
+  using namespace net;
+  const Protocol proto{Protocol::UDP};
+  Conntrack ct;
+  // everything expires right away
+  ct.timeout.unconfirmed.udp = Conntrack::Timeout_duration{0};
+
+  std::vector<Quadruple> quads;
+  for(uint16_t port = 1000; port < 1010; port++)
+  {
+    quads.emplace_back(Socket{ip4::Addr{10,0,0,42}, port}, Socket{ip4::Addr{10,0,0,1}, 80});
+    EXPECT(ct.simple_track_in(quads.back(), proto) != nullptr);
+  }
+  // one that lives on
+  Quadruple alive{{ip4::Addr{10,0,0,43}, 2000}, {ip4::Addr{10,0,0,1}, 80}};
+  ct.timeout.unconfirmed.udp = Conntrack::Timeout_duration{600};
+  EXPECT(ct.simple_track_in(alive, proto) != nullptr);
+  EXPECT(ct.number_of_entries() == 22);
+
+  int closed = 0;
+  for(auto& q : quads)
+    ct.get(q, proto)->on_close = [&closed](auto*){ closed++; };
+
+  // reclaimed a few at a time
+  EXPECT(ct.reap(4) == 4);
+  EXPECT(ct.pending_reaps() == 6);
+  EXPECT(closed == 4);
+  EXPECT(ct.number_of_entries() == 14);
+
+  // an entry seen again before it is reclaimed is kept
+  Quadruple revived{};
+  for(auto& q : quads) {
+    if(ct.get(q, proto) != nullptr) { revived = q; break; }
+  }
+  auto* entry = ct.get(revived, proto);
+  EXPECT(entry != nullptr);
+  EXPECT(ct.simple_track_in(revived, proto) == entry);
+
+  EXPECT(ct.reap(100) == 5);
+  EXPECT(ct.pending_reaps() == 0);
+  EXPECT(closed == 9);
+  EXPECT(ct.get(revived, proto) == entry);
+  EXPECT(ct.get(alive, proto) != nullptr);
+  EXPECT(ct.number_of_entries() == 4);
+
+  // nothing is due
+  EXPECT(ct.reap(100) == 0);
+
+  // freed entries are reused
+  ct.timeout.unconfirmed.udp = Conntrack::Timeout_duration{0};
+  Quadruple fresh{{ip4::Addr{10,0,0,44}, 3000}, {ip4::Addr{10,0,0,1}, 80}};
+  EXPECT(ct.simple_track_in(fresh, proto) != nullptr);
+  EXPECT(ct.get(fresh, proto)->id < 10);
+}
@@ -0,0 +1,79 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <common.cxx>
+#include <net/flow_table.hpp>
+#include <net/ip4/addr.hpp>
+#include <chrono>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+using namespace net;
+using Flow = std::pair<Socket, Socket>;
+
+// a server socket with clients from a /16, like the TCP connection table
+static Flow make_flow(uint32_t n)
+{
+  const Socket local {ip4::Addr{10,0,0,1}, 80};
+  const Socket remote {ip4::Addr{10,1, uint8_t(n >> 8), uint8_t(n)},
+                       uint16_t(1024 + (n >> 16))};
+  return {local, remote};
+}
+
+/**
+ * Demux microbenchmark: lookups of existing flows in random order,
+ * with Flow_table and with std::unordered_map as TCP used before.
+ */
+template <typename Table>
+static double ns_per_lookup(const Table& table, const std::vector<uint32_t>& order)
+{
+  using namespace std::chrono;
+  const auto t0 = high_resolution_clock::now();
+  size_t found = 0;
+  for (auto n : order)
+    found += table.find(make_flow(n))->second == n;
+  const auto t1 = high_resolution_clock::now();
+  assert(found == order.size());
+  return duration_cast<nanoseconds>(t1 - t0).count() / (double) order.size();
+}
+
+CASE("Flow_table demux benchmark")
+{
+  static const size_t LOOKUPS = 1000000;
+  for (const uint32_t count : {10000u, 100000u, 1000000u})
+  {
+    std::mt19937 rng{count};
+    std::vector<uint32_t> order(LOOKUPS);
+    for (auto& n : order) n = rng() % count;
+
+    double flow_ns, map_ns;
+    {
+      Flow_table<Flow, uint32_t> table;
+      for (uint32_t n = 0; n < count; n++) table.emplace(make_flow(n), n);
+      EXPECT(table.size() == count);
+      flow_ns = ns_per_lookup(table, order);
+    }
+    {
+      std::unordered_map<Flow, uint32_t, Flow_hash> map;
+      for (uint32_t n = 0; n < count; n++) map.emplace(make_flow(n), n);
+      map_ns = ns_per_lookup(map, order);
+    }
+    printf("%8u flows: Flow_table %6.1f ns/lookup, unordered_map %6.1f ns/lookup\n",
+           count, flow_ns, map_ns);
+  }
+}
@@ -0,0 +1,135 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <common.cxx>
+#include <net/flow_table.hpp>
+#include <net/port_table.hpp>
+#include <net/ip4/addr.hpp>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+using namespace net;
+using Flow = std::pair<Socket, Socket>;
+
+// a server socket with clients from a /16, like the TCP connection table
+static Flow make_flow(uint32_t n)
+{
+  const Socket local {ip4::Addr{10,0,0,1}, 80};
+  const Socket remote {ip4::Addr{10,1, uint8_t(n >> 8), uint8_t(n)},
+                       uint16_t(1024 + (n >> 16))};
+  return {local, remote};
+}
+
+CASE("Flow_table insert, find and erase")
+{
+  Flow_table<Flow, int> table;
+  EXPECT(table.empty());
+  EXPECT(table.find(make_flow(1)) == table.end());
+
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    auto res = table.emplace(make_flow(i), i);
+    EXPECT(res.second);
+    EXPECT(res.first->second == i);
+  }
+  EXPECT(table.size() == (size_t) N);
+  // no duplicates, and the existing value is kept
+  auto res = table.emplace(make_flow(7), 1234);
+  EXPECT(not res.second);
+  EXPECT(res.first->second == 7);
+
+  for (int i = 0; i < N; i++) {
+    auto it = table.find(make_flow(i));
+    EXPECT(it != table.end());
+    EXPECT(it->second == i);
+  }
+  EXPECT(table.find(make_flow(N)) == table.end());
+
+  // erase every other, the rest is still found
+  for (int i = 0; i < N; i += 2)
+    EXPECT(table.erase(make_flow(i)) == 1u);
+  EXPECT(table.erase(make_flow(0)) == 0u);
+  EXPECT(table.size() == (size_t) N / 2);
+  for (int i = 0; i < N; i++)
+    EXPECT((table.find(make_flow(i)) != table.end()) == (i % 2 == 1));
+
+  // iteration visits every entry once
+  int count = 0;
+  long sum = 0;
+  for (const auto& entry : table) {
+    count++;
+    sum += entry.second;
+  }
+  EXPECT(count == N / 2);
+  EXPECT(sum == (long) (N / 2) * (N / 2));
+
+  table.clear();
+  EXPECT(table.empty());
+  EXPECT(table.begin() == table.end());
+}
+
+CASE("Flow_table matches std::unordered_map under churn")
+{
+  Flow_table<Flow, uint32_t> table;
+  std::unordered_map<Flow, uint32_t> reference;
+  std::mt19937 rng{42};
+
+  // random inserts and erases keep tombstones around, and force rehashes
+  for (int i = 0; i < 200000; i++)
+  {
+    const uint32_t n = rng() % 5000;
+    const auto flow = make_flow(n);
+    if (rng() % 3 == 0) {
+      EXPECT(table.erase(flow) == reference.erase(flow));
+    }
+    else {
+      const bool inserted = table.emplace(flow, n).second;
+      EXPECT(inserted == reference.emplace(flow, n).second);
+    }
+  }
+  EXPECT(table.size() == reference.size());
+  // the table only grows for live entries
+  EXPECT(table.capacity() <= 16384u);
+  for (const auto& entry : reference) {
+    auto it = table.find(entry.first);
+    EXPECT(it != table.end());
+    EXPECT(it->second == entry.second);
+  }
+  size_t count = 0;
+  for (auto it = table.begin(); it != table.end(); ++it) {
+    EXPECT(reference.count(it->first) == 1u);
+    count++;
+  }
+  EXPECT(count == reference.size());
+}
+
+CASE("Port_table allocates pages on use")
+{
+  Port_table<std::vector<int>> ports;
+  EXPECT(ports.find(80) == nullptr);
+  ports[80].push_back(1);
+  ports[81].push_back(2);
+  EXPECT(ports.find(80) != nullptr);
+  EXPECT(ports.find(80)->size() == 1u);
+  // same page, but nothing bound
+  EXPECT(ports.find(82) != nullptr);
+  EXPECT(ports.find(82)->empty());
+  EXPECT(ports.find(65535) == nullptr);
+  ports[65535].push_back(3);
+  EXPECT(ports.find(65535)->front() == 3);
+}
@@ -0,0 +1,372 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2017 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <common.cxx>
+#include <net/http2/connection.hpp>
+#include <net/http/response_writer.hpp>
+#include <map>
+#include <vector>
+
+using namespace http2;
+
+// the transport, keeping what is written to it
+class Loop_stream : public net::Stream {
+public:
+  void on_connect(ConnectCallback) override {}
+  void on_read(size_t, ReadCallback) override {}
+  void on_data(DataCallback) override {}
+  size_t next_size() override { return 0; }
+  buffer_t read_next() override { return nullptr; }
+  void on_close(CloseCallback) override {}
+  void on_write(WriteCallback) override {}
+  void write(const void* buf, size_t n) override
+  { out.append((const char*) buf, n); writes++; }
+  void write(buffer_t buf) override
+  { write(buf->data(), buf->size()); }
+  void write(const std::string& str) override
+  { write(str.data(), str.size()); }
+  void close() override { closed = true; }
+  void reset_callbacks() override {}
+  net::Socket local() const override { return {}; }
+  net::Socket remote() const override { return {}; }
+  std::string to_string() const override { return "loop"; }
+  bool is_connected() const noexcept override { return not closed; }
+  bool is_writable() const noexcept override { return not closed; }
+  bool is_readable() const noexcept override { return not closed; }
+  bool is_closing() const noexcept override { return closed; }
+  bool is_closed() const noexcept override { return closed; }
+  int get_cpuid() const noexcept override { return 0; }
+  net::Stream* transport() noexcept override { return nullptr; }
+
+  std::string out;
+  int  writes = 0;
+  bool closed = false;
+};
+
+struct Frame {
+  Frame_header hdr;
+  std::string  payload;
+};
+
+// the frames written since last time
+static std::vector<Frame> frames(Loop_stream& s)
+{
+  std::vector<Frame> list;
+  size_t off = 0;
+  while (off + Frame_header::SIZE <= s.out.size())
+  {
+    const auto hdr = Frame_header::read((const uint8_t*) s.out.data() + off);
+    list.push_back({hdr, s.out.substr(off + Frame_header::SIZE, hdr.length)});
+    off += Frame_header::SIZE + hdr.length;
+  }
+  s.out.clear();
+  return list;
+}
+
+static std::string frame(Frame_type type, uint8_t flags, uint32_t stream, const std::string& payload = {})
+{
+  uint8_t hdr[Frame_header::SIZE];
+  Frame_header{uint32_t(payload.size()), type, flags, stream}.write(hdr);
+  return std::string((const char*) hdr, sizeof(hdr)) + payload;
+}
+
+static std::string u32(uint32_t v)
+{
+  return {char(v >> 24), char(v >> 16), char(v >> 8), char(v)};
+}
+
+static std::string setting(uint16_t id, uint32_t value)
+{
+  return std::string{char(id >> 8), char(id)} + u32(value);
+}
+
+static std::string request(Hpack_encoder& enc, const char* path)
+{
+  std::string block;
+  enc.begin(block);
+  enc.encode(block, ":method", "GET");
+  enc.encode(block, ":scheme", "https");
+  enc.encode(block, ":path", path);
+  enc.encode(block, ":authority", "includeos.org");
+  enc.encode(block, "cookie", "a=1");
+  enc.encode(block, "cookie", "b=2");
+  return block;
+}
+
+static void feed(Connection& conn, const std::string& data)
+{
+  conn.receive((const uint8_t*) data.data(), data.size());
+}
+
+struct Server {
+  Loop_stream transport;
+  std::vector<std::pair<http::Request_ptr, std::unique_ptr<Exchange>>> requests;
+  Connection conn {transport, {this, &Server::on_request}};
+
+  void on_request(http::Request_ptr req, std::unique_ptr<Exchange> ex)
+  { requests.emplace_back(std::move(req), std::move(ex)); }
+
+  // the client preface and an empty SETTINGS
+  void start(const std::string& settings = {})
+  {
+    feed(conn, std::string(PREFACE) + frame(Frame_type::SETTINGS, 0, 0, settings));
+    frames(transport);
+  }
+};
+
+CASE("HTTP/2 connection preface and SETTINGS")
+{
+  Server srv;
+  // the preface may arrive in pieces, the replies to each go in one write
+  const auto data = std::string(PREFACE) + frame(Frame_type::SETTINGS, 0, 0)
+                  + frame(Frame_type::PING, 0, 0, "12345678");
+  feed(srv.conn, data.substr(0, 10));
+  EXPECT(srv.transport.writes == 1);
+  feed(srv.conn, data.substr(10));
+  EXPECT(srv.transport.writes == 2);
+  auto sent = frames(srv.transport);
+  EXPECT(sent.size() == 4u);
+  // the server preface goes first
+  EXPECT(sent[0].hdr.type == Frame_type::SETTINGS);
+  EXPECT(not sent[0].hdr.has(flag::ACK));
+  EXPECT(sent[1].hdr.type == Frame_type::WINDOW_UPDATE);
+  EXPECT(sent[2].hdr.type == Frame_type::SETTINGS);
+  EXPECT(sent[2].hdr.has(flag::ACK));
+  EXPECT(sent[3].hdr.type == Frame_type::PING);
+  EXPECT(sent[3].hdr.has(flag::ACK));
+  EXPECT(sent[3].payload == "12345678");
+  EXPECT(not srv.transport.closed);
+}
+
+CASE("HTTP/2 rejects a bad preface with GOAWAY")
+{
+  Server srv;
+  feed(srv.conn, "GET / HTTP/1.1\r\n\r\n");
+  auto sent = frames(srv.transport);
+  EXPECT(sent.back().hdr.type == Frame_type::GOAWAY);
+  EXPECT(read_u32((const uint8_t*) sent.back().payload.data() + 4) == uint32_t(Error::PROTOCOL_ERROR));
+  EXPECT(srv.transport.closed);
+}
+
+CASE("HTTP/2 requests are answered through a Response_writer")
+{
+  Server srv;
+  srv.start();
+  Hpack_encoder enc;
+  feed(srv.conn, frame(Frame_type::HEADERS, flag::END_HEADERS | flag::END_STREAM, 1, request(enc, "/index.html")));
+  EXPECT(srv.requests.size() == 1u);
+  auto& req = *srv.requests[0].first;
+  EXPECT(req.method() == http::GET);
+  EXPECT(req.uri().path() == "/index.html");
+  EXPECT(req.version() == http::Version(2, 0));
+  EXPECT(req.header().value(http::header::Host) == "includeos.org");
+  EXPECT(req.header().value(http::header::Cookie) == "a=1; b=2");
+
+  {
+    http::Response_writer writer(http::make_response(), std::move(srv.requests[0].second));
+    writer.header().set_field(http::header::Content_Type, "text/plain");
+    writer.header().set_field(http::header::Connection, "keep-alive");
+    writer.write("hello");
+  }
+  auto sent = frames(srv.transport);
+  EXPECT(sent.size() == 3u);
+  EXPECT(sent[0].hdr.type == Frame_type::HEADERS);
+  EXPECT(sent[0].hdr.has(flag::END_HEADERS));
+  EXPECT(sent[1].hdr.type == Frame_type::DATA);
+  EXPECT(sent[1].payload == "hello");
+  // ending the writer ends the stream
+  EXPECT(sent[2].hdr.type == Frame_type::DATA);
+  EXPECT(sent[2].hdr.has(flag::END_STREAM));
+  EXPECT(sent[2].payload.empty());
+
+  std::vector<std::pair<std::string, std::string>> fields;
+  Hpack_decoder dec;
+  dec.decode((const uint8_t*) sent[0].payload.data(), sent[0].payload.size(),
+    [&fields] (util::csview name, util::csview value) {
+      fields.emplace_back(std::string(name), std::string(value));
+    });
+  EXPECT(fields.at(0).first == ":status");
+  EXPECT(fields.at(0).second == "200");
+  // no connection specific fields
+  for (auto& f : fields) EXPECT(f.first != "connection");
+  EXPECT(srv.conn.active_streams() == 0u);
+}
+
+CASE("HTTP/2 request bodies and flow control")
+{
+  Server srv;
+  // the client lets a stream have 4 bytes at a time, and frames of 16K
+  srv.start(setting(INITIAL_WINDOW_SIZE, 4));
+  Hpack_encoder enc;
+  feed(srv.conn, frame(Frame_type::HEADERS, flag::END_HEADERS, 1, request(enc, "/upload")));
+  EXPECT(srv.requests.empty());
+  // padded DATA, then the end
+  feed(srv.conn, frame(Frame_type::DATA, flag::PADDED, 1, std::string("\x02" "abc" "\0\0", 6))
+               + frame(Frame_type::DATA, flag::END_STREAM, 1, "def"));
+  EXPECT(srv.requests.size() == 1u);
+  EXPECT(srv.requests[0].first->body() == "abcdef");
+
+  auto ex = std::move(srv.requests[0].second);
+  auto res = http::make_response();
+  res->set_status_code(http::OK);
+  ex->write_header(*res);
+  ex->stream()->write("0123456789");
+  ex->stream()->close();
+  auto sent = frames(srv.transport);
+  EXPECT(sent.size() == 2u);
+  EXPECT(sent[1].payload == "0123");
+  EXPECT(not sent[1].hdr.has(flag::END_STREAM));
+
+  feed(srv.conn, frame(Frame_type::WINDOW_UPDATE, 0, 1, u32(100)));
+  sent = frames(srv.transport);
+  EXPECT(sent.size() == 1u);
+  EXPECT(sent[0].payload == "456789");
+  EXPECT(sent[0].hdr.has(flag::END_STREAM));
+}
+
+CASE("HTTP/2 shares the connection by weight, dependencies first")
+{
+  Server srv;
+  // nothing is sent until every stream has its response ready
+  srv.start(setting(INITIAL_WINDOW_SIZE, 0));
+  Hpack_encoder enc;
+  // 3 depends on 1, and 5 weighs 4 times as much as 1
+  for (uint32_t id : {1, 3, 5})
+    feed(srv.conn, frame(Frame_type::HEADERS, flag::END_HEADERS | flag::END_STREAM | flag::PRIORITY, id,
+         u32(id == 3 ? 1 : 0) + std::string(1, char(id == 5 ? 63 : 15)) + request(enc, "/")));
+  EXPECT(srv.requests.size() == 3u);
+  for (auto& r : srv.requests) {
+    r.second->write_header(*http::make_response());
+    r.second->stream()->write(std::string(100000, 'x'));
+    r.second->stream()->close();
+  }
+  frames(srv.transport);
+
+  feed(srv.conn, frame(Frame_type::SETTINGS, 0, 0, setting(INITIAL_WINDOW_SIZE, 100000)));
+  std::map<uint32_t, size_t> bytes;
+  for (auto& f : frames(srv.transport))
+    if (f.hdr.type == Frame_type::DATA) bytes[f.hdr.stream] += f.payload.size();
+  // the connection window is shared by 1 and 5
+  EXPECT(bytes[1] + bytes[5] == DEFAULT_WINDOW);
+  EXPECT(bytes[5] > 2 * bytes[1]);
+  EXPECT(bytes[3] == 0u);
+
+  // 3 gets to send when 1 is done
+  feed(srv.conn, frame(Frame_type::WINDOW_UPDATE, 0, 0, u32(1 << 20)));
+  int last1 = -1, first3 = -1, i = 0;
+  for (auto& f : frames(srv.transport)) {
+    if (f.hdr.stream == 1) last1 = i;
+    if (f.hdr.stream == 3 and first3 < 0) first3 = i;
+    i++;
+  }
+  EXPECT(last1 >= 0);
+  EXPECT(first3 > last1);
+  EXPECT(srv.conn.active_streams() == 0u);
+}
+
+CASE("HTTP/2 stream errors and limits")
+{
+  Loop_stream transport;
+  std::vector<std::unique_ptr<Exchange>> exchanges;
+  struct Handler {
+    std::vector<std::unique_ptr<Exchange>>& list;
+    void operator()(http::Request_ptr, std::unique_ptr<Exchange> ex) { list.push_back(std::move(ex)); }
+  };
+  Connection::Limits limits;
+  limits.max_streams = 1;
+  Connection conn {transport, Handler{exchanges}, limits};
+  feed(conn, std::string(PREFACE) + frame(Frame_type::SETTINGS, 0, 0));
+  frames(transport);
+
+  Hpack_encoder enc;
+  feed(conn, frame(Frame_type::HEADERS, flag::END_HEADERS | flag::END_STREAM, 1, request(enc, "/")));
+  feed(conn, frame(Frame_type::HEADERS, flag::END_HEADERS | flag::END_STREAM, 3, request(enc, "/")));
+  auto sent = frames(transport);
+  EXPECT(exchanges.size() == 1u);
+  EXPECT(sent.size() == 1u);
+  EXPECT(sent[0].hdr.type == Frame_type::RST_STREAM);
+  EXPECT(sent[0].hdr.stream == 3u);
+  EXPECT(read_u32((const uint8_t*) sent[0].payload.data()) == uint32_t(Error::REFUSED_STREAM));
+
+  // a response dropped without being ended is cancelled
+  exchanges.clear();
+  sent = frames(transport);
+  EXPECT(sent.size() == 1u);
+  EXPECT(read_u32((const uint8_t*) sent[0].payload.data()) == uint32_t(Error::CANCEL));
+  EXPECT(conn.active_streams() == 0u);
+
+  // an uppercase field name is malformed
+  std::string block = request(enc, "/");
+  block += std::string("\x00\x03" "Foo" "\x01" "x", 7);
+  feed(conn, frame(Frame_type::HEADERS, flag::END_HEADERS | flag::END_STREAM, 5, block));
+  sent = frames(transport);
+  EXPECT(exchanges.empty());
+  EXPECT(sent.size() == 1u);
+  EXPECT(sent[0].hdr.stream == 5u);
+  EXPECT(read_u32((const uint8_t*) sent[0].payload.data()) == uint32_t(Error::PROTOCOL_ERROR));
+
+  // new streams can not reuse old ids
+  feed(conn, frame(Frame_type::HEADERS, flag::END_HEADERS | flag::END_STREAM, 3, request(enc, "/")));
+  sent = frames(transport);
+  EXPECT(sent.size() == 1u);
+  EXPECT(sent[0].hdr.type == Frame_type::GOAWAY);
+  EXPECT(read_u32((const uint8_t*) sent[0].payload.data() + 4) == uint32_t(Error::STREAM_CLOSED));
+  EXPECT(transport.closed);
+}
+
+CASE("HTTP/2 bounds the request bodies held for a connection")
+{
+  Loop_stream transport;
+  std::vector<http::Request_ptr> requests;
+  struct Handler {
+    std::vector<http::Request_ptr>& list;
+    void operator()(http::Request_ptr req, std::unique_ptr<Exchange>) { list.push_back(std::move(req)); }
+  };
+  Connection::Limits limits;
+  limits.max_body     = 100;
+  limits.max_buffered = 150;
+  Connection conn {transport, Handler{requests}, limits};
+  feed(conn, std::string(PREFACE) + frame(Frame_type::SETTINGS, 0, 0));
+  frames(transport);
+
+  Hpack_encoder enc;
+  feed(conn, frame(Frame_type::HEADERS, flag::END_HEADERS, 1, request(enc, "/a")));
+  feed(conn, frame(Frame_type::HEADERS, flag::END_HEADERS, 3, request(enc, "/b")));
+  feed(conn, frame(Frame_type::DATA, 0, 1, std::string(80, 'a')));
+  EXPECT(frames(transport).empty());
+  // both bodies can not be held at once
+  feed(conn, frame(Frame_type::DATA, 0, 3, std::string(80, 'b')));
+  auto sent = frames(transport);
+  EXPECT(sent.size() == 1u);
+  EXPECT(sent[0].hdr.type == Frame_type::RST_STREAM);
+  EXPECT(sent[0].hdr.stream == 3u);
+  EXPECT(read_u32((const uint8_t*) sent[0].payload.data()) == uint32_t(Error::REFUSED_STREAM));
+
+  // a handed over body is no longer held
+  feed(conn, frame(Frame_type::DATA, flag::END_STREAM, 1, std::string(20, 'a')));
+  EXPECT(requests.size() == 1u);
+  EXPECT(requests[0]->body().size() == 100u);
+  feed(conn, frame(Frame_type::HEADERS, flag::END_HEADERS, 5, request(enc, "/c")));
+  feed(conn, frame(Frame_type::DATA, flag::END_STREAM, 5, std::string(80, 'c')));
+  EXPECT(requests.size() == 2u);
+  // but a body is never larger than max_body
+  feed(conn, frame(Frame_type::HEADERS, flag::END_HEADERS, 7, request(enc, "/d")));
+  feed(conn, frame(Frame_type::DATA, 0, 7, std::string(80, 'd')));
+  feed(conn, frame(Frame_type::DATA, flag::END_STREAM, 7, std::string(80, 'd')));
+  EXPECT(requests.size() == 2u);
+  EXPECT(not transport.closed);
+}
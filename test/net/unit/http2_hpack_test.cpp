@@ -0,0 +1,187 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2017 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <common.cxx>
+#include <net/http2/hpack.hpp>
+#include <vector>
+
+using namespace http2;
+using Fields = std::vector<std::pair<std::string, std::string>>;
+
+static std::string unhex(const char* hex)
+{
+  std::string out;
+  for (const char* p = hex; *p; )
+  {
+    if (*p == ' ') { p++; continue; }
+    out += (char) std::stoi(std::string(p, 2), nullptr, 16);
+    p += 2;
+  }
+  return out;
+}
+
+static Fields decode(Hpack_decoder& dec, const std::string& block)
+{
+  Fields fields;
+  dec.decode((const uint8_t*) block.data(), block.size(),
+    [&fields] (util::csview name, util::csview value) {
+      fields.emplace_back(std::string(name), std::string(value));
+    });
+  return fields;
+}
+
+static std::string encode(Hpack_encoder& enc, const Fields& fields)
+{
+  std::string out;
+  enc.begin(out);
+  for (const auto& f : fields)
+    enc.encode(out, f.first, f.second);
+  return out;
+}
+
+CASE("HPACK integers are encoded with a prefix (RFC 7541 C.1)")
+{
+  std::string out;
+  hpack::encode_int(out, 5, 0, 10);
+  EXPECT(out == unhex("0a"));
+  out.clear();
+  hpack::encode_int(out, 5, 0, 1337);
+  EXPECT(out == unhex("1f9a0a"));
+  out.clear();
+  hpack::encode_int(out, 8, 0, 42);
+  EXPECT(out == unhex("2a"));
+
+  const auto* p = (const uint8_t*) "\x1f\x9a\x0a";
+  EXPECT(hpack::decode_int(p, p + 3, 5) == 1337u);
+  const auto* q = (const uint8_t*) "\x1f\x9a";
+  EXPECT_THROWS_AS(hpack::decode_int(q, q + 2, 5), Hpack_error);
+  const auto* r = (const uint8_t*) "\x1f\xff\xff\xff\xff\xff\x01";
+  EXPECT_THROWS_AS(hpack::decode_int(r, r + 7, 5), Hpack_error);
+}
+
+CASE("HPACK Huffman coding round trips")
+{
+  std::string out;
+  hpack::huffman_encode("www.example.com", out);
+  EXPECT(out == unhex("f1e3c2e5f23a6ba0ab90f4ff"));
+  EXPECT(hpack::huffman_size("www.example.com") == 12u);
+
+  std::string all;
+  for (int c = 0; c < 256; c++) all += (char) c;
+  std::string code, back;
+  hpack::huffman_encode(all, code);
+  hpack::huffman_decode((const uint8_t*) code.data(), code.size(), back);
+  EXPECT(back == all);
+
+  // padding longer than 7 bits, and padding that is not EOS
+  std::string bad;
+  EXPECT_THROWS_AS(hpack::huffman_decode((const uint8_t*) "\xff", 1, bad), Hpack_error);
+  EXPECT_THROWS_AS(hpack::huffman_decode((const uint8_t*) "\x00", 1, bad), Hpack_error);
+}
+
+CASE("HPACK requests with Huffman coding (RFC 7541 C.4)")
+{
+  const Fields req1 {{":method", "GET"}, {":scheme", "http"}, {":path", "/"},
+                     {":authority", "www.example.com"}};
+  Fields req2 = req1;
+  req2.emplace_back("cache-control", "no-cache");
+  const Fields req3 {{":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"},
+                     {":authority", "www.example.com"}, {"custom-key", "custom-value"}};
+  const auto blk1 = unhex("828684418cf1e3c2e5f23a6ba0ab90f4ff");
+  const auto blk2 = unhex("828684be5886a8eb10649cbf");
+  const auto blk3 = unhex("828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf");
+
+  Hpack_decoder dec;
+  EXPECT(decode(dec, blk1) == req1);
+  EXPECT(dec.table().size() == 57u);
+  EXPECT(decode(dec, blk2) == req2);
+  EXPECT(dec.table().size() == 110u);
+  EXPECT(decode(dec, blk3) == req3);
+  EXPECT(dec.table().size() == 164u);
+  EXPECT(dec.table()[0].name == "custom-key");
+
+  // the encoder makes the same choices
+  Hpack_encoder enc;
+  EXPECT(encode(enc, req1) == blk1);
+  EXPECT(encode(enc, req2) == blk2);
+  EXPECT(encode(enc, req3) == blk3);
+  EXPECT(enc.table().size() == 164u);
+}
+
+CASE("HPACK responses evict from a small table (RFC 7541 C.6)")
+{
+  Hpack_decoder dec {256};
+  auto res = decode(dec, unhex("488264025885aec3771a4b6196d07abe941054d444a8200595040b8166e082a62d1bff"
+                               "6e919d29ad171863c78f0b97c8e9ae82ae43d3"));
+  EXPECT(res.size() == 4u);
+  EXPECT(res[0].second == "302");
+  EXPECT(res[2].second == "Mon, 21 Oct 2013 20:13:21 GMT");
+  EXPECT(dec.table().size() == 222u);
+
+  res = decode(dec, unhex("4883640effc1c0bf"));
+  EXPECT(res[0].second == "307");
+  EXPECT(res[3].second == "https://www.example.com");
+  EXPECT(dec.table().count() == 4u);
+
+  res = decode(dec, unhex("88c16196d07abe941054d444a8200595040b8166e084a62d1bffc05a839bd9ab77ad94e7"
+                          "821dd7f2e6c7b335dfdfcd5b3960d5af27087f3672c1ab270fb5291f9587316065c003ed"
+                          "4ee5b1063d5007"));
+  EXPECT(res.size() == 6u);
+  EXPECT(res[4].second == "gzip");
+  EXPECT(res[5].second == "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1");
+  EXPECT(dec.table().size() == 215u);
+  EXPECT(dec.table().count() == 3u);
+}
+
+CASE("HPACK decoder rejects malformed blocks")
+{
+  Hpack_decoder dec {4096, 100};
+  // index 0, an index past the tables, and a truncated literal
+  EXPECT_THROWS_AS(decode(dec, unhex("80")), Hpack_error);
+  EXPECT_THROWS_AS(decode(dec, unhex("c0")), Hpack_error);
+  EXPECT_THROWS_AS(decode(dec, unhex("4088")), Hpack_error);
+  // a table size update after a field, or above the limit
+  EXPECT_THROWS_AS(decode(dec, unhex("823f00")), Hpack_error);
+  EXPECT_THROWS_AS(decode(dec, unhex("3fe21f")), Hpack_error);
+  EXPECT(decode(dec, unhex("3fe11f82")).size() == 1u);
+  // beyond the header list limit
+  std::string big = unhex("0f2f");
+  big += char(90);
+  big += std::string(90, 'x');
+  EXPECT_THROWS_AS(decode(dec, big), Hpack_error);
+}
+
+CASE("HPACK encoder signals table size changes and never indexes secrets")
+{
+  Hpack_encoder enc;
+  Hpack_decoder dec;
+  const Fields fields {{"Authorization", "Basic c2VjcmV0"}, {"X-Thing", "a"}};
+  auto blk = encode(enc, fields);
+  EXPECT(enc.table().count() == 1u);
+  EXPECT(((uint8_t) blk[0] & 0xf0) == 0x10);
+  const auto back = decode(dec, blk);
+  EXPECT(back[0].first == "authorization");
+  EXPECT(back[1].first == "x-thing");
+
+  // shrinking to nothing and back again is seen by the decoder
+  enc.set_max_table_size(0);
+  enc.set_max_table_size(1024);
+  blk = encode(enc, {{"x-thing", "a"}});
+  EXPECT(blk.substr(0, 4) == unhex("203fe107"));
+  EXPECT(decode(dec, blk) == Fields({{"x-thing", "a"}}));
+  EXPECT(dec.table().count() == 1u);
+}
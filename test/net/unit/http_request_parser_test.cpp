@@ -0,0 +1,171 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2017 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <common.cxx>
+#include <net/http/request_parser.hpp>
+
+using namespace http;
+
+static Request_parser::buffer_t make_buffer(util::csview data)
+{
+  return std::make_shared<os::mem::buffer>(data.begin(), data.end());
+}
+
+CASE("Request_parser parses a request in place")
+{
+  Request_parser parser;
+  auto buf = make_buffer("GET /index.html?q=1 HTTP/1.1\r\n"
+                         "Host: includeos.org\r\n"
+                         "user-agent:  lest/1.0 \r\n"
+                         "X-Custom: yes\r\n\r\n");
+  const auto* begin = (const char*) buf->data();
+  const auto* end   = begin + buf->size();
+  parser.feed(buf);
+
+  auto req = parser.next();
+  EXPECT(req != nullptr);
+  EXPECT(req->method() == GET);
+  EXPECT(req->uri().path() == "/index.html");
+  EXPECT(req->version() == Version(1, 1));
+  EXPECT(req->header().size() == 3u);
+  EXPECT(req->header().value(header::User_Agent) == "lest/1.0");
+  EXPECT(req->header().value("x-custom") == "yes");
+  // the fields are views into the receive buffer, which is kept alive
+  const auto host = req->header().value(header::Host);
+  EXPECT(host == "includeos.org");
+  EXPECT(host.data() >= begin and host.data() < end);
+  buf.reset();
+  EXPECT(req->header().value(header::Host) == "includeos.org");
+
+  EXPECT(parser.next() == nullptr);
+  EXPECT(not parser.partial());
+}
+
+CASE("Request_parser hands out pipelined requests")
+{
+  Request_parser parser;
+  parser.feed(make_buffer("GET /a HTTP/1.1\r\nHost: x\r\n\r\n"
+                          "POST /b HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello"
+                          "GET /c HTTP/1.0\r\n\r\n"
+                          "GET /d HT"));
+  auto a = parser.next();
+  auto b = parser.next();
+  auto c = parser.next();
+  EXPECT(a->uri().path() == "/a");
+  EXPECT(b->method() == POST);
+  EXPECT(b->body() == "hello");
+  EXPECT(c->version() == Version(1, 0));
+  // the last one is not complete
+  EXPECT(parser.next() == nullptr);
+  EXPECT(parser.partial());
+  parser.feed(make_buffer("TP/1.1\r\n\r\n"));
+  auto d = parser.next();
+  EXPECT(d != nullptr);
+  EXPECT(d->uri().path() == "/d");
+  // the earlier requests still see their own buffer
+  EXPECT(a->header().value(header::Host) == "x");
+}
+
+CASE("Request_parser keeps state across reads")
+{
+  const std::string request = "PUT /upload HTTP/1.1\r\n"
+                              "Content-Type: text/plain\r\n"
+                              "Content-Length: 10\r\n\r\n"
+                              "0123456789";
+  // one byte at a time
+  Request_parser parser;
+  Request_ptr req;
+  for (size_t i = 0; i < request.size(); i++) {
+    EXPECT(req == nullptr);
+    parser.feed(make_buffer(request.substr(i, 1)));
+    req = parser.next();
+  }
+  EXPECT(req != nullptr);
+  EXPECT(req->method() == PUT);
+  EXPECT(req->header().value(header::Content_Type) == "text/plain");
+  EXPECT(req->body() == "0123456789");
+}
+
+CASE("Request_parser reads chunked bodies")
+{
+  Request_parser parser;
+  parser.feed(make_buffer("POST /chunked HTTP/1.1\r\n"
+                          "Transfer-Encoding: chunked\r\n\r\n"
+                          "5;ext=1\r\nhello\r\n"
+                          "7\r\n, world\r\n"));
+  EXPECT(parser.next() == nullptr);
+  parser.feed(make_buffer("0\r\nTrailer: x\r\n\r\nGET / HTTP/1.1\r\n\r\n"));
+  auto req = parser.next();
+  EXPECT(req != nullptr);
+  EXPECT(req->body() == "hello, world");
+  EXPECT(parser.next() != nullptr);
+}
+
+CASE("Request_parser rejects malformed requests")
+{
+  const char* bad[] = {
+    "BREW /pot HTTP/1.1\r\n\r\n",
+    "GET /\r\n\r\n",
+    "GET / HTTP/1.1 extra\r\n\r\n",
+    "GET / HTTQ/1.1\r\n\r\n",
+    "GET / HTTP/1.1\r\nNo colon\r\n\r\n",
+    "GET / HTTP/1.1\r\nName : value\r\n\r\n",
+    "GET / HTTP/1.1\r\nA: b\r\n folded\r\n\r\n",
+    "POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n",
+    "POST / HTTP/1.1\r\nContent-Length: 1\r\nTransfer-Encoding: chunked\r\n\r\n",
+    "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+  };
+  for (const auto* data : bad) {
+    Request_parser parser;
+    parser.feed(make_buffer(data));
+    EXPECT_THROWS_AS(parser.next(), Request_error);
+    // nothing more until reset
+    parser.feed(make_buffer("GET / HTTP/1.1\r\n\r\n"));
+    EXPECT(parser.next() == nullptr);
+    parser.reset();
+    parser.feed(make_buffer("GET / HTTP/1.1\r\n\r\n"));
+    EXPECT(parser.next() != nullptr);
+  }
+
+  // limits
+  Request_parser::Limits limits;
+  limits.max_head = 64;
+  limits.max_body = 4;
+  Request_parser parser {limits};
+  parser.feed(make_buffer("GET / HTTP/1.1\r\nX-Long: " + std::string(64, 'a')));
+  EXPECT_THROWS_AS(parser.next(), Request_error);
+  parser.reset();
+  parser.feed(make_buffer("POST / HTTP/1.1\r\nContent-Length: 5\r\n\r\n"));
+  EXPECT_THROWS_AS(parser.next(), Request_error);
+}
+
+CASE("Header fields beyond the limit are ignored")
+{
+  Request_parser::Limits limits;
+  limits.max_fields = 2;
+  Request_parser parser {limits};
+  parser.feed(make_buffer("GET / HTTP/1.1\r\nA: 1\r\nB: 2\r\nC: 3\r\n\r\n"));
+  auto req = parser.next();
+  EXPECT(req->header().size() == 2u);
+  EXPECT(not req->header().has_field("C"));
+
+  // copies own the fields added by value
+  Header copy = req->header();
+  copy.set_field("A", "changed");
+  EXPECT(copy.value("A") == "changed");
+  EXPECT(req->header().value("A") == "1");
+}
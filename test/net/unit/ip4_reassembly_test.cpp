@@ -0,0 +1,174 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2017 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <packet_factory.hpp>
+#include <common.cxx>
+#include <net/ip4/reassembly.hpp>
+
+using namespace net;
+using Reassembly = ip4::Reassembly;
+
+static const ip4::Addr SRC {10,0,0,1};
+static const ip4::Addr DST {10,0,0,2};
+
+static uint8_t data_at(uint16_t id, uint32_t offset)
+{ return offset * 7 + id; }
+
+static Reassembly::Packet_ptr fragment(uint16_t id, uint32_t offset,
+                                       uint32_t len, bool more)
+{
+  auto pkt = create_ip4_packet_init(SRC, DST);
+  pkt->set_ip_id(id);
+  pkt->set_protocol(Protocol::UDP);
+  auto& hdr = *(ip4::Header*) pkt->layer_begin();
+  hdr.frag_off_flags = htons((more ? 0x2000 : 0) | (offset / 8));
+  pkt->set_ip_data_length(len);
+  pkt->set_ip_total_length(pkt->size());
+  auto* data = pkt->layer_begin() + pkt->ip_header_length();
+  for (uint32_t i = 0; i < len; i++)
+    data[i] = data_at(id, offset + i);
+  return pkt;
+}
+
+static bool verify(const PacketIP4& pkt, uint16_t id, uint32_t len)
+{
+  if (pkt.ip_data_length() != len or pkt.ip_total_length() != 20 + len)
+    return false;
+  if (pkt.ip_frag_offs() != 0 or pkt.ip_flags() != ip4::Flags::NONE)
+    return false;
+  auto* data = pkt.layer_begin() + pkt.ip_header_length();
+  for (uint32_t i = 0; i < len; i++)
+    if (data[i] != data_at(id, i)) return false;
+  return true;
+}
+
+CASE("Reassembly of fragments in and out of order")
+{
+  Reassembly ra;
+  // in order, fits in the buffer of the first fragment
+  EXPECT(ra.process(fragment(1, 0, 600, true), 0) == nullptr);
+  EXPECT(ra.size() == 1u);
+  auto pkt = ra.process(fragment(1, 600, 300, false), 0);
+  EXPECT(pkt != nullptr);
+  EXPECT(verify(*pkt, 1, 900));
+  EXPECT(ra.size() == 0u);
+  EXPECT(ra.bytes() == 0u);
+
+  // out of order and larger than one buffer
+  const uint32_t SZ = 1200;
+  EXPECT(ra.process(fragment(2, 3 * SZ, 100, false), 0) == nullptr);
+  EXPECT(ra.process(fragment(2, SZ, SZ, true), 0) == nullptr);
+  EXPECT(ra.process(fragment(2, 0, SZ, true), 0) == nullptr);
+  pkt = ra.process(fragment(2, 2 * SZ, SZ, true), 0);
+  EXPECT(pkt != nullptr);
+  EXPECT(verify(*pkt, 2, 3 * SZ + 100));
+  EXPECT(pkt->compute_ip_checksum() == 0);
+  EXPECT(ra.stats().reassembled == 2u);
+}
+
+CASE("Reassembly keeps datagrams apart")
+{
+  Reassembly ra;
+  EXPECT(ra.process(fragment(1, 0, 800, true), 0) == nullptr);
+  EXPECT(ra.process(fragment(2, 0, 800, true), 0) == nullptr);
+  EXPECT(ra.size() == 2u);
+  auto pkt = ra.process(fragment(2, 800, 10, false), 0);
+  EXPECT(pkt != nullptr);
+  EXPECT(verify(*pkt, 2, 810));
+  pkt = ra.process(fragment(1, 800, 20, false), 0);
+  EXPECT(pkt != nullptr);
+  EXPECT(verify(*pkt, 1, 820));
+}
+
+CASE("Reassembly drops duplicates, overlaps and invalid fragments")
+{
+  Reassembly ra;
+  // duplicates are ignored
+  EXPECT(ra.process(fragment(1, 0, 800, true), 0) == nullptr);
+  EXPECT(ra.process(fragment(1, 0, 800, true), 0) == nullptr);
+  EXPECT(ra.stats().dropped == 1u);
+  EXPECT(ra.size() == 1u);
+  // partial overlaps drop the datagram
+  EXPECT(ra.process(fragment(1, 400, 800, true), 0) == nullptr);
+  EXPECT(ra.stats().overlapped == 1u);
+  EXPECT(ra.size() == 0u);
+  EXPECT(ra.bytes() == 0u);
+
+  // data after the last fragment
+  EXPECT(ra.process(fragment(2, 800, 800, true), 0) == nullptr);
+  EXPECT(ra.process(fragment(2, 0, 400, false), 0) == nullptr);
+  EXPECT(ra.stats().overlapped == 2u);
+  EXPECT(ra.size() == 0u);
+
+  // tiny, unaligned or too large fragments
+  EXPECT(ra.process(fragment(3, 0, 80, true), 0) == nullptr);
+  EXPECT(ra.process(fragment(3, 0, 804, true), 0) == nullptr);
+  EXPECT(ra.process(fragment(3, 65000, 1000, false), 0) == nullptr);
+  EXPECT(ra.stats().dropped == 4u);
+  EXPECT(ra.size() == 0u);
+}
+
+CASE("Reassembly times out and evicts the oldest datagrams")
+{
+  Reassembly::Config config;
+  config.max_datagrams = 4;
+  config.timeout = 10;
+  Reassembly ra {config};
+
+  EXPECT(ra.process(fragment(1, 0, 800, true), 100) == nullptr);
+  EXPECT(ra.process(fragment(2, 0, 800, true), 105) == nullptr);
+  ra.expire(109);
+  EXPECT(ra.size() == 2u);
+  ra.expire(110);
+  EXPECT(ra.size() == 1u);
+  EXPECT(ra.stats().timed_out == 1u);
+
+  // a full table evicts the oldest
+  for (uint16_t id = 3; id <= 6; id++)
+    EXPECT(ra.process(fragment(id, 0, 800, true), 110) == nullptr);
+  EXPECT(ra.size() == 4u);
+  EXPECT(ra.stats().evicted == 1u);
+  EXPECT(ra.process(fragment(2, 800, 8, false), 110) == nullptr);
+  auto pkt = ra.process(fragment(6, 800, 8, false), 110);
+  EXPECT(pkt != nullptr);
+  EXPECT(verify(*pkt, 6, 808));
+}
+
+CASE("Reassembly limits the buffers held")
+{
+  Reassembly::Config config;
+  config.max_bytes = 3 * PACKET_CAPA;
+  Reassembly ra {config};
+
+  for (uint16_t id = 1; id <= 3; id++)
+    EXPECT(ra.process(fragment(id, 0, 800, true), 0) == nullptr);
+  EXPECT(ra.size() == 3u);
+  // room is made by evicting the oldest datagram
+  EXPECT(ra.process(fragment(4, 0, 800, true), 0) == nullptr);
+  EXPECT(ra.size() == 3u);
+  EXPECT(ra.bytes() == config.max_bytes);
+  EXPECT(ra.stats().evicted == 1u);
+  // the oldest datagram is dropped rather than evicting newer ones
+  EXPECT(ra.process(fragment(2, 800, 8, false), 0) == nullptr);
+  EXPECT(ra.size() == 2u);
+  EXPECT(ra.stats().evicted == 2u);
+  auto pkt = ra.process(fragment(4, 800, 8, false), 0);
+  EXPECT(pkt != nullptr);
+  EXPECT(verify(*pkt, 4, 808));
+  EXPECT(ra.size() == 1u);
+  EXPECT(ra.bytes() == (size_t) PACKET_CAPA);
+}
@@ -0,0 +1,139 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2017 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <common.cxx>
+#include <net/lpm.hpp>
+
+using namespace net;
+
+static int linear_lookup(const std::vector<Lpm4::Prefix>& prefixes, ip4::Addr dst)
+{
+  int best = Lpm4::NONE;
+  for (size_t i = 0; i < prefixes.size(); i++)
+  {
+    const auto& pfx = prefixes[i];
+    const uint32_t mask = pfx.len ? ~uint32_t(0) << (32 - pfx.len) : 0;
+    if ((ntohl(dst.whole) & mask) != (ntohl(pfx.net.whole) & mask)) continue;
+    if (best == Lpm4::NONE or pfx.len > prefixes[best].len) best = i;
+  }
+  return best;
+}
+
+CASE("net::lpm: IPv4 longest prefix match in a small table")
+{
+  Lpm4 lpm;
+  EXPECT(lpm.lookup({10,0,0,1}) == Lpm4::NONE);
+
+  lpm.build({
+    {{10,0,0,0},  8},
+    {{10,42,0,0}, 16},
+    {{10,42,42,0}, 24},
+    {{10,42,0,0}, 16},
+    {{0,0,0,0},   0},
+    {{10,42,42,7}, 32},
+    {{20,0,0,0},  -1}
+  });
+  EXPECT(not lpm.compiled());
+  EXPECT(lpm.lookup({10,1,2,3}) == 0);
+  // the first of equal prefixes wins
+  EXPECT(lpm.lookup({10,42,1,1}) == 1);
+  EXPECT(lpm.lookup({10,42,42,1}) == 2);
+  EXPECT(lpm.lookup({10,42,42,7}) == 5);
+  EXPECT(lpm.lookup({20,0,0,1}) == 4);
+  EXPECT(lpm.lookup({192,168,0,1}) == 4);
+}
+
+CASE("net::lpm: IPv4 DIR-24-8 table agrees with a linear search")
+{
+  std::vector<Lpm4::Prefix> prefixes;
+  prefixes.push_back({{10,0,0,0}, 8});
+  for (int i = 0; i < 40; i++)
+    prefixes.push_back({{10, (uint8_t) i, 0, 0}, 16});
+  for (int i = 0; i < 40; i++)
+    prefixes.push_back({{10, 1, (uint8_t) i, 0}, 24});
+  // longer than 24 bits, in tbl8 groups
+  for (int len = 25; len <= 32; len++)
+    prefixes.push_back({{10, 1, 1, (uint8_t) (256 - (1 << (32 - len)))}, len});
+  prefixes.push_back({{10, 2, 0, 128}, 25});
+  prefixes.push_back({{172, 16, 0, 1}, 32});
+
+  Lpm4 lpm;
+  lpm.build(prefixes);
+  EXPECT(lpm.compiled());
+  EXPECT(lpm.tbl8_groups() == 3u);
+
+  for (int c = 0; c < 4; c++)
+    for (int d = 0; d < 256; d++)
+    {
+      const ip4::Addr dst{10, (uint8_t) c, 1, (uint8_t) d};
+      EXPECT(lpm.lookup(dst) == linear_lookup(prefixes, dst));
+      const ip4::Addr dst2{10, (uint8_t) c, 0, (uint8_t) d};
+      EXPECT(lpm.lookup(dst2) == linear_lookup(prefixes, dst2));
+    }
+  EXPECT(lpm.lookup({10,1,1,255}) == 88);
+  EXPECT(lpm.lookup({172,16,0,1}) == (int) prefixes.size() - 1);
+  EXPECT(lpm.lookup({172,16,0,2}) == Lpm4::NONE);
+
+  // going back to a small table
+  lpm.build({{{10,0,0,0}, 8}});
+  EXPECT(not lpm.compiled());
+  EXPECT(lpm.lookup({10,1,1,255}) == 0);
+}
+
+CASE("net::lpm: IPv6 longest prefix match")
+{
+  const ip6::Addr fd00{0xfd00, 0, 0, 0, 0, 0, 0, 0};
+  const ip6::Addr fd00_1{0xfd00, 0, 0, 1, 0, 0, 0, 0};
+  const ip6::Addr host{0xfd00, 0, 0, 1, 0, 0, 0, 0x42};
+
+  Lpm6 lpm;
+  EXPECT(lpm.lookup(host) == Lpm6::NONE);
+
+  lpm.build({
+    {fd00,   8},
+    {fd00_1, 64},
+    {fd00,   12},
+    {host,   128},
+    {ip6::Addr{}, 0}
+  });
+  EXPECT(lpm.lookup(host) == 3);
+  EXPECT(lpm.lookup({0xfd00, 0, 0, 1, 0, 0, 0, 0x43}) == 1);
+  EXPECT(lpm.lookup({0xfd00, 0, 0, 2, 0, 0, 0, 1}) == 2);
+  // expanded within the byte the prefix ends in
+  EXPECT(lpm.lookup({0xfd0f, 0, 0, 0, 0, 0, 0, 1}) == 2);
+  EXPECT(lpm.lookup({0xfd10, 0, 0, 0, 0, 0, 0, 1}) == 0);
+  EXPECT(lpm.lookup({0x2001, 0xdb8, 0, 0, 0, 0, 0, 1}) == 4);
+}
+
+CASE("net::lpm: Route cache hits until invalidated")
+{
+  Route_cache<ip4::Addr> cache;
+  int lookups = 0;
+  auto lookup = [&lookups] (const ip4::Addr&) { lookups++; return 7; };
+
+  EXPECT(cache.get({10,0,0,1}, lookup) == 7);
+  EXPECT(cache.get({10,0,0,1}, lookup) == 7);
+  EXPECT(cache.get({10,0,0,2}, lookup) == 7);
+  EXPECT(lookups == 2);
+  EXPECT(cache.hits() == 1u);
+  EXPECT(cache.misses() == 2u);
+
+  cache.invalidate();
+  EXPECT(cache.get({10,0,0,1}, [] (const ip4::Addr&) { return 3; }) == 3);
+  EXPECT(cache.misses() == 3u);
+}
@@ -0,0 +1,162 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2017 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <common.cxx>
+#include <net/netfilter.hpp>
+#include <net/ip4/ip4.hpp>
+#include <packet_factory.hpp>
+
+using namespace net;
+using Rules4 = Filter_rules<ip4::Addr>;
+
+static Rules4::Key key4(ip4::Addr src, ip4::Addr dst, Protocol proto,
+                        uint16_t sport, uint16_t dport)
+{ return {src, dst, sport, dport, static_cast<uint8_t>(proto)}; }
+
+CASE("net::netfilter: The first matching rule decides")
+{
+  Rules4 rules;
+  Rules4::Rule ssh;
+  ssh.src = {10,0,0,0}; ssh.src_len = 8;
+  ssh.proto = Protocol::TCP;
+  ssh.dport = {22, 22};
+  ssh.verdict = Filter_verdict_type::ACCEPT;
+
+  Rules4::Rule no_tcp;
+  no_tcp.proto = Protocol::TCP;
+
+  Rules4::Rule high_ports;
+  high_ports.proto = Protocol::UDP;
+  high_ports.dport = {1024, 65535};
+  high_ports.verdict = Filter_verdict_type::ACCEPT;
+
+  Rules4::Rule host;
+  host.dst = {10,0,0,1}; host.dst_len = 32;
+
+  rules.assign({ssh, no_tcp, high_ports, host});
+  EXPECT(rules.size() == 4u);
+
+  const ip4::Addr lan{10,0,0,42}, wan{80,1,2,3}, me{10,0,0,1};
+  EXPECT(rules.classify(key4(lan, me, Protocol::TCP, 40000, 22)) == Filter_verdict_type::ACCEPT);
+  EXPECT(rules.classify(key4(wan, me, Protocol::TCP, 40000, 22)) == Filter_verdict_type::DROP);
+  EXPECT(rules.classify(key4(lan, me, Protocol::TCP, 40000, 80)) == Filter_verdict_type::DROP);
+  EXPECT(rules.classify(key4(wan, me, Protocol::UDP, 53, 1024)) == Filter_verdict_type::ACCEPT);
+  EXPECT(rules.classify(key4(wan, me, Protocol::UDP, 53, 65535)) == Filter_verdict_type::ACCEPT);
+  EXPECT(rules.classify(key4(wan, me, Protocol::UDP, 53, 1023)) == Filter_verdict_type::DROP);
+  EXPECT(rules.classify(key4(wan, me, Protocol::ICMPv4, 0, 0)) == Filter_verdict_type::DROP);
+  // nothing matches, so the policy decides
+  EXPECT(rules.classify(key4(wan, lan, Protocol::UDP, 53, 53)) == Filter_verdict_type::ACCEPT);
+  rules.policy = Filter_verdict_type::DROP;
+  EXPECT(rules.classify(key4(wan, lan, Protocol::UDP, 53, 53)) == Filter_verdict_type::DROP);
+}
+
+CASE("net::netfilter: Many rules share a few tuples")
+{
+  Rules4 rules;
+  for (int i = 0; i < 10000; i++)
+  {
+    Rules4::Rule rule;
+    rule.dst = ip4::Addr{10, (uint8_t) (i >> 8), (uint8_t) i, 0};
+    rule.dst_len = 24;
+    rule.proto = Protocol::TCP;
+    rule.dport = {(uint16_t) (1000 + i % 100), (uint16_t) (1000 + i % 100)};
+    rule.verdict = (i % 2) ? Filter_verdict_type::ACCEPT : Filter_verdict_type::DROP;
+    rules.push_back(rule);
+  }
+  rules.compile();
+  EXPECT(rules.tuples() == 1u);
+
+  for (int i = 0; i < 10000; i += 777)
+  {
+    const ip4::Addr dst{10, (uint8_t) (i >> 8), (uint8_t) i, 9};
+    const auto expected = (i % 2) ? Filter_verdict_type::ACCEPT : Filter_verdict_type::DROP;
+    EXPECT(rules.classify(key4({1,2,3,4}, dst, Protocol::TCP, 5000, 1000 + i % 100)) == expected);
+    EXPECT(rules.classify(key4({1,2,3,4}, dst, Protocol::TCP, 5000, 999)) == Filter_verdict_type::ACCEPT);
+  }
+}
+
+CASE("net::netfilter: Verdicts are cached per direction in the conntrack entry")
+{
+  Socket client{ip4::Addr{10,0,0,42}, 5000};
+  Socket server{ip4::Addr{10,0,0,1}, 53};
+  auto request = create_udp_packet_init(client, server);
+  auto reply   = create_udp_packet_init(server, client);
+
+  Conntrack ct;
+  auto* entry = ct.simple_track_in({client, server}, Protocol::UDP);
+  EXPECT(entry != nullptr);
+
+  // only the requests are let in
+  Filter_chain<IP4> input{"Input", {}};
+  Rules4::Rule rule;
+  rule.dst = server.address().v4(); rule.dst_len = 32;
+  rule.verdict = Filter_verdict_type::ACCEPT;
+  input.rules.push_back(rule);
+  input.rules.policy = Filter_verdict_type::DROP;
+
+  EXPECT(input.rules(*request, entry) == Filter_verdict_type::ACCEPT);
+  EXPECT(input.rules(*reply, entry) == Filter_verdict_type::DROP);
+
+  // cached, so a change to the rules is only seen once they are compiled
+  input.rules.policy = Filter_verdict_type::ACCEPT;
+  EXPECT(input.rules(*reply, entry) == Filter_verdict_type::DROP);
+  input.rules.compile();
+  EXPECT(input.rules(*reply, entry) == Filter_verdict_type::ACCEPT);
+
+  // the chain drops the packet on a DROP verdict
+  input.rules.policy = Filter_verdict_type::DROP;
+  input.rules.compile();
+  auto res = input(std::move(reply), *(Inet*) nullptr, entry);
+  EXPECT(res == Filter_verdict_type::DROP);
+  res = input(std::move(request), *(Inet*) nullptr, entry);
+  EXPECT(res == Filter_verdict_type::ACCEPT);
+  EXPECT(res.packet != nullptr);
+}
+
+CASE("net::netfilter: Fragments are not cached")
+{
+  Socket client{ip4::Addr{10,0,0,42}, 5000};
+  Socket server{ip4::Addr{10,0,0,1}, 53};
+  auto first = create_udp_packet_init(client, server);
+  auto later = create_udp_packet_init(client, server);
+  auto reply = create_udp_packet_init(server, client);
+  first->set_ip_flags(ip4::Flags::MF);
+  later->set_ip_frag_offs(64);
+
+  Conntrack ct;
+  auto* entry = ct.simple_track_in({client, server}, Protocol::UDP);
+
+  // only DNS is let through, both ways
+  Rules4 rules;
+  Rules4::Rule request_rule;
+  request_rule.proto = Protocol::UDP;
+  request_rule.dport = {53, 53};
+  request_rule.verdict = Filter_verdict_type::ACCEPT;
+  Rules4::Rule reply_rule = request_rule;
+  reply_rule.dport = {};
+  reply_rule.sport = {53, 53};
+  rules.assign({request_rule, reply_rule});
+  rules.policy = Filter_verdict_type::DROP;
+
+  // a later fragment has no ports (and looks like a reply),
+  // so its verdict is neither kept nor taken from the cache
+  EXPECT(rules(*later, entry) == Filter_verdict_type::DROP);
+  EXPECT(rules(*reply, entry) == Filter_verdict_type::ACCEPT);
+  EXPECT(rules(*later, entry) == Filter_verdict_type::DROP);
+  EXPECT(rules(*first, entry) == Filter_verdict_type::ACCEPT);
+}
@@ -89,3 +89,39 @@ CASE("TCP benchmark")
     Events::get().process_events();
   }
 }
+
+CASE("UDP packets per second")
+{
+  static const size_t NUM_PACKETS = 20000;
+  static const size_t BURST = 64;
+  static size_t received = 0;
+
+  auto& inet_server = net::Interfaces::get(0);
+  auto& inet_client = net::Interfaces::get(1);
+
+  auto& server = inet_server.udp().bind(4242);
+  server.on_read(
+  [] (auto, auto, const char*, size_t) {
+    received++;
+  });
+  auto& client = inet_client.udp().bind(4243);
+  const char data[64] {};
+
+  printf("Measuring small datagram rate...\n");
+  const auto time_start = now();
+  // bursts of datagrams, each received as one burst on the other side
+  for (size_t sent = 0; sent < NUM_PACKETS; sent += BURST)
+  {
+    for (size_t i = 0; i < BURST; i++)
+      client.sendto(net::ip4::Addr{10,0,0,42}, 4242, data, sizeof(data));
+
+    for (int rounds = 0; received < sent + BURST and rounds < 100; rounds++)
+      Events::get().process_events();
+  }
+  EXPECT(received == NUM_PACKETS);
+
+  auto timediff = now() - time_start;
+  double time_sec = std::max(timediff.count(), 1l) / 1000.0;
+  printf("Server received %zu packets in %f sec. - %f pps \n",
+         received, time_sec, received / time_sec);
+}
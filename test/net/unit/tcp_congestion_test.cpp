@@ -0,0 +1,164 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <common.cxx>
+#include <net/tcp/congestion.hpp>
+
+using namespace net;
+using namespace net::tcp;
+using Algorithm = Congestion_control::Algorithm;
+
+static const uint16_t SMSS = 1460;
+
+/**
+ * A bottleneck link with a fixed bandwidth (bytes/ms) and base RTT (us).
+ * Every round a full window is acked one segment at a time, spread over
+ * the round, and each ACK clocks out as much new data.
+ */
+struct Link {
+  uint32_t bw;
+  uint32_t rtt;
+  int64_t  now = 0;
+  seq_t    una = 0;
+
+  void run(Congestion_control& cc, Congestion_control::Window& w, int rounds)
+  {
+    for (int r = 0; r < rounds; r++)
+    {
+      const uint32_t window = w.cwnd;
+      // the queue delays the round when the window exceeds the BDP
+      const uint32_t duration = std::max<uint64_t>(rtt, window * 1000ull / bw);
+      const uint32_t acks = std::max(window / SMSS, 1u);
+      for (uint32_t i = 1; i <= acks; i++)
+      {
+        const uint32_t acked = (i == acks) ? window - (acks-1) * SMSS : SMSS;
+        una += acked;
+        const Congestion_control::Ack a {
+          acked, window, una, una + window, now + duration * i / acks
+        };
+        cc.on_ack(w, a);
+      }
+      now += duration;
+    }
+  }
+};
+
+CASE("Creating congestion control algorithms")
+{
+  EXPECT(Congestion_control::create(Algorithm::RENO)->algorithm() == Algorithm::RENO);
+  EXPECT(Congestion_control::create(Algorithm::CUBIC)->algorithm() == Algorithm::CUBIC);
+  EXPECT(Congestion_control::create(Algorithm::BBR)->algorithm() == Algorithm::BBR);
+  EXPECT(std::string(Congestion_control::create(Algorithm::CUBIC)->name()) == "cubic");
+}
+
+CASE("Reno slow start, congestion avoidance and loss")
+{
+  Reno reno;
+  Congestion_control::Window w {0, 0, 64 * SMSS, SMSS};
+  reno.init(w);
+  EXPECT(w.cwnd == 3u * SMSS);
+  EXPECT(w.ssthresh == 64u * SMSS);
+
+  // slow start, at most one SMSS per ACK
+  reno.on_ack(w, {2 * SMSS, 0, 0, 0, 0});
+  EXPECT(w.cwnd == 4u * SMSS);
+
+  // congestion avoidance, about one SMSS per window
+  w.cwnd = w.ssthresh;
+  for (int i = 0; i < 64; i++)
+    reno.on_ack(w, {SMSS, 0, 0, 0, 0});
+  EXPECT(w.cwnd >= 64u * SMSS + SMSS - 64);
+  EXPECT(w.cwnd <= 65u * SMSS);
+
+  reno.on_loss(w, 20 * SMSS);
+  EXPECT(w.ssthresh == 10u * SMSS);
+  reno.on_loss(w, SMSS);
+  EXPECT(w.ssthresh == 2u * SMSS);
+}
+
+CASE("CUBIC regrows to the window before loss faster than Reno")
+{
+  Link link {1000, 50000}; // 8 Mbit/s with 50 ms base RTT
+  Cubic cubic;
+  Reno  reno;
+  Congestion_control::Window wc {0, 0, 1000 * SMSS, SMSS};
+  Congestion_control::Window wr {0, 0, 1000 * SMSS, SMSS};
+  cubic.init(wc);
+  reno.init(wr);
+
+  // loss at 200 segments
+  wc.cwnd = wr.cwnd = 200 * SMSS;
+  cubic.on_loss(wc, wc.cwnd);
+  reno.on_loss(wr, wr.cwnd);
+  EXPECT(cubic.w_max() == 200.0f);
+  EXPECT(wc.ssthresh == uint32_t(200 * SMSS * Cubic::beta));
+  wc.cwnd = wc.ssthresh;
+  wr.cwnd = wr.ssthresh;
+
+  Link link2 = link;
+  link.run(cubic, wc, 30);
+  link2.run(reno, wr, 30);
+  // K = cbrt(200 * 0.3 / 0.4) = 5.3s, but the concave region is close
+  EXPECT(wc.cwnd > wr.cwnd);
+  EXPECT(wc.cwnd > 180u * SMSS);
+
+  // fast convergence, a loss below the last W_max releases bandwidth
+  wc.cwnd = 150 * SMSS;
+  cubic.on_loss(wc, wc.cwnd);
+  EXPECT(cubic.w_max() < 150.0f);
+}
+
+CASE("BBR finds the bottleneck bandwidth and RTT")
+{
+  Link link {1000, 40000}; // BDP of 40000 bytes
+  Bbr bbr;
+  Congestion_control::Window w {0, 0, 1000 * SMSS, SMSS};
+  bbr.init(w);
+  EXPECT(bbr.mode() == Bbr::Mode::STARTUP);
+
+  link.run(bbr, w, 60);
+  EXPECT(bbr.mode() == Bbr::Mode::PROBE_BW);
+  // rounds are measured between ACKs, and the window grows within a round
+  EXPECT(bbr.min_rtt() >= 30000u);
+  EXPECT(bbr.min_rtt() <= 45000u);
+  EXPECT(bbr.btl_bw() >= 900000u);
+  EXPECT(bbr.btl_bw() <= 1100000u);
+  // the window stays within a few BDPs, not growing without bounds
+  EXPECT(w.cwnd <= 3 * bbr.bdp() + 3 * SMSS);
+  EXPECT(w.cwnd >= bbr.bdp() / 2);
+
+  // loss does not collapse the window once recovery is over
+  const auto before = w.cwnd;
+  bbr.on_loss(w, w.cwnd);
+  w.cwnd = w.ssthresh + 3 * SMSS;
+  bbr.on_recovery_exit(w);
+  EXPECT(w.cwnd >= before);
+}
+
+CASE("BBR bounds the window with a round trip below a millisecond")
+{
+  Link link {125000, 100}; // 1 Gbit/s with 100 us RTT, BDP of 12500 bytes
+  Bbr bbr;
+  Congestion_control::Window w {0, 0, 1000 * SMSS, SMSS};
+  bbr.init(w);
+
+  link.run(bbr, w, 200);
+  EXPECT(bbr.min_rtt() > 0u);
+  EXPECT(bbr.min_rtt() <= 150u);
+  EXPECT(bbr.mode() == Bbr::Mode::PROBE_BW);
+  EXPECT(w.cwnd <= 3 * bbr.bdp() + 3 * SMSS);
+}
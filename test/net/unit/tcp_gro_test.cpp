@@ -0,0 +1,161 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <common.cxx>
+#include <packet_factory.hpp>
+#include <net/tcp/gro.hpp>
+#include <net/tcp/packet4_view.hpp>
+
+using namespace net;
+using namespace net::tcp;
+
+static Packet_ptr create_segment(uint16_t dport, seq_t seq, const std::string& data,
+                                 uint16_t flags = ACK)
+{
+  auto ip = create_ip4_packet();
+  ip->init(Protocol::TCP);
+  ip->set_ip_src({10,0,0,1});
+  ip->set_ip_dst({10,0,0,2});
+  Packet4_view tcp{std::move(ip)};
+  tcp.init();
+  tcp.set_src_port(5000).set_dst_port(dport);
+  tcp.set_seq(seq).set_ack(777).set_flags(flags);
+  tcp.fill((const uint8_t*) data.data(), data.size());
+  tcp.set_tcp_checksum();
+  return tcp.release();
+}
+
+struct Delivered {
+  std::string data;
+  seq_t    seq;
+  uint16_t length;
+  int      segments;
+  bool     push;
+};
+
+CASE("GRO coalesces in order segments of a flow")
+{
+  std::vector<Delivered> delivered;
+  Gro gro{[&delivered] (Packet_ptr ptr, uint16_t length, uint8_t segments) {
+    Packet4_view seg{static_unique_ptr_cast<PacketIP4>(std::move(ptr))};
+    seg.set_coalesced(length, segments);
+    std::string data;
+    seg.for_each_payload([&data] (const uint8_t* d, size_t len) {
+      data.append((const char*) d, len);
+    });
+    delivered.push_back({data, seg.seq(), seg.tcp_data_length(),
+                         seg.coalesced_segments(), seg.isset(PSH)});
+  }};
+
+  gro.receive(create_segment(80, 1000, "aaaa"));
+  gro.receive(create_segment(80, 1004, "bbbb"));
+  gro.receive(create_segment(443, 50, "xxxx"));
+  gro.receive(create_segment(80, 1008, "cccc"));
+  EXPECT(delivered.empty());
+  EXPECT(gro.held() == 2);
+
+  // a segment with PSH ends the run
+  gro.receive(create_segment(80, 1012, "dd", ACK | PSH));
+  EXPECT(delivered.size() == 1u);
+  EXPECT(delivered[0].data == "aaaabbbbccccdd");
+  EXPECT(delivered[0].seq == 1000u);
+  EXPECT(delivered[0].length == 14u);
+  EXPECT(delivered[0].segments == 3);
+  EXPECT(delivered[0].push);
+  EXPECT(gro.coalesced() == 3u);
+
+  gro.flush();
+  EXPECT(delivered.size() == 2u);
+  EXPECT(delivered[1].data == "xxxx");
+  EXPECT(delivered[1].segments == 0);
+  EXPECT(gro.held() == 0);
+}
+
+CASE("GRO flushes on gaps and other segments")
+{
+  std::vector<Delivered> delivered;
+  Gro gro{[&delivered] (Packet_ptr ptr, uint16_t length, uint8_t segments) {
+    Packet4_view seg{static_unique_ptr_cast<PacketIP4>(std::move(ptr))};
+    seg.set_coalesced(length, segments);
+    delivered.push_back({"", seg.seq(), seg.tcp_data_length(),
+                         seg.coalesced_segments(), seg.isset(PSH)});
+  }};
+
+  // a gap starts a new run
+  gro.receive(create_segment(80, 1000, "aaaa"));
+  gro.receive(create_segment(80, 2000, "bbbb"));
+  EXPECT(delivered.size() == 1u);
+  EXPECT(delivered[0].seq == 1000u);
+
+  // a FIN is delivered after the run before it
+  gro.receive(create_segment(80, 2004, "cccc"));
+  gro.receive(create_segment(80, 2008, "", ACK | FIN));
+  EXPECT(delivered.size() == 3u);
+  EXPECT(delivered[1].seq == 2000u);
+  EXPECT(delivered[1].length == 8u);
+  EXPECT(not delivered[1].push);
+  EXPECT(delivered[2].seq == 2008u);
+
+  // a bad checksum is not coalesced
+  auto bad = create_segment(80, 3004, "eeee");
+  gro.receive(create_segment(80, 3000, "dddd"));
+  static_cast<PacketIP4&>(*bad).ip_data().data()[sizeof(Header)] ^= 1;
+  gro.receive(std::move(bad));
+  EXPECT(delivered.size() == 5u);
+  EXPECT(delivered[3].length == 4u);
+  EXPECT(delivered[4].length == 4u);
+
+  // a segment shorter than the first ends the run, a longer one is not added
+  gro.receive(create_segment(80, 4000, "ffff"));
+  gro.receive(create_segment(80, 4004, "gggggg"));
+  EXPECT(delivered.size() == 6u);
+  gro.receive(create_segment(80, 4010, "hh"));
+  EXPECT(delivered.size() == 7u);
+  EXPECT(delivered[6].seq == 4004u);
+  EXPECT(delivered[6].length == 8u);
+  EXPECT(gro.held() == 0);
+}
+
+CASE("GRO keeps the payload of a run within the 16 bit IP length")
+{
+  std::vector<Delivered> delivered;
+  Gro gro{[&delivered] (Packet_ptr ptr, uint16_t length, uint8_t segments) {
+    Packet4_view seg{static_unique_ptr_cast<PacketIP4>(std::move(ptr))};
+    seg.set_coalesced(length, segments);
+    delivered.push_back({"", seg.seq(), seg.tcp_data_length(),
+                         seg.coalesced_segments(), seg.isset(PSH)});
+  }};
+
+  // 45 full segments fit, with the first one, the 46th would wrap
+  const std::string mss(1448, 'a');
+  const int fit = Gro::MAX_LENGTH / mss.size();
+  EXPECT(fit == 45);
+  for (int i = 0; i < fit; i++)
+    gro.receive(create_segment(80, i * mss.size(), mss));
+  EXPECT(delivered.empty());
+
+  gro.receive(create_segment(80, fit * mss.size(), mss));
+  EXPECT(delivered.size() == 1u);
+  EXPECT(delivered[0].seq == 0u);
+  EXPECT(delivered[0].length == fit * mss.size());
+  EXPECT(delivered[0].segments == fit - 1);
+
+  gro.flush();
+  EXPECT(delivered.size() == 2u);
+  EXPECT(delivered[1].seq == fit * mss.size());
+  EXPECT(delivered[1].length == mss.size());
+}
@@ -201,3 +201,77 @@ CASE("TCP checksum")
   tcp->set_tcp_checksum();
   EXPECT(tcp->compute_tcp_checksum() == 0);
 }
+
+#include <net/tcp/packet4_view.hpp>
+CASE("TCP partial checksum is completed from csum_start (checksum offload)")
+{
+  auto ip = create_ip4_packet();
+  ip->init(Protocol::TCP);
+  tcp::Packet4_view tcp{std::move(ip)};
+  tcp.init();
+
+  tcp.set_source({ip4::Addr{10,0,0,1}, 666});
+  tcp.set_destination({ip4::Addr{10,0,0,2}, 667});
+  EXPECT(tcp.fill((const uint8_t*) "data here!", 10) == 10);
+
+  tcp.set_tcp_checksum_partial();
+  auto& pkt = *tcp.packet_ptr();
+  EXPECT(pkt.checksum_state() == Packet::Checksum::PARTIAL);
+  EXPECT(pkt.csum_start() == tcp.tcp_data() - tcp.tcp_header_length());
+  EXPECT(pkt.csum_offset() == 16);
+  EXPECT(pkt.gso_type() == Packet::GSO::NONE);
+
+  // complete the checksum the way the NIC does
+  auto* start = pkt.csum_start();
+  const uint16_t csum = net::checksum(start, pkt.data_end() - start);
+  memcpy(start + pkt.csum_offset(), &csum, sizeof(csum));
+  EXPECT(tcp.compute_tcp_checksum() == 0);
+
+  tcp.set_segmentation_offload(1460);
+  EXPECT(pkt.gso_type() == Packet::GSO::TCPV4);
+  EXPECT(pkt.gso_size() == 1460);
+}
+
+CASE("TCP data attached from outside the packet (scatter-gather)")
+{
+  std::vector<uint8_t> payload(1000);
+  for (size_t i = 0; i < payload.size(); i++) payload[i] = i * 7;
+  auto owner = std::make_shared<std::vector<uint8_t>>(payload);
+
+  auto create = [] {
+    auto ip = create_ip4_packet();
+    ip->init(Protocol::TCP);
+    auto tcp = std::make_unique<tcp::Packet4_view>(std::move(ip));
+    tcp->init();
+    tcp->set_source({ip4::Addr{10,0,0,1}, 666});
+    tcp->set_destination({ip4::Addr{10,0,0,2}, 667});
+    return tcp;
+  };
+
+  auto copied = create();
+  EXPECT(copied->fill(payload.data(), payload.size()) == payload.size());
+
+  auto attached = create();
+  EXPECT(attached->attach(owner, owner->data(), owner->size()) == payload.size());
+  EXPECT(owner.use_count() == 2);
+  EXPECT(attached->tcp_data_length() == payload.size());
+  EXPECT(attached->packet_ptr()->size() == 40);
+
+  // the checksum covers the attached data (odd length too)
+  EXPECT(attached->compute_tcp_checksum() == copied->compute_tcp_checksum());
+  auto odd = create();
+  auto odd_copied = create();
+  odd->attach(owner, owner->data(), 333);
+  odd_copied->fill(payload.data(), 333);
+  EXPECT(odd->compute_tcp_checksum() == odd_copied->compute_tcp_checksum());
+
+  // copied into the buffer when needed, releasing the owner
+  auto& pkt = *attached->packet_ptr();
+  const auto refs = owner.use_count();
+  EXPECT(pkt.linearize());
+  EXPECT(not pkt.has_ext_payload());
+  EXPECT(owner.use_count() == refs - 1);
+  EXPECT(attached->tcp_data_length() == payload.size());
+  EXPECT(memcmp(attached->tcp_data(), payload.data(), payload.size()) == 0);
+  EXPECT(attached->compute_tcp_checksum() == copied->compute_tcp_checksum());
+}
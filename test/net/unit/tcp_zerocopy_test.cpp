@@ -0,0 +1,111 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <common.cxx>
+#include <packet_factory.hpp>
+#include <net/tcp/packet4_view.hpp>
+#include <net/tcp/packet_slice.hpp>
+
+using namespace net;
+using namespace net::tcp;
+
+static std::unique_ptr<Packet4_view> create_data_packet(const char* data)
+{
+  auto ip = create_ip4_packet();
+  ip->init(Protocol::TCP);
+  auto tcp = std::make_unique<Packet4_view>(std::move(ip));
+  tcp->init();
+  tcp->fill((const uint8_t*) data, strlen(data));
+  return tcp;
+}
+
+CASE("A detached TCP packet view is still readable")
+{
+  auto tcp = create_data_packet("hello");
+  tcp->set_seq(1000);
+  auto pkt = tcp->detach();
+  EXPECT(tcp->packet_ptr() == nullptr);
+  EXPECT(tcp->seq() == 1000u);
+  EXPECT(tcp->tcp_data_length() == 5u);
+  EXPECT(memcmp(tcp->tcp_data(), "hello", 5) == 0);
+}
+
+CASE("Packet slices share the packet")
+{
+  auto tcp = create_data_packet("zero-copy");
+  const auto* data = tcp->tcp_data();
+  const size_t len = tcp->tcp_data_length();
+
+  int released = 0;
+  Zerocopy_rx zc{4096, nullptr};
+  zc.account->on_release = [&released] { released++; };
+
+  auto slice = zc.capture(tcp->detach(), data, len);
+  EXPECT(zc.held() == len);
+  EXPECT(slice.size() == len);
+
+  auto part = slice.slice(5, 100);
+  EXPECT(part.size() == 4u);
+  EXPECT(memcmp(part.data(), "copy", 4) == 0);
+  EXPECT(slice.slice(100, 1).empty());
+
+  slice.consume(5);
+  EXPECT(memcmp(slice.data(), "copy", 4) == 0);
+
+  Packet_chain chain{slice, part};
+  EXPECT(chain_size(chain) == 8u);
+
+  // the packet is held until the last slice of it is gone
+  zc.processing = nullptr;
+  slice = {};
+  chain.clear();
+  EXPECT(released == 0);
+  EXPECT(zc.held() == len);
+  part = {};
+  EXPECT(released == 1);
+  EXPECT(zc.held() == 0u);
+}
+
+CASE("Out of order segments are kept in sequence order")
+{
+  Zerocopy_rx zc{4096, nullptr};
+  const uint32_t base = 0xfffffff0;
+  for (uint32_t off : {32u, 0u, 16u})
+  {
+    auto tcp = create_data_packet("0123456789abcdef");
+    const auto* data = tcp->tcp_data();
+    zc.out_of_order.emplace(base + off, zc.capture(tcp->detach(), data, 16));
+  }
+  zc.processing = nullptr;
+  EXPECT(zc.held() == 48u);
+
+  // with wrap around
+  uint32_t expected = base;
+  for (auto& entry : zc.out_of_order)
+  {
+    EXPECT(entry.first == expected);
+    expected += 16;
+  }
+
+  // packets held after the owner is gone are still returned
+  auto slice = zc.out_of_order.begin()->second;
+  auto account = zc.account;
+  zc.out_of_order.clear();
+  EXPECT(account->held == 16u);
+  slice = {};
+  EXPECT(account->held == 0u);
+}
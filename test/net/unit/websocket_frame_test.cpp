@@ -0,0 +1,255 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2017 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <common.cxx>
+#include <net/ws/websocket.hpp>
+#include <string>
+#include <vector>
+
+using namespace net;
+
+// the transport, keeping what is written to it
+class Loop_stream : public net::Stream {
+public:
+  void on_connect(ConnectCallback) override {}
+  void on_read(size_t, ReadCallback cb) override { read = cb; }
+  void on_data(DataCallback) override {}
+  size_t next_size() override { return 0; }
+  buffer_t read_next() override { return nullptr; }
+  void on_close(CloseCallback) override {}
+  void on_write(WriteCallback) override {}
+  void write(const void* buf, size_t n) override
+  { out.append((const char*) buf, n); writes++; }
+  void write(buffer_t buf) override
+  { write(buf->data(), buf->size()); }
+  void write(const std::string& str) override
+  { write(str.data(), str.size()); }
+  void writev(const buffer_t* bufs, size_t count) override
+  {
+    for (size_t i = 0; i < count; i++)
+      out.append((const char*) bufs[i]->data(), bufs[i]->size());
+    writes++;
+  }
+  void close() override { closed = true; }
+  void reset_callbacks() override {}
+  net::Socket local() const override { return {}; }
+  net::Socket remote() const override { return {}; }
+  std::string to_string() const override { return "loop"; }
+  bool is_connected() const noexcept override { return not closed; }
+  bool is_writable() const noexcept override { return not closed; }
+  bool is_readable() const noexcept override { return not closed; }
+  bool is_closing() const noexcept override { return closed; }
+  bool is_closed() const noexcept override { return closed; }
+  int get_cpuid() const noexcept override { return 0; }
+  net::Stream* transport() noexcept override { return nullptr; }
+
+  void feed(const std::string& data)
+  { read(construct_buffer(data.begin(), data.end())); }
+
+  ReadCallback read;
+  std::string out;
+  int  writes = 0;
+  bool closed = false;
+};
+
+static void mask_reference(char* data, size_t len, const uint8_t* key, size_t offset)
+{
+  for (size_t i = 0; i < len; i++)
+    data[i] ^= key[(i + offset) & 3];
+}
+
+// a frame as sent by a client
+static std::string client_frame(op_code code, const std::string& payload,
+                                bool fin = true, uint32_t key = 0x12345678)
+{
+  std::string frame(ws_header::header_length(payload.size(), true), '\0');
+  auto& hdr = *(ws_header*) frame.data();
+  hdr.bits = 0;
+  if (fin) hdr.set_final();
+  hdr.set_payload(payload.size());
+  hdr.set_opcode(code);
+  hdr.set_masked(key);
+  frame += payload;
+  auto& mhdr = *(ws_header*) frame.data();
+  mhdr.masking_algorithm(mhdr.data());
+  return frame;
+}
+
+CASE("ws_mask matches the byte at a time masking")
+{
+  const uint8_t key[4] {0xa1, 0xb2, 0xc3, 0xd4};
+  uint32_t key32;
+  memcpy(&key32, key, sizeof(key32));
+
+  std::vector<char> orig(300);
+  for (size_t i = 0; i < orig.size(); i++) orig[i] = i * 7 + 3;
+
+  for (size_t start : {0, 1, 3})
+  for (size_t len : {0, 1, 3, 7, 8, 15, 16, 17, 31, 32, 33, 64, 100, 255})
+  for (size_t offset : {0, 1, 2, 3, 6})
+  {
+    auto a = orig;
+    auto b = orig;
+    ws_mask(&a[start], len, key32, offset);
+    mask_reference(&b[start], len, key, offset);
+    EXPECT(a == b);
+  }
+  // masking in parts is the same as all at once
+  auto a = orig;
+  auto b = orig;
+  ws_mask(a.data(), 13, key32);
+  ws_mask(a.data() + 13, 150, key32, 13);
+  ws_mask(a.data() + 163, 137, key32, 163);
+  mask_reference(b.data(), b.size(), key, 0);
+  EXPECT(a == b);
+}
+
+CASE("Frames are unmasked in place, also when split between reads")
+{
+  auto* loop = new Loop_stream;
+  WebSocket ws(net::Stream_ptr(loop), false);
+  std::vector<std::string> got;
+  ws.on_read = [&] (WebSocket::Message_ptr msg) {
+    EXPECT(msg->is_complete());
+    got.push_back(msg->to_string());
+  };
+
+  const std::string text(300, 'x');
+  // two frames in one read, the payload is kept where it arrived
+  size_t slices = 0;
+  ws.on_read = [&] (WebSocket::Message_ptr msg) {
+    slices = msg->chain().size();
+    got.push_back(msg->to_string());
+  };
+  loop->feed(client_frame(op_code::TEXT, "hello") + client_frame(op_code::BINARY, text));
+  EXPECT(got.size() == 2u);
+  EXPECT(got.at(0) == "hello");
+  EXPECT(got.at(1) == text);
+  EXPECT(slices == 1u);
+
+  // one byte at a time, with the header split too
+  got.clear();
+  const auto frame = client_frame(op_code::TEXT, text);
+  for (char c : frame) loop->feed(std::string(1, c));
+  EXPECT(got.size() == 1u);
+  EXPECT(got.at(0) == text);
+  EXPECT(not loop->closed);
+}
+
+CASE("Fragmented messages are assembled, with control frames in between")
+{
+  auto* loop = new Loop_stream;
+  WebSocket ws(net::Stream_ptr(loop), false);
+  std::vector<std::string> got;
+  size_t slices = 0;
+  op_code code = op_code::CONTINUE;
+  ws.on_read = [&] (WebSocket::Message_ptr msg) {
+    code   = msg->opcode();
+    slices = msg->chain().size();
+    got.push_back(msg->to_string());
+  };
+  std::string pinged;
+  ws.on_ping = [&] (const char* data, size_t len) {
+    pinged.assign(data, len);
+    return true;
+  };
+
+  loop->feed(client_frame(op_code::BINARY, "Hello, ", false));
+  loop->feed(client_frame(op_code::PING, "ping!"));
+  EXPECT(pinged == "ping!");
+  // the pong echoes the data
+  EXPECT(loop->out.size() == 2u + 5u);
+  EXPECT(loop->out.substr(2) == "ping!");
+  loop->feed(client_frame(op_code::CONTINUE, "fragmented ", false)
+           + client_frame(op_code::CONTINUE, "world"));
+  EXPECT(got.size() == 1u);
+  EXPECT(got.at(0) == "Hello, fragmented world");
+  EXPECT(code == op_code::BINARY);
+  EXPECT(slices == 3u);
+  EXPECT(not loop->closed);
+}
+
+CASE("Invalid frames fail the websocket")
+{
+  std::string error;
+  auto test = [&error] (const std::string& data, uint32_t max_size = 0) {
+    auto* loop = new Loop_stream;
+    WebSocket ws(net::Stream_ptr(loop), false);
+    ws.set_max_message_size(max_size);
+    ws.on_error = [&error] (std::string reason) { error = reason; };
+    error.clear();
+    loop->feed(data);
+    return loop->closed;
+  };
+  // continuation without a message
+  EXPECT(test(client_frame(op_code::CONTINUE, "abc")));
+  // a new message before the last was finished
+  EXPECT(test(client_frame(op_code::TEXT, "a", false) + client_frame(op_code::TEXT, "b")));
+  // fragmented control frame
+  EXPECT(test(client_frame(op_code::PING, "a", false)));
+  // reserved opcode
+  EXPECT(test(client_frame((op_code) 3, "a")));
+  // too big, also when fragmented
+  EXPECT(test(client_frame(op_code::TEXT, std::string(100, 'a')), 64));
+  EXPECT(test(client_frame(op_code::TEXT, std::string(40, 'a'), false)
+            + client_frame(op_code::CONTINUE, std::string(40, 'a')), 64));
+  EXPECT(error.find("Maximum message size") != std::string::npos);
+  EXPECT(not test(client_frame(op_code::TEXT, std::string(64, 'a')), 64));
+  // the server does not accept unmasked frames
+  EXPECT(test(std::string{char(0x81), 0x01, 'a'}));
+}
+
+CASE("Server writes header and shared buffer as one gather write")
+{
+  auto* loop = new Loop_stream;
+  WebSocket ws(net::Stream_ptr(loop), false);
+  auto buf = Stream::construct_buffer(1000, 'z');
+  ws.write(buf, op_code::BINARY);
+  EXPECT(loop->writes == 1);
+  EXPECT(loop->out.size() == 4u + 1000u);
+  const auto& hdr = *(const ws_header*) loop->out.data();
+  EXPECT(hdr.opcode() == op_code::BINARY);
+  EXPECT(hdr.data_length() == 1000u);
+  EXPECT(not hdr.is_masked());
+  EXPECT(loop->out.substr(4) == std::string(1000, 'z'));
+}
+
+CASE("Client frames are masked, also from shared buffers")
+{
+  auto* loop = new Loop_stream;
+  WebSocket ws(net::Stream_ptr(loop), true);
+  ws.write(Stream::construct_buffer(200, 'c'), op_code::TEXT);
+  EXPECT(loop->writes == 1);
+  std::string frame = loop->out;
+  auto& hdr = *(ws_header*) frame.data();
+  EXPECT(hdr.is_masked());
+  EXPECT(hdr.data_length() == 200u);
+  hdr.masking_algorithm(hdr.data());
+  EXPECT(std::string(hdr.data(), 200) == std::string(200, 'c'));
+
+  // and the message data can be taken as a buffer
+  auto* sloop = new Loop_stream;
+  WebSocket server(net::Stream_ptr(sloop), false);
+  Stream::buffer_t payload;
+  server.on_read = [&] (WebSocket::Message_ptr msg) {
+    payload = msg->extract_buffer();
+    EXPECT(msg->size() == 0u);
+  };
+  sloop->feed(loop->out);
+  EXPECT(payload != nullptr);
+  EXPECT(std::string(payload->begin(), payload->end()) == std::string(200, 'c'));
+}
@@ -0,0 +1,169 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <common.cxx>
+#include <posix/epoll_fd.hpp>
+#include <posix/fd_map.hpp>
+
+class Ready_fd : public FD {
+public:
+  Ready_fd(const int id) : FD(id) {}
+
+  int close() override
+  { return 0; }
+
+  short poll_events(short events) override
+  { return ready & (events | POLLERR | POLLHUP); }
+
+  short ready = 0;
+};
+
+static epoll_event make_event(uint32_t events, int tag)
+{
+  epoll_event ev;
+  ev.events   = events;
+  ev.data.u32 = tag;
+  return ev;
+}
+
+CASE("FDs are always ready by default")
+{
+  auto& fd = FD_map::_open<Ready_fd>();
+  EXPECT(fd.FD::poll_events(POLLIN | POLLOUT) == (POLLIN | POLLOUT));
+  EXPECT(fd.FD::poll_events(POLLIN) == POLLIN);
+  FD_map::close(fd.get_id());
+}
+
+CASE("epoll_ctl adds, modifies and removes fds")
+{
+  auto& ep = FD_map::_open<Epoll_FD>();
+  auto& fd = FD_map::_open<Ready_fd>();
+  auto ev = make_event(EPOLLIN, 1);
+
+  EXPECT(ep.ctl(EPOLL_CTL_MOD, fd.get_id(), &ev) == -ENOENT);
+  EXPECT(ep.ctl(EPOLL_CTL_ADD, fd.get_id(), &ev) == 0);
+  EXPECT(ep.ctl(EPOLL_CTL_ADD, fd.get_id(), &ev) == -EEXIST);
+  EXPECT(ep.ctl(EPOLL_CTL_ADD, ep.get_id(), &ev) == -EINVAL);
+  EXPECT(ep.ctl(EPOLL_CTL_ADD, 12345, &ev) == -EBADF);
+  EXPECT(ep.ctl(EPOLL_CTL_MOD, fd.get_id(), &ev) == 0);
+  EXPECT(ep.size() == 1u);
+  EXPECT(ep.ctl(EPOLL_CTL_DEL, fd.get_id(), nullptr) == 0);
+  EXPECT(ep.ctl(EPOLL_CTL_DEL, fd.get_id(), nullptr) == -ENOENT);
+  EXPECT(ep.size() == 0u);
+
+  FD_map::close(fd.get_id());
+  FD_map::close(ep.get_id());
+}
+
+CASE("epoll reports level-triggered readiness")
+{
+  auto& ep = FD_map::_open<Epoll_FD>();
+  auto& a  = FD_map::_open<Ready_fd>();
+  auto& b  = FD_map::_open<Ready_fd>();
+  auto eva = make_event(EPOLLIN, 1);
+  auto evb = make_event(EPOLLIN | EPOLLOUT, 2);
+  EXPECT(ep.ctl(EPOLL_CTL_ADD, a.get_id(), &eva) == 0);
+  EXPECT(ep.ctl(EPOLL_CTL_ADD, b.get_id(), &evb) == 0);
+
+  epoll_event events[4];
+  EXPECT(ep.ready(events, 4) == 0);
+  EXPECT(ep.poll_events(POLLIN) == 0);
+
+  // only the asked for events, but always errors
+  a.ready = POLLOUT;
+  EXPECT(ep.ready(events, 4) == 0);
+  a.ready = POLLIN | POLLOUT;
+  b.ready = POLLHUP;
+  EXPECT(ep.ready(events, 4) == 2);
+  EXPECT(events[0].data.u32 == 1u);
+  EXPECT(events[0].events == (uint32_t) EPOLLIN);
+  EXPECT(events[1].data.u32 == 2u);
+  EXPECT(events[1].events == (uint32_t) EPOLLHUP);
+  EXPECT(ep.poll_events(POLLIN) == POLLIN);
+
+  // still ready, so reported again
+  b.ready = 0;
+  EXPECT(ep.ready(events, 4) == 1);
+  EXPECT(events[0].data.u32 == 1u);
+
+  // a closed fd leaves the set
+  FD_map::close(a.get_id());
+  EXPECT(ep.ready(events, 4) == 0);
+  EXPECT(ep.size() == 1u);
+
+  FD_map::close(b.get_id());
+  FD_map::close(ep.get_id());
+}
+
+CASE("epoll with maxevents does not starve fds")
+{
+  auto& ep = FD_map::_open<Epoll_FD>();
+  std::vector<Ready_fd*> fds;
+  for (int i = 0; i < 5; i++) {
+    auto& fd = FD_map::_open<Ready_fd>();
+    fd.ready = POLLIN;
+    auto ev = make_event(EPOLLIN, i);
+    EXPECT(ep.ctl(EPOLL_CTL_ADD, fd.get_id(), &ev) == 0);
+    fds.push_back(&fd);
+  }
+  // two at a time visits all five in three rounds
+  epoll_event events[2];
+  std::vector<int> seen(5, 0);
+  for (int round = 0; round < 3; round++) {
+    const int n = ep.ready(events, 2);
+    EXPECT(n == 2);
+    for (int i = 0; i < n; i++) seen.at(events[i].data.u32)++;
+  }
+  for (auto count : seen) EXPECT(count >= 1);
+
+  for (auto* fd : fds) FD_map::close(fd->get_id());
+  FD_map::close(ep.get_id());
+}
+
+CASE("epoll edge-triggered and one-shot")
+{
+  auto& ep = FD_map::_open<Epoll_FD>();
+  auto& et = FD_map::_open<Ready_fd>();
+  auto& os = FD_map::_open<Ready_fd>();
+  auto evet = make_event(EPOLLIN | EPOLLET, 1);
+  auto evos = make_event(EPOLLIN | EPOLLONESHOT, 2);
+  EXPECT(ep.ctl(EPOLL_CTL_ADD, et.get_id(), &evet) == 0);
+  EXPECT(ep.ctl(EPOLL_CTL_ADD, os.get_id(), &evos) == 0);
+
+  epoll_event events[4];
+  et.ready = POLLIN;
+  os.ready = POLLIN;
+  EXPECT(ep.ready(events, 4) == 2);
+  // both are still ready, but neither is reported again
+  EXPECT(ep.ready(events, 4) == 0);
+
+  // an edge after being drained
+  et.ready = 0;
+  EXPECT(ep.ready(events, 4) == 0);
+  et.ready = POLLIN;
+  EXPECT(ep.ready(events, 4) == 1);
+  EXPECT(events[0].data.u32 == 1u);
+
+  // one-shot is re-armed by EPOLL_CTL_MOD
+  EXPECT(ep.ctl(EPOLL_CTL_MOD, os.get_id(), &evos) == 0);
+  EXPECT(ep.ready(events, 4) == 1);
+  EXPECT(events[0].data.u32 == 2u);
+
+  FD_map::close(et.get_id());
+  FD_map::close(os.get_id());
+  FD_map::close(ep.get_id());
+}
@@ -0,0 +1,85 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <common.cxx>
+#include <util/slab_pool.hpp>
+
+struct Counted {
+  static int alive;
+  int value;
+  Counted(int v) : value{v} { alive++; }
+  ~Counted() { alive--; }
+};
+int Counted::alive = 0;
+
+CASE("Slab pool creates and destroys objects by id")
+{
+  Slab_pool<Counted, 4> pool;
+  EXPECT(pool.empty());
+  EXPECT(pool.capacity() == 0u);
+
+  std::vector<Slab_pool<Counted, 4>::id_t> ids;
+  for (int i = 0; i < 6; i++)
+    ids.push_back(pool.create(i));
+
+  // ids are dense, and the pool grew by whole slabs
+  for (int i = 0; i < 6; i++) {
+    EXPECT(ids[i] == i);
+    EXPECT(pool[ids[i]].value == i);
+  }
+  EXPECT(pool.size() == 6u);
+  EXPECT(pool.capacity() == 8u);
+  EXPECT(Counted::alive == 6);
+
+  auto* addr = &pool[ids[1]];
+  pool.destroy(ids[2]);
+  EXPECT(not pool.alive(ids[2]));
+  EXPECT(Counted::alive == 5);
+  // objects do not move when others come and go
+  EXPECT(&pool[ids[1]] == addr);
+
+  // freed ids are reused before growing
+  EXPECT(pool.create(42) == ids[2]);
+  EXPECT(pool[ids[2]].value == 42);
+  EXPECT(pool.capacity() == 8u);
+
+  int sum = 0;
+  pool.for_each([&sum] (Counted& c) { sum += c.value; });
+  EXPECT(sum == 0 + 1 + 42 + 3 + 4 + 5);
+
+  pool.clear();
+  EXPECT(pool.empty());
+  EXPECT(Counted::alive == 0);
+  EXPECT(pool.capacity() == 8u);
+}
+
+CASE("Slab pool destroys what is left with it")
+{
+  {
+    Slab_pool<Counted> pool;
+    pool.reserve(300);
+    EXPECT(pool.capacity() == 512u);
+    for (int i = 0; i < 10; i++) pool.create(i);
+    // for_each may destroy the object it is given
+    pool.for_each([&pool] (Counted& c) {
+      if (c.value % 2) pool.destroy(c.value);
+    });
+    EXPECT(pool.size() == 5u);
+    EXPECT(Counted::alive == 5);
+  }
+  EXPECT(Counted::alive == 0);
+}